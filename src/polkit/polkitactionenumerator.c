@@ -0,0 +1,288 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "polkitactiondescription.h"
+#include "polkitactionenumerator.h"
+#include "polkitauthority.h"
+
+#include "polkitprivate.h"
+
+/**
+ * SECTION:polkitactionenumerator
+ * @title: PolkitActionEnumerator
+ * @short_description: Iterate over registered actions
+ * @stability: Stable
+ *
+ * #PolkitActionEnumerator retrieves the registered actions matching a
+ * set of filters one page at a time, see
+ * polkit_authority_enumerate_actions_filtered(), so that a large number
+ * of actions never has to be held in memory at once.
+ *
+ * Actions are returned ordered by action id. If the set of registered
+ * actions changes while enumerating, actions may be skipped or
+ * returned twice.
+ */
+
+/* page size used when none is given */
+#define DEFAULT_PAGE_SIZE 64
+
+/**
+ * PolkitActionEnumerator:
+ *
+ * The #PolkitActionEnumerator struct should not be accessed directly.
+ */
+struct _PolkitActionEnumerator
+{
+  GObject parent_instance;
+
+  PolkitAuthority *authority;
+  gchar *id_prefix;
+  gchar *annotation_key;
+  gchar *annotation_value;
+  guint page_size;
+
+  /* the current page */
+  GList *actions;
+  /* offset of the next page */
+  guint offset;
+  gboolean at_end;
+};
+
+struct _PolkitActionEnumeratorClass
+{
+  GObjectClass parent_class;
+};
+
+G_DEFINE_TYPE (PolkitActionEnumerator, polkit_action_enumerator, G_TYPE_OBJECT);
+
+static void
+polkit_action_enumerator_init (PolkitActionEnumerator *enumerator)
+{
+}
+
+static void
+polkit_action_enumerator_finalize (GObject *object)
+{
+  PolkitActionEnumerator *enumerator;
+
+  enumerator = POLKIT_ACTION_ENUMERATOR (object);
+
+  g_list_free_full (enumerator->actions, g_object_unref);
+  g_object_unref (enumerator->authority);
+  g_free (enumerator->id_prefix);
+  g_free (enumerator->annotation_key);
+  g_free (enumerator->annotation_value);
+
+  G_OBJECT_CLASS (polkit_action_enumerator_parent_class)->finalize (object);
+}
+
+static void
+polkit_action_enumerator_class_init (PolkitActionEnumeratorClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = polkit_action_enumerator_finalize;
+}
+
+/**
+ * polkit_action_enumerator_new:
+ * @authority: A #PolkitAuthority.
+ * @id_prefix: (allow-none): Only include actions whose id starts with this or %NULL.
+ * @annotation_key: (allow-none): Only include actions with this annotation or %NULL or empty.
+ * @annotation_value: (allow-none): If not %NULL or empty, the value @annotation_key must have.
+ * @page_size: The number of actions to retrieve at a time or 0 for a default.
+ *
+ * Creates a new enumerator for the actions registered with @authority
+ * that match the given filters. Use polkit_action_enumerator_next_sync()
+ * to get the actions.
+ *
+ * Returns: (transfer full): A #PolkitActionEnumerator. Free with g_object_unref().
+ *
+ * Since: 127
+ */
+PolkitActionEnumerator *
+polkit_action_enumerator_new (PolkitAuthority *authority,
+                              const gchar     *id_prefix,
+                              const gchar     *annotation_key,
+                              const gchar     *annotation_value,
+                              guint            page_size)
+{
+  PolkitActionEnumerator *enumerator;
+
+  g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), NULL);
+
+  enumerator = POLKIT_ACTION_ENUMERATOR (g_object_new (POLKIT_TYPE_ACTION_ENUMERATOR, NULL));
+  enumerator->authority = g_object_ref (authority);
+  enumerator->id_prefix = g_strdup (id_prefix);
+  /* empty filters match everything, as they do in polkitd */
+  if (annotation_key != NULL && annotation_key[0] != '\0')
+    enumerator->annotation_key = g_strdup (annotation_key);
+  if (annotation_value != NULL && annotation_value[0] != '\0')
+    enumerator->annotation_value = g_strdup (annotation_value);
+  enumerator->page_size = page_size > 0 ? page_size : DEFAULT_PAGE_SIZE;
+
+  return enumerator;
+}
+
+static gint
+compare_by_action_id (gconstpointer a,
+                      gconstpointer b)
+{
+  return strcmp (polkit_action_description_get_action_id (POLKIT_ACTION_DESCRIPTION (a)),
+                 polkit_action_description_get_action_id (POLKIT_ACTION_DESCRIPTION (b)));
+}
+
+static gboolean
+matches (PolkitActionEnumerator  *enumerator,
+         PolkitActionDescription *action)
+{
+  const gchar *value;
+
+  if (enumerator->id_prefix != NULL &&
+      !g_str_has_prefix (polkit_action_description_get_action_id (action), enumerator->id_prefix))
+    return FALSE;
+
+  if (enumerator->annotation_key != NULL)
+    {
+      value = polkit_action_description_get_annotation (action, enumerator->annotation_key);
+      if (value == NULL)
+        return FALSE;
+      if (enumerator->annotation_value != NULL && strcmp (value, enumerator->annotation_value) != 0)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* An older polkitd can only return all actions at once */
+static gboolean
+fetch_all (PolkitActionEnumerator  *enumerator,
+           GCancellable            *cancellable,
+           GError                 **error)
+{
+  GError *local_error;
+  GList *actions;
+  GList *l;
+  GList *ll;
+
+  /* no actions is not an error, so look at the error even if the caller passed none */
+  local_error = NULL;
+  actions = polkit_authority_enumerate_actions_sync (enumerator->authority, cancellable, &local_error);
+  if (local_error != NULL)
+    {
+      g_propagate_error (error, local_error);
+      return FALSE;
+    }
+
+  for (l = actions; l != NULL; l = ll)
+    {
+      ll = l->next;
+      if (!matches (enumerator, l->data))
+        {
+          g_object_unref (l->data);
+          actions = g_list_delete_link (actions, l);
+        }
+    }
+
+  enumerator->actions = g_list_sort (actions, compare_by_action_id);
+  enumerator->at_end = TRUE;
+
+  return TRUE;
+}
+
+static gboolean
+fetch_page (PolkitActionEnumerator  *enumerator,
+            GCancellable            *cancellable,
+            GError                 **error)
+{
+  GError *local_error;
+  guint num_matches;
+
+  local_error = NULL;
+  enumerator->actions = polkit_authority_enumerate_actions_filtered_sync (enumerator->authority,
+                                                                          enumerator->id_prefix,
+                                                                          enumerator->annotation_key,
+                                                                          enumerator->annotation_value,
+                                                                          enumerator->offset,
+                                                                          enumerator->page_size,
+                                                                          &num_matches,
+                                                                          cancellable,
+                                                                          &local_error);
+  if (local_error != NULL)
+    {
+      if (enumerator->offset == 0 &&
+          g_error_matches (local_error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+        {
+          g_error_free (local_error);
+          return fetch_all (enumerator, cancellable, error);
+        }
+      g_propagate_error (error, local_error);
+      return FALSE;
+    }
+
+  enumerator->offset += enumerator->page_size;
+  if (enumerator->offset >= num_matches)
+    enumerator->at_end = TRUE;
+
+  return TRUE;
+}
+
+/**
+ * polkit_action_enumerator_next_sync:
+ * @enumerator: A #PolkitActionEnumerator.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: (allow-none): Return location for error or %NULL.
+ *
+ * Gets the next action from @enumerator, retrieving the next page of
+ * actions from the authority if needed. The calling thread is blocked
+ * until a reply is received.
+ *
+ * Returns: (transfer full): A #PolkitActionDescription or %NULL if
+ * there are no more actions or @error is set. Free with g_object_unref().
+ *
+ * Since: 127
+ */
+PolkitActionDescription *
+polkit_action_enumerator_next_sync (PolkitActionEnumerator  *enumerator,
+                                    GCancellable            *cancellable,
+                                    GError                 **error)
+{
+  PolkitActionDescription *ret;
+
+  g_return_val_if_fail (POLKIT_IS_ACTION_ENUMERATOR (enumerator), NULL);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  ret = NULL;
+
+  if (enumerator->actions == NULL && !enumerator->at_end)
+    {
+      if (!fetch_page (enumerator, cancellable, error))
+        goto out;
+    }
+
+  if (enumerator->actions != NULL)
+    {
+      ret = enumerator->actions->data;
+      enumerator->actions = g_list_delete_link (enumerator->actions, enumerator->actions);
+    }
+
+ out:
+  return ret;
+}
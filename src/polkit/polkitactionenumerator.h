@@ -0,0 +1,55 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#if !defined (_POLKIT_COMPILATION) && !defined(_POLKIT_INSIDE_POLKIT_H)
+#error "Only <polkit/polkit.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef __POLKIT_ACTION_ENUMERATOR_H
+#define __POLKIT_ACTION_ENUMERATOR_H
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <polkit/polkittypes.h>
+
+G_BEGIN_DECLS
+
+#define POLKIT_TYPE_ACTION_ENUMERATOR          (polkit_action_enumerator_get_type())
+#define POLKIT_ACTION_ENUMERATOR(o)            (G_TYPE_CHECK_INSTANCE_CAST ((o), POLKIT_TYPE_ACTION_ENUMERATOR, PolkitActionEnumerator))
+#define POLKIT_ACTION_ENUMERATOR_CLASS(k)      (G_TYPE_CHECK_CLASS_CAST((k), POLKIT_TYPE_ACTION_ENUMERATOR, PolkitActionEnumeratorClass))
+#define POLKIT_ACTION_ENUMERATOR_GET_CLASS(o)  (G_TYPE_INSTANCE_GET_CLASS ((o), POLKIT_TYPE_ACTION_ENUMERATOR, PolkitActionEnumeratorClass))
+#define POLKIT_IS_ACTION_ENUMERATOR(o)         (G_TYPE_CHECK_INSTANCE_TYPE ((o), POLKIT_TYPE_ACTION_ENUMERATOR))
+#define POLKIT_IS_ACTION_ENUMERATOR_CLASS(k)   (G_TYPE_CHECK_CLASS_TYPE ((k), POLKIT_TYPE_ACTION_ENUMERATOR))
+
+#if 0
+typedef struct _PolkitActionEnumerator PolkitActionEnumerator;
+#endif
+typedef struct _PolkitActionEnumeratorClass PolkitActionEnumeratorClass;
+
+GType                    polkit_action_enumerator_get_type  (void) G_GNUC_CONST;
+PolkitActionEnumerator  *polkit_action_enumerator_new       (PolkitAuthority         *authority,
+                                                             const gchar             *id_prefix,
+                                                             const gchar             *annotation_key,
+                                                             const gchar             *annotation_value,
+                                                             guint                    page_size);
+PolkitActionDescription *polkit_action_enumerator_next_sync (PolkitActionEnumerator  *enumerator,
+                                                             GCancellable            *cancellable,
+                                                             GError                 **error);
+
+G_END_DECLS
+
+#endif /* __POLKIT_ACTION_ENUMERATOR_H */
@@ -19,6 +19,10 @@
  * Author: David Zeuthen <davidz@redhat.com>
  */
 
+#include <unistd.h>
+
+#include <gio/gunixfdlist.h>
+
 #include "polkitauthorizationresult.h"
 #include "polkitcheckauthorizationflags.h"
 #include "polkitauthority.h"
@@ -29,6 +33,7 @@
 #include "polkitdetails.h"
 
 #include "polkitprivate.h"
+#include "polkitimplicitsnapshot.h"
 
 /**
  * SECTION:polkitauthority
@@ -66,6 +71,16 @@ struct _PolkitAuthority
 
   gboolean initialized;
   GError *initialization_error;
+
+  /* see get_implicit_snapshot() */
+  GMutex snapshot_lock;
+  PolkitImplicitSnapshot *snapshot;
+  gboolean snapshot_unavailable;
+
+  /* see get_check_proxy() */
+  GMutex peer_lock;
+  GDBusProxy *peer_proxy;
+  gchar *peer_owner;
 };
 
 struct _PolkitAuthorityClass
@@ -136,12 +151,25 @@ on_notify_g_name_owner (GObject    *object,
                         gpointer    user_data)
 {
   PolkitAuthority *authority = POLKIT_AUTHORITY (user_data);
+
+  /* a new polkitd may support snapshots even if the old one didn't */
+  g_mutex_lock (&authority->snapshot_lock);
+  authority->snapshot_unavailable = FALSE;
+  if (authority->snapshot != NULL)
+    {
+      _polkit_implicit_snapshot_unref (authority->snapshot);
+      authority->snapshot = NULL;
+    }
+  g_mutex_unlock (&authority->snapshot_lock);
+
   g_object_notify (G_OBJECT (authority), "owner");
 }
 
 static void
 polkit_authority_init (PolkitAuthority *authority)
 {
+  g_mutex_init (&authority->snapshot_lock);
+  g_mutex_init (&authority->peer_lock);
 }
 
 static void
@@ -171,6 +199,15 @@ polkit_authority_finalize (GObject *object)
   if (authority->proxy != NULL)
     g_object_unref (authority->proxy);
 
+  if (authority->snapshot != NULL)
+    _polkit_implicit_snapshot_unref (authority->snapshot);
+  g_mutex_clear (&authority->snapshot_lock);
+
+  if (authority->peer_proxy != NULL)
+    g_object_unref (authority->peer_proxy);
+  g_free (authority->peer_owner);
+  g_mutex_clear (&authority->peer_lock);
+
   if (G_OBJECT_CLASS (polkit_authority_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (polkit_authority_parent_class)->finalize (object);
 }
@@ -789,11 +826,318 @@ polkit_authority_enumerate_actions_sync (PolkitAuthority *authority,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/**
+ * polkit_authority_enumerate_actions_filtered:
+ * @authority: A #PolkitAuthority.
+ * @id_prefix: (allow-none): Only include actions whose id starts with this or %NULL.
+ * @annotation_key: (allow-none): Only include actions with this annotation or %NULL or empty.
+ * @annotation_value: (allow-none): If not %NULL or empty, the value @annotation_key must have.
+ * @offset: The number of matching actions to skip.
+ * @limit: The maximum number of actions to retrieve or 0 for no limit.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied.
+ * @user_data: The data to pass to @callback.
+ *
+ * Asynchronously retrieves the registered actions matching the given
+ * filters, ordered by action id. Use @offset and @limit to retrieve
+ * a large set of actions in pages, see also #PolkitActionEnumerator.
+ *
+ * When the operation is finished, @callback will be invoked in the
+ * <link linkend="g-main-context-push-thread-default">thread-default
+ * main loop</link> of the thread you are calling this method
+ * from. You can then call polkit_authority_enumerate_actions_filtered_finish()
+ * to get the result of the operation.
+ *
+ * Since: 127
+ **/
+void
+polkit_authority_enumerate_actions_filtered (PolkitAuthority     *authority,
+                                             const gchar         *id_prefix,
+                                             const gchar         *annotation_key,
+                                             const gchar         *annotation_value,
+                                             guint                offset,
+                                             guint                limit,
+                                             GCancellable        *cancellable,
+                                             GAsyncReadyCallback  callback,
+                                             gpointer             user_data)
+{
+  GVariantBuilder builder;
+
+  g_return_if_fail (POLKIT_IS_AUTHORITY (authority));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  if (id_prefix != NULL)
+    g_variant_builder_add (&builder, "{sv}", "id-prefix", g_variant_new_string (id_prefix));
+  if (annotation_key != NULL)
+    g_variant_builder_add (&builder, "{sv}", "annotation-key", g_variant_new_string (annotation_key));
+  if (annotation_value != NULL)
+    g_variant_builder_add (&builder, "{sv}", "annotation-value", g_variant_new_string (annotation_value));
+  g_variant_builder_add (&builder, "{sv}", "offset", g_variant_new_uint32 (offset));
+  g_variant_builder_add (&builder, "{sv}", "limit", g_variant_new_uint32 (limit));
+
+  g_dbus_proxy_call (authority->proxy,
+                     "EnumerateActionsWithOptions",
+                     g_variant_new ("(sa{sv})",
+                                    "", /* TODO: use system locale */
+                                    &builder),
+                     G_DBUS_CALL_FLAGS_NONE,
+                     -1,
+                     cancellable,
+                     generic_async_cb,
+                     g_simple_async_result_new (G_OBJECT (authority),
+                                                callback,
+                                                user_data,
+                                                polkit_authority_enumerate_actions_filtered));
+}
+
+/**
+ * polkit_authority_enumerate_actions_filtered_finish:
+ * @authority: A #PolkitAuthority.
+ * @res: A #GAsyncResult obtained from the callback.
+ * @out_num_matches: (out) (allow-none): Return location for the number of
+ * actions matching the filters, regardless of @offset and @limit.
+ * @error: (allow-none): Return location for error or %NULL.
+ *
+ * Finishes retrieving registered actions.
+ *
+ * Returns: (element-type Polkit.ActionDescription) (transfer full): A list of
+ * #PolkitActionDescription objects or %NULL if @error is set. The returned
+ * list should be freed with g_list_free() after each element have been freed
+ * with g_object_unref().
+ *
+ * Since: 127
+ **/
+GList *
+polkit_authority_enumerate_actions_filtered_finish (PolkitAuthority *authority,
+                                                    GAsyncResult    *res,
+                                                    guint           *out_num_matches,
+                                                    GError         **error)
+{
+  GList *ret;
+  GVariant *value;
+  GVariantIter iter;
+  GVariant *child;
+  GVariant *array;
+  GAsyncResult *_res;
+  guint32 num_matches;
+
+  g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), NULL);
+  g_return_val_if_fail (G_IS_SIMPLE_ASYNC_RESULT (res), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  ret = NULL;
+
+  g_warn_if_fail (g_simple_async_result_get_source_tag (G_SIMPLE_ASYNC_RESULT (res)) == polkit_authority_enumerate_actions_filtered);
+  _res = G_ASYNC_RESULT (g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (res)));
+
+  value = g_dbus_proxy_call_finish (authority->proxy, _res, error);
+  if (value == NULL)
+    goto out;
+
+  g_variant_get (value, "(@a(ssssssuuua{ss})u)", &array, &num_matches);
+  g_variant_iter_init (&iter, array);
+  while ((child = g_variant_iter_next_value (&iter)) != NULL)
+    {
+      ret = g_list_prepend (ret, polkit_action_description_new_for_gvariant (child));
+      g_variant_unref (child);
+    }
+  ret = g_list_reverse (ret);
+  g_variant_unref (array);
+  g_variant_unref (value);
+
+  if (out_num_matches != NULL)
+    *out_num_matches = num_matches;
+
+ out:
+  return ret;
+}
+
+/**
+ * polkit_authority_enumerate_actions_filtered_sync:
+ * @authority: A #PolkitAuthority.
+ * @id_prefix: (allow-none): Only include actions whose id starts with this or %NULL.
+ * @annotation_key: (allow-none): Only include actions with this annotation or %NULL or empty.
+ * @annotation_value: (allow-none): If not %NULL or empty, the value @annotation_key must have.
+ * @offset: The number of matching actions to skip.
+ * @limit: The maximum number of actions to retrieve or 0 for no limit.
+ * @out_num_matches: (out) (allow-none): Return location for the number of
+ * actions matching the filters, regardless of @offset and @limit.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: (allow-none): Return location for error or %NULL.
+ *
+ * Synchronously retrieves the registered actions matching the given
+ * filters - the calling thread is blocked until a reply is
+ * received. See polkit_authority_enumerate_actions_filtered() for the
+ * asynchronous version.
+ *
+ * Returns: (element-type Polkit.ActionDescription) (transfer full): A list of
+ * #PolkitActionDescription or %NULL if @error is set. The returned list should
+ * be freed with g_list_free() after each element have been freed with
+ * g_object_unref().
+ *
+ * Since: 127
+ **/
+GList *
+polkit_authority_enumerate_actions_filtered_sync (PolkitAuthority *authority,
+                                                  const gchar     *id_prefix,
+                                                  const gchar     *annotation_key,
+                                                  const gchar     *annotation_value,
+                                                  guint            offset,
+                                                  guint            limit,
+                                                  guint           *out_num_matches,
+                                                  GCancellable    *cancellable,
+                                                  GError         **error)
+{
+  GList *ret;
+  CallSyncData *data;
+
+  g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), NULL);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  data = call_sync_new ();
+  polkit_authority_enumerate_actions_filtered (authority, id_prefix, annotation_key, annotation_value,
+                                               offset, limit, cancellable, call_sync_cb, data);
+  call_sync_block (data);
+  ret = polkit_authority_enumerate_actions_filtered_finish (authority, data->res, out_num_matches, error);
+  call_sync_free (data);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* polkitd may also serve us directly, without the bus daemon in
+ * between, see polkit_backend_authority_register_peer_socket(). The
+ * socket is only used if the process at the other end is @owner, the
+ * owner of the org.freedesktop.PolicyKit1 name.
+ */
+static GDBusProxy *
+peer_proxy_new (PolkitAuthority *authority,
+                const gchar     *owner)
+{
+  GDBusConnection *connection;
+  GCredentials *credentials;
+  GDBusProxy *ret;
+  GVariant *value;
+  GIOStream *stream;
+  guint32 owner_pid;
+
+  connection = NULL;
+  credentials = NULL;
+  ret = NULL;
+  value = NULL;
+
+  if (!g_file_test (POLKIT_PEER_SOCKET_PATH, G_FILE_TEST_EXISTS))
+    goto out;
+
+  connection = g_dbus_connection_new_for_address_sync ("unix:path=" POLKIT_PEER_SOCKET_PATH,
+                                                       G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                                       NULL, /* GDBusAuthObserver */
+                                                       NULL, /* GCancellable */
+                                                       NULL);
+  if (connection == NULL)
+    goto out;
+
+  stream = g_dbus_connection_get_stream (connection);
+  if (!G_IS_SOCKET_CONNECTION (stream))
+    goto out;
+  credentials = g_socket_get_credentials (g_socket_connection_get_socket (G_SOCKET_CONNECTION (stream)), NULL);
+  if (credentials == NULL)
+    goto out;
+
+  value = g_dbus_connection_call_sync (g_dbus_proxy_get_connection (authority->proxy),
+                                       "org.freedesktop.DBus",
+                                       "/org/freedesktop/DBus",
+                                       "org.freedesktop.DBus",
+                                       "GetConnectionUnixProcessID",
+                                       g_variant_new ("(s)", owner),
+                                       G_VARIANT_TYPE ("(u)"),
+                                       G_DBUS_CALL_FLAGS_NONE,
+                                       -1,
+                                       NULL, /* GCancellable */
+                                       NULL);
+  if (value == NULL)
+    goto out;
+  g_variant_get (value, "(u)", &owner_pid);
+  if (g_credentials_get_unix_pid (credentials, NULL) != (pid_t) owner_pid)
+    goto out;
+
+  ret = g_dbus_proxy_new_sync (connection,
+                               G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                               G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                               NULL, /* GDBusInterfaceInfo* */
+                               NULL, /* name */
+                               "/org/freedesktop/PolicyKit1/Authority",
+                               "org.freedesktop.PolicyKit1.Authority",
+                               NULL, /* GCancellable */
+                               NULL);
+
+ out:
+  if (value != NULL)
+    g_variant_unref (value);
+  if (credentials != NULL)
+    g_object_unref (credentials);
+  if (connection != NULL)
+    {
+      if (ret == NULL)
+        g_dbus_connection_close (connection, NULL, NULL, NULL);
+      g_object_unref (connection);
+    }
+  return ret;
+}
+
+/* Returns the proxy to check authorizations with, polkitd's peer
+ * socket if it has one and the bus otherwise. Signals and everything
+ * else keep coming over the bus. Free with g_object_unref().
+ *
+ * May block while connecting to the socket, so only the synchronous
+ * check uses it.
+ */
+static GDBusProxy *
+get_check_proxy (PolkitAuthority *authority)
+{
+  GDBusProxy *ret;
+  gchar *owner;
+
+  /* leave starting polkitd to the bus */
+  owner = g_dbus_proxy_get_name_owner (authority->proxy);
+  if (owner == NULL)
+    return g_object_ref (authority->proxy);
+
+  g_mutex_lock (&authority->peer_lock);
+
+  if (authority->peer_proxy != NULL &&
+      (g_dbus_connection_is_closed (g_dbus_proxy_get_connection (authority->peer_proxy)) ||
+       g_strcmp0 (authority->peer_owner, owner) != 0))
+    g_clear_object (&authority->peer_proxy);
+
+  /* try once for each polkitd we see */
+  if (authority->peer_proxy == NULL && g_strcmp0 (authority->peer_owner, owner) != 0)
+    {
+      authority->peer_proxy = peer_proxy_new (authority, owner);
+      g_free (authority->peer_owner);
+      authority->peer_owner = g_strdup (owner);
+    }
+
+  ret = g_object_ref (authority->peer_proxy != NULL ? authority->peer_proxy : authority->proxy);
+
+  g_mutex_unlock (&authority->peer_lock);
+
+  g_free (owner);
+  return ret;
+}
+
 typedef struct
 {
   PolkitAuthority *authority;
   GSimpleAsyncResult *simple;
   gchar *cancellation_id;
+  /* to send the check again over the bus, see check_authorization_cb() */
+  GVariant *parameters;
+  GCancellable *cancellable;
+  PolkitCheckAuthorizationFlags flags;
 } CheckAuthData;
 
 static void
@@ -828,6 +1172,26 @@ check_authorization_cb (GDBusProxy    *proxy,
 
   error = NULL;
   value = g_dbus_proxy_call_finish (proxy, res, &error);
+  if (value == NULL &&
+      proxy != data->authority->proxy &&
+      !(data->flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION) &&
+      g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CLOSED))
+    {
+      /* polkitd went away; fall back to the bus, which can start it again.
+       * The check may already have reached polkitd, so only do this when
+       * sending it twice can't show the user a second dialog. */
+      g_error_free (error);
+      g_dbus_proxy_call (data->authority->proxy,
+                         "CheckAuthorization",
+                         data->parameters,
+                         G_DBUS_CALL_FLAGS_NONE,
+                         G_MAXINT, /* no timeout */
+                         data->cancellable,
+                         (GAsyncReadyCallback) check_authorization_cb,
+                         data);
+      return;
+    }
+
   if (value == NULL)
     {
       if (data->cancellation_id != NULL &&
@@ -835,7 +1199,8 @@ check_authorization_cb (GDBusProxy    *proxy,
            error->domain == G_IO_ERROR &&
            error->code == G_IO_ERROR_CANCELLED))
         {
-          g_dbus_proxy_call (data->authority->proxy,
+          /* cancellation ids are scoped by connection */
+          g_dbus_proxy_call (proxy,
                              "CancelCheckAuthorization",
                              g_variant_new ("(s)", data->cancellation_id),
                              G_DBUS_CALL_FLAGS_NONE,
@@ -863,9 +1228,59 @@ check_authorization_cb (GDBusProxy    *proxy,
   g_object_unref (data->authority);
   g_object_unref (data->simple);
   g_free (data->cancellation_id);
+  g_variant_unref (data->parameters);
+  if (data->cancellable != NULL)
+    g_object_unref (data->cancellable);
   g_free (data);
 }
 
+/* Sends the check to polkitd over @proxy, which is either
+ * @authority's proxy on the bus or one from get_check_proxy()
+ */
+static void
+check_authorization_on_proxy (PolkitAuthority               *authority,
+                              GDBusProxy                    *proxy,
+                              PolkitSubject                 *subject,
+                              const gchar                   *action_id,
+                              PolkitDetails                 *details,
+                              PolkitCheckAuthorizationFlags  flags,
+                              GCancellable                  *cancellable,
+                              GAsyncReadyCallback            callback,
+                              gpointer                       user_data)
+{
+  CheckAuthData *data;
+
+  data = g_new0 (CheckAuthData, 1);
+  data->authority = g_object_ref (authority);
+  data->simple = g_simple_async_result_new (G_OBJECT (authority),
+                                            callback,
+                                            user_data,
+                                            polkit_authority_check_authorization);
+  G_LOCK (the_lock);
+  if (cancellable != NULL)
+    data->cancellation_id = g_strdup_printf ("cancellation-id-%d", authority->cancellation_id_counter++);
+  G_UNLOCK (the_lock);
+
+  data->parameters = g_variant_ref_sink (g_variant_new ("(@(sa{sv})s@a{ss}us)",
+                                                        polkit_subject_to_gvariant (subject), /* A floating value */
+                                                        action_id,
+                                                        polkit_details_to_gvariant (details), /* A floating value */
+                                                        flags,
+                                                        data->cancellation_id != NULL ? data->cancellation_id : ""));
+  if (cancellable != NULL)
+    data->cancellable = g_object_ref (cancellable);
+  data->flags = flags;
+
+  g_dbus_proxy_call (proxy,
+                     "CheckAuthorization",
+                     data->parameters,
+                     G_DBUS_CALL_FLAGS_NONE,
+                     G_MAXINT, /* no timeout */
+                     cancellable,
+                     (GAsyncReadyCallback) check_authorization_cb,
+                     data);
+}
+
 /**
  * polkit_authority_check_authorization:
  * @authority: A #PolkitAuthority.
@@ -912,38 +1327,22 @@ polkit_authority_check_authorization (PolkitAuthority               *authority,
                                       GAsyncReadyCallback            callback,
                                       gpointer                       user_data)
 {
-  CheckAuthData *data;
-
   g_return_if_fail (POLKIT_IS_AUTHORITY (authority));
   g_return_if_fail (POLKIT_IS_SUBJECT (subject));
   g_return_if_fail (action_id != NULL);
   g_return_if_fail (details == NULL || POLKIT_IS_DETAILS (details));
   g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
 
-  data = g_new0 (CheckAuthData, 1);
-  data->authority = g_object_ref (authority);
-  data->simple = g_simple_async_result_new (G_OBJECT (authority),
-                                            callback,
-                                            user_data,
-                                            polkit_authority_check_authorization);
-  G_LOCK (the_lock);
-  if (cancellable != NULL)
-    data->cancellation_id = g_strdup_printf ("cancellation-id-%d", authority->cancellation_id_counter++);
-  G_UNLOCK (the_lock);
-
-  g_dbus_proxy_call (authority->proxy,
-                     "CheckAuthorization",
-                     g_variant_new ("(@(sa{sv})s@a{ss}us)",
-                                    polkit_subject_to_gvariant (subject), /* A floating value */
-                                    action_id,
-                                    polkit_details_to_gvariant (details), /* A floating value */
-                                    flags,
-                                    data->cancellation_id != NULL ? data->cancellation_id : ""),
-                     G_DBUS_CALL_FLAGS_NONE,
-                     G_MAXINT, /* no timeout */
-                     cancellable,
-                     (GAsyncReadyCallback) check_authorization_cb,
-                     data);
+  /* setting up the peer socket blocks, see get_check_proxy() */
+  check_authorization_on_proxy (authority,
+                                authority->proxy,
+                                subject,
+                                action_id,
+                                details,
+                                flags,
+                                cancellable,
+                                callback,
+                                user_data);
 }
 
 /**
@@ -979,6 +1378,82 @@ polkit_authority_check_authorization_finish (PolkitAuthority          *authority
   return ret;
 }
 
+/* Returns a reference to a current snapshot of polkitd's implicit
+ * authorizations, or %NULL if there is none. polkitd only hands out
+ * snapshots to uid 0 since only trusted callers may check
+ * authorizations for other users anyway.
+ */
+static PolkitImplicitSnapshot *
+get_implicit_snapshot (PolkitAuthority *authority,
+                       GCancellable    *cancellable)
+{
+  PolkitImplicitSnapshot *ret;
+  GUnixFDList *fd_list;
+  GVariant *value;
+  GError *error;
+  gint32 fd_index;
+  gint fd;
+
+  ret = NULL;
+  fd_list = NULL;
+  value = NULL;
+  error = NULL;
+
+  g_mutex_lock (&authority->snapshot_lock);
+
+  if (authority->snapshot != NULL && !_polkit_implicit_snapshot_is_current (authority->snapshot))
+    {
+      _polkit_implicit_snapshot_unref (authority->snapshot);
+      authority->snapshot = NULL;
+    }
+
+  if (authority->snapshot == NULL && !authority->snapshot_unavailable && geteuid () == 0)
+    {
+      value = g_dbus_proxy_call_with_unix_fd_list_sync (authority->proxy,
+                                                        "GetImplicitAuthorizations",
+                                                        g_variant_new ("()"),
+                                                        G_DBUS_CALL_FLAGS_NONE,
+                                                        -1,
+                                                        NULL, /* fd_list */
+                                                        &fd_list,
+                                                        cancellable,
+                                                        &error);
+      if (value == NULL)
+        goto out;
+
+      g_variant_get (value, "(h)", &fd_index);
+      fd = g_unix_fd_list_get (fd_list, fd_index, &error);
+      if (fd < 0)
+        goto out;
+
+      authority->snapshot = _polkit_implicit_snapshot_new_for_fd (fd, &error);
+    }
+
+ out:
+  if (error != NULL)
+    {
+      /* e.g. an older polkitd; don't ask again until it is replaced,
+       * see on_notify_g_name_owner() */
+      if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD) ||
+          g_error_matches (error, POLKIT_ERROR, POLKIT_ERROR_NOT_SUPPORTED) ||
+          g_error_matches (error, POLKIT_ERROR, POLKIT_ERROR_NOT_AUTHORIZED))
+        authority->snapshot_unavailable = TRUE;
+      g_error_free (error);
+    }
+
+  if (authority->snapshot != NULL)
+    ret = _polkit_implicit_snapshot_ref (authority->snapshot);
+
+  g_mutex_unlock (&authority->snapshot_lock);
+
+  if (value != NULL)
+    g_variant_unref (value);
+  if (fd_list != NULL)
+    g_object_unref (fd_list);
+
+  return ret;
+}
+
 /**
  * polkit_authority_check_authorization_sync:
  * @authority: A #PolkitAuthority.
@@ -1011,6 +1486,14 @@ polkit_authority_check_authorization_finish (PolkitAuthority          *authority
  * override the message shown to the user. See the documentation for
  * the <link linkend="eggdbus-method-org.freedesktop.PolicyKit1.Authority.CheckAuthorization">D-Bus method</link> for more details.
  *
+ * When called by uid 0 without @details, checks that polkitd decides
+ * from the implicit authorizations of @action_id alone are answered
+ * locally from a shared memory snapshot, without a D-Bus round trip.
+ *
+ * If polkitd was started with <literal>--peer-socket</literal>, the
+ * check is sent to it directly rather than through the system bus
+ * daemon, and sent again over the bus should that connection fail.
+ *
  * Returns: (transfer full): A #PolkitAuthorizationResult or %NULL if @error is set. Free with g_object_unref().
  */
 PolkitAuthorizationResult *
@@ -1023,7 +1506,9 @@ polkit_authority_check_authorization_sync (PolkitAuthority               *author
                                            GError                       **error)
 {
   PolkitAuthorizationResult *ret;
+  PolkitImplicitSnapshot *snapshot;
   CallSyncData *data;
+  GDBusProxy *proxy;
 
   g_return_val_if_fail (POLKIT_IS_AUTHORITY (authority), NULL);
   g_return_val_if_fail (POLKIT_IS_SUBJECT (subject), NULL);
@@ -1032,11 +1517,23 @@ polkit_authority_check_authorization_sync (PolkitAuthority               *author
   g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
   g_return_val_if_fail (error == NULL || *error == NULL, NULL);
 
+  snapshot = get_implicit_snapshot (authority, cancellable);
+  if (snapshot != NULL)
+    {
+      ret = _polkit_implicit_snapshot_check (snapshot, subject, action_id, details, flags);
+      _polkit_implicit_snapshot_unref (snapshot);
+      if (ret != NULL)
+        return ret;
+    }
+
+  /* blocking is fine here, so the peer socket can be set up */
+  proxy = get_check_proxy (authority);
   data = call_sync_new ();
-  polkit_authority_check_authorization (authority, subject, action_id, details, flags, cancellable, call_sync_cb, data);
+  check_authorization_on_proxy (authority, proxy, subject, action_id, details, flags, cancellable, call_sync_cb, data);
   call_sync_block (data);
   ret = polkit_authority_check_authorization_finish (authority, data->res, error);
   call_sync_free (data);
+  g_object_unref (proxy);
 
   return ret;
 }
@@ -68,6 +68,16 @@ GList                     *polkit_authority_enumerate_actions_sync (PolkitAuthor
                                                                     GCancellable    *cancellable,
                                                                     GError         **error);
 
+GList                     *polkit_authority_enumerate_actions_filtered_sync (PolkitAuthority *authority,
+                                                                             const gchar     *id_prefix,
+                                                                             const gchar     *annotation_key,
+                                                                             const gchar     *annotation_value,
+                                                                             guint            offset,
+                                                                             guint            limit,
+                                                                             guint           *out_num_matches,
+                                                                             GCancellable    *cancellable,
+                                                                             GError         **error);
+
 PolkitAuthorizationResult *polkit_authority_check_authorization_sync (PolkitAuthority               *authority,
                                                                       PolkitSubject                 *subject,
                                                                       const gchar                   *action_id,
@@ -129,6 +139,21 @@ GList *                    polkit_authority_enumerate_actions_finish (PolkitAuth
                                                                       GAsyncResult    *res,
                                                                       GError         **error);
 
+void                       polkit_authority_enumerate_actions_filtered (PolkitAuthority     *authority,
+                                                                        const gchar         *id_prefix,
+                                                                        const gchar         *annotation_key,
+                                                                        const gchar         *annotation_value,
+                                                                        guint                offset,
+                                                                        guint                limit,
+                                                                        GCancellable        *cancellable,
+                                                                        GAsyncReadyCallback  callback,
+                                                                        gpointer             user_data);
+
+GList *                    polkit_authority_enumerate_actions_filtered_finish (PolkitAuthority *authority,
+                                                                               GAsyncResult    *res,
+                                                                               guint           *out_num_matches,
+                                                                               GError         **error);
+
 void                       polkit_authority_check_authorization (PolkitAuthority               *authority,
                                                                  PolkitSubject                 *subject,
                                                                  const gchar                   *action_id,
@@ -19,6 +19,7 @@
  * Author: David Zeuthen <davidz@redhat.com>
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include "polkitimplicitauthorization.h"
 #include "polkitdetails.h"
@@ -34,6 +35,13 @@
  * An object used for passing details around.
  */
 
+typedef struct
+{
+  const gchar *key;
+  const gchar *value;
+  gsize position;
+} DetailEntry;
+
 /**
  * PolkitDetails:
  *
@@ -43,6 +51,17 @@ struct _PolkitDetails
 {
   GObject parent_instance;
 
+  /* The a{ss} dictionary the object was created from, if any, and a
+   * lazily built index, sorted by key, of the strings it contains.
+   * The strings are owned by @variant.
+   */
+  GVariant *variant;
+  DetailEntry *entries;
+  guint num_entries;
+
+  /* Copy-on-write overlay for polkit_details_insert(). A %NULL value
+   * means that the key has been removed.
+   */
   GHashTable *hash;
 };
 
@@ -67,6 +86,9 @@ polkit_details_finalize (GObject *object)
 
   if (details->hash != NULL)
     g_hash_table_unref (details->hash);
+  g_free (details->entries);
+  if (details->variant != NULL)
+    g_variant_unref (details->variant);
 
   if (G_OBJECT_CLASS (polkit_details_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (polkit_details_parent_class)->finalize (object);
@@ -97,17 +119,75 @@ polkit_details_new (void)
   return details;
 }
 
-/* private */
-static PolkitDetails *
-polkit_details_new_for_hash (GHashTable *hash)
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gint
+compare_entries (gconstpointer a,
+                 gconstpointer b)
 {
-  PolkitDetails *details;
+  const DetailEntry *ea = a;
+  const DetailEntry *eb = b;
+  gint ret;
 
-  details = POLKIT_DETAILS (g_object_new (POLKIT_TYPE_DETAILS, NULL));
-  if (hash != NULL)
-    details->hash = g_hash_table_ref (hash);
+  ret = strcmp (ea->key, eb->key);
+  if (ret == 0)
+    ret = (ea->position > eb->position) - (ea->position < eb->position);
+  return ret;
+}
 
-  return details;
+static gint
+compare_key_to_entry (gconstpointer key,
+                      gconstpointer entry)
+{
+  return strcmp (key, ((const DetailEntry *) entry)->key);
+}
+
+/* Builds the index on first use. A dictionary received over D-Bus may
+ * contain the same key more than once; like the hash table this
+ * replaces, the last occurrence wins.
+ */
+static void
+ensure_entries (PolkitDetails *details)
+{
+  gsize num_children;
+  gsize n;
+  guint m;
+
+  if (details->variant == NULL || details->entries != NULL)
+    return;
+
+  num_children = g_variant_n_children (details->variant);
+  if (num_children == 0)
+    return;
+
+  details->entries = g_new (DetailEntry, num_children);
+  for (n = 0; n < num_children; n++)
+    {
+      g_variant_get_child (details->variant, n, "{&s&s}",
+                           &details->entries[n].key,
+                           &details->entries[n].value);
+      details->entries[n].position = n;
+    }
+  qsort (details->entries, num_children, sizeof (DetailEntry), compare_entries);
+
+  for (n = 1, m = 0; n < num_children; n++)
+    {
+      if (strcmp (details->entries[n].key, details->entries[m].key) != 0)
+        m++;
+      details->entries[m] = details->entries[n];
+    }
+  details->num_entries = m + 1;
+}
+
+static const DetailEntry *
+lookup_entry (PolkitDetails *details,
+              const gchar   *key)
+{
+  ensure_entries (details);
+  if (details->num_entries == 0)
+    return NULL;
+  return bsearch (key, details->entries, details->num_entries,
+                  sizeof (DetailEntry), compare_key_to_entry);
 }
 
 /**
@@ -123,12 +203,17 @@ const gchar *
 polkit_details_lookup (PolkitDetails *details,
                        const gchar   *key)
 {
+  const DetailEntry *entry;
+  gpointer value;
+
   g_return_val_if_fail (POLKIT_IS_DETAILS (details), NULL);
   g_return_val_if_fail (key != NULL, NULL);
-  if (details->hash == NULL)
-    return NULL;
-  else
-    return g_hash_table_lookup (details->hash, key);
+
+  if (details->hash != NULL && g_hash_table_lookup_extended (details->hash, key, NULL, &value))
+    return value;
+
+  entry = lookup_entry (details, key);
+  return entry != NULL ? entry->value : NULL;
 }
 
 /**
@@ -155,10 +240,146 @@ polkit_details_insert (PolkitDetails *details,
                                            g_free);
   if (value != NULL)
     g_hash_table_insert (details->hash, g_strdup (key), g_strdup (value));
+  else if (lookup_entry (details, key) != NULL)
+    g_hash_table_insert (details->hash, g_strdup (key), NULL);
   else
     g_hash_table_remove (details->hash, key);
 }
 
+/**
+ * polkit_details_get_count:
+ * @details: A #PolkitDetails.
+ *
+ * Gets the number of keys on @details without copying them.
+ *
+ * Returns: The number of keys on @details.
+ *
+ * Since: 127
+ */
+guint
+polkit_details_get_count (PolkitDetails *details)
+{
+  GHashTableIter hash_iter;
+  const gchar *key;
+  const gchar *value;
+  guint ret;
+
+  g_return_val_if_fail (POLKIT_IS_DETAILS (details), 0);
+
+  ensure_entries (details);
+  ret = details->num_entries;
+
+  if (details->hash != NULL)
+    {
+      g_hash_table_iter_init (&hash_iter, details->hash);
+      while (g_hash_table_iter_next (&hash_iter, (gpointer) &key, (gpointer) &value))
+        {
+          gboolean in_variant = lookup_entry (details, key) != NULL;
+          if (value == NULL && in_variant)
+            ret--;
+          else if (value != NULL && !in_variant)
+            ret++;
+        }
+    }
+
+  return ret;
+}
+
+/**
+ * PolkitDetailsIter:
+ *
+ * A stack-allocated iterator over the keys and values of a
+ * #PolkitDetails, see polkit_details_iter_init(). The fields are
+ * private.
+ *
+ * Since: 127
+ */
+
+/**
+ * polkit_details_iter_init:
+ * @iter: An uninitialized #PolkitDetailsIter.
+ * @details: A #PolkitDetails.
+ *
+ * Initializes @iter for iterating over the keys and values of
+ * @details with polkit_details_iter_next(). Neither function
+ * allocates memory.
+ *
+ * @details must not be modified while it is being iterated over.
+ *
+ * Since: 127
+ */
+void
+polkit_details_iter_init (PolkitDetailsIter *iter,
+                          PolkitDetails     *details)
+{
+  g_return_if_fail (iter != NULL);
+  g_return_if_fail (POLKIT_IS_DETAILS (details));
+
+  ensure_entries (details);
+  iter->details = details;
+  iter->position = 0;
+  if (details->hash != NULL)
+    g_hash_table_iter_init (&iter->hash_iter, details->hash);
+}
+
+/**
+ * polkit_details_iter_next:
+ * @iter: A #PolkitDetailsIter.
+ * @out_key: (out) (allow-none) (transfer none): Return location for the key or %NULL.
+ * @out_value: (out) (allow-none) (transfer none): Return location for the value or %NULL.
+ *
+ * Advances @iter. The returned strings are owned by the #PolkitDetails.
+ *
+ * Returns: %FALSE if the end has been reached, %TRUE otherwise.
+ *
+ * Since: 127
+ */
+gboolean
+polkit_details_iter_next (PolkitDetailsIter  *iter,
+                          const gchar       **out_key,
+                          const gchar       **out_value)
+{
+  PolkitDetails *details;
+  const gchar *key;
+  const gchar *value;
+
+  g_return_val_if_fail (iter != NULL, FALSE);
+
+  details = iter->details;
+
+  /* First the entries of the dictionary not shadowed by the overlay... */
+  while (iter->position < details->num_entries)
+    {
+      const DetailEntry *entry = &details->entries[iter->position++];
+
+      if (details->hash != NULL && g_hash_table_contains (details->hash, entry->key))
+        continue;
+
+      key = entry->key;
+      value = entry->value;
+      goto found;
+    }
+
+  /* ... then the inserted ones */
+  if (details->hash != NULL)
+    {
+      while (g_hash_table_iter_next (&iter->hash_iter, (gpointer) &key, (gpointer) &value))
+        {
+          if (value != NULL)
+            goto found;
+        }
+    }
+
+  return FALSE;
+
+ found:
+  if (out_key != NULL)
+    *out_key = key;
+  if (out_value != NULL)
+    *out_value = value;
+  return TRUE;
+}
+
 /**
  * polkit_details_get_keys:
  * @details: A #PolkitDetails.
@@ -172,21 +393,20 @@ polkit_details_insert (PolkitDetails *details,
 gchar **
 polkit_details_get_keys (PolkitDetails *details)
 {
-  GList *keys, *l;
+  PolkitDetailsIter iter;
+  const gchar *key;
   gchar **ret;
   guint n;
 
   g_return_val_if_fail (POLKIT_IS_DETAILS (details), NULL);
 
-  if (details->hash == NULL)
+  if (details->variant == NULL && details->hash == NULL)
     return NULL;
 
-  keys = g_hash_table_get_keys (details->hash);
-  ret = g_new0 (gchar*, g_list_length (keys) + 1);
-  for (l = keys, n = 0; l != NULL; l = l->next, n++)
-    ret[n] = g_strdup (l->data);
-
-  g_list_free (keys);
+  ret = g_new0 (gchar*, polkit_details_get_count (details) + 1);
+  polkit_details_iter_init (&iter, details);
+  for (n = 0; polkit_details_iter_next (&iter, &key, NULL); n++)
+    ret[n] = g_strdup (key);
 
   return ret;
 }
@@ -198,34 +418,30 @@ polkit_details_to_gvariant (PolkitDetails *details)
   GVariantBuilder builder;
 
   g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
-  if (details != NULL && details->hash != NULL)
+  if (details != NULL)
     {
-      GHashTableIter hash_iter;
+      PolkitDetailsIter iter;
       const gchar *key;
       const gchar *value;
 
-      g_hash_table_iter_init (&hash_iter, details->hash);
-      while (g_hash_table_iter_next (&hash_iter, (gpointer) &key, (gpointer) &value))
+      polkit_details_iter_init (&iter, details);
+      while (polkit_details_iter_next (&iter, &key, &value))
         g_variant_builder_add (&builder, "{ss}", key, value);
     }
   return g_variant_builder_end (&builder);
 }
 
+/* The returned object keeps a reference to @value and looks up the
+ * strings in it on demand instead of copying them.
+ */
 PolkitDetails *
 polkit_details_new_for_gvariant (GVariant *value)
 {
   PolkitDetails *ret;
-  GHashTable *hash;
-  GVariantIter iter;
-  gchar *hash_key;
-  gchar *hash_value;
-
-  hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
-  g_variant_iter_init (&iter, value);
-  while (g_variant_iter_next (&iter, "{ss}", &hash_key, &hash_value))
-    g_hash_table_insert (hash, hash_key, hash_value);
-  ret = polkit_details_new_for_hash (hash);
-  g_hash_table_unref (hash);
+
+  g_return_val_if_fail (g_variant_is_of_type (value, G_VARIANT_TYPE ("a{ss}")), NULL);
+
+  ret = POLKIT_DETAILS (g_object_new (POLKIT_TYPE_DETAILS, NULL));
+  ret->variant = g_variant_ref_sink (value);
   return ret;
 }
-
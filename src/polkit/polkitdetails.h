@@ -43,6 +43,15 @@ G_BEGIN_DECLS
 typedef struct _PolkitDetails PolkitDetails;
 #endif
 typedef struct _PolkitDetailsClass PolkitDetailsClass;
+typedef struct _PolkitDetailsIter PolkitDetailsIter;
+
+struct _PolkitDetailsIter
+{
+  /*< private >*/
+  PolkitDetails  *details;
+  guint           position;
+  GHashTableIter  hash_iter;
+};
 
 GType                polkit_details_get_type (void) G_GNUC_CONST;
 PolkitDetails       *polkit_details_new      (void);
@@ -52,6 +61,13 @@ void                 polkit_details_insert   (PolkitDetails *details,
                                               const gchar   *key,
                                               const gchar   *value);
 gchar              **polkit_details_get_keys (PolkitDetails *details);
+guint                polkit_details_get_count (PolkitDetails *details);
+
+void                 polkit_details_iter_init (PolkitDetailsIter  *iter,
+                                               PolkitDetails      *details);
+gboolean             polkit_details_iter_next (PolkitDetailsIter  *iter,
+                                               const gchar       **out_key,
+                                               const gchar       **out_value);
 
 G_END_DECLS
 
@@ -0,0 +1,358 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef HAVE_PIDFD_OPEN
+#include <sys/syscall.h>
+#endif /* HAVE_PIDFD_OPEN */
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBSYSTEMD
+#include <systemd/sd-login.h>
+#endif
+
+#include "polkitimplicitsnapshot.h"
+#include "polkitauthorizationresult.h"
+#include "polkitdetails.h"
+#include "polkiterror.h"
+#include "polkitsubject.h"
+#include "polkitsystembusname.h"
+#include "polkitunixprocess.h"
+#include "polkitprivate.h"
+
+/* Client side of polkitd's GetImplicitAuthorizations() snapshot, see
+ * polkitimplicitsnapshot.h for the layout. Only used by
+ * polkit_authority_check_authorization_sync().
+ */
+
+struct _PolkitImplicitSnapshot
+{
+  volatile gint ref_count;
+
+  const guint8 *data;
+  gsize size;
+  const PolkitImplicitSnapshotHeader *header;
+  const PolkitImplicitSnapshotEntry *entries;
+
+  /* pins polkitd so we notice when it goes away */
+  gint daemon_pidfd;
+};
+
+PolkitImplicitSnapshot *
+_polkit_implicit_snapshot_new_for_fd (gint     fd,
+                                      GError **error)
+{
+#if defined(HAVE_PIDFD_OPEN) && defined(F_GET_SEALS) && defined(F_SEAL_FUTURE_WRITE)
+  PolkitImplicitSnapshot *snapshot;
+  const PolkitImplicitSnapshotHeader *header;
+  struct stat statbuf;
+  gpointer data;
+  gsize strings_offset;
+  gint seals;
+  guint n;
+
+  snapshot = NULL;
+  data = MAP_FAILED;
+
+  /* polkitd can't change the snapshot under us, except for the header */
+  seals = fcntl (fd, F_GET_SEALS);
+  if (seals < 0 ||
+      (seals & F_SEAL_SHRINK) == 0 ||
+      (seals & (F_SEAL_WRITE | F_SEAL_FUTURE_WRITE)) == 0)
+    {
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
+                   "Implicit authorization snapshot is not sealed");
+      goto out;
+    }
+
+  if (fstat (fd, &statbuf) != 0)
+    {
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
+                   "Error calling fstat(): %m");
+      goto out;
+    }
+  if (statbuf.st_size < (off_t) sizeof (PolkitImplicitSnapshotHeader) ||
+      statbuf.st_size > G_MAXUINT32)
+    {
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
+                   "Implicit authorization snapshot has bad size %" G_GINT64_FORMAT,
+                   (gint64) statbuf.st_size);
+      goto out;
+    }
+
+  data = mmap (NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED)
+    {
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
+                   "Error mapping implicit authorization snapshot: %m");
+      goto out;
+    }
+
+  header = data;
+  strings_offset = sizeof (PolkitImplicitSnapshotHeader) +
+                   (gsize) header->num_actions * sizeof (PolkitImplicitSnapshotEntry);
+  if (header->magic != POLKIT_IMPLICIT_SNAPSHOT_MAGIC ||
+      header->version != POLKIT_IMPLICIT_SNAPSHOT_VERSION ||
+      header->size != (gsize) statbuf.st_size ||
+      strings_offset > header->size ||
+      ((const guint8 *) data)[header->size - 1] != '\0')
+    {
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
+                   "Malformed implicit authorization snapshot");
+      goto out;
+    }
+
+  snapshot = g_new0 (PolkitImplicitSnapshot, 1);
+  snapshot->ref_count = 1;
+  snapshot->data = data;
+  snapshot->size = header->size;
+  snapshot->header = header;
+  snapshot->entries = (const PolkitImplicitSnapshotEntry *) (header + 1);
+  snapshot->daemon_pidfd = -1;
+  data = MAP_FAILED;
+
+  for (n = 0; n < header->num_actions; n++)
+    {
+      if (snapshot->entries[n].action_id_offset < strings_offset ||
+          snapshot->entries[n].action_id_offset >= snapshot->size)
+        {
+          g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
+                       "Malformed implicit authorization snapshot");
+          _polkit_implicit_snapshot_unref (snapshot);
+          snapshot = NULL;
+          goto out;
+        }
+    }
+
+  snapshot->daemon_pidfd = (gint) syscall (SYS_pidfd_open, (pid_t) header->pid, 0);
+  if (snapshot->daemon_pidfd < 0)
+    {
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
+                   "Error opening pidfd for polkitd: %m");
+      _polkit_implicit_snapshot_unref (snapshot);
+      snapshot = NULL;
+      goto out;
+    }
+
+ out:
+  if (data != MAP_FAILED)
+    munmap (data, statbuf.st_size);
+  close (fd);
+  return snapshot;
+#else
+  close (fd);
+  g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_NOT_SUPPORTED,
+               "Implicit authorization snapshots are not supported on this system");
+  return NULL;
+#endif
+}
+
+PolkitImplicitSnapshot *
+_polkit_implicit_snapshot_ref (PolkitImplicitSnapshot *snapshot)
+{
+  g_atomic_int_inc (&snapshot->ref_count);
+  return snapshot;
+}
+
+void
+_polkit_implicit_snapshot_unref (PolkitImplicitSnapshot *snapshot)
+{
+  if (!g_atomic_int_dec_and_test (&snapshot->ref_count))
+    return;
+
+  if (snapshot->daemon_pidfd >= 0)
+    close (snapshot->daemon_pidfd);
+  munmap ((gpointer) snapshot->data, snapshot->size);
+  g_free (snapshot);
+}
+
+gboolean
+_polkit_implicit_snapshot_is_current (PolkitImplicitSnapshot *snapshot)
+{
+  struct pollfd pfd;
+
+  if (g_atomic_int_get (&snapshot->header->current_generation) != (gint) snapshot->header->generation)
+    return FALSE;
+
+  /* a pidfd becomes readable when the process exits */
+  pfd.fd = snapshot->daemon_pidfd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  if (poll (&pfd, 1, 0) != 0)
+    return FALSE;
+
+  return TRUE;
+}
+
+/* entries are sorted by action id */
+static const PolkitImplicitSnapshotEntry *
+lookup_entry (PolkitImplicitSnapshot *snapshot,
+              const gchar            *action_id)
+{
+  guint lo, hi;
+
+  lo = 0;
+  hi = snapshot->header->num_actions;
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      gint c;
+
+      c = strcmp (action_id, (const gchar *) snapshot->data + snapshot->entries[mid].action_id_offset);
+      if (c == 0)
+        return &snapshot->entries[mid];
+      else if (c < 0)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+  return NULL;
+}
+
+#ifdef HAVE_LIBSYSTEMD
+/* Mirrors polkitd's session monitor, except that subjects without a
+ * session of their own are left to polkitd.
+ */
+static gboolean
+get_session_state (PolkitUnixProcess *process,
+                   gboolean          *out_is_local,
+                   gboolean          *out_is_active)
+{
+  gchar *session_id;
+  gchar *seat;
+  gchar *state;
+  uid_t uid;
+  gint r;
+
+  session_id = NULL;
+  r = -1;
+#if HAVE_SD_PIDFD_GET_SESSION
+  if (polkit_unix_process_get_pidfd (process) >= 0)
+    r = sd_pidfd_get_session (polkit_unix_process_get_pidfd (process), &session_id);
+#endif
+  if (r < 0)
+    r = sd_pid_get_session (polkit_unix_process_get_pid (process), &session_id);
+  if (r < 0)
+    return FALSE;
+
+  *out_is_local = FALSE;
+  if (sd_session_get_seat (session_id, &seat) >= 0)
+    {
+      *out_is_local = TRUE;
+      free (seat);
+    }
+
+  /* any active session of the user counts */
+  if (sd_session_get_uid (session_id, &uid) >= 0 && sd_uid_get_state (uid, &state) >= 0)
+    {
+      *out_is_active = g_strcmp0 (state, "active") == 0;
+      free (state);
+    }
+  else
+    {
+      *out_is_active = sd_session_is_active (session_id) > 0;
+    }
+
+  free (session_id);
+  return TRUE;
+}
+#endif
+
+/* Returns %NULL unless the answer is known to be the one polkitd would give */
+PolkitAuthorizationResult *
+_polkit_implicit_snapshot_check (PolkitImplicitSnapshot        *snapshot,
+                                 PolkitSubject                 *subject,
+                                 const gchar                   *action_id,
+                                 PolkitDetails                 *details,
+                                 PolkitCheckAuthorizationFlags  flags)
+{
+  const PolkitImplicitSnapshotEntry *entry;
+  PolkitAuthorizationResult *ret;
+  PolkitSubject *process;
+  guint8 decision;
+  gint uid;
+
+  ret = NULL;
+  process = NULL;
+
+  /* rules and authentication dialogs may look at details */
+  if (details != NULL && polkit_details_get_count (details) > 0)
+    goto out;
+
+  entry = lookup_entry (snapshot, action_id);
+  if (entry == NULL)
+    goto out;
+
+  if (POLKIT_IS_UNIX_PROCESS (subject))
+    process = g_object_ref (subject);
+  else if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
+    process = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (subject), NULL, NULL);
+  if (process == NULL)
+    goto out;
+
+  /* the same check polkitd does before trusting the uid of the subject */
+  uid = polkit_unix_process_get_uid (POLKIT_UNIX_PROCESS (process));
+  if (uid == -1 || polkit_unix_process_get_racy_uid__ (POLKIT_UNIX_PROCESS (process), NULL) != uid)
+    goto out;
+
+  if (uid == 0 && !(flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_ALWAYS_CHECK))
+    {
+      decision = POLKIT_IMPLICIT_SNAPSHOT_AUTHORIZED;
+    }
+  else if (entry->any == entry->inactive && entry->any == entry->active)
+    {
+      decision = entry->any;
+    }
+  else
+    {
+#ifdef HAVE_LIBSYSTEMD
+      gboolean is_local;
+      gboolean is_active;
+
+      if (!get_session_state (POLKIT_UNIX_PROCESS (process), &is_local, &is_active))
+        goto out;
+      if (!is_local)
+        decision = entry->any;
+      else if (is_active)
+        decision = entry->active;
+      else
+        decision = entry->inactive;
+#else
+      goto out;
+#endif
+    }
+
+  /* the snapshot may have been superseded while we looked */
+  if (!_polkit_implicit_snapshot_is_current (snapshot))
+    goto out;
+
+  if (decision == POLKIT_IMPLICIT_SNAPSHOT_AUTHORIZED)
+    ret = polkit_authorization_result_new (TRUE, FALSE, NULL);
+  else if (decision == POLKIT_IMPLICIT_SNAPSHOT_NOT_AUTHORIZED)
+    ret = polkit_authorization_result_new (FALSE, FALSE, NULL);
+
+ out:
+  if (process != NULL)
+    g_object_unref (process);
+  return ret;
+}
@@ -0,0 +1,91 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __POLKIT_IMPLICIT_SNAPSHOT_H
+#define __POLKIT_IMPLICIT_SNAPSHOT_H
+
+#include <glib.h>
+
+#include "polkittypes.h"
+#include "polkitcheckauthorizationflags.h"
+
+/* This header is not installed. It describes the layout of the memfd
+ * handed out by polkitd's GetImplicitAuthorizations() method and is
+ * shared between polkitd and libpolkit-gobject.
+ *
+ * The memfd is laid out as
+ *
+ *   PolkitImplicitSnapshotHeader
+ *   PolkitImplicitSnapshotEntry[num_actions], sorted by action id
+ *   NUL-terminated action ids
+ *
+ * and its last byte is always NUL. It is sealed against writes,
+ * except that polkitd keeps a writable mapping of the header so it can
+ * store a new @current_generation when the snapshot is superseded.
+ * Clients must check that @current_generation still equals
+ * @generation, and that @pid is still running, before trusting an
+ * answer.
+ */
+
+#define POLKIT_IMPLICIT_SNAPSHOT_MAGIC   0x53494b50 /* "PKIS" */
+#define POLKIT_IMPLICIT_SNAPSHOT_VERSION 1
+
+/* What a client may answer locally for one session state */
+typedef enum
+{
+  POLKIT_IMPLICIT_SNAPSHOT_ASK_AUTHORITY = 0,
+  POLKIT_IMPLICIT_SNAPSHOT_AUTHORIZED = 1,
+  POLKIT_IMPLICIT_SNAPSHOT_NOT_AUTHORIZED = 2
+} PolkitImplicitSnapshotDecision;
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 size;
+  guint32 num_actions;
+  /* the snapshot is stale once polkitd exits */
+  guint32 pid;
+  guint32 generation;
+  volatile gint current_generation;
+} PolkitImplicitSnapshotHeader;
+
+typedef struct
+{
+  /* offset from the start of the snapshot */
+  guint32 action_id_offset;
+  /* PolkitImplicitSnapshotDecision for subjects in no/an inactive/an active local session */
+  guint8 any;
+  guint8 inactive;
+  guint8 active;
+  guint8 reserved;
+} PolkitImplicitSnapshotEntry;
+
+typedef struct _PolkitImplicitSnapshot PolkitImplicitSnapshot;
+
+PolkitImplicitSnapshot    *_polkit_implicit_snapshot_new_for_fd (gint     fd,
+                                                                 GError **error);
+PolkitImplicitSnapshot    *_polkit_implicit_snapshot_ref        (PolkitImplicitSnapshot *snapshot);
+void                       _polkit_implicit_snapshot_unref      (PolkitImplicitSnapshot *snapshot);
+gboolean                   _polkit_implicit_snapshot_is_current (PolkitImplicitSnapshot *snapshot);
+PolkitAuthorizationResult *_polkit_implicit_snapshot_check      (PolkitImplicitSnapshot        *snapshot,
+                                                                 PolkitSubject                 *subject,
+                                                                 const gchar                   *action_id,
+                                                                 PolkitDetails                 *details,
+                                                                 PolkitCheckAuthorizationFlags  flags);
+
+#endif /* __POLKIT_IMPLICIT_SNAPSHOT_H */
@@ -38,6 +38,10 @@
    were necessary in the future.  In the meantime, consider that there is
    non-zero risk that changing these functions might break some applications. */
 
+/* Where polkitd serves peer-to-peer D-Bus when started with
+ * --peer-socket, see polkit_backend_authority_register_peer_socket() */
+#define POLKIT_PEER_SOCKET_PATH "/run/polkitd/authority"
+
 PolkitActionDescription  *polkit_action_description_new_for_gvariant (GVariant *value);
 GVariant *polkit_action_description_to_gvariant (PolkitActionDescription *action_description);
 
@@ -46,6 +50,26 @@ GVariant *polkit_identity_to_gvariant (PolkitIdentity *identity);
 
 gint polkit_unix_process_get_racy_uid__ (PolkitUnixProcess *process, GError **error);
 
+/* What the kernel reported about a process at some point, see
+ * polkit_unix_process_refresh_info__(). Never changed once returned. */
+typedef struct
+{
+  gint pid;
+  gint uid;
+  guint64 start_time;
+  /* of gid_t, %NULL if not known */
+  GArray *gids;
+  /* identity of the executable, both 0 if not known */
+  guint64 exe_dev;
+  guint64 exe_ino;
+  /*< private >*/
+  volatile gint ref_count;
+} PolkitUnixProcessInfo;
+
+PolkitUnixProcessInfo *polkit_unix_process_get_info__ (PolkitUnixProcess *process, GError **error);
+PolkitUnixProcessInfo *polkit_unix_process_refresh_info__ (PolkitUnixProcess *process, GError **error);
+void polkit_unix_process_info_unref__ (PolkitUnixProcessInfo *info);
+
 PolkitSubject  *polkit_subject_new_for_gvariant (GVariant *variant, GError **error);
 PolkitSubject  *polkit_subject_new_for_gvariant_invocation (GVariant              *variant,
                                                             GDBusMethodInvocation *invocation,
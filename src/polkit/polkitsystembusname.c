@@ -60,9 +60,6 @@ enum
 };
 
 
-guint8 dbus_call_respond_fails;      // has to be global because of callback
-
-
 static void subject_iface_init (PolkitSubjectIface *subject_iface);
 
 G_DEFINE_TYPE_WITH_CODE (PolkitSystemBusName, polkit_system_bus_name, G_TYPE_OBJECT,
@@ -347,6 +344,7 @@ typedef struct {
   guint retrieved_uid : 1;
   guint retrieved_pid : 1;
   guint caught_error : 1;
+  guint8 respond_fails;
 
   guint32 uid;
   guint32 pid;
@@ -365,7 +363,7 @@ on_retrieved_unix_uid_pid (GObject              *src,
   if (!v)
     {
       data->caught_error = TRUE;
-      dbus_call_respond_fails += 1;
+      data->respond_fails += 1;
     }
   else
     {
@@ -400,8 +398,6 @@ polkit_system_bus_name_get_creds_fallback (PolkitSystemBusName           *system
 
   data.error = error;
 
-  dbus_call_respond_fails = 0;
-
   /* Do two async calls as it's basically as fast as one sync call.
    */
   g_dbus_connection_call (connection,
@@ -436,7 +432,7 @@ polkit_system_bus_name_get_creds_fallback (PolkitSystemBusName           *system
      * Resolves: GHSL-2021-077
     */
 
-    if ( (dbus_call_respond_fails > 1) )
+    if ( (data.respond_fails > 1) )
     {
       // we got two faults, we can leave
       goto out;
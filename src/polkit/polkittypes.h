@@ -30,6 +30,9 @@ typedef struct _PolkitAuthority PolkitAuthority;
 struct _PolkitActionDescription;
 typedef struct _PolkitActionDescription PolkitActionDescription;
 
+struct _PolkitActionEnumerator;
+typedef struct _PolkitActionEnumerator PolkitActionEnumerator;
+
 typedef struct _PolkitSubject PolkitSubject; /* Dummy typedef */
 
 struct _PolkitUnixProcess;
@@ -67,6 +70,7 @@ typedef struct _PolkitPermission PolkitPermission;
 #if GLIB_CHECK_VERSION(2, 44, 0)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (PolkitAuthority, g_object_unref)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (PolkitActionDescription, g_object_unref)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PolkitActionEnumerator, g_object_unref)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (PolkitSubject, g_object_unref)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (PolkitUnixProcess, g_object_unref)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (PolkitUnixSession, g_object_unref)
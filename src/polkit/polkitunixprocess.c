@@ -20,6 +20,7 @@
  */
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #ifdef HAVE_FREEBSD
 #include <sys/param.h>
 #include <sys/sysctl.h>
@@ -35,10 +36,13 @@
 #ifdef HAVE_PIDFD_OPEN
 #include <sys/syscall.h>
 #endif /* HAVE_PIDFD_OPEN */
+#include <fcntl.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "polkitunixprocess.h"
 #include "polkitsubject.h"
@@ -154,9 +158,17 @@ struct _PolkitUnixProcess
   gint uid;
   gint pidfd;
   gboolean pidfd_is_safe;
+  /* what @pidfd refers to, 0 until looked up; see polkit_unix_process_get_pid() */
+  gint pidfd_pid;
   GArray *gids;
+
+  /* see polkit_unix_process_refresh_info__(), protected by info_lock */
+  PolkitUnixProcessInfo *info;
 };
 
+/* only held to swap or take a reference to PolkitUnixProcess.info */
+G_LOCK_DEFINE_STATIC (info_lock);
+
 struct _PolkitUnixProcessClass
 {
   GObjectClass parent_class;
@@ -175,8 +187,9 @@ enum
 
 static void subject_iface_init (PolkitSubjectIface *subject_iface);
 
-static guint64 get_start_time_for_pid (gint    pid,
-                                       GError **error);
+static gboolean read_process_info (PolkitUnixProcess      *process,
+                                   PolkitUnixProcessInfo  *info,
+                                   GError                **error);
 
 #if defined(HAVE_FREEBSD) || defined(HAVE_NETBSD) || defined(HAVE_OPENBSD)
 static gboolean get_kinfo_proc (gint pid,
@@ -279,39 +292,74 @@ polkit_unix_process_get_pid_from_pidfd (PolkitUnixProcess  *process,
                                         GError            **error)
 {
   gint result;
-  gchar *contents;
-  gchar **lines;
   gchar filename[64];
-  guint n;
+  /* fdinfo of a pidfd is a handful of short lines */
+  gchar buf[1024];
+  const gchar *line;
+  gchar *endptr;
+  gssize num_read;
+  gsize len;
+  glong pid;
+  gint fd;
 
   g_return_val_if_fail (POLKIT_IS_UNIX_PROCESS (process), -1);
   g_return_val_if_fail (error == NULL || *error == NULL, -1);
   g_return_val_if_fail (process->pidfd >= 0, -1);
 
   result = -1;
-  lines = NULL;
-  contents = NULL;
 
   g_snprintf (filename, sizeof filename, "/proc/self/fdinfo/%d", process->pidfd);
-  if (!g_file_get_contents (filename,
-                            &contents,
-                            NULL,
-                            error))
-    goto out;
-
-  lines = g_strsplit (contents, "\n", -1);
-  for (n = 0; lines != NULL && lines[n] != NULL; n++)
+  fd = open (filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    {
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_FAILED,
+                   "Error opening %s: %s",
+                   filename,
+                   g_strerror (errno));
+      goto out;
+    }
+
+  len = 0;
+  while (len < sizeof buf - 1)
+    {
+      num_read = read (fd, buf + len, sizeof buf - 1 - len);
+      if (num_read < 0 && errno == EINTR)
+        continue;
+      if (num_read < 0)
+        {
+          g_set_error (error,
+                       POLKIT_ERROR,
+                       POLKIT_ERROR_FAILED,
+                       "Error reading %s: %s",
+                       filename,
+                       g_strerror (errno));
+          close (fd);
+          goto out;
+        }
+      if (num_read == 0)
+        break;
+      len += num_read;
+    }
+  close (fd);
+  buf[len] = '\0';
+
+  for (line = buf; line != NULL; line = strchr (line, '\n'))
     {
-      gint pid;
-      if (!g_str_has_prefix (lines[n], "Pid:"))
+      if (*line == '\n')
+        line++;
+      if (strncmp (line, "Pid:", 4) != 0)
         continue;
-      if (sscanf (lines[n] + 4, "%d", &pid) != 1)
+      errno = 0;
+      pid = strtol (line + 4, &endptr, 10);
+      if (errno != 0 || endptr == line + 4 || (*endptr != '\n' && *endptr != '\0') ||
+          pid < G_MININT || pid > G_MAXINT)
         g_set_error (error,
-                      POLKIT_ERROR,
-                      POLKIT_ERROR_FAILED,
-                      "Unexpected line `%s' in file %s",
-                      lines[n],
-                      filename);
+                     POLKIT_ERROR,
+                     POLKIT_ERROR_FAILED,
+                     "Unexpected `Pid:' line in file %s",
+                     filename);
       else
         result = pid;
       goto out;
@@ -324,11 +372,33 @@ polkit_unix_process_get_pid_from_pidfd (PolkitUnixProcess  *process,
                filename);
 
 out:
-  g_strfreev (lines);
-  g_free (contents);
   return result;
 }
 
+/* Whether the process @process->pidfd refers to has not been reaped
+ * yet, i.e. whether /proc/self/fdinfo would still show its pid.
+ */
+static gboolean
+polkit_unix_process_pidfd_is_alive (PolkitUnixProcess *process)
+{
+#if defined(HAVE_PIDFD_OPEN) && defined(SYS_pidfd_send_signal)
+  if (syscall (SYS_pidfd_send_signal, process->pidfd, 0, NULL, 0) == 0)
+    return TRUE;
+  /* e.g. EPERM for processes of other users, which still exist */
+  if (errno != ENOSYS)
+    return errno != ESRCH;
+#endif
+  {
+    struct pollfd pfd;
+
+    /* a pidfd becomes readable when the process exits */
+    pfd.fd = process->pidfd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll (&pfd, 1, 0) == 0;
+  }
+}
+
 static void
 polkit_unix_process_constructed (GObject *object)
 {
@@ -348,23 +418,26 @@ polkit_unix_process_constructed (GObject *object)
       if (pidfd >= 0)
         {
           process->pidfd = pidfd;
+          process->pidfd_pid = process->pid;
           process->pid = 0;
         }
     }
 #endif /* HAVE_PIDFD_OPEN */
 
-  if (process->start_time == 0)
-    process->start_time = get_start_time_for_pid (polkit_unix_process_get_pid (process), NULL);
-
-  if (process->uid == -1)
+  if (process->start_time == 0 || process->uid == -1)
     {
-      GError *error;
-      error = NULL;
-      process->uid = polkit_unix_process_get_racy_uid__ (process, &error);
-      if (error != NULL)
+      PolkitUnixProcessInfo *info;
+
+      /* one read of /proc gives us both */
+      info = polkit_unix_process_refresh_info__ (process, NULL);
+      if (info != NULL)
         {
-          process->uid = -1;
-          g_error_free (error);
+          if (process->start_time == 0)
+            process->start_time = info->start_time;
+          /* same as polkit_unix_process_get_racy_uid__() */
+          if (process->uid == -1 && info->start_time == process->start_time)
+            process->uid = info->uid;
+          polkit_unix_process_info_unref__ (info);
         }
     }
 
@@ -386,6 +459,9 @@ polkit_unix_process_finalize (GObject *object)
   if (process->gids)
     g_array_unref (process->gids);
 
+  if (process->info != NULL)
+    polkit_unix_process_info_unref__ (process->info);
+
   if (G_OBJECT_CLASS (polkit_unix_process_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (polkit_unix_process_parent_class)->finalize (object);
 }
@@ -603,14 +679,32 @@ polkit_unix_process_get_pid (PolkitUnixProcess *process)
 
   if (process->pidfd >= 0)
     {
-      GError *error = NULL;
-      gint pid = polkit_unix_process_get_pid_from_pidfd(process, &error);
+      /* The pid a pidfd refers to never changes, so fdinfo is only
+       * parsed once; after that it is enough to check that the
+       * process is still around, which is a single syscall. This is
+       * called a lot while checking an authorization.
+       */
+      gint pid = g_atomic_int_get (&process->pidfd_pid);
+
+      /* threads racing here all store the same pid */
+      if (pid == 0)
+        {
+          GError *error = NULL;
+
+          pid = polkit_unix_process_get_pid_from_pidfd (process, &error);
+          if (pid <= 0)
+            {
+              if (error != NULL)
+                g_error_free (error);
+              return -1;
+            }
+          g_atomic_int_set (&process->pidfd_pid, pid);
+        }
 
-      if (pid > 0)
-        return pid;
+      if (!polkit_unix_process_pidfd_is_alive (process))
+        return -1;
 
-      g_error_free (error);
-      return -1;
+      return pid;
     }
 
   return process->pid;
@@ -665,14 +759,16 @@ polkit_unix_process_set_pid (PolkitUnixProcess *process,
       close (process->pidfd);
       process->pidfd = -1;
       process->pidfd_is_safe = FALSE;
+      process->pidfd_pid = 0;
     }
   if (pid > 0)
     {
-      gint pidfd = (int) syscall (SYS_pidfd_open, process->pid, 0);
+      gint pidfd = (int) syscall (SYS_pidfd_open, pid, 0);
       if (pidfd >= 0)
         {
           process->pidfd_is_safe = FALSE;
           process->pidfd = pidfd;
+          process->pidfd_pid = pid;
           process->pid = 0;
           return;
         }
@@ -731,6 +827,7 @@ polkit_unix_process_set_pidfd (PolkitUnixProcess *process,
       process->pidfd_is_safe = FALSE;
     }
   process->pidfd = pidfd;
+  process->pidfd_pid = 0;
 }
 
 /**
@@ -871,8 +968,8 @@ polkit_unix_process_exists_sync (PolkitSubject   *subject,
                                  GError         **error)
 {
   PolkitUnixProcess *process = POLKIT_UNIX_PROCESS (subject);
+  PolkitUnixProcessInfo *info;
   GError *local_error;
-  guint64 start_time;
   gboolean ret;
   gint pid;
 
@@ -888,8 +985,8 @@ polkit_unix_process_exists_sync (PolkitSubject   *subject,
     return TRUE;
 
   local_error = NULL;
-  start_time = get_start_time_for_pid (pid, &local_error);
-  if (local_error != NULL)
+  info = polkit_unix_process_refresh_info__ (process, &local_error);
+  if (info == NULL)
     {
       /* Don't propagate the error - it just means there is no process with this pid */
       g_error_free (local_error);
@@ -897,10 +994,11 @@ polkit_unix_process_exists_sync (PolkitSubject   *subject,
     }
   else
     {
-      if (start_time != process->start_time)
+      if (info->start_time != process->start_time)
         {
           ret = FALSE;
         }
+      polkit_unix_process_info_unref__ (info);
     }
 
   return ret;
@@ -1022,243 +1120,398 @@ get_kinfo_proc (gint pid,
 }
 #endif
 
-static guint64
-get_start_time_for_pid (pid_t    pid,
-                        GError **error)
-{
-  guint64 start_time;
 #if !defined(HAVE_FREEBSD) && !defined(HAVE_NETBSD) && !defined(HAVE_OPENBSD)
-  gchar *filename;
-  gchar *contents;
-  size_t length;
-  gchar **tokens;
-  guint num_tokens;
-  gchar *p;
-  gchar *endp;
-
-  start_time = 0;
-  contents = NULL;
-
-  filename = g_strdup_printf ("/proc/%d/stat", pid);
-
-  if (!g_file_get_contents (filename, &contents, &length, error))
-    goto out;
+/* Reads @name in @proc_fd into @buf, which is always NUL-terminated.
+ * Returns the number of bytes read or -1 if @error is set.
+ */
+static gssize
+read_file_at (gint          proc_fd,
+              const gchar  *name,
+              gchar        *buf,
+              gsize         size,
+              GError      **error)
+{
+  gssize num_read;
+  gsize len;
+  gint fd;
 
-  /* start time is the token at index 19 after the '(process name)' entry - since only this
-   * field can contain the ')' character, search backwards for this to avoid malicious
-   * processes trying to fool us
-   */
-  p = strrchr (contents, ')');
-  if (p == NULL)
+  fd = openat (proc_fd, name, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
     {
       g_set_error (error,
                    POLKIT_ERROR,
                    POLKIT_ERROR_FAILED,
-                   "Error parsing file %s",
-                   filename);
-      goto out;
+                   "Error opening %s: %s",
+                   name,
+                   g_strerror (errno));
+      return -1;
     }
-  p += 2; /* skip ') ' */
-  if (p - contents >= (int) length)
+
+  len = 0;
+  while (len < size - 1)
     {
-      g_set_error (error,
-                   POLKIT_ERROR,
-                   POLKIT_ERROR_FAILED,
-                   "Error parsing file %s",
-                   filename);
-      goto out;
+      num_read = read (fd, buf + len, size - 1 - len);
+      if (num_read < 0 && errno == EINTR)
+        continue;
+      if (num_read < 0)
+        {
+          g_set_error (error,
+                       POLKIT_ERROR,
+                       POLKIT_ERROR_FAILED,
+                       "Error reading %s: %s",
+                       name,
+                       g_strerror (errno));
+          close (fd);
+          return -1;
+        }
+      if (num_read == 0)
+        break;
+      len += num_read;
     }
+  close (fd);
+  buf[len] = '\0';
 
-  tokens = g_strsplit (p, " ", 0);
-
-  num_tokens = g_strv_length (tokens);
+  return len;
+}
 
-  if (num_tokens < 20)
-    {
-      g_set_error (error,
-                   POLKIT_ERROR,
-                   POLKIT_ERROR_FAILED,
-                   "Error parsing file %s",
-                   filename);
-      goto out;
-    }
+/* Returns the line in @buf starting with @prefix, or %NULL */
+static const gchar *
+find_line (const gchar *buf,
+           const gchar *prefix)
+{
+  gsize prefix_len = strlen (prefix);
+  const gchar *line;
 
-  start_time = strtoull (tokens[19], &endp, 10);
-  if (endp == tokens[19])
+  for (line = buf; line != NULL; line = strchr (line, '\n'))
     {
-      g_set_error (error,
-                   POLKIT_ERROR,
-                   POLKIT_ERROR_FAILED,
-                   "Error parsing file %s",
-                   filename);
-      goto out;
+      if (*line == '\n')
+        line++;
+      if (strncmp (line, prefix, prefix_len) == 0)
+        return line + prefix_len;
     }
+  return NULL;
+}
+#endif
 
-  g_strfreev (tokens);
-
- out:
-  g_free (filename);
-  g_free (contents);
+/* Fills in @info for @process without touching @process itself, so
+ * this can be called from several threads at once, e.g. while checking
+ * an implicit authorization snapshot. On Linux, everything is read
+ * through a single /proc/<pid> directory fd; if @process has a pidfd it is
+ * checked after opening the directory, so the directory is known to
+ * belong to our process rather than one that reused its pid.
+ */
+static gboolean
+read_process_info (PolkitUnixProcess      *process,
+                   PolkitUnixProcessInfo  *info,
+                   GError                **error)
+{
+  gboolean ret;
+#if !defined(HAVE_FREEBSD) && !defined(HAVE_NETBSD) && !defined(HAVE_OPENBSD)
+  gchar dirname[64];
+  /* /proc/<pid>/stat is a single line of numbers and the command name */
+  gchar stat_buf[1024];
+  /* /proc/<pid>/status is around 1.5k plus the Groups: line */
+  gchar status_buf[4096];
+  struct stat statbuf;
+  const gchar *p;
+  gchar *endp;
+  gint proc_fd;
+  guint n;
 #else
 #ifdef HAVE_NETBSD
   struct kinfo_proc2 p;
 #else
   struct kinfo_proc p;
+#endif
 #endif
 
-  start_time = 0;
+  ret = FALSE;
+  memset (info, 0, sizeof (PolkitUnixProcessInfo));
 
-  if (! get_kinfo_proc (pid, &p))
+  info->pid = polkit_unix_process_get_pid (process);
+  if (info->pid <= 0)
     {
       g_set_error (error,
                    POLKIT_ERROR,
                    POLKIT_ERROR_FAILED,
-                   "Error obtaining start time for %d (%s)",
-                   (gint) pid,
-                   g_strerror (errno));
+                   "Process not found");
       goto out;
     }
 
-#ifdef HAVE_FREEBSD
-  start_time = (guint64) p.ki_start.tv_sec;
-#else
-  start_time = (guint64) p.p_ustart_sec;
-#endif
-
-out:
-#endif
-
-  return start_time;
-}
-
-/*
- * Private: Return the "current" UID.  Note that this is inherently racy,
- * and the value may already be obsolete by the time this function returns;
- * this function only guarantees that the UID was valid at some point during
- * its execution.
- */
-gint
-polkit_unix_process_get_racy_uid__ (PolkitUnixProcess  *process,
-                                    GError            **error)
-{
-  gint result, pid;
-  gchar *contents;
-  gchar **lines;
-  guint64 start_time;
-#if defined(HAVE_FREEBSD) || defined(HAVE_OPENBSD)
-  struct kinfo_proc p;
-#elif defined(HAVE_NETBSD)
-  struct kinfo_proc2 p;
-#else
-  gchar filename[64];
-  guint n;
-  GError *local_error;
-#endif
-
-  g_return_val_if_fail (POLKIT_IS_UNIX_PROCESS (process), 0);
-  g_return_val_if_fail (error == NULL || *error == NULL, 0);
-
-  result = 0;
-  lines = NULL;
-  contents = NULL;
+#if !defined(HAVE_FREEBSD) && !defined(HAVE_NETBSD) && !defined(HAVE_OPENBSD)
+  proc_fd = -1;
 
-  pid = polkit_unix_process_get_pid(process);
-  if (pid <= 0)
+  g_snprintf (dirname, sizeof dirname, "/proc/%d", info->pid);
+  proc_fd = open (dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (proc_fd < 0)
     {
       g_set_error (error,
                    POLKIT_ERROR,
                    POLKIT_ERROR_FAILED,
-                   "Process not found");
+                   "Error opening %s: %s",
+                   dirname,
+                   g_strerror (errno));
       goto out;
     }
 
-#if defined(HAVE_FREEBSD) || defined(HAVE_NETBSD) || defined(HAVE_OPENBSD)
-  if (get_kinfo_proc (pid, &p) == 0)
+  /* Once opened, the directory keeps referring to the same process (reads
+   * fail with ESRCH after it is gone), so this pins it.
+   */
+  if (process->pidfd >= 0 && !polkit_unix_process_pidfd_is_alive (process))
     {
       g_set_error (error,
                    POLKIT_ERROR,
                    POLKIT_ERROR_FAILED,
-                   "get_kinfo_proc() failed for pid %d: %s",
-                   pid,
-                   g_strerror (errno));
-      goto out;
+                   "Process not found");
+      goto out_dir;
     }
 
-#if defined(HAVE_FREEBSD)
-  result = p.ki_uid;
-  start_time = (guint64) p.ki_start.tv_sec;
-#else
-  result = p.p_uid;
-  start_time = (guint64) p.p_ustart_sec;
-#endif
-#else
+  if (read_file_at (proc_fd, "stat", stat_buf, sizeof stat_buf, error) < 0)
+    goto out_dir;
+
+  /* start time is the token at index 19 after the '(process name)' entry - since only this
+   * field can contain the ')' character, search backwards for this to avoid malicious
+   * processes trying to fool us
+   */
+  p = strrchr (stat_buf, ')');
+  if (p == NULL || p[1] != ' ')
+    goto stat_error;
+  p += 2; /* skip ') ' */
+  for (n = 0; n < 19 && p != NULL; n++)
+    {
+      p = strchr (p, ' ');
+      if (p != NULL)
+        p++;
+    }
+  if (p == NULL)
+    goto stat_error;
+  info->start_time = g_ascii_strtoull (p, &endp, 10);
+  if (endp == p || (*endp != ' ' && *endp != '\n' && *endp != '\0'))
+    goto stat_error;
 
   /* see 'man proc' for layout of the status file
    *
    * Uid, Gid: Real, effective, saved set,  and  file  system  UIDs (GIDs).
    */
-  g_snprintf (filename, sizeof filename, "/proc/%d/status", pid);
-  if (!g_file_get_contents (filename,
-                            &contents,
-                            NULL,
-                            error))
+  if (read_file_at (proc_fd, "status", status_buf, sizeof status_buf, error) < 0)
+    goto out_dir;
+
+  p = find_line (status_buf, "Uid:");
+  if (p == NULL)
     {
-      goto out;
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_FAILED,
+                   "Didn't find any line starting with `Uid:' in file %s/status",
+                   dirname);
+      goto out_dir;
     }
-  lines = g_strsplit (contents, "\n", -1);
-  for (n = 0; lines != NULL && lines[n] != NULL; n++)
+  {
+    gint real_uid, effective_uid;
+
+    if (sscanf (p, "%d %d", &real_uid, &effective_uid) != 2)
+      {
+        g_set_error (error,
+                     POLKIT_ERROR,
+                     POLKIT_ERROR_FAILED,
+                     "Unexpected `Uid:' line in file %s/status",
+                     dirname);
+        goto out_dir;
+      }
+    info->uid = real_uid;
+  }
+
+  /* only trust the Groups: line if it wasn't cut off by our buffer */
+  p = find_line (status_buf, "Groups:");
+  if (p != NULL && strchr (p, '\n') != NULL)
     {
-      gint real_uid, effective_uid;
-      if (!g_str_has_prefix (lines[n], "Uid:"))
-        continue;
-      if (sscanf (lines[n] + 4, "%d %d", &real_uid, &effective_uid) != 2)
+      info->gids = g_array_new (FALSE, FALSE, sizeof (gid_t));
+      while (TRUE)
         {
-          g_set_error (error,
-                       POLKIT_ERROR,
-                       POLKIT_ERROR_FAILED,
-                       "Unexpected line `%s' in file %s",
-                       lines[n],
-                       filename);
-          goto out;
-        }
-      else
-        {
-          result = real_uid;
-          goto found;
+          gid_t gid;
+
+          while (*p == ' ' || *p == '\t')
+            p++;
+          if (*p == '\n')
+            break;
+          gid = (gid_t) g_ascii_strtoull (p, &endp, 10);
+          if (endp == p)
+            {
+              g_array_unref (info->gids);
+              info->gids = NULL;
+              break;
+            }
+          g_array_append_val (info->gids, gid);
+          p = endp;
         }
     }
+
+  /* may fail with EACCES for processes of other users unless we are root */
+  if (fstatat (proc_fd, "exe", &statbuf, 0) == 0)
+    {
+      info->exe_dev = statbuf.st_dev;
+      info->exe_ino = statbuf.st_ino;
+    }
+
+  ret = TRUE;
+  goto out_dir;
+
+ stat_error:
   g_set_error (error,
                POLKIT_ERROR,
                POLKIT_ERROR_FAILED,
-               "Didn't find any line starting with `Uid:' in file %s",
-               filename);
-  goto out;
+               "Error parsing file %s/stat",
+               dirname);
 
-found:
-  /* The UID and start time are, sadly, not available in a single file.  So,
-   * read the UID first, and then the start time; if the start time is the same
-   * before and after reading the UID, it couldn't have changed.
-   */
-  local_error = NULL;
-  start_time = get_start_time_for_pid (pid, &local_error);
-  if (local_error != NULL)
+ out_dir:
+  close (proc_fd);
+#else
+  if (! get_kinfo_proc (info->pid, &p))
     {
-      g_propagate_error (error, local_error);
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_FAILED,
+                   "Error obtaining process info for %d (%s)",
+                   info->pid,
+                   g_strerror (errno));
       goto out;
     }
+
+#if defined(HAVE_FREEBSD)
+  info->uid = p.ki_uid;
+  info->start_time = (guint64) p.ki_start.tv_sec;
+#else
+  info->uid = p.p_uid;
+  info->start_time = (guint64) p.p_ustart_sec;
+#endif
+  ret = TRUE;
 #endif
 
-  if (process->start_time != start_time)
+ out:
+  if (!ret && info->gids != NULL)
+    {
+      g_array_unref (info->gids);
+      info->gids = NULL;
+    }
+  return ret;
+}
+
+/*
+ * Private: Re-reads the pid, real uid, supplementary groups, start time
+ * and executable of @process from the kernel and caches them on
+ * @process; see polkit_unix_process_get_info__(). Like
+ * polkit_unix_process_get_racy_uid__(), the result only reflects some
+ * point in time during the call. Safe to call from any thread.
+ *
+ * Returns: A reference to the new info, free with
+ * polkit_unix_process_info_unref__(), or %NULL if @error is set.
+ */
+PolkitUnixProcessInfo *
+polkit_unix_process_refresh_info__ (PolkitUnixProcess  *process,
+                                    GError            **error)
+{
+  PolkitUnixProcessInfo *info;
+  PolkitUnixProcessInfo *old_info;
+
+  g_return_val_if_fail (POLKIT_IS_UNIX_PROCESS (process), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  info = g_new (PolkitUnixProcessInfo, 1);
+  if (!read_process_info (process, info, error))
+    {
+      g_free (info);
+      return NULL;
+    }
+  /* one for the cache, one for the caller */
+  info->ref_count = 2;
+
+  G_LOCK (info_lock);
+  old_info = process->info;
+  process->info = info;
+  G_UNLOCK (info_lock);
+
+  if (old_info != NULL)
+    polkit_unix_process_info_unref__ (old_info);
+
+  return info;
+}
+
+/*
+ * Private: Like polkit_unix_process_refresh_info__() but returns the
+ * cached info if there is any, without any syscalls.
+ */
+PolkitUnixProcessInfo *
+polkit_unix_process_get_info__ (PolkitUnixProcess  *process,
+                                GError            **error)
+{
+  PolkitUnixProcessInfo *info;
+
+  g_return_val_if_fail (POLKIT_IS_UNIX_PROCESS (process), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  G_LOCK (info_lock);
+  info = process->info;
+  if (info != NULL)
+    g_atomic_int_inc (&info->ref_count);
+  G_UNLOCK (info_lock);
+
+  if (info != NULL)
+    return info;
+
+  return polkit_unix_process_refresh_info__ (process, error);
+}
+
+/*
+ * Private: Drops a reference to @info returned by
+ * polkit_unix_process_get_info__() or
+ * polkit_unix_process_refresh_info__().
+ */
+void
+polkit_unix_process_info_unref__ (PolkitUnixProcessInfo *info)
+{
+  g_return_if_fail (info != NULL);
+
+  if (g_atomic_int_dec_and_test (&info->ref_count))
+    {
+      if (info->gids != NULL)
+        g_array_unref (info->gids);
+      g_free (info);
+    }
+}
+
+/*
+ * Private: Return the "current" UID.  Note that this is inherently racy,
+ * and the value may already be obsolete by the time this function returns;
+ * this function only guarantees that the UID was valid at some point during
+ * its execution.
+ */
+gint
+polkit_unix_process_get_racy_uid__ (PolkitUnixProcess  *process,
+                                    GError            **error)
+{
+  PolkitUnixProcessInfo *info;
+  gint uid;
+
+  g_return_val_if_fail (POLKIT_IS_UNIX_PROCESS (process), 0);
+  g_return_val_if_fail (error == NULL || *error == NULL, 0);
+
+  /* The UID and start time come from the same /proc/<pid> directory,
+   * so if the start time matches, the UID is that of our process.
+   */
+  info = polkit_unix_process_refresh_info__ (process, error);
+  if (info == NULL)
+    return 0;
+
+  uid = info->uid;
+  if (process->start_time != info->start_time)
     {
       g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
-		   "process with PID %d has been replaced", pid);
-      goto out;
+		   "process with PID %d has been replaced", info->pid);
+      uid = 0;
     }
 
-out:
-  g_strfreev (lines);
-  g_free (contents);
-  return result;
+  polkit_unix_process_info_unref__ (info);
+  return uid;
 }
 
 /* deprecated public method */
@@ -21,6 +21,7 @@
 
 #include "polkitagenthelperprivate.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,47 +35,17 @@
 
 static int conversation_function (int n, const struct pam_message **msg, struct pam_response **resp, void *data);
 
-static void
-send_to_helper (const gchar *str1,
-                const gchar *str2)
-{
-  char *escaped;
-  char *tmp2;
-  size_t len2;
-
-  tmp2 = g_strdup(str2);
-  len2 = strlen(tmp2);
-#ifdef PAH_DEBUG
-  fprintf (stderr, "polkit-agent-helper-1: writing `%s ' to stdout\n", str1);
-#endif /* PAH_DEBUG */
-  fprintf (stdout, "%s ", str1);
-
-  if (len2 > 0 && tmp2[len2 - 1] == '\n')
-    tmp2[len2 - 1] = '\0';
-  escaped = g_strescape (tmp2, NULL);
-#ifdef PAH_DEBUG
-  fprintf (stderr, "polkit-agent-helper-1: writing `%s' to stdout\n", escaped);
-#endif /* PAH_DEBUG */
-  fprintf (stdout, "%s", escaped);
-#ifdef PAH_DEBUG
-  fprintf (stderr, "polkit-agent-helper-1: writing newline to stdout\n");
-#endif /* PAH_DEBUG */
-  fputc ('\n', stdout);
-#ifdef PAH_DEBUG
-  fprintf (stderr, "polkit-agent-helper-1: flushing stdout\n");
-#endif /* PAH_DEBUG */
-  fflush (stdout);
-
-  g_free (escaped);
-  g_free (tmp2);
-}
-
 int
 main (int argc, char *argv[])
 {
   int rc;
   const char *user_to_auth;
+  char *user = NULL;
   char *cookie = NULL;
+  uid_t caller_uid;
+  gid_t caller_gid;
+  int listen_fd;
+  gboolean socket_activated;
   struct pam_conv pam_conversation;
   pam_handle_t *pam_h;
   const void *authed_user;
@@ -82,6 +53,11 @@ main (int argc, char *argv[])
   rc = 0;
   pam_h = NULL;
 
+  socket_activated = (argc == 2 && strcmp (argv[1], "--socket-activated") == 0);
+
+  /* the service manager passes the socket in the environment */
+  listen_fd = socket_activated ? take_listen_fd () : -1;
+
   /* clear the entire environment to avoid attacks using with libraries honoring environment variables */
   if (_polkit_clearenv () != 0)
     goto error;
@@ -98,26 +74,48 @@ main (int argc, char *argv[])
 
       /* Special-case a very common error triggered in jhbuild setups */
       s = g_strdup_printf ("Incorrect permissions on %s (needs to be setuid root)", argv[0]);
-      send_to_helper ("PAM_ERROR_MSG", s);
+      send_to_agent ("PAM_ERROR_MSG", s);
       g_free (s);
       goto error;
     }
 
   openlog ("polkit-agent-helper-1", LOG_CONS | LOG_PID, LOG_AUTHPRIV);
 
+  if (socket_activated)
+    {
+      /* only returns in a child process talking to a single agent */
+      if (!serve_agent_connections (listen_fd, &user, &cookie, &caller_uid, &caller_gid))
+        goto error;
+
+      /* run PAM as the setuid helper would when started by the agent,
+       * with the agent's uid and gid as real ids, so that e.g.
+       * pam_rootok sees the same user. Supplementary groups and the
+       * environment are still those of the service, not the agent's.
+       */
+      if (setregid (caller_gid, 0) != 0 || setreuid (caller_uid, 0) != 0)
+        {
+          fprintf (stderr, "polkit-agent-helper-1: cannot set the real uid of the agent: %s\n", g_strerror (errno));
+          goto error;
+        }
+
+      user_to_auth = user;
+    }
   /* check for correct invocation */
-  if (!(argc == 2 || argc == 3))
+  else if (!(argc == 2 || argc == 3))
     {
       syslog (LOG_NOTICE, "inappropriate use of helper, wrong number of arguments [uid=%d]", getuid ());
       fprintf (stderr, "polkit-agent-helper-1: wrong number of arguments. This incident has been logged.\n");
       goto error;
     }
+  else
+    {
+      user_to_auth = argv[1];
+      caller_uid = getuid ();
 
-  user_to_auth = argv[1];
-
-  cookie = read_cookie (argc, argv);
-  if (!cookie)
-    goto error;
+      cookie = read_cookie (argc, argv);
+      if (!cookie)
+        goto error;
+    }
 
   if (getuid () != 0)
     {
@@ -207,7 +205,7 @@ main (int argc, char *argv[])
   /* now send a D-Bus message to the PolicyKit daemon that
    * includes a) the cookie; and b) the user we authenticated
    */
-  if (!send_dbus_message (cookie, user_to_auth))
+  if (!send_dbus_message_for_uid (cookie, user_to_auth, caller_uid))
     {
 #ifdef PAH_DEBUG
       fprintf (stderr, "polkit-agent-helper-1: error sending D-Bus message to PolicyKit daemon\n");
@@ -216,21 +214,23 @@ main (int argc, char *argv[])
     }
 
   free (cookie);
+  free (user);
 
 #ifdef PAH_DEBUG
   fprintf (stderr, "polkit-agent-helper-1: successfully sent D-Bus message to PolicyKit daemon\n");
 #endif /* PAH_DEBUG */
 
-  fprintf (stdout, "SUCCESS\n");
+  send_to_agent ("SUCCESS", NULL);
   flush_and_wait();
   return 0;
 
 error:
   free (cookie);
+  free (user);
   if (pam_h != NULL)
     pam_end (pam_h, rc);
 
-  fprintf (stdout, "FAILURE\n");
+  send_to_agent ("FAILURE", NULL);
   flush_and_wait();
   return 1;
 }
@@ -257,31 +257,27 @@ conversation_function (int n, const struct pam_message **msg, struct pam_respons
         {
 
         case PAM_PROMPT_ECHO_OFF:
-          send_to_helper ("PAM_PROMPT_ECHO_OFF", msg[i]->msg);
+          send_to_agent ("PAM_PROMPT_ECHO_OFF", msg[i]->msg);
           goto conv1;
 
         case PAM_PROMPT_ECHO_ON:
-          send_to_helper ("PAM_PROMPT_ECHO_ON", msg[i]->msg);
+          send_to_agent ("PAM_PROMPT_ECHO_ON", msg[i]->msg);
 
         conv1:
-          if (fgets (buf, sizeof buf, stdin) == NULL)
+          if (read_from_agent (buf, sizeof buf) == NULL)
             goto error;
 
-          if (strlen (buf) > 0 &&
-              buf[strlen (buf) - 1] == '\n')
-            buf[strlen (buf) - 1] = '\0';
-
           aresp[i].resp = strdup (buf);
           if (aresp[i].resp == NULL)
             goto error;
           break;
 
         case PAM_ERROR_MSG:
-          send_to_helper ("PAM_ERROR_MSG", msg[i]->msg);
+          send_to_agent ("PAM_ERROR_MSG", msg[i]->msg);
           break;
 
         case PAM_TEXT_INFO:
-          send_to_helper ("PAM_TEXT_INFO", msg[i]->msg);
+          send_to_agent ("PAM_TEXT_INFO", msg[i]->msg);
           break;
 
         default:
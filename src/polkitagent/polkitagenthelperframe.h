@@ -0,0 +1,68 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __POLKIT_AGENT_HELPER_FRAME_H
+#define __POLKIT_AGENT_HELPER_FRAME_H
+
+#include <string.h>
+#include <glib.h>
+
+/* Framing used on the socket of the polkit-agent-helper service,
+ * shared by the helper and #PolkitAgentSession: each message is a
+ * 32-bit length in network byte order followed by that many bytes of
+ * payload.
+ */
+
+/* Largest message exchanged with an agent over the helper socket */
+#define HELPER_MAX_FRAME_SIZE 65536
+
+#define HELPER_FRAME_HEADER_SIZE 4
+
+typedef enum
+{
+  HELPER_FRAME_INCOMPLETE,
+  HELPER_FRAME_COMPLETE,
+  HELPER_FRAME_INVALID
+} HelperFrameStatus;
+
+/* Looks for a frame at the start of the @size bytes at @data. If it is
+ * complete, its payload starts at @data + HELPER_FRAME_HEADER_SIZE and
+ * is @out_payload_len bytes long.
+ */
+static inline HelperFrameStatus
+helper_frame_parse (const guint8 *data,
+                    gsize         size,
+                    gsize        *out_payload_len)
+{
+  guint32 be_len;
+  gsize len;
+
+  if (size < HELPER_FRAME_HEADER_SIZE)
+    return HELPER_FRAME_INCOMPLETE;
+
+  memcpy (&be_len, data, sizeof be_len);
+  len = GUINT32_FROM_BE (be_len);
+  if (len > HELPER_MAX_FRAME_SIZE)
+    return HELPER_FRAME_INVALID;
+  if (size - HELPER_FRAME_HEADER_SIZE < len)
+    return HELPER_FRAME_INCOMPLETE;
+
+  *out_payload_len = len;
+  return HELPER_FRAME_COMPLETE;
+}
+
+#endif /* __POLKIT_AGENT_HELPER_FRAME_H */
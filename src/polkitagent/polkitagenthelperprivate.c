@@ -21,10 +21,43 @@
  */
 
 #include "polkitagenthelperprivate.h"
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <polkit/polkitprivate.h>
+
+/* The first socket passed by the service manager, see sd_listen_fds(3) */
+#define LISTEN_FDS_START 3
+
+/* How long the socket activated helper stays around without agents */
+#define IDLE_TIMEOUT_MSEC (10 * 60 * 1000)
+
+/* Upper bound on concurrent authentication conversations, in total
+ * and for each uid; agents beyond that fall back to the setuid helper
+ */
+#define MAX_CONNECTIONS 64
+#define MAX_CONNECTIONS_PER_UID 8
+
+/* How long an agent may take to send its request, and to answer a
+ * prompt, before the conversation is dropped
+ */
+#define REQUEST_TIMEOUT_SEC 10
+#define RESPONSE_TIMEOUT_SEC (5 * 60)
+
+/* When serving a connection accepted by the socket activated helper,
+ * messages are exchanged as length-prefixed frames on agent_fd instead
+ * of escaped lines on stdin/stdout.
+ */
+static gboolean framed = FALSE;
+static int agent_fd = -1;
 
 #ifndef HAVE_CLEARENV
 extern char **environ;
@@ -80,18 +113,29 @@ read_cookie (int argc, char **argv)
 gboolean
 send_dbus_message (const char *cookie, const char *user)
 {
-  PolkitAuthority *authority = NULL;
+  return send_dbus_message_for_uid (cookie, user, getuid ());
+}
+
+/* Like send_dbus_message() but for an agent running as @uid - the
+ * socket activated helper runs as root so it cannot rely on its real
+ * uid like polkit_authority_authentication_agent_response() does.
+ */
+gboolean
+send_dbus_message_for_uid (const char *cookie, const char *user, uid_t uid)
+{
+  GDBusConnection *connection = NULL;
   PolkitIdentity *identity = NULL;
+  GVariant *result;
   GError *error;
   gboolean ret;
 
   ret = FALSE;
 
   error = NULL;
-  authority = polkit_authority_get_sync (NULL /* GCancellable* */, &error);
-  if (authority == NULL)
+  connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL /* GCancellable* */, &error);
+  if (connection == NULL)
     {
-      g_printerr ("Error getting authority: %s\n", error->message);
+      g_printerr ("Error connecting to the system bus: %s\n", error->message);
       g_error_free (error);
       goto out;
     }
@@ -104,16 +148,27 @@ send_dbus_message (const char *cookie, const char *user)
       goto out;
     }
 
-  if (!polkit_authority_authentication_agent_response_sync (authority,
-                                                            cookie,
-                                                            identity,
-                                                            NULL,
-                                                            &error))
+  result = g_dbus_connection_call_sync (connection,
+                                        "org.freedesktop.PolicyKit1",
+                                        "/org/freedesktop/PolicyKit1/Authority",
+                                        "org.freedesktop.PolicyKit1.Authority",
+                                        "AuthenticationAgentResponse2",
+                                        g_variant_new ("(us@(sa{sv}))",
+                                                       (guint32) uid,
+                                                       cookie,
+                                                       polkit_identity_to_gvariant (identity)), /* A floating value */
+                                        G_VARIANT_TYPE ("()"),
+                                        G_DBUS_CALL_FLAGS_NONE,
+                                        -1,
+                                        NULL, /* GCancellable* */
+                                        &error);
+  if (result == NULL)
     {
       g_printerr ("polkit-agent-helper-1: error response to PolicyKit daemon: %s\n", error->message);
       g_error_free (error);
       goto out;
     }
+  g_variant_unref (result);
 
   ret = TRUE;
 
@@ -122,15 +177,486 @@ send_dbus_message (const char *cookie, const char *user)
   if (identity != NULL)
     g_object_unref (identity);
 
-  if (authority != NULL)
-    g_object_unref (authority);
+  if (connection != NULL)
+    g_object_unref (connection);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+write_all (int fd, const void *buf, size_t len)
+{
+  const char *p = buf;
+
+  while (len > 0)
+    {
+      ssize_t r = write (fd, p, len);
+      if (r < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return FALSE;
+        }
+      p += r;
+      len -= r;
+    }
+  return TRUE;
+}
+
+static gboolean
+read_all (int fd, void *buf, size_t len)
+{
+  char *p = buf;
+
+  while (len > 0)
+    {
+      ssize_t r = read (fd, p, len);
+      if (r < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return FALSE;
+        }
+      if (r == 0)
+        return FALSE;
+      p += r;
+      len -= r;
+    }
+  return TRUE;
+}
+
+/* A frame is a 32-bit length in network byte order followed by that
+ * many bytes of payload. The payload is not NUL-terminated and may not
+ * contain NUL bytes.
+ */
+static gboolean
+write_frame (int fd, const char *str1, const char *str2)
+{
+  size_t len1, len2;
+  guint32 be_len;
+
+  len1 = strlen (str1);
+  len2 = str2 != NULL ? strlen (str2) + 1 : 0;
+  if (len1 + len2 > HELPER_MAX_FRAME_SIZE)
+    return FALSE;
+
+  be_len = GUINT32_TO_BE ((guint32) (len1 + len2));
+  if (!write_all (fd, &be_len, sizeof be_len) ||
+      !write_all (fd, str1, len1))
+    return FALSE;
+  if (str2 != NULL && (!write_all (fd, " ", 1) || !write_all (fd, str2, len2 - 1)))
+    return FALSE;
+  return TRUE;
+}
+
+/* Returns a NUL-terminated copy of the next frame, free with free() */
+static char *
+read_frame (int fd)
+{
+  guint32 be_len;
+  size_t len;
+  char *ret;
+
+  if (!read_all (fd, &be_len, sizeof be_len))
+    return NULL;
+
+  len = GUINT32_FROM_BE (be_len);
+  if (len > HELPER_MAX_FRAME_SIZE)
+    return NULL;
+
+  ret = malloc (len + 1);
+  if (ret == NULL)
+    return NULL;
+
+  if (!read_all (fd, ret, len) || memchr (ret, '\0', len) != NULL)
+    {
+      memset (ret, 0, len + 1);
+      free (ret);
+      return NULL;
+    }
+  ret[len] = '\0';
+
+  return ret;
+}
+
+/**
+ * send_to_agent:
+ * @str1: The message type, e.g. "PAM_PROMPT_ECHO_OFF" or "SUCCESS".
+ * @str2: (allow-none): The message text or %NULL.
+ *
+ * Sends a message to the authentication agent, see #PolkitAgentSession
+ * for the other side of the protocol.
+ */
+void
+send_to_agent (const char *str1,
+               const char *str2)
+{
+  char *escaped;
+  char *tmp2;
+  size_t len2;
+
+  if (framed)
+    {
+      tmp2 = NULL;
+      if (str2 != NULL)
+        {
+          tmp2 = g_strdup (str2);
+          len2 = strlen (tmp2);
+          if (len2 > 0 && tmp2[len2 - 1] == '\n')
+            tmp2[len2 - 1] = '\0';
+        }
+      if (!write_frame (agent_fd, str1, tmp2))
+        fprintf (stderr, "polkit-agent-helper-1: error writing to agent: %s\n", g_strerror (errno));
+      g_free (tmp2);
+      return;
+    }
+
+  if (str2 == NULL)
+    {
+      fprintf (stdout, "%s\n", str1);
+      fflush (stdout);
+      return;
+    }
+
+  tmp2 = g_strdup(str2);
+  len2 = strlen(tmp2);
+#ifdef PAH_DEBUG
+  fprintf (stderr, "polkit-agent-helper-1: writing `%s ' to stdout\n", str1);
+#endif /* PAH_DEBUG */
+  fprintf (stdout, "%s ", str1);
+
+  if (len2 > 0 && tmp2[len2 - 1] == '\n')
+    tmp2[len2 - 1] = '\0';
+  escaped = g_strescape (tmp2, NULL);
+#ifdef PAH_DEBUG
+  fprintf (stderr, "polkit-agent-helper-1: writing `%s' to stdout\n", escaped);
+#endif /* PAH_DEBUG */
+  fprintf (stdout, "%s", escaped);
+#ifdef PAH_DEBUG
+  fprintf (stderr, "polkit-agent-helper-1: writing newline to stdout\n");
+#endif /* PAH_DEBUG */
+  fputc ('\n', stdout);
+#ifdef PAH_DEBUG
+  fprintf (stderr, "polkit-agent-helper-1: flushing stdout\n");
+#endif /* PAH_DEBUG */
+  fflush (stdout);
+
+  g_free (escaped);
+  g_free (tmp2);
+}
+
+/**
+ * read_from_agent:
+ * @buf: Return location for the response.
+ * @size: Size of @buf.
+ *
+ * Reads the next response from the authentication agent into @buf,
+ * without the trailing newline.
+ *
+ * Returns: @buf or %NULL on error or if the response doesn't fit in @buf.
+ */
+char *
+read_from_agent (char *buf, size_t size)
+{
+  char *frame;
+  size_t len;
+
+  if (!framed)
+    {
+      if (fgets (buf, size, stdin) == NULL)
+        return NULL;
+
+      len = strlen (buf);
+      if (len > 0 && buf[len - 1] == '\n')
+        buf[len - 1] = '\0';
+      return buf;
+    }
+
+  frame = read_frame (agent_fd);
+  if (frame == NULL)
+    return NULL;
+
+  len = strlen (frame);
+  if (len >= size)
+    {
+      memset (frame, 0, len);
+      free (frame);
+      return NULL;
+    }
+
+  memcpy (buf, frame, len + 1);
+  memset (frame, 0, len);
+  free (frame);
+
+  return buf;
+}
+
+/**
+ * take_listen_fd:
+ *
+ * Gets the listening socket passed by the service manager, following
+ * the protocol of sd_listen_fds(3). Must be called before the
+ * environment is cleared.
+ *
+ * Returns: The socket or -1 if none was passed to this process.
+ */
+int
+take_listen_fd (void)
+{
+  const char *e;
+  char *endp;
+  unsigned long long value;
+
+  e = getenv ("LISTEN_PID");
+  if (e == NULL)
+    return -1;
+  errno = 0;
+  value = strtoull (e, &endp, 10);
+  if (errno != 0 || endp == e || *endp != '\0' || value != (unsigned long long) getpid ())
+    return -1;
+
+  /* a unit listening on several sockets is not ours */
+  e = getenv ("LISTEN_FDS");
+  if (e == NULL)
+    return -1;
+  errno = 0;
+  value = strtoull (e, &endp, 10);
+  if (errno != 0 || endp == e || *endp != '\0' || value != 1)
+    return -1;
+
+  unsetenv ("LISTEN_PID");
+  unsetenv ("LISTEN_FDS");
+  unsetenv ("LISTEN_FDNAMES");
+
+  return LISTEN_FDS_START;
+}
+
+static void
+set_timeouts (int fd, int seconds)
+{
+  struct timeval tv;
+
+  tv.tv_sec = seconds;
+  tv.tv_usec = 0;
+  (void) setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+  (void) setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+}
+
+static gboolean
+accept_agent_connection (int                 fd,
+                         const struct ucred *ucred,
+                         char              **out_user,
+                         char              **out_cookie)
+{
+  char *user = NULL;
+  char *cookie = NULL;
+
+  agent_fd = fd;
+  framed = TRUE;
 
+  /* the agent sends the user to authenticate followed by the cookie;
+   * reads fail once the timeout expires, so an idle agent can't hold
+   * on to a child
+   */
+  set_timeouts (fd, REQUEST_TIMEOUT_SEC);
+  user = read_frame (fd);
+  cookie = user != NULL ? read_frame (fd) : NULL;
+  if (cookie == NULL || user[0] == '\0' || cookie[0] == '\0')
+    {
+      syslog (LOG_NOTICE, "inappropriate use of helper, malformed request [uid=%d]", (int) ucred->uid);
+      goto error;
+    }
+  set_timeouts (fd, RESPONSE_TIMEOUT_SEC);
+
+  *out_user = user;
+  *out_cookie = cookie;
+  return TRUE;
+
+ error:
+  free (user);
+  free (cookie);
+  return FALSE;
+}
+
+typedef struct
+{
+  pid_t pid;
+  uid_t uid;
+} Child;
+
+static Child children[MAX_CONNECTIONS];
+static guint n_children = 0;
+
+/* Forgets the children that have exited, without waiting for any */
+static void
+reap_children (void)
+{
+  pid_t pid;
+  guint n;
+
+  while (n_children > 0 && (pid = waitpid (-1, NULL, WNOHANG)) > 0)
+    {
+      for (n = 0; n < n_children; n++)
+        {
+          if (children[n].pid == pid)
+            {
+              children[n] = children[--n_children];
+              break;
+            }
+        }
+    }
+}
+
+static guint
+count_children_for_uid (uid_t uid)
+{
+  guint ret = 0;
+  guint n;
+
+  for (n = 0; n < n_children; n++)
+    {
+      if (children[n].uid == uid)
+        ret++;
+    }
   return ret;
 }
 
+/**
+ * serve_agent_connections:
+ * @listen_fd: The listening socket obtained with take_listen_fd().
+ * @out_user: Return location for the user to authenticate, free with free().
+ * @out_cookie: Return location for the cookie, free with free().
+ * @out_caller_uid: Return location for the uid of the authentication agent.
+ * @out_caller_gid: Return location for the gid of the authentication agent.
+ *
+ * Runs the socket activated helper: accepts connections from
+ * authentication agents on the listening socket passed by the service
+ * manager and forks a child for each of them. This avoids paying for
+ * exec(), dynamic linking and setuid handling for every authentication
+ * attempt.
+ *
+ * Connections beyond %MAX_CONNECTIONS, or %MAX_CONNECTIONS_PER_UID for
+ * the uid of the agent, are closed right away and the agent falls back
+ * to the setuid helper.
+ *
+ * This function only returns in a child process, for a single agent
+ * connection. Subsequent messages are exchanged using send_to_agent()
+ * and read_from_agent(). The parent exits once it has been idle for a
+ * while; the service manager will start it again on demand.
+ *
+ * Returns: %TRUE if a request was read, %FALSE on error.
+ */
+gboolean
+serve_agent_connections (int    listen_fd,
+                         char **out_user,
+                         char **out_cookie,
+                         uid_t *out_caller_uid,
+                         gid_t *out_caller_gid)
+{
+  int accepting;
+  socklen_t len;
+
+  /* unlike the setuid mode, this is only meant to be started by root */
+  if (getuid () != 0)
+    {
+      syslog (LOG_NOTICE, "inappropriate use of helper, socket mode requested [uid=%d]", getuid ());
+      fprintf (stderr, "polkit-agent-helper-1: socket mode must be started by the service manager. This incident has been logged.\n");
+      return FALSE;
+    }
+
+  len = sizeof accepting;
+  if (listen_fd < 0 ||
+      getsockopt (listen_fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &len) != 0 || !accepting)
+    {
+      fprintf (stderr, "polkit-agent-helper-1: no listening socket passed\n");
+      return FALSE;
+    }
+
+  for (;;)
+    {
+      struct pollfd pfd;
+      struct ucred ucred;
+      pid_t pid;
+      int fd;
+      int r;
+
+      reap_children ();
+
+      pfd.fd = listen_fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      r = poll (&pfd, 1, n_children > 0 ? 1000 : IDLE_TIMEOUT_MSEC);
+      if (r < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          fprintf (stderr, "polkit-agent-helper-1: poll failed: %s\n", g_strerror (errno));
+          exit (1);
+        }
+      if (r == 0)
+        {
+          if (n_children == 0)
+            exit (0);
+          continue;
+        }
+
+      fd = accept4 (listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      if (fd < 0)
+        continue;
+
+      /* the uid of the agent is what polkitd matches the cookie against */
+      len = sizeof ucred;
+      if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &ucred, &len) != 0 || len != sizeof ucred)
+        {
+          syslog (LOG_NOTICE, "cannot get credentials of agent: %m");
+          close (fd);
+          continue;
+        }
+
+      if (n_children >= MAX_CONNECTIONS ||
+          count_children_for_uid (ucred.uid) >= MAX_CONNECTIONS_PER_UID)
+        {
+          syslog (LOG_NOTICE, "too many authentication conversations, refusing agent [uid=%d]", (int) ucred.uid);
+          close (fd);
+          continue;
+        }
+
+      pid = fork ();
+      if (pid < 0)
+        {
+          fprintf (stderr, "polkit-agent-helper-1: fork failed: %s\n", g_strerror (errno));
+          close (fd);
+          continue;
+        }
+      else if (pid > 0)
+        {
+          close (fd);
+          children[n_children].pid = pid;
+          children[n_children].uid = ucred.uid;
+          n_children++;
+          continue;
+        }
+
+      /* child */
+      close (listen_fd);
+      *out_caller_uid = ucred.uid;
+      *out_caller_gid = ucred.gid;
+      return accept_agent_connection (fd, &ucred, out_user, out_cookie);
+    }
+}
+
 void
 flush_and_wait (void)
 {
+  if (framed)
+    {
+      /* frames are written unbuffered, just make sure the agent sees EOF */
+      shutdown (agent_fd, SHUT_WR);
+      return;
+    }
+
   fflush (stdout);
   fflush (stderr);
 #ifdef HAVE_FDATASYNC
@@ -23,6 +23,10 @@
 #define __POLKIT_AGENT_HELPER_PRIVATE_H
 
 #include <polkit/polkit.h>
+#include <sys/types.h>
+#include <syslog.h>
+
+#include "polkitagenthelperframe.h"
 
 /* Development aid: define PAH_DEBUG to get debugging output. Do _NOT_
  * enable this in production builds; it may leak passwords and other
@@ -41,6 +45,17 @@ char *read_cookie (int argc, char **argv);
 
 gboolean send_dbus_message (const char *cookie, const char *user);
 
+gboolean send_dbus_message_for_uid (const char *cookie, const char *user, uid_t uid);
+
+void send_to_agent (const char *str1, const char *str2);
+
+char *read_from_agent (char *buf, size_t size);
+
+int take_listen_fd (void);
+
+gboolean serve_agent_connections (int listen_fd, char **out_user, char **out_cookie,
+                                  uid_t *out_caller_uid, gid_t *out_caller_gid);
+
 void flush_and_wait (void);
 
 #endif /* __POLKIT_AGENT_HELPER_PRIVATE_H */
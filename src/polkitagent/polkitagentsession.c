@@ -30,9 +30,11 @@
  * This class is typically used together with instances that are derived from
  * the #PolkitAgentListener abstract base class.
  *
- * To perform the actual authentication, #PolkitAgentSession uses a trusted suid helper.
- * The authentication conversation is done through a pipe. This is transparent; the user
- * only need to handle the
+ * To perform the actual authentication, #PolkitAgentSession uses a trusted helper.
+ * If the socket activated helper service is available, the authentication conversation
+ * is done through its socket; otherwise, or if the service doesn't answer within a few
+ * seconds, a suid helper is spawned and the conversation is done through a pipe. This is
+ * transparent; the user only need to handle the
  * #PolkitAgentSession::request,
  * #PolkitAgentSession::show-info,
  * #PolkitAgentSession::show-error and
@@ -49,16 +51,27 @@
  * be emitted with the @gained_authorization paramter set to %FALSE.
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/wait.h>
+#include <unistd.h>
 #include <gio/gunixoutputstream.h>
 #include <pwd.h>
 
 #include "polkitagentmarshal.h"
 #include "polkitagentsession.h"
+#include "polkitagenthelperframe.h"
+
+/* How long the helper service may take to send its first message
+ * before the setuid helper is spawned instead
+ */
+#define HELPER_SERVICE_TIMEOUT_MSEC (10 * 1000)
 
 static gboolean
 _show_debug (void)
@@ -95,6 +108,17 @@ struct _PolkitAgentSession
   GSource *child_stdout_watch_source;
   GIOChannel *child_stdout_channel;
 
+  /* TRUE if talking to the helper service using length-prefixed frames */
+  gboolean framed;
+  GByteArray *frame_buf;
+  /* until the helper service sends its first message, see fall_back_to_setuid_helper() */
+  GSource *service_timeout_source;
+  gboolean service_answered;
+
+  /* for falling back to the setuid helper */
+  gchar *user_name;
+  GMainContext *main_context;
+
   gboolean success;
   gboolean helper_is_running;
   gboolean have_emitted_completed;
@@ -147,6 +171,9 @@ polkit_agent_session_finalize (GObject *object)
   g_free (session->cookie);
   if (session->identity != NULL)
     g_object_unref (session->identity);
+  g_free (session->user_name);
+  if (session->main_context != NULL)
+    g_main_context_unref (session->main_context);
 
   if (G_OBJECT_CLASS (polkit_agent_session_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (polkit_agent_session_parent_class)->finalize (object);
@@ -396,6 +423,21 @@ kill_helper (PolkitAgentSession *session)
 
   g_clear_object (&session->child_stdin);
 
+  if (session->frame_buf != NULL)
+    {
+      g_byte_array_unref (session->frame_buf);
+      session->frame_buf = NULL;
+    }
+  session->framed = FALSE;
+
+  if (session->service_timeout_source != NULL)
+    {
+      g_source_destroy (session->service_timeout_source);
+      g_source_unref (session->service_timeout_source);
+      session->service_timeout_source = NULL;
+    }
+  session->service_answered = FALSE;
+
   session->helper_is_running = FALSE;
 
  out:
@@ -417,6 +459,56 @@ complete_session (PolkitAgentSession *session,
     }
 }
 
+static void
+handle_helper_message (PolkitAgentSession *session,
+                       const gchar        *message)
+{
+  if (G_UNLIKELY (_show_debug ()))
+    g_print ("PolkitAgentSession: read `%s' from helper\n", message);
+
+  if (g_str_has_prefix (message, "PAM_PROMPT_ECHO_OFF "))
+    {
+      const gchar *s = message + sizeof "PAM_PROMPT_ECHO_OFF " - 1;
+      if (G_UNLIKELY (_show_debug ()))
+        g_print ("PolkitAgentSession: emitting ::request('%s', FALSE)\n", s);
+      g_signal_emit_by_name (session, "request", s, FALSE);
+    }
+  else if (g_str_has_prefix (message, "PAM_PROMPT_ECHO_ON "))
+    {
+      const gchar *s = message + sizeof "PAM_PROMPT_ECHO_ON " - 1;
+      if (G_UNLIKELY (_show_debug ()))
+        g_print ("PolkitAgentSession: emitting ::request('%s', TRUE)\n", s);
+      g_signal_emit_by_name (session, "request", s, TRUE);
+    }
+  else if (g_str_has_prefix (message, "PAM_ERROR_MSG "))
+    {
+      const gchar *s = message + sizeof "PAM_ERROR_MSG " - 1;
+      if (G_UNLIKELY (_show_debug ()))
+        g_print ("PolkitAgentSession: emitting ::show-error('%s')\n", s);
+      g_signal_emit_by_name (session, "show-error", s);
+    }
+  else if (g_str_has_prefix (message, "PAM_TEXT_INFO "))
+    {
+      const gchar *s = message + sizeof "PAM_TEXT_INFO " - 1;
+      if (G_UNLIKELY (_show_debug ()))
+        g_print ("PolkitAgentSession: emitting ::show-info('%s')\n", s);
+      g_signal_emit_by_name (session, "show-info", s);
+    }
+  else if (g_str_has_prefix (message, "SUCCESS"))
+    {
+      complete_session (session, TRUE);
+    }
+  else if (g_str_has_prefix (message, "FAILURE"))
+    {
+      complete_session (session, FALSE);
+    }
+  else
+    {
+      g_warning ("Unknown line '%s' from helper", message);
+      complete_session (session, FALSE);
+    }
+}
+
 static gboolean
 io_watch_have_data (GIOChannel    *channel,
                     GIOCondition   condition,
@@ -461,63 +553,116 @@ io_watch_have_data (GIOChannel    *channel,
 
   unescaped = g_strcompress (line);
 
-  if (G_UNLIKELY (_show_debug ()))
-    g_print ("PolkitAgentSession: read `%s' from helper\n", unescaped);
+  handle_helper_message (session, unescaped);
 
-  if (g_str_has_prefix (unescaped, "PAM_PROMPT_ECHO_OFF "))
-    {
-      const gchar *s = unescaped + sizeof "PAM_PROMPT_ECHO_OFF " - 1;
-      if (G_UNLIKELY (_show_debug ()))
-        g_print ("PolkitAgentSession: emitting ::request('%s', FALSE)\n", s);
-      g_signal_emit_by_name (session, "request", s, FALSE);
-    }
-  else if (g_str_has_prefix (unescaped, "PAM_PROMPT_ECHO_ON "))
-    {
-      const gchar *s = unescaped + sizeof "PAM_PROMPT_ECHO_ON " - 1;
-      if (G_UNLIKELY (_show_debug ()))
-        g_print ("PolkitAgentSession: emitting ::request('%s', TRUE)\n", s);
-      g_signal_emit_by_name (session, "request", s, TRUE);
-    }
-  else if (g_str_has_prefix (unescaped, "PAM_ERROR_MSG "))
-    {
-      const gchar *s = unescaped + sizeof "PAM_ERROR_MSG " - 1;
-      if (G_UNLIKELY (_show_debug ()))
-        g_print ("PolkitAgentSession: emitting ::show-error('%s')\n", s);
-      g_signal_emit_by_name (session, "show-error", s);
-    }
-  else if (g_str_has_prefix (unescaped, "PAM_TEXT_INFO "))
+ out:
+  g_free (line);
+  g_free (unescaped);
+
+  if (condition & (G_IO_ERR | G_IO_HUP))
+    complete_session (session, FALSE);
+
+  /* keep the IOChannel around */
+  return TRUE;
+}
+
+/* Each frame from the helper service is a 32-bit length in network
+ * byte order followed by the message - the same messages as in the
+ * line based protocol, just without escaping.
+ */
+static void fall_back_to_setuid_helper (PolkitAgentSession *session);
+
+static gboolean
+io_watch_have_frames (GIOChannel    *channel,
+                      GIOCondition   condition,
+                      gpointer       user_data)
+{
+  PolkitAgentSession *session = POLKIT_AGENT_SESSION (user_data);
+  guint8 buf[4096];
+  gssize num_read;
+
+  if (!session->helper_is_running)
     {
-      const gchar *s = unescaped + sizeof "PAM_TEXT_INFO " - 1;
-      if (G_UNLIKELY (_show_debug ()))
-        g_print ("PolkitAgentSession: emitting ::show-info('%s')\n", s);
-      g_signal_emit_by_name (session, "show-info", s);
+      g_warning ("in io_watch_have_frames() but helper is not supposed to be running");
+
+      complete_session (session, FALSE);
+      return TRUE;
     }
-  else if (g_str_has_prefix (unescaped, "SUCCESS"))
+
+  /* the signal handlers may drop the last reference to session */
+  g_object_ref (session);
+
+  num_read = read (session->child_stdout, buf, sizeof buf);
+  if (num_read < 0 && (errno == EINTR || errno == EAGAIN))
+    goto out;
+  if (num_read <= 0 && !session->service_answered)
     {
-      complete_session (session, TRUE);
+      /* e.g. the service is busy and refused us */
+      fall_back_to_setuid_helper (session);
+      goto out;
     }
-  else if (g_str_has_prefix (unescaped, "FAILURE"))
+  if (num_read <= 0)
     {
+      g_warning ("Error reading from helper service: %s",
+                 num_read < 0 ? g_strerror (errno) : "connection closed");
       complete_session (session, FALSE);
+      goto out;
     }
-  else
+
+  g_byte_array_append (session->frame_buf, buf, num_read);
+
+  while (session->helper_is_running)
     {
-      g_warning ("Unknown line '%s' from helper", line);
-      complete_session (session, FALSE);
-      goto out;
+      HelperFrameStatus status;
+      gsize len;
+      gchar *message;
+
+      status = helper_frame_parse (session->frame_buf->data, session->frame_buf->len, &len);
+      if (status == HELPER_FRAME_INVALID)
+        {
+          g_warning ("Oversized message from helper service");
+          complete_session (session, FALSE);
+          break;
+        }
+      if (status == HELPER_FRAME_INCOMPLETE)
+        break;
+
+      message = g_strndup ((const gchar *) session->frame_buf->data + HELPER_FRAME_HEADER_SIZE, len);
+      g_byte_array_remove_range (session->frame_buf, 0, HELPER_FRAME_HEADER_SIZE + len);
+
+      if (!session->service_answered)
+        {
+          session->service_answered = TRUE;
+          g_source_destroy (session->service_timeout_source);
+          g_clear_pointer (&session->service_timeout_source, g_source_unref);
+        }
+
+      handle_helper_message (session, message);
+      g_free (message);
     }
 
  out:
-  g_free (line);
-  g_free (unescaped);
-
-  if (condition & (G_IO_ERR | G_IO_HUP))
-    complete_session (session, FALSE);
+  g_object_unref (session);
 
   /* keep the IOChannel around */
   return TRUE;
 }
 
+static gboolean
+write_frame (PolkitAgentSession *session,
+             const gchar        *data,
+             gsize               len)
+{
+  guint32 be_len;
+
+  if (len > HELPER_MAX_FRAME_SIZE)
+    return FALSE;
+
+  be_len = GUINT32_TO_BE ((guint32) len);
+  return g_output_stream_write_all (session->child_stdin, &be_len, sizeof be_len, NULL, NULL, NULL) &&
+         g_output_stream_write_all (session->child_stdin, data, len, NULL, NULL, NULL);
+}
+
 /**
  * polkit_agent_session_response:
  * @session: A #PolkitAgentSession.
@@ -539,6 +684,14 @@ polkit_agent_session_response (PolkitAgentSession *session,
 
   response_len = strlen (response);
 
+  if (session->framed)
+    {
+      if (response_len > 0 && response[response_len - 1] == '\n')
+        response_len--;
+      (void) write_frame (session, response, response_len);
+      return;
+    }
+
   add_newline = (response_len == 0 || response[response_len - 1] != '\n');
 
   (void) g_output_stream_write_all (session->child_stdin, response, response_len, NULL, NULL, NULL);
@@ -546,60 +699,91 @@ polkit_agent_session_response (PolkitAgentSession *session,
     (void) g_output_stream_write_all (session->child_stdin, newline, 1, NULL, NULL, NULL);
 }
 
-/**
- * polkit_agent_session_initiate:
- * @session: A #PolkitAgentSession.
- *
- * Initiates the authentication session. Before calling this method,
- * make sure to connect to the various signals. The signals will be
- * emitted in the <link
- * linkend="g-main-context-push-thread-default">thread-default main
- * loop</link> that this method is invoked from.
- *
- * Use polkit_agent_session_cancel() to cancel the session.
- **/
-void
-polkit_agent_session_initiate (PolkitAgentSession *session)
+/* Connects to the socket activated helper service, if available */
+static gboolean
+connect_helper_service (PolkitAgentSession *session,
+                        const gchar        *user_name)
 {
-  uid_t uid;
-  GError *error;
-  gchar *helper_argv[3];
-  struct passwd *passwd;
-  int stdin_fd = -1;
+  struct sockaddr_un addr;
+  struct ucred ucred;
+  socklen_t len;
+  int fd;
 
-  g_return_if_fail (POLKIT_AGENT_IS_SESSION (session));
+  /* so that a full backlog makes connect() fail rather than wait */
+  fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (fd < 0)
+    return FALSE;
 
-  if (G_UNLIKELY (_show_debug ()))
+  memset (&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  g_strlcpy (addr.sun_path, POLKIT_AGENT_HELPER_SOCKET, sizeof addr.sun_path);
+
+  if (connect (fd, (struct sockaddr *) &addr, sizeof addr) != 0)
     {
-      gchar *s;
-      s = polkit_identity_to_string (session->identity);
-      g_print ("PolkitAgentSession: initiating authentication for identity `%s', cookie %s\n",
-               s,
-               session->cookie);
-      g_free (s);
+      if (G_UNLIKELY (_show_debug ()))
+        g_print ("PolkitAgentSession: cannot connect to %s: %s\n",
+                 POLKIT_AGENT_HELPER_SOCKET, g_strerror (errno));
+      close (fd);
+      return FALSE;
     }
 
-  /* TODO: also support authorization for other kinds of identities */
-  if (!POLKIT_IS_UNIX_USER (session->identity))
+  /* don't hand out the cookie unless the socket was set up by root */
+  len = sizeof ucred;
+  if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &ucred, &len) != 0 ||
+      len != sizeof ucred || ucred.uid != 0)
     {
-      g_warning ("Unsupported identity type");
-      goto error;
+      g_warning ("Helper service socket %s is not owned by root, ignoring",
+                 POLKIT_AGENT_HELPER_SOCKET);
+      close (fd);
+      return FALSE;
     }
 
-  uid = polkit_unix_user_get_uid (POLKIT_UNIX_USER (session->identity));
+  if (fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) & ~O_NONBLOCK) != 0)
+    {
+      close (fd);
+      return FALSE;
+    }
 
-  passwd = getpwuid (uid);
-  if (passwd == NULL)
+  session->child_stdout = fd;
+  session->child_stdin = (GOutputStream*)g_unix_output_stream_new (fd, FALSE);
+  session->frame_buf = g_byte_array_new ();
+  session->framed = TRUE;
+
+  if (!write_frame (session, user_name, strlen (user_name)) ||
+      !write_frame (session, session->cookie, strlen (session->cookie)))
     {
-      g_warning ("No user with uid %d", uid);
-      goto error;
+      g_warning ("Error writing to helper service");
+      g_clear_object (&session->child_stdin);
+      g_byte_array_unref (session->frame_buf);
+      session->frame_buf = NULL;
+      session->framed = FALSE;
+      session->child_stdout = -1;
+      close (fd);
+      return FALSE;
     }
 
+  if (G_UNLIKELY (_show_debug ()))
+    g_print ("PolkitAgentSession: connected to helper service at %s\n", POLKIT_AGENT_HELPER_SOCKET);
+
+  return TRUE;
+}
+
+/* Spawns the setuid helper, the fallback if the service isn't available */
+static gboolean
+spawn_helper (PolkitAgentSession *session,
+              const gchar        *user_name)
+{
+  GError *error;
+  gchar *helper_argv[3];
+  int stdin_fd = -1;
+
   helper_argv[0] = PACKAGE_PREFIX "/lib/polkit-1/polkit-agent-helper-1";
-  helper_argv[1] = passwd->pw_name;
+  helper_argv[1] = (gchar *) user_name;
   helper_argv[2] = NULL;
 
   session->child_stdout = -1;
+  /* the line based protocol, even if the service was tried first */
+  session->framed = FALSE;
 
   error = NULL;
   if (!g_spawn_async_with_pipes (NULL,
@@ -617,7 +801,7 @@ polkit_agent_session_initiate (PolkitAgentSession *session)
     {
       g_warning ("Cannot spawn helper: %s\n", error->message);
       g_error_free (error);
-      goto error;
+      return FALSE;
     }
 
   if (G_UNLIKELY (_show_debug ()))
@@ -630,16 +814,119 @@ polkit_agent_session_initiate (PolkitAgentSession *session)
                                     NULL, NULL, NULL);
   (void) g_output_stream_write_all (session->child_stdin, "\n", 1, NULL, NULL, NULL);
 
+  return TRUE;
+}
+
+static void
+watch_helper (PolkitAgentSession *session,
+              GSourceFunc         func)
+{
   session->child_stdout_channel = g_io_channel_unix_new (session->child_stdout);
   session->child_stdout_watch_source = g_io_create_watch (session->child_stdout_channel,
                                                           G_IO_IN | G_IO_ERR | G_IO_HUP);
-  g_source_set_callback (session->child_stdout_watch_source, (GSourceFunc) io_watch_have_data, session, NULL);
-  g_source_attach (session->child_stdout_watch_source, g_main_context_get_thread_default ());
+  g_source_set_callback (session->child_stdout_watch_source, func, session, NULL);
+  g_source_attach (session->child_stdout_watch_source, session->main_context);
+
+  session->helper_is_running = TRUE;
+}
+
+/* The helper service is busy or wedged; nothing but the user name and
+ * the cookie has been sent to it, so start over with the setuid helper
+ */
+static void
+fall_back_to_setuid_helper (PolkitAgentSession *session)
+{
+  if (G_UNLIKELY (_show_debug ()))
+    g_print ("PolkitAgentSession: helper service did not answer, spawning the setuid helper\n");
+
+  kill_helper (session);
+
+  if (spawn_helper (session, session->user_name))
+    watch_helper (session, (GSourceFunc) io_watch_have_data);
+  else
+    complete_session (session, FALSE);
+}
+
+static gboolean
+on_helper_service_timeout (gpointer user_data)
+{
+  PolkitAgentSession *session = POLKIT_AGENT_SESSION (user_data);
+
+  g_object_ref (session);
+  fall_back_to_setuid_helper (session);
+  g_object_unref (session);
 
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * polkit_agent_session_initiate:
+ * @session: A #PolkitAgentSession.
+ *
+ * Initiates the authentication session. Before calling this method,
+ * make sure to connect to the various signals. The signals will be
+ * emitted in the <link
+ * linkend="g-main-context-push-thread-default">thread-default main
+ * loop</link> that this method is invoked from.
+ *
+ * Use polkit_agent_session_cancel() to cancel the session.
+ **/
+void
+polkit_agent_session_initiate (PolkitAgentSession *session)
+{
+  uid_t uid;
+  struct passwd *passwd;
+
+  g_return_if_fail (POLKIT_AGENT_IS_SESSION (session));
+
+  if (G_UNLIKELY (_show_debug ()))
+    {
+      gchar *s;
+      s = polkit_identity_to_string (session->identity);
+      g_print ("PolkitAgentSession: initiating authentication for identity `%s', cookie %s\n",
+               s,
+               session->cookie);
+      g_free (s);
+    }
+
+  /* TODO: also support authorization for other kinds of identities */
+  if (!POLKIT_IS_UNIX_USER (session->identity))
+    {
+      g_warning ("Unsupported identity type");
+      goto error;
+    }
+
+  uid = polkit_unix_user_get_uid (POLKIT_UNIX_USER (session->identity));
+
+  passwd = getpwuid (uid);
+  if (passwd == NULL)
+    {
+      g_warning ("No user with uid %d", uid);
+      goto error;
+    }
+
+  g_free (session->user_name);
+  session->user_name = g_strdup (passwd->pw_name);
+  if (session->main_context != NULL)
+    g_main_context_unref (session->main_context);
+  session->main_context = g_main_context_ref_thread_default ();
 
   session->success = FALSE;
 
-  session->helper_is_running = TRUE;
+  if (connect_helper_service (session, session->user_name))
+    {
+      watch_helper (session, (GSourceFunc) io_watch_have_frames);
+
+      session->service_timeout_source = g_timeout_source_new (HELPER_SERVICE_TIMEOUT_MSEC);
+      g_source_set_callback (session->service_timeout_source, on_helper_service_timeout, session, NULL);
+      g_source_attach (session->service_timeout_source, session->main_context);
+    }
+  else if (spawn_helper (session, session->user_name))
+    {
+      watch_helper (session, (GSourceFunc) io_watch_have_data);
+    }
+  else
+    goto error;
 
   return;
 
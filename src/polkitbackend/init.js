@@ -52,6 +52,8 @@ polkit.addAdminRule = function(callback) {this._adminRuleFuncs.push(callback);};
 polkit._runAdminRules = function(action, subject) {
     var ret = null;
     for (var n = 0; n < this._adminRuleFuncs.length; n++) {
+        if (this._isCancelled())
+            break;
         var func = this._adminRuleFuncs[n];
         var func_ret = func(action, subject);
         if (func_ret) {
@@ -63,10 +65,24 @@ polkit._runAdminRules = function(action, subject) {
 };
 
 polkit._ruleFuncs = [];
-polkit.addRule = function(callback) {this._ruleFuncs.push(callback);};
-polkit._runRules = function(action, subject) {
+// for each of _ruleFuncs, whether it asked to be memoized
+polkit._ruleFuncsMemoize = [];
+polkit._numMemoizedRules = 0;
+polkit.addRule = function(callback, options) {
+    var memoize = !!(options && options.memoize);
+    this._ruleFuncs.push(callback);
+    this._ruleFuncsMemoize.push(memoize);
+    if (memoize)
+        this._numMemoizedRules++;
+};
+polkit._runRuleFuncs = function(action, subject) {
     var ret = null;
     for (var n = 0; n < this._ruleFuncs.length; n++) {
+        // the result is thrown away if the check was cancelled
+        if (this._isCancelled())
+            break;
+        if (this._trace && !this._ruleFuncsMemoize[n])
+            this._trace.memoize = false;
         var func = this._ruleFuncs[n];
         var func_ret = func(action, subject);
         if (func_ret) {
@@ -77,9 +93,238 @@ polkit._runRules = function(action, subject) {
     return ret;
 };
 
+// ---------------------------------------------------------------------
+// Results of the rules are memoized if every rule that ran was added
+// with {memoize: true}, keyed on the values of exactly those Action and
+// Subject properties the rules read while computing them, so e.g.
+// checks that only differ in the pid of the subject share a result.
+// Nothing else a rule reads is tracked, e.g. variables it keeps between
+// calls, which is why rules have to ask for it. Even then, rules that
+// call polkit.spawn(), polkit.log(), subject.isInNetGroup(),
+// Math.random() or read the clock through Date, or that modify or
+// enumerate their arguments, are not memoized.
+
+// for each action id, of {reads: [[object, name, value, isIn]], ret}
+polkit._cache = Object.create(null);
+polkit._cacheHits = 0;
+polkit._cacheMisses = 0;
+polkit._maxCacheEntriesPerAction = 32;
+// the trace of the evaluation in progress, see _trackReads()
+polkit._trace = null;
+
+// arrays, e.g. subject.groups, are compared by value
+polkit._cacheValue = function(value) {
+    return (value !== null && typeof value == "object") ? JSON.stringify(value) : value;
+};
+
+polkit._uncacheable = function() {
+    if (this._trace)
+        this._trace.cacheable = false;
+};
+
+// Returns a proxy for @obj (0 for the action, 1 for the subject) that
+// records what is read from it in @trace. Methods are not recorded,
+// they are the same for every object and what they read is recorded
+// as they read it through the proxy.
+polkit._trackReads = function(obj, which, trace) {
+    var self = this;
+    return new Proxy(obj, {
+        get: function(target, name) {
+            var value = target[name];
+            if (typeof name == "string" && typeof value != "function")
+                trace.reads.push([which, name, self._cacheValue(value), false]);
+            return value;
+        },
+        has: function(target, name) {
+            var value = name in target;
+            if (typeof name == "string")
+                trace.reads.push([which, name, value, true]);
+            return value;
+        },
+        set: function(target, name, value) {
+            trace.cacheable = false;
+            target[name] = value;
+            return true;
+        },
+        deleteProperty: function(target, name) {
+            trace.cacheable = false;
+            return delete target[name];
+        },
+        ownKeys: function(target) {
+            trace.cacheable = false;
+            return Object.getOwnPropertyNames(target);
+        }
+    });
+};
+
+polkit._cacheLookup = function(action, subject) {
+    var entries = this._cache[action.id];
+    if (!entries)
+        return undefined;
+    var objs = [action, subject];
+    for (var n = 0; n < entries.length; n++) {
+        var reads = entries[n].reads;
+        var m;
+        for (m = 0; m < reads.length; m++) {
+            var read = reads[m];
+            var obj = objs[read[0]];
+            var value = read[3] ? (read[1] in obj) : this._cacheValue(obj[read[1]]);
+            if (value !== read[2])
+                break;
+        }
+        if (m == reads.length)
+            return entries[n];
+    }
+    return undefined;
+};
+
+polkit._runRules = function(action, subject) {
+    // not worth tracking reads if nothing can be memoized
+    if (this._numMemoizedRules == 0)
+        return this._runRuleFuncs(action, subject);
+
+    var entry = this._cacheLookup(action, subject);
+    if (entry) {
+        this._cacheHits++;
+        return entry.ret;
+    }
+    this._cacheMisses++;
+
+    var trace = {reads: [], cacheable: true, memoize: true};
+    var ret;
+    this._trace = trace;
+    try {
+        ret = this._runRuleFuncs(this._trackReads(action, 0, trace),
+                                 this._trackReads(subject, 1, trace));
+    } finally {
+        this._trace = null;
+    }
+
+    // a cancelled evaluation may not have run all the rules it should have
+    if (trace.cacheable && trace.memoize && !this._isCancelled()) {
+        if (!this._cache[action.id])
+            this._cache[action.id] = [];
+        var entries = this._cache[action.id];
+        if (entries.length >= this._maxCacheEntriesPerAction)
+            entries.shift();
+        entries.push({reads: trace.reads, ret: ret});
+    }
+    return ret;
+};
+
+// Also runs the admin rules if the result (@implicit, unless a rule
+// handles the action) is an admin challenge, so that such a check only
+// makes one call into the rules and builds the Action and Subject objects
+// once. An admin rule that throws leaves the result standing, with ""
+// for the identities so that root authenticates; one that runs away
+// still fails the whole call.
+polkit._runRulesAndAdminRules = function(action, subject, implicit) {
+    var ret = this._runRules(action, subject);
+    var result = ret ? ret : implicit;
+    var adminRet = "";
+    if (result == this.Result.AUTH_ADMIN || result == this.Result.AUTH_ADMIN_KEEP) {
+        try {
+            adminRet = this._runAdminRules(action, subject);
+        } catch (e) {
+            this.log("Error evaluating admin rules: " + e);
+        }
+    }
+    return [ret, adminRet];
+};
+
+// Whether the rules leave checks of @actionId without details to the
+// implicit authorizations, whoever the subject is: run with an empty
+// Subject they return nothing without having read from it. They may
+// still read the action, since without details it only holds the id.
+polkit._rulesIgnoreSubjectForAction = function(actionId) {
+    var action = new Action();
+    action.id = actionId;
+    var trace = {reads: [], cacheable: true, probe: true};
+    var ret;
+    this._trace = trace;
+    try {
+        ret = this._runRuleFuncs(this._trackReads(action, 0, trace),
+                                 this._trackReads(new Subject(), 1, trace));
+    } catch (e) {
+        return false;
+    } finally {
+        this._trace = null;
+    }
+
+    if (ret || !trace.cacheable)
+        return false;
+    for (var n = 0; n < trace.reads.length; n++) {
+        if (trace.reads[n][0] == 1)
+            return false;
+    }
+    return true;
+};
+
+// _rulesIgnoreSubjectForAction() for each of @actionIds, in one call
+// so GetImplicitAuthorizations() doesn't start a runaway killer per
+// action
+polkit._rulesIgnoreSubject = function(actionIds) {
+    var ret = [];
+    for (var n = 0; n < actionIds.length; n++)
+        ret.push(this._ruleFuncs.length == 0 || this._rulesIgnoreSubjectForAction(actionIds[n]));
+    return ret;
+};
+
+// Called before anything with side effects; a probe of the rules
+// doesn't get that far
+polkit._sideEffect = function() {
+    this._uncacheable();
+    if (this._trace && this._trace.probe)
+        throw new Error("Rules have side effects");
+};
+
+// rules may call these without polkit as this
+polkit._spawn = polkit.spawn;
+polkit.spawn = function(argv) {
+    polkit._sideEffect();
+    return polkit._spawn(argv);
+};
+polkit._log = polkit.log;
+polkit.log = function(message) {
+    polkit._sideEffect();
+    return polkit._log(message);
+};
+polkit._userIsInNetGroupUncached = polkit._userIsInNetGroup;
+polkit._userIsInNetGroup = function(user, netGroup) {
+    polkit._uncacheable();
+    return polkit._userIsInNetGroupUncached(user, netGroup);
+};
+// These replace the globals for all rules, memoized or not. Only Date()
+// and new Date() without arguments read the clock.
+polkit._Date = Date;
+Date = new Proxy(Date, {
+    apply: function(target, thisArg, args) {
+        polkit._uncacheable();
+        return target.apply(thisArg, args);
+    },
+    construct: function(target, args) {
+        if (args.length == 0)
+            polkit._uncacheable();
+        return new (Function.prototype.bind.apply(target, [null].concat(args)))();
+    }
+});
+polkit._dateNow = polkit._Date.now;
+polkit._Date.now = function() {
+    polkit._uncacheable();
+    return polkit._dateNow();
+};
+polkit._random = Math.random;
+Math.random = function() {
+    polkit._uncacheable();
+    return polkit._random();
+};
+
 polkit._deleteRules = function() {
     this._adminRuleFuncs = [];
     this._ruleFuncs = [];
+    this._ruleFuncsMemoize = [];
+    this._numMemoizedRules = 0;
+    this._cache = Object.create(null);
 };
 
 polkit.Result = {
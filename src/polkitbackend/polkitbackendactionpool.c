@@ -21,6 +21,7 @@
 
 #include <errno.h>
 #include <pwd.h>
+#include <stdlib.h>
 #include <string.h>
 #include <expat.h>
 
@@ -37,11 +38,196 @@
  * The #PolkitBackendActionPool class is a utility class to look up registered PolicyKit actions.
  */
 
+/* Strings that repeat across many actions, such as vendor names and
+ * annotation keys, are stored once per pool. Parsing threads add to
+ * the table concurrently, so it is locked. It is emptied when the
+ * actions are reloaded, so unlike g_intern_string() nothing outlives
+ * the actions that used it.
+ */
+typedef struct
+{
+  GMutex lock;
+  /* maps from a string to itself */
+  GHashTable *strings;
+  /* bytes held by the strings */
+  gsize num_bytes;
+} StringTable;
+
+static void
+string_table_init (StringTable *table)
+{
+  g_mutex_init (&table->lock);
+  table->strings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  table->num_bytes = 0;
+}
+
+static void
+string_table_clear (StringTable *table)
+{
+  g_clear_pointer (&table->strings, g_hash_table_unref);
+  g_mutex_clear (&table->lock);
+}
+
+/* Must only be called while no parsing thread is running */
+static void
+string_table_remove_all (StringTable *table)
+{
+  g_hash_table_remove_all (table->strings);
+  table->num_bytes = 0;
+}
+
+/* Returns the copy of @str held by @table, valid until it is emptied */
+static const gchar *
+string_table_intern (StringTable *table,
+                     const gchar *str)
+{
+  gchar *ret;
+
+  if (str == NULL)
+    return NULL;
+
+  g_mutex_lock (&table->lock);
+  ret = g_hash_table_lookup (table->strings, str);
+  if (ret == NULL)
+    {
+      ret = g_strdup (str);
+      g_hash_table_add (table->strings, ret);
+      table->num_bytes += strlen (ret) + 1;
+    }
+  g_mutex_unlock (&table->lock);
+
+  return ret;
+}
+
+/* A small immutable map from interned keys to strings, sorted by key.
+ *
+ * Actions typically have a handful of annotations and translations so
+ * a sorted array is both smaller and faster to search than a GHashTable.
+ */
+typedef struct
+{
+  const gchar *key;
+  gchar *value;
+} StringPair;
+
+typedef struct
+{
+  guint num_pairs;
+  StringPair pairs[];
+} StringMap;
+
+static gint
+string_pair_compare (gconstpointer a,
+                     gconstpointer b)
+{
+  return strcmp (((const StringPair *) a)->key, ((const StringPair *) b)->key);
+}
+
+/* Steals the values from @hash, which must have interned keys. Returns
+ * %NULL if @hash is empty.
+ */
+static StringMap *
+string_map_new_take_hash (GHashTable *hash)
+{
+  StringMap *map;
+  GHashTableIter hash_iter;
+  const gchar *key;
+  gchar *value;
+  guint n;
+
+  if (hash == NULL || g_hash_table_size (hash) == 0)
+    return NULL;
+
+  map = g_malloc (sizeof (StringMap) + g_hash_table_size (hash) * sizeof (StringPair));
+  map->num_pairs = g_hash_table_size (hash);
+
+  n = 0;
+  g_hash_table_iter_init (&hash_iter, hash);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &key, (gpointer) &value))
+    {
+      map->pairs[n].key = key;
+      map->pairs[n].value = value;
+      g_hash_table_iter_steal (&hash_iter);
+      n++;
+    }
+
+  qsort (map->pairs, map->num_pairs, sizeof (StringPair), string_pair_compare);
+
+  return map;
+}
+
+static void
+string_map_free (StringMap *map)
+{
+  guint n;
+
+  if (map == NULL)
+    return;
+
+  for (n = 0; n < map->num_pairs; n++)
+    g_free (map->pairs[n].value);
+  g_free (map);
+}
+
+static const gchar *
+string_map_lookup (const StringMap *map,
+                   const gchar     *key)
+{
+  StringPair needle;
+  const StringPair *pair;
+
+  if (map == NULL)
+    return NULL;
+
+  needle.key = key;
+  pair = bsearch (&needle, map->pairs, map->num_pairs, sizeof (StringPair), string_pair_compare);
+
+  return pair != NULL ? pair->value : NULL;
+}
+
+static GHashTable *
+string_map_to_hash (const StringMap *map)
+{
+  GHashTable *hash;
+  guint n;
+
+  /* the keys are copied as well since descriptions holding the table
+   * can outlive a reload, which frees the interned strings
+   */
+  hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  if (map != NULL)
+    {
+      for (n = 0; n < map->num_pairs; n++)
+        g_hash_table_insert (hash, g_strdup (map->pairs[n].key), g_strdup (map->pairs[n].value));
+    }
+
+  return hash;
+}
+
+/* Approximate number of bytes owned by @map */
+static gsize
+string_map_get_size (const StringMap *map)
+{
+  gsize ret;
+  guint n;
+
+  if (map == NULL)
+    return 0;
+
+  ret = sizeof (StringMap) + map->num_pairs * sizeof (StringPair);
+  for (n = 0; n < map->num_pairs; n++)
+    ret += strlen (map->pairs[n].value) + 1;
+
+  return ret;
+}
+
 typedef struct
 {
-  gchar *vendor_name;
-  gchar *vendor_url;
-  gchar *icon_name;
+  /* these repeat across many actions, so they are interned */
+  const gchar *vendor_name;
+  const gchar *vendor_url;
+  const gchar *icon_name;
+
   gchar *description;
   gchar *message;
 
@@ -49,40 +235,93 @@ typedef struct
   PolkitImplicitAuthorization implicit_authorization_inactive;
   PolkitImplicitAuthorization implicit_authorization_active;
 
-  /* each of these map from the locale identifer (e.g. da_DK) to the localized value */
-  GHashTable *localized_description;
-  GHashTable *localized_message;
+  /* each of these map from the interned locale identifer (e.g. da_DK) to the localized value */
+  StringMap *localized_description;
+  StringMap *localized_message;
 
-  /* this maps from annotation key (string) to annotation value (also a string) */
-  GHashTable *annotations;
+  /* this maps from interned annotation key (string) to annotation value (also a string) */
+  StringMap *annotations;
+
+  /* descriptions handed out by polkit_backend_action_pool_get_action(),
+   * one per distinct translation, see SharedDescription
+   */
+  GPtrArray *shared_descriptions;
+  GHashTable *annotations_hash;
 } ParsedAction;
 
+/* A PolkitActionDescription has no setters, so a single instance can be
+ * shared by all callers asking for the same translation. It is keyed on
+ * the strings _localize() picked rather than on the locale, so the
+ * number of instances is bounded by the number of translations no
+ * matter what locales clients pass.
+ *
+ * All instances are also linked into a pool-wide LRU queue (most
+ * recently used first) so the cache can be capped, see
+ * polkit_backend_action_pool_set_max_cached_descriptions().
+ */
+typedef struct
+{
+  const gchar *description;
+  const gchar *message;
+  PolkitActionDescription *action_description;
+  ParsedAction *parsed_action;
+  GQueue *lru;
+  GList lru_link;
+} SharedDescription;
+
+static void
+shared_description_free (SharedDescription *shared)
+{
+  g_queue_unlink (shared->lru, &shared->lru_link);
+  g_object_unref (shared->action_description);
+  g_free (shared);
+}
+
 static void
 parsed_action_free (ParsedAction *action)
 {
-  g_free (action->vendor_name);
-  g_free (action->vendor_url);
-  g_free (action->icon_name);
+  if (action->shared_descriptions != NULL)
+    g_ptr_array_unref (action->shared_descriptions);
+  if (action->annotations_hash != NULL)
+    g_hash_table_unref (action->annotations_hash);
+
   g_free (action->description);
   g_free (action->message);
 
-  g_hash_table_unref (action->localized_description);
-  g_hash_table_unref (action->localized_message);
+  string_map_free (action->localized_description);
+  string_map_free (action->localized_message);
 
-  g_hash_table_unref (action->annotations);
+  string_map_free (action->annotations);
   g_free (action);
 }
 
-static gboolean process_policy_file (PolkitBackendActionPool *pool,
+/* Approximate number of bytes owned by @action, not counting the interned strings */
+static gsize
+parsed_action_get_size (const ParsedAction *action)
+{
+  gsize ret;
+
+  ret = sizeof (ParsedAction);
+  if (action->description != NULL)
+    ret += strlen (action->description) + 1;
+  if (action->message != NULL)
+    ret += strlen (action->message) + 1;
+  ret += string_map_get_size (action->localized_description);
+  ret += string_map_get_size (action->localized_message);
+  ret += string_map_get_size (action->annotations);
+
+  return ret;
+}
+
+static gboolean process_policy_file (StringTable *strings,
+                                     GHashTable *parsed_actions,
                                      const gchar *xml,
+                                     gsize xml_len,
                                      GError **error);
 
-static void ensure_file (PolkitBackendActionPool *pool,
-                         GFile *file);
-
 static void ensure_all_files (PolkitBackendActionPool *pool);
 
-static const gchar *_localize (GHashTable *translations,
+static const gchar *_localize (const StringMap *translations,
                                const gchar *untranslated,
                                const gchar *lang);
 
@@ -97,12 +336,24 @@ typedef struct
   /* maps from action_id to a ParsedAction struct */
   GHashTable *parsed_actions;
 
+  /* the keys of @parsed_actions in strcmp() order, built on demand */
+  const gchar **sorted_action_ids;
+
   /* maps from basename of parsed file to nothing */
   GHashTable *parsed_files;
 
+  /* the strings interned while parsing @parsed_actions */
+  StringTable strings;
+
   /* is TRUE only when we've read all files */
   gboolean has_loaded_all_files;
 
+  /* SharedDescription instances, most recently used first */
+  GQueue cached_descriptions;
+
+  /* 0 means no limit */
+  guint max_cached_descriptions;
+
 } PolkitBackendActionPoolPrivate;
 
 enum
@@ -137,6 +388,10 @@ polkit_backend_action_pool_init (PolkitBackendActionPool *pool)
                                               g_str_equal,
                                               g_free,
                                               NULL);
+
+  string_table_init (&priv->strings);
+
+  g_queue_init (&priv->cached_descriptions);
 }
 
 static void
@@ -154,12 +409,16 @@ polkit_backend_action_pool_finalize (GObject *object)
   if (priv->dir_monitors != NULL)
     g_list_free_full (priv->dir_monitors, g_object_unref);
 
+  g_free (priv->sorted_action_ids);
+
   if (priv->parsed_actions != NULL)
     g_hash_table_unref (priv->parsed_actions);
 
   if (priv->parsed_files != NULL)
     g_hash_table_unref (priv->parsed_files);
 
+  string_table_clear (&priv->strings);
+
   G_OBJECT_CLASS (polkit_backend_action_pool_parent_class)->finalize (object);
 }
 
@@ -187,6 +446,21 @@ polkit_backend_action_pool_get_property (GObject     *object,
     }
 }
 
+/* Forgets all registered actions and the strings they used */
+static void
+remove_all_actions (PolkitBackendActionPool *pool)
+{
+  PolkitBackendActionPoolPrivate *priv;
+
+  priv = polkit_backend_action_pool_get_instance_private (pool);
+
+  g_hash_table_remove_all (priv->parsed_files);
+  g_hash_table_remove_all (priv->parsed_actions);
+  g_clear_pointer (&priv->sorted_action_ids, g_free);
+  string_table_remove_all (&priv->strings);
+  priv->has_loaded_all_files = FALSE;
+}
+
 static void
 dir_monitor_changed (GFileMonitor     *monitor,
                      GFile            *file,
@@ -223,9 +497,7 @@ dir_monitor_changed (GFileMonitor     *monitor,
           //g_debug ("match");
 
           /* now throw away all caches */
-          g_hash_table_remove_all (priv->parsed_files);
-          g_hash_table_remove_all (priv->parsed_actions);
-          priv->has_loaded_all_files = FALSE;
+          remove_all_actions (pool);
 
           g_signal_emit_by_name (pool, "changed");
         }
@@ -357,6 +629,29 @@ polkit_backend_action_pool_new (const gchar **directories)
   return pool;
 }
 
+/* Drops the least recently used descriptions until the cache is within
+ * its limit. Callers holding a reference keep their object alive; it is
+ * just no longer handed out to new callers.
+ */
+static void
+trim_cached_descriptions (PolkitBackendActionPool *pool)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  SharedDescription *shared;
+
+  priv = polkit_backend_action_pool_get_instance_private (pool);
+
+  if (priv->max_cached_descriptions == 0)
+    return;
+
+  while (priv->cached_descriptions.length > priv->max_cached_descriptions)
+    {
+      shared = priv->cached_descriptions.tail->data;
+      /* frees @shared via shared_description_free() */
+      g_ptr_array_remove_fast (shared->parsed_action->shared_descriptions, shared);
+    }
+}
+
 /**
  * polkit_backend_action_pool_get_action:
  * @pool: A #PolkitBackendActionPool.
@@ -365,6 +660,9 @@ polkit_backend_action_pool_new (const gchar **directories)
  *
  * Gets a #PolkitActionDescription object describing the action with identifier @action_id.
  *
+ * The returned object is shared with other callers asking for the same
+ * action and translation and it must not be modified.
+ *
  * Returns: A #PolkitActionDescription (free with g_object_unref()) or %NULL
  *          if @action_id isn't registered or valid.
  **/
@@ -376,8 +674,10 @@ polkit_backend_action_pool_get_action (PolkitBackendActionPool *pool,
   PolkitBackendActionPoolPrivate *priv;
   PolkitActionDescription *ret;
   ParsedAction *parsed_action;
+  SharedDescription *shared;
   const gchar *description;
   const gchar *message;
+  guint n;
 
   g_return_val_if_fail (POLKIT_BACKEND_IS_ACTION_POOL (pool), NULL);
 
@@ -402,6 +702,24 @@ polkit_backend_action_pool_get_action (PolkitBackendActionPool *pool,
                        parsed_action->message,
                        locale);
 
+  if (parsed_action->shared_descriptions == NULL)
+    parsed_action->shared_descriptions = g_ptr_array_new_with_free_func ((GDestroyNotify) shared_description_free);
+
+  for (n = 0; n < parsed_action->shared_descriptions->len; n++)
+    {
+      shared = g_ptr_array_index (parsed_action->shared_descriptions, n);
+      if (shared->description == description && shared->message == message)
+        {
+          g_queue_unlink (&priv->cached_descriptions, &shared->lru_link);
+          g_queue_push_head_link (&priv->cached_descriptions, &shared->lru_link);
+          ret = g_object_ref (shared->action_description);
+          goto out;
+        }
+    }
+
+  /* all translations of an action share the annotations table */
+  if (parsed_action->annotations_hash == NULL)
+    parsed_action->annotations_hash = string_map_to_hash (parsed_action->annotations);
   ret = polkit_action_description_new (action_id,
                                        description,
                                        message,
@@ -411,12 +729,127 @@ polkit_backend_action_pool_get_action (PolkitBackendActionPool *pool,
                                        parsed_action->implicit_authorization_any,
                                        parsed_action->implicit_authorization_inactive,
                                        parsed_action->implicit_authorization_active,
-                                       parsed_action->annotations);
+                                       parsed_action->annotations_hash);
+
+  shared = g_new0 (SharedDescription, 1);
+  shared->description = description;
+  shared->message = message;
+  shared->action_description = g_object_ref (ret);
+  shared->parsed_action = parsed_action;
+  shared->lru = &priv->cached_descriptions;
+  shared->lru_link.data = shared;
+  g_ptr_array_add (parsed_action->shared_descriptions, shared);
+  g_queue_push_head_link (&priv->cached_descriptions, &shared->lru_link);
+
+  trim_cached_descriptions (pool);
 
  out:
   return ret;
 }
 
+/**
+ * polkit_backend_action_pool_get_memory_usage:
+ * @pool: A #PolkitBackendActionPool.
+ * @out_num_actions: (out) (allow-none): Return location for the number of registered actions.
+ *
+ * Gets the approximate number of bytes used for storing the registered
+ * actions, including the strings they share such as vendor names.
+ *
+ * Returns: The number of bytes.
+ **/
+gsize
+polkit_backend_action_pool_get_memory_usage (PolkitBackendActionPool *pool,
+                                             guint                   *out_num_actions)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  GHashTableIter hash_iter;
+  const gchar *action_id;
+  ParsedAction *parsed_action;
+  gsize ret;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_ACTION_POOL (pool), 0);
+
+  priv = polkit_backend_action_pool_get_instance_private (pool);
+
+  ret = 0;
+  g_hash_table_iter_init (&hash_iter, priv->parsed_actions);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer) &action_id, (gpointer) &parsed_action))
+    {
+      /* GHashTable stores a hash, a key and a value per entry */
+      ret += sizeof (guint) + 2 * sizeof (gpointer);
+      ret += strlen (action_id) + 1;
+      ret += parsed_action_get_size (parsed_action);
+    }
+  ret += priv->strings.num_bytes;
+
+  if (out_num_actions != NULL)
+    *out_num_actions = g_hash_table_size (priv->parsed_actions);
+
+  return ret;
+}
+
+/**
+ * polkit_backend_action_pool_get_cache_usage:
+ * @pool: A #PolkitBackendActionPool.
+ * @out_num_descriptions: (out) (allow-none): Return location for the number of cached descriptions.
+ *
+ * Gets the approximate number of bytes used by the #PolkitActionDescription
+ * objects cached by polkit_backend_action_pool_get_action(). Strings
+ * shared with the registered actions are not included.
+ *
+ * Returns: The number of bytes.
+ **/
+gsize
+polkit_backend_action_pool_get_cache_usage (PolkitBackendActionPool *pool,
+                                            guint                   *out_num_descriptions)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  GList *l;
+  gsize ret;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_ACTION_POOL (pool), 0);
+
+  priv = polkit_backend_action_pool_get_instance_private (pool);
+
+  ret = 0;
+  for (l = priv->cached_descriptions.head; l != NULL; l = l->next)
+    {
+      SharedDescription *shared = l->data;
+      GTypeQuery query;
+
+      g_type_query (G_OBJECT_TYPE (shared->action_description), &query);
+      ret += sizeof (SharedDescription) + sizeof (gpointer) + query.instance_size;
+    }
+
+  if (out_num_descriptions != NULL)
+    *out_num_descriptions = priv->cached_descriptions.length;
+
+  return ret;
+}
+
+/**
+ * polkit_backend_action_pool_set_max_cached_descriptions:
+ * @pool: A #PolkitBackendActionPool.
+ * @max_descriptions: The maximum number of descriptions to cache or 0 for no limit.
+ *
+ * Limits the number of #PolkitActionDescription objects kept around
+ * by polkit_backend_action_pool_get_action(). When the limit is
+ * exceeded the least recently used ones are dropped.
+ **/
+void
+polkit_backend_action_pool_set_max_cached_descriptions (PolkitBackendActionPool *pool,
+                                                        guint                    max_descriptions)
+{
+  PolkitBackendActionPoolPrivate *priv;
+
+  g_return_if_fail (POLKIT_BACKEND_IS_ACTION_POOL (pool));
+
+  priv = polkit_backend_action_pool_get_instance_private (pool);
+
+  priv->max_cached_descriptions = max_descriptions;
+  trim_cached_descriptions (pool);
+}
+
 /**
  * polkit_backend_action_pool_get_all_actions:
  * @pool: A #PolkitBackendActionPool.
@@ -463,6 +896,151 @@ polkit_backend_action_pool_get_all_actions (PolkitBackendActionPool *pool,
   return ret;
 }
 
+static gint
+action_id_compare (gconstpointer a,
+                   gconstpointer b)
+{
+  return strcmp (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+static const gchar **
+ensure_sorted_action_ids (PolkitBackendActionPool *pool)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  guint num_action_ids;
+
+  priv = polkit_backend_action_pool_get_instance_private (pool);
+
+  if (priv->sorted_action_ids == NULL)
+    {
+      priv->sorted_action_ids = (const gchar **) g_hash_table_get_keys_as_array (priv->parsed_actions,
+                                                                                 &num_action_ids);
+      qsort (priv->sorted_action_ids, num_action_ids, sizeof (gchar *), action_id_compare);
+    }
+
+  return priv->sorted_action_ids;
+}
+
+static GVariant *
+parsed_action_to_gvariant (const gchar        *action_id,
+                           const ParsedAction *parsed_action,
+                           const gchar        *locale)
+{
+  GVariantBuilder builder;
+  guint n;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
+  for (n = 0; parsed_action->annotations != NULL && n < parsed_action->annotations->num_pairs; n++)
+    g_variant_builder_add (&builder, "{ss}",
+                           parsed_action->annotations->pairs[n].key,
+                           parsed_action->annotations->pairs[n].value);
+
+  /* the same as polkit_action_description_to_gvariant() */
+  return g_variant_new ("(ssssssuuua{ss})",
+                        action_id,
+                        _localize (parsed_action->localized_description, parsed_action->description, locale) ? : "",
+                        _localize (parsed_action->localized_message, parsed_action->message, locale) ? : "",
+                        parsed_action->vendor_name ? : "",
+                        parsed_action->vendor_url ? : "",
+                        parsed_action->icon_name ? : "",
+                        parsed_action->implicit_authorization_any,
+                        parsed_action->implicit_authorization_inactive,
+                        parsed_action->implicit_authorization_active,
+                        &builder);
+}
+
+/**
+ * polkit_backend_action_pool_enumerate_actions:
+ * @pool: A #PolkitBackendActionPool.
+ * @locale: The locale to get descriptions for or %NULL for system locale.
+ * @id_prefix: (allow-none): Only include actions whose id starts with this or %NULL.
+ * @annotation_key: (allow-none): Only include actions with this annotation or %NULL or empty.
+ * @annotation_value: (allow-none): If not %NULL or empty, the value @annotation_key must have.
+ * @offset: The number of matching actions to skip.
+ * @limit: The maximum number of actions to return or 0 for no limit.
+ * @out_num_matches: (out) (allow-none): Return location for the number of matching actions.
+ *
+ * Like polkit_backend_action_pool_get_all_actions() but filters the
+ * actions and returns them serialized, ordered by action id, without
+ * creating #PolkitActionDescription objects. Use @offset and @limit
+ * to return a large set in pages.
+ *
+ * Returns: A floating #GVariant of type <literal>a(ssssssuuua{ss})</literal>.
+ **/
+GVariant *
+polkit_backend_action_pool_enumerate_actions (PolkitBackendActionPool *pool,
+                                              const gchar             *locale,
+                                              const gchar             *id_prefix,
+                                              const gchar             *annotation_key,
+                                              const gchar             *annotation_value,
+                                              guint                    offset,
+                                              guint                    limit,
+                                              guint                   *out_num_matches)
+{
+  PolkitBackendActionPoolPrivate *priv;
+  GVariantBuilder builder;
+  const gchar **action_ids;
+  guint num_action_ids;
+  guint num_matches;
+  guint lo, hi;
+  guint n;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_ACTION_POOL (pool), NULL);
+
+  priv = polkit_backend_action_pool_get_instance_private (pool);
+
+  ensure_all_files (pool);
+  action_ids = ensure_sorted_action_ids (pool);
+  num_action_ids = g_hash_table_size (priv->parsed_actions);
+
+  if (id_prefix == NULL)
+    id_prefix = "";
+  if (annotation_value != NULL && annotation_value[0] == '\0')
+    annotation_value = NULL;
+
+  /* actions with @id_prefix are a contiguous range, starting at the
+   * first id that doesn't compare less than @id_prefix
+   */
+  lo = 0;
+  hi = num_action_ids;
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (strcmp (action_ids[mid], id_prefix) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssssssuuua{ss})"));
+  num_matches = 0;
+  for (n = lo; n < num_action_ids && g_str_has_prefix (action_ids[n], id_prefix); n++)
+    {
+      ParsedAction *parsed_action;
+
+      parsed_action = g_hash_table_lookup (priv->parsed_actions, action_ids[n]);
+
+      if (annotation_key != NULL && annotation_key[0] != '\0')
+        {
+          const gchar *value;
+
+          value = string_map_lookup (parsed_action->annotations, annotation_key);
+          if (value == NULL || (annotation_value != NULL && strcmp (value, annotation_value) != 0))
+            continue;
+        }
+
+      if (num_matches >= offset && (limit == 0 || num_matches - offset < limit))
+        g_variant_builder_add_value (&builder, parsed_action_to_gvariant (action_ids[n], parsed_action, locale));
+      num_matches++;
+    }
+
+  if (out_num_matches != NULL)
+    *out_num_matches = num_matches;
+
+  return g_variant_builder_end (&builder);
+}
+
 /**
  * polkit_backend_action_pool_reload:
  * @pool: A #PolkitBackendActionPool.
@@ -479,67 +1057,127 @@ polkit_backend_action_pool_reload (PolkitBackendActionPool *pool)
 
   priv = polkit_backend_action_pool_get_instance_private (pool);
 
-  g_hash_table_remove_all (priv->parsed_files);
-  g_hash_table_remove_all (priv->parsed_actions);
-  priv->has_loaded_all_files = FALSE;
+  remove_all_actions (pool);
   ensure_all_files (pool);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static void
-ensure_file (PolkitBackendActionPool *pool,
-             GFile *file)
+/* Upper bound on the number of threads used for parsing .policy files */
+#define MAX_PARSER_THREADS 8
+
+typedef struct
 {
-  PolkitBackendActionPoolPrivate *priv;
-  gchar *contents;
-  GError *error = NULL;
   gchar *path;
-  gchar *basename;
 
-  priv = polkit_backend_action_pool_get_instance_private (pool);
+  /* the pool's, shared by all files */
+  StringTable *strings;
 
-  path = g_file_get_path (file);
-  basename = g_file_get_basename (file);
+  /* maps from action_id to a ParsedAction struct, for this file only */
+  GHashTable *parsed_actions;
 
-  if (g_hash_table_lookup_extended (priv->parsed_files, basename, NULL, NULL) == TRUE)
-    goto out;
+  GError *error;
+} PolicyFile;
+
+static PolicyFile *
+policy_file_new (gchar       *path,
+                 StringTable *strings)
+{
+  PolicyFile *policy_file;
+
+  policy_file = g_new0 (PolicyFile, 1);
+  policy_file->path = path;
+  policy_file->strings = strings;
+  policy_file->parsed_actions = g_hash_table_new_full (g_str_hash,
+                                                       g_str_equal,
+                                                       g_free,
+                                                       (GDestroyNotify) parsed_action_free);
+  return policy_file;
+}
+
+static void
+policy_file_free (PolicyFile *policy_file)
+{
+  g_free (policy_file->path);
+  g_hash_table_unref (policy_file->parsed_actions);
+  g_clear_error (&policy_file->error);
+  g_free (policy_file);
+}
+
+/* Only touches @policy_file and the locked string table so it can run on any thread */
+static void
+policy_file_load (PolicyFile *policy_file)
+{
+  GMappedFile *mapped_file;
 
-  if (!g_file_load_contents (file,
-                             NULL,
-                             &contents,
-                             NULL,
-                             NULL,
-                             &error))
+  /* the file is handed to expat straight from the page cache */
+  mapped_file = g_mapped_file_new (policy_file->path, FALSE, &policy_file->error);
+  if (mapped_file == NULL)
     {
-      g_warning ("Error loading file with path '%s': %s", path, error->message);
-      goto out;
+      g_prefix_error (&policy_file->error, "Error loading file with path '%s': ", policy_file->path);
+      return;
     }
 
-  if (!process_policy_file (pool,
-                            contents,
-                            &error))
+  if (!process_policy_file (policy_file->strings,
+                            policy_file->parsed_actions,
+                            g_mapped_file_get_contents (mapped_file),
+                            g_mapped_file_get_length (mapped_file),
+                            &policy_file->error))
+    g_prefix_error (&policy_file->error, "Error parsing file with path '%s': ", policy_file->path);
+
+  g_mapped_file_unref (mapped_file);
+}
+
+static void
+policy_file_load_func (gpointer data,
+                       gpointer user_data)
+{
+  policy_file_load (data);
+}
+
+static void
+load_policy_files (GPtrArray *policy_files)
+{
+  GThreadPool *thread_pool = NULL;
+  GError *error = NULL;
+  guint num_threads;
+  guint n;
+
+  num_threads = MIN (MIN ((guint) g_get_num_processors (), MAX_PARSER_THREADS), policy_files->len);
+
+  if (num_threads > 1)
     {
-      g_warning ("Error parsing file with path '%s': %s", path, error->message);
-      g_free (contents);
-      goto out;
+      thread_pool = g_thread_pool_new (policy_file_load_func,
+                                       NULL,
+                                       num_threads,
+                                       TRUE,
+                                       &error);
+      if (thread_pool == NULL)
+        {
+          g_warning ("Error creating threads for parsing action files: %s", error->message);
+          g_clear_error (&error);
+        }
     }
 
-  g_free (contents);
+  if (thread_pool == NULL)
+    {
+      for (n = 0; n < policy_files->len; n++)
+        policy_file_load (policy_files->pdata[n]);
+      return;
+    }
 
-  /* steal basename */
-  g_hash_table_insert (priv->parsed_files, basename, NULL);
-  basename = NULL;
+  for (n = 0; n < policy_files->len; n++)
+    g_thread_pool_push (thread_pool, policy_files->pdata[n], NULL);
 
- out:
-  g_free (basename);
-  g_free (path);
+  /* waits for all files to be parsed */
+  g_thread_pool_free (thread_pool, FALSE, TRUE);
 }
 
 static void
 ensure_all_files (PolkitBackendActionPool *pool)
 {
   PolkitBackendActionPoolPrivate *priv;
+  GPtrArray *policy_files;
 
   GList *files = NULL;
 
@@ -587,14 +1225,54 @@ ensure_all_files (PolkitBackendActionPool *pool)
   /* standard sorting places /etc before /usr as desired */
   files = g_list_sort (files, (GCompareFunc) g_strcmp0);
 
+  /* Parse all files concurrently, each into its own table. A file
+   * shadowed by one with the same basename is parsed as well so that
+   * it can take over if the first one turns out to be broken.
+   */
+  policy_files = g_ptr_array_new_with_free_func ((GDestroyNotify) policy_file_free);
   for (GList *l = files; l != NULL; l = l->next)
+    g_ptr_array_add (policy_files, policy_file_new (l->data, &priv->strings));
+  g_list_free (files);
+
+  load_policy_files (policy_files);
+
+  /* ... and merge the results in sorted order */
+  for (guint n = 0; n < policy_files->len; n++)
     {
-      GFile *file = g_file_new_for_path((gchar *)l->data);
-      ensure_file (pool, file);
-      g_object_unref (file);
+      PolicyFile *policy_file = policy_files->pdata[n];
+      GHashTableIter hash_iter;
+      gchar *action_id;
+      ParsedAction *action;
+      gchar *basename;
+
+      basename = g_path_get_basename (policy_file->path);
+      if (g_hash_table_contains (priv->parsed_files, basename))
+        {
+          g_free (basename);
+          continue;
+        }
+
+      /* actions parsed before an error are kept */
+      g_hash_table_iter_init (&hash_iter, policy_file->parsed_actions);
+      while (g_hash_table_iter_next (&hash_iter, (gpointer) &action_id, (gpointer) &action))
+        {
+          g_hash_table_iter_steal (&hash_iter);
+          g_hash_table_insert (priv->parsed_actions, action_id, action);
+          g_clear_pointer (&priv->sorted_action_ids, g_free);
+        }
+
+      if (policy_file->error != NULL)
+        {
+          g_warning ("%s", policy_file->error->message);
+          g_free (basename);
+          continue;
+        }
+
+      /* steal basename */
+      g_hash_table_insert (priv->parsed_files, basename, NULL);
     }
 
-  g_list_free_full (files, g_free);
+  g_ptr_array_unref (policy_files);
 
   priv->has_loaded_all_files = TRUE;
 }
@@ -629,14 +1307,17 @@ typedef struct {
   int state_stack[PARSER_MAX_DEPTH];
   int stack_depth;
 
-  char *global_vendor;
-  char *global_vendor_url;
-  char *global_icon_name;
+  /* interned */
+  const char *global_vendor;
+  const char *global_vendor_url;
+  const char *global_icon_name;
 
   char *action_id;
-  char *vendor;
-  char *vendor_url;
-  char *icon_name;
+
+  /* interned */
+  const char *vendor;
+  const char *vendor_url;
+  const char *icon_name;
 
   PolkitImplicitAuthorization implicit_authorization_any;
   PolkitImplicitAuthorization implicit_authorization_inactive;
@@ -648,13 +1329,18 @@ typedef struct {
   char *policy_description_nolang;
   char *policy_message_nolang;
 
-  /* the value of xml:lang for the thing we're reading in _cdata() */
-  char *elem_lang;
+  /* the interned value of xml:lang for the thing we're reading in _cdata() */
+  const char *elem_lang;
 
-  char *annotate_key;
+  /* interned */
+  const char *annotate_key;
   GHashTable *annotations;
 
-  PolkitBackendActionPool *pool;
+  /* where parsed actions end up, maps from action_id to a ParsedAction struct */
+  GHashTable *parsed_actions;
+
+  /* the pool's table that the strings marked interned above are in */
+  StringTable *strings;
 } ParserData;
 
 static void
@@ -663,11 +1349,8 @@ pd_unref_action_data (ParserData *pd)
   g_free (pd->action_id);
   pd->action_id = NULL;
 
-  g_free (pd->vendor);
   pd->vendor = NULL;
-  g_free (pd->vendor_url);
   pd->vendor_url = NULL;
-  g_free (pd->icon_name);
   pd->icon_name = NULL;
 
   g_free (pd->policy_description_nolang);
@@ -684,14 +1367,12 @@ pd_unref_action_data (ParserData *pd)
       g_hash_table_unref (pd->policy_messages);
       pd->policy_messages = NULL;
     }
-  g_free (pd->annotate_key);
   pd->annotate_key = NULL;
   if (pd->annotations != NULL)
     {
       g_hash_table_unref (pd->annotations);
       pd->annotations = NULL;
     }
-  g_free (pd->elem_lang);
   pd->elem_lang = NULL;
 }
 
@@ -700,11 +1381,8 @@ pd_unref_data (ParserData *pd)
 {
   pd_unref_action_data (pd);
 
-  g_free (pd->global_vendor);
   pd->global_vendor = NULL;
-  g_free (pd->global_vendor_url);
   pd->global_vendor_url = NULL;
-  g_free (pd->global_icon_name);
   pd->global_icon_name = NULL;
 }
 
@@ -743,13 +1421,13 @@ _start (void *data, const char *el, const char **attr)
           pd->action_id = g_strdup (attr[1]);
           pd->policy_descriptions = g_hash_table_new_full (g_str_hash,
                                                            g_str_equal,
-                                                           g_free,
+                                                           NULL,
                                                            g_free);
           pd->policy_messages = g_hash_table_new_full (g_str_hash,
                                                        g_str_equal,
-                                                       g_free,
+                                                       NULL,
                                                        g_free);
-          pd->annotations = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+          pd->annotations = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
           /* initialize defaults */
           pd->implicit_authorization_any = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED;
           pd->implicit_authorization_inactive = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED;
@@ -778,7 +1456,7 @@ _start (void *data, const char *el, const char **attr)
         {
           if (num_attr == 2 && strcmp (attr[0], "xml:lang") == 0)
             {
-              pd->elem_lang = g_strdup (attr[1]);
+              pd->elem_lang = string_table_intern (pd->strings, attr[1]);
             }
           state = STATE_IN_ACTION_DESCRIPTION;
         }
@@ -786,7 +1464,7 @@ _start (void *data, const char *el, const char **attr)
         {
           if (num_attr == 2 && strcmp (attr[0], "xml:lang") == 0)
             {
-              pd->elem_lang = g_strdup (attr[1]);
+              pd->elem_lang = string_table_intern (pd->strings, attr[1]);
             }
           state = STATE_IN_ACTION_MESSAGE;
         }
@@ -809,8 +1487,7 @@ _start (void *data, const char *el, const char **attr)
 
           state = STATE_IN_ANNOTATE;
 
-          g_free (pd->annotate_key);
-          pd->annotate_key = g_strdup (attr[1]);
+          pd->annotate_key = string_table_intern (pd->strings, attr[1]);
         }
       break;
 
@@ -895,7 +1572,7 @@ _cdata (void *data, const char *s, int len)
       else
         {
           g_hash_table_insert (pd->policy_descriptions,
-                               g_strdup (pd->elem_lang),
+                               (gpointer) pd->elem_lang,
                                str);
           str = NULL;
         }
@@ -911,22 +1588,18 @@ _cdata (void *data, const char *s, int len)
       else
         {
           g_hash_table_insert (pd->policy_messages,
-                               g_strdup (pd->elem_lang),
+                               (gpointer) pd->elem_lang,
                                str);
           str = NULL;
         }
       break;
 
     case STATE_IN_POLICY_VENDOR:
-      g_free (pd->global_vendor);
-      pd->global_vendor = str;
-      str = NULL;
+      pd->global_vendor = string_table_intern (pd->strings, str);
       break;
 
     case STATE_IN_POLICY_VENDOR_URL:
-      g_free (pd->global_vendor_url);
-      pd->global_vendor_url = str;
-      str = NULL;
+      pd->global_vendor_url = string_table_intern (pd->strings, str);
       break;
 
     case STATE_IN_POLICY_ICON_NAME:
@@ -935,21 +1608,15 @@ _cdata (void *data, const char *s, int len)
           g_warning ("Icon name '%s' is invalid", str);
           goto error;
         }
-      g_free (pd->global_icon_name);
-      pd->global_icon_name = str;
-      str = NULL;
+      pd->global_icon_name = string_table_intern (pd->strings, str);
       break;
 
     case STATE_IN_ACTION_VENDOR:
-      g_free (pd->vendor);
-      pd->vendor = str;
-      str = NULL;
+      pd->vendor = string_table_intern (pd->strings, str);
       break;
 
     case STATE_IN_ACTION_VENDOR_URL:
-      g_free (pd->vendor_url);
-      pd->vendor_url = str;
-      str = NULL;
+      pd->vendor_url = string_table_intern (pd->strings, str);
       break;
 
     case STATE_IN_ACTION_ICON_NAME:
@@ -959,9 +1626,7 @@ _cdata (void *data, const char *s, int len)
           goto error;
         }
 
-      g_free (pd->icon_name);
-      pd->icon_name = str;
-      str = NULL;
+      pd->icon_name = string_table_intern (pd->strings, str);
       break;
 
     case STATE_IN_DEFAULTS_ALLOW_ANY:
@@ -980,7 +1645,7 @@ _cdata (void *data, const char *s, int len)
       break;
 
     case STATE_IN_ANNOTATE:
-      g_hash_table_insert (pd->annotations, g_strdup (pd->annotate_key), str);
+      g_hash_table_insert (pd->annotations, (gpointer) pd->annotate_key, str);
       str = NULL;
       break;
 
@@ -1001,20 +1666,16 @@ _end (void *data, const char *el)
 {
   ParserData *pd = data;
 
-  g_free (pd->elem_lang);
   pd->elem_lang = NULL;
 
   switch (pd->state)
     {
     case STATE_IN_ACTION:
       {
-        gchar *vendor;
-        gchar *vendor_url;
-        gchar *icon_name;
+        const gchar *vendor;
+        const gchar *vendor_url;
+        const gchar *icon_name;
         ParsedAction *action;
-        PolkitBackendActionPoolPrivate *priv;
-
-        priv = polkit_backend_action_pool_get_instance_private (pd->pool);
 
         vendor = pd->vendor;
         if (vendor == NULL)
@@ -1029,28 +1690,27 @@ _end (void *data, const char *el)
           icon_name = pd->global_icon_name;
 
         action = g_new0 (ParsedAction, 1);
-        action->vendor_name = g_strdup (vendor);
-        action->vendor_url = g_strdup (vendor_url);
-        action->icon_name = g_strdup (icon_name);
-        action->description = g_strdup (pd->policy_description_nolang);
-        action->message = g_strdup (pd->policy_message_nolang);
-
-        action->localized_description = pd->policy_descriptions;
-        action->localized_message     = pd->policy_messages;
-        action->annotations           = pd->annotations;
+        action->vendor_name = vendor;
+        action->vendor_url = vendor_url;
+        action->icon_name = icon_name;
+        /* we steal these strings */
+        action->description = pd->policy_description_nolang;
+        action->message = pd->policy_message_nolang;
+        pd->policy_description_nolang = NULL;
+        pd->policy_message_nolang = NULL;
+
+        /* ... and the values of these hash tables */
+        action->localized_description = string_map_new_take_hash (pd->policy_descriptions);
+        action->localized_message     = string_map_new_take_hash (pd->policy_messages);
+        action->annotations           = string_map_new_take_hash (pd->annotations);
 
         action->implicit_authorization_any = pd->implicit_authorization_any;
         action->implicit_authorization_inactive = pd->implicit_authorization_inactive;
         action->implicit_authorization_active = pd->implicit_authorization_active;
 
-        g_hash_table_insert (priv->parsed_actions, g_strdup (pd->action_id),
+        g_hash_table_insert (pd->parsed_actions, g_strdup (pd->action_id),
                              action);
 
-        /* we steal these hash tables */
-        pd->annotations = NULL;
-        pd->policy_descriptions = NULL;
-        pd->policy_messages = NULL;
-
         break;
       }
 
@@ -1079,9 +1739,37 @@ error:
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Each thread parsing policy files keeps its own parser around */
+static GPrivate thread_parser = G_PRIVATE_INIT ((GDestroyNotify) XML_ParserFree);
+
+static XML_Parser
+get_thread_parser (void)
+{
+  XML_Parser parser;
+
+  parser = g_private_get (&thread_parser);
+  if (parser == NULL)
+    {
+      parser = XML_ParserCreate (NULL);
+      if (parser == NULL)
+        abort ();
+      g_private_set (&thread_parser, parser);
+    }
+  else
+    {
+      /* this also clears handlers and user data */
+      if (!XML_ParserReset (parser, NULL))
+        abort ();
+    }
+
+  return parser;
+}
+
 static gboolean
-process_policy_file (PolkitBackendActionPool *pool,
+process_policy_file (StringTable *strings,
+                     GHashTable *parsed_actions,
                      const gchar *xml,
+                     gsize xml_len,
                      GError **error)
 {
   ParserData pd;
@@ -1090,9 +1778,10 @@ process_policy_file (PolkitBackendActionPool *pool,
   /* clear parser data */
   memset (&pd, 0, sizeof (ParserData));
 
-  pd.pool = pool;
+  pd.parsed_actions = parsed_actions;
+  pd.strings = strings;
 
-  pd.parser = XML_ParserCreate (NULL);
+  pd.parser = get_thread_parser ();
   pd.stack_depth = 0;
   XML_SetUserData (pd.parser, &pd);
   XML_SetElementHandler (pd.parser, _start, _end);
@@ -1101,7 +1790,16 @@ process_policy_file (PolkitBackendActionPool *pool,
   /* init parser data */
   pd.state = STATE_NONE;
 
-  xml_res = XML_Parse (pd.parser, xml, strlen (xml), 1);
+  if (xml_len > G_MAXINT)
+    {
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_FAILED,
+                   "File is too large");
+      goto error;
+    }
+
+  xml_res = XML_Parse (pd.parser, xml, (int) xml_len, 1);
 
   if (xml_res == 0)
     {
@@ -1118,12 +1816,9 @@ process_policy_file (PolkitBackendActionPool *pool,
                        (int) XML_GetCurrentLineNumber (pd.parser),
                        XML_ErrorString (XML_GetErrorCode (pd.parser)));
         }
-      XML_ParserFree (pd.parser);
       goto error;
     }
 
-  XML_ParserFree (pd.parser);
-
   pd_unref_data (&pd);
   return TRUE;
 
@@ -1144,7 +1839,7 @@ error:
  * Returns: the localized string to use
  */
 static const gchar *
-_localize (GHashTable *translations,
+_localize (const StringMap *translations,
            const gchar *untranslated,
            const gchar *lang)
 {
@@ -1159,7 +1854,7 @@ _localize (GHashTable *translations,
     }
 
   /* first see if we have the translation */
-  result = (const char *) g_hash_table_lookup (translations, (void *) lang);
+  result = string_map_lookup (translations, lang);
   if (result != NULL)
     goto out;
 
@@ -1167,7 +1862,7 @@ _localize (GHashTable *translations,
   langs = g_get_locale_variants (lang);
   for (n = 0; langs[n] != NULL; n++)
     {
-      result = (const char *) g_hash_table_lookup (translations, (void *) langs[n]);
+      result = string_map_lookup (translations, langs[n]);
       if (result != NULL)
         break;
     }
@@ -68,10 +68,25 @@ PolkitBackendActionPool *polkit_backend_action_pool_new              (const gcha
 GList                   *polkit_backend_action_pool_get_all_actions  (PolkitBackendActionPool  *pool,
                                                                       const gchar              *locale);
 
+GVariant                *polkit_backend_action_pool_enumerate_actions (PolkitBackendActionPool  *pool,
+                                                                      const gchar              *locale,
+                                                                      const gchar              *id_prefix,
+                                                                      const gchar              *annotation_key,
+                                                                      const gchar              *annotation_value,
+                                                                      guint                     offset,
+                                                                      guint                     limit,
+                                                                      guint                    *out_num_matches);
+
 PolkitActionDescription *polkit_backend_action_pool_get_action       (PolkitBackendActionPool  *pool,
                                                                       const gchar              *action_id,
                                                                       const gchar              *locale);
 void                     polkit_backend_action_pool_reload           (PolkitBackendActionPool *pool);
+gsize                    polkit_backend_action_pool_get_memory_usage (PolkitBackendActionPool *pool,
+                                                                      guint                   *out_num_actions);
+gsize                    polkit_backend_action_pool_get_cache_usage  (PolkitBackendActionPool *pool,
+                                                                      guint                   *out_num_descriptions);
+void                     polkit_backend_action_pool_set_max_cached_descriptions (PolkitBackendActionPool *pool,
+                                                                                 guint                    max_descriptions);
 
 G_END_DECLS
 
@@ -20,13 +20,22 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <pwd.h>
+#include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
 #include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gio/gunixfdlist.h>
 
 #include <polkit/polkit.h>
 #include <polkit/polkitprivate.h>
+#include <polkit/polkitimplicitsnapshot.h>
 
 #include "polkitbackendauthority.h"
 #include "polkitbackendjsauthority.h"
@@ -181,6 +190,105 @@ polkit_backend_authority_enumerate_actions (PolkitBackendAuthority   *authority,
     }
 }
 
+static gint
+action_description_compare_by_id (gconstpointer a,
+                                   gconstpointer b)
+{
+  return strcmp (polkit_action_description_get_action_id (POLKIT_ACTION_DESCRIPTION (a)),
+                 polkit_action_description_get_action_id (POLKIT_ACTION_DESCRIPTION (b)));
+}
+
+/**
+ * polkit_backend_authority_enumerate_actions_as_gvariant:
+ * @authority: A #PolkitBackendAuthority.
+ * @caller: The system bus name that initiated the query.
+ * @locale: The locale to retrieve descriptions for.
+ * @id_prefix: (allow-none): Only include actions whose id starts with this or %NULL.
+ * @annotation_key: (allow-none): Only include actions with this annotation or %NULL or empty.
+ * @annotation_value: (allow-none): If not %NULL or empty, the value @annotation_key must have.
+ * @offset: The number of matching actions to skip.
+ * @limit: The maximum number of actions to return or 0 for no limit.
+ * @out_num_matches: (out) (allow-none): Return location for the number of matching actions.
+ * @error: Return location for error or %NULL.
+ *
+ * Retrieves the registered actions matching the given filters,
+ * ordered by action id, the way they are sent over D-Bus.
+ *
+ * Returns: A floating #GVariant of type <literal>a(ssssssuuua{ss})</literal>
+ * or %NULL if @error is set.
+ *
+ * Since: 127
+ **/
+GVariant *
+polkit_backend_authority_enumerate_actions_as_gvariant (PolkitBackendAuthority   *authority,
+                                                        PolkitSubject            *caller,
+                                                        const gchar              *locale,
+                                                        const gchar              *id_prefix,
+                                                        const gchar              *annotation_key,
+                                                        const gchar              *annotation_value,
+                                                        guint                     offset,
+                                                        guint                     limit,
+                                                        guint                    *out_num_matches,
+                                                        GError                  **error)
+{
+  PolkitBackendAuthorityClass *klass;
+  GVariantBuilder builder;
+  GError *local_error;
+  GList *actions;
+  GList *l;
+  guint num_matches;
+
+  klass = POLKIT_BACKEND_AUTHORITY_GET_CLASS (authority);
+
+  if (klass->enumerate_actions_as_gvariant != NULL)
+    return klass->enumerate_actions_as_gvariant (authority, caller, locale,
+                                                 id_prefix, annotation_key, annotation_value,
+                                                 offset, limit, out_num_matches, error);
+
+  local_error = NULL;
+  actions = polkit_backend_authority_enumerate_actions (authority, caller, locale, &local_error);
+  if (local_error != NULL)
+    {
+      g_propagate_error (error, local_error);
+      return NULL;
+    }
+
+  if (annotation_value != NULL && annotation_value[0] == '\0')
+    annotation_value = NULL;
+
+  actions = g_list_sort (actions, action_description_compare_by_id);
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssssssuuua{ss})"));
+  num_matches = 0;
+  for (l = actions; l != NULL; l = l->next)
+    {
+      PolkitActionDescription *ad = POLKIT_ACTION_DESCRIPTION (l->data);
+
+      if (id_prefix != NULL && !g_str_has_prefix (polkit_action_description_get_action_id (ad), id_prefix))
+        continue;
+
+      if (annotation_key != NULL && annotation_key[0] != '\0')
+        {
+          const gchar *value;
+
+          value = polkit_action_description_get_annotation (ad, annotation_key);
+          if (value == NULL || (annotation_value != NULL && strcmp (value, annotation_value) != 0))
+            continue;
+        }
+
+      if (num_matches >= offset && (limit == 0 || num_matches - offset < limit))
+        g_variant_builder_add_value (&builder,
+                                     polkit_action_description_to_gvariant (ad)); /* A floating value */
+      num_matches++;
+    }
+  g_list_foreach (actions, (GFunc) g_object_unref, NULL);
+  g_list_free (actions);
+
+  if (out_num_matches != NULL)
+    *out_num_matches = num_matches;
+
+  return g_variant_builder_end (&builder);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 /**
@@ -427,6 +535,62 @@ polkit_backend_authority_enumerate_temporary_authorizations (PolkitBackendAuthor
     }
 }
 
+/**
+ * polkit_backend_authority_enumerate_temporary_authorizations_as_gvariant:
+ * @authority: A #PolkitBackendAuthority.
+ * @caller: The system bus name that initiated the query.
+ * @subject: The subject to get temporary authorizations for.
+ * @error: Return location for error.
+ *
+ * Like polkit_backend_authority_enumerate_temporary_authorizations()
+ * but returns the authorizations the way they are sent over D-Bus.
+ *
+ * Returns: A floating #GVariant of type <literal>a(ss(sa{sv})tt)</literal>
+ * or %NULL if @error is set.
+ *
+ * Since: 127
+ */
+GVariant *
+polkit_backend_authority_enumerate_temporary_authorizations_as_gvariant (PolkitBackendAuthority   *authority,
+                                                                         PolkitSubject            *caller,
+                                                                         PolkitSubject            *subject,
+                                                                         GError                  **error)
+{
+  PolkitBackendAuthorityClass *klass;
+  GList *authorizations;
+  GList *l;
+  GVariantBuilder builder;
+  GError *local_error;
+
+  klass = POLKIT_BACKEND_AUTHORITY_GET_CLASS (authority);
+
+  if (klass->enumerate_temporary_authorizations_as_gvariant != NULL)
+    return klass->enumerate_temporary_authorizations_as_gvariant (authority, caller, subject, error);
+
+  local_error = NULL;
+  authorizations = polkit_backend_authority_enumerate_temporary_authorizations (authority,
+                                                                                caller,
+                                                                                subject,
+                                                                                &local_error);
+  if (local_error != NULL)
+    {
+      g_propagate_error (error, local_error);
+      return NULL;
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ss(sa{sv})tt)"));
+  for (l = authorizations; l != NULL; l = l->next)
+    {
+      PolkitTemporaryAuthorization *a = POLKIT_TEMPORARY_AUTHORIZATION (l->data);
+      g_variant_builder_add_value (&builder,
+                                   polkit_temporary_authorization_to_gvariant (a)); /* A floating value */
+    }
+  g_list_foreach (authorizations, (GFunc) g_object_unref, NULL);
+  g_list_free (authorizations);
+
+  return g_variant_builder_end (&builder);
+}
+
 /**
  * polkit_backend_authority_revoke_temporary_authorizations:
  * @authority: A #PolkitBackendAuthority.
@@ -497,8 +661,116 @@ polkit_backend_authority_revoke_temporary_authorization_by_id (PolkitBackendAuth
     }
 }
 
+/**
+ * polkit_backend_authority_get_memory_usage:
+ * @authority: A #PolkitBackendAuthority.
+ *
+ * Gets the approximate memory used by the long-lived structures of
+ * @authority, e.g. registered actions, authentication agents and
+ * temporary authorizations. This is intended for debugging.
+ *
+ * Returns: A #GVariant of type <literal>a{s(tt)}</literal> mapping
+ * the name of each structure to its number of entries and its size in
+ * bytes. Free with g_variant_unref().
+ *
+ * Since: 127
+ **/
+GVariant *
+polkit_backend_authority_get_memory_usage (PolkitBackendAuthority *authority)
+{
+  PolkitBackendAuthorityClass *klass;
+  GVariantBuilder builder;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_AUTHORITY (authority), NULL);
+
+  klass = POLKIT_BACKEND_AUTHORITY_GET_CLASS (authority);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(tt)}"));
+  if (klass->add_memory_usage != NULL)
+    klass->add_memory_usage (authority, &builder);
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+/**
+ * polkit_backend_authority_get_statistics:
+ * @authority: A #PolkitBackendAuthority.
+ *
+ * Gets counters describing the work done by @authority since it was
+ * created, e.g. how many authorization checks were cancelled before
+ * the rules were run. This is intended for debugging.
+ *
+ * Returns: A #GVariant of type <literal>a{st}</literal> mapping the
+ * name of each counter to its value. Free with g_variant_unref().
+ *
+ * Since: 127
+ **/
+GVariant *
+polkit_backend_authority_get_statistics (PolkitBackendAuthority *authority)
+{
+  PolkitBackendAuthorityClass *klass;
+  GVariantBuilder builder;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_AUTHORITY (authority), NULL);
+
+  klass = POLKIT_BACKEND_AUTHORITY_GET_CLASS (authority);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+  if (klass->add_statistics != NULL)
+    klass->add_statistics (authority, &builder);
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+/**
+ * polkit_backend_authority_get_implicit_authorizations:
+ * @authority: A #PolkitBackendAuthority.
+ *
+ * Gets, for every registered action, what
+ * polkit_backend_authority_check_authorization() would decide for a
+ * subject without a session, in an inactive local session and in an
+ * active local session, as long as no details are passed and the
+ * decision does not involve authentication. Decisions that depend on
+ * anything else are %POLKIT_IMPLICIT_SNAPSHOT_ASK_AUTHORITY.
+ *
+ * The result is only valid until @authority emits the
+ * #PolkitBackendAuthority::changed signal.
+ *
+ * Returns: A #GVariant of type <literal>a(syyy)</literal> with the
+ * action id and #PolkitImplicitSnapshotDecision values for the three
+ * cases, or %NULL if @authority doesn't support the operation. Free
+ * with g_variant_unref().
+ *
+ * Since: 127
+ **/
+GVariant *
+polkit_backend_authority_get_implicit_authorizations (PolkitBackendAuthority *authority)
+{
+  PolkitBackendAuthorityClass *klass;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_AUTHORITY (authority), NULL);
+
+  klass = POLKIT_BACKEND_AUTHORITY_GET_CLASS (authority);
+
+  if (klass->get_implicit_authorizations == NULL)
+    return NULL;
+
+  return klass->get_implicit_authorizations (authority);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Method calls are dispatched in the order of these classes, see
+ * server_schedule_method_call()
+ */
+typedef enum
+{
+  SERVER_CALL_CLASS_PRIORITY,
+  SERVER_CALL_CLASS_DEFAULT,
+  SERVER_CALL_CLASS_BULK,
+  SERVER_NUM_CALL_CLASSES
+} ServerCallClass;
+
 typedef struct
 {
   guint authority_registration_id;
@@ -516,13 +788,89 @@ typedef struct
 
   gchar *object_path;
 
+  /* on peer connections, which have no bus names, the process at the
+   * other end; it is the caller of every method call
+   */
+  PolkitSubject *peer_caller;
+  /* on peer connections, the CheckAuthData of every pending check, so
+   * that checks, and the authentications they started, are cancelled
+   * when the peer goes away
+   */
+  GHashTable *peer_checks;
+
+  /* also looked up from the GDBus worker thread, see server_filter_func() */
+  GMutex cancellation_lock;
   GHashTable *cancellation_id_to_check_auth_data;
+  guint filter_id;
+
+  /* the memfd handed out by GetImplicitAuthorizations(), see
+   * polkitimplicitsnapshot.h; built on demand and dropped when the
+   * authority changes
+   */
+  gint snapshot_fd;
+  PolkitImplicitSnapshotHeader *snapshot_header;
+  gsize snapshot_size;
+  guint32 snapshot_generation;
+
+  /* see polkit_backend_authority_set_scheduling() */
+  gboolean scheduling;
+  guint max_queued_calls;
+  GHashTable *priority_uids;
+  /* of ServerNameWatch* */
+  GPtrArray *priority_name_watches;
+  /* maps from unique bus name to ServerCaller* */
+  GHashTable *callers;
+  guint name_owner_changed_id;
+  GCancellable *cancellable;
+  GQueue queued_calls[SERVER_NUM_CALL_CLASSES];
+  guint dispatch_source_id;
+  guint64 num_calls_rejected;
+  guint64 max_calls_queued;
 } Server;
 
+typedef struct
+{
+  gchar *name;
+  /* %FALSE while we ask the bus for the uid */
+  gboolean resolved;
+  gboolean has_priority_uid;
+  /* calls that arrived before the caller was resolved */
+  GQueue unresolved_calls;
+} ServerCaller;
+
+typedef struct
+{
+  guint watch_id;
+  gchar *owner;
+} ServerNameWatch;
+
+static void server_free_scheduling (Server *server);
+
+static void server_invalidate_snapshot (Server *server);
+
+/* the part of the server server_filter_func() uses */
 static void
-server_free (Server *server)
+server_free_filter_data (Server *server)
 {
   g_free (server->object_path);
+  if (server->peer_caller != NULL)
+    g_object_unref (server->peer_caller);
+
+  if (server->cancellation_id_to_check_auth_data != NULL)
+    g_hash_table_unref (server->cancellation_id_to_check_auth_data);
+  g_mutex_clear (&server->cancellation_lock);
+
+  g_free (server);
+}
+
+static void server_cancel_peer_checks (Server *server);
+
+static void
+server_free (Server *server)
+{
+  server_invalidate_snapshot (server);
+  server_free_scheduling (server);
+  server_cancel_peer_checks (server);
 
   if (server->authority_registration_id > 0)
     g_dbus_connection_unregister_object (server->connection, server->authority_registration_id);
@@ -530,9 +878,6 @@ server_free (Server *server)
   if (server->log_control_registration_id > 0)
     g_dbus_connection_unregister_object (server->connection, server->log_control_registration_id);
 
-  if (server->connection != NULL)
-    g_object_unref (server->connection);
-
   if (server->introspection_info != NULL)
     g_dbus_node_info_unref (server->introspection_info);
 
@@ -542,12 +887,22 @@ server_free (Server *server)
   if (server->authority != NULL && server->authority_session_monitor_signaller > 0)
     g_signal_handler_disconnect (server->authority, server->authority_session_monitor_signaller);
 
-  if (server->cancellation_id_to_check_auth_data != NULL)
-    g_hash_table_unref (server->cancellation_id_to_check_auth_data);
-
   g_object_unref (server->authority);
 
-  g_free (server);
+  /* the filter may still be running on the worker thread, so the rest
+   * is freed by the destroy notify passed to g_dbus_connection_add_filter()
+   */
+  if (server->filter_id > 0)
+    {
+      g_dbus_connection_remove_filter (server->connection, server->filter_id);
+      g_object_unref (server->connection);
+    }
+  else
+    {
+      if (server->connection != NULL)
+        g_object_unref (server->connection);
+      server_free_filter_data (server);
+    }
 }
 
 static void changed_dbus_call_handler(PolkitBackendAuthority *authority,
@@ -579,8 +934,11 @@ static void
 on_authority_changed (PolkitBackendAuthority *authority,
                       gpointer                user_data)
 {
+  Server *server = user_data;
   guint16 msg_mask;
 
+  server_invalidate_snapshot (server);
+
   msg_mask = (guint16) CHANGED_SIGNAL;
   changed_dbus_call_handler(authority, user_data, msg_mask);
 }
@@ -604,6 +962,12 @@ static const gchar *server_introspection_data =
   "      <arg type='s' name='locale' direction='in'/>"
   "      <arg type='a(ssssssuuua{ss})' name='action_descriptions' direction='out'/>"
   "    </method>"
+  "    <method name='EnumerateActionsWithOptions'>"
+  "      <arg type='s' name='locale' direction='in'/>"
+  "      <arg type='a{sv}' name='options' direction='in'/>"
+  "      <arg type='a(ssssssuuua{ss})' name='action_descriptions' direction='out'/>"
+  "      <arg type='u' name='num_matches' direction='out'/>"
+  "    </method>"
   "    <method name='CheckAuthorization'>"
   "      <arg type='(sa{sv})' name='subject' direction='in'/>"
   "      <arg type='s' name='action_id' direction='in'/>"
@@ -649,6 +1013,15 @@ static const gchar *server_introspection_data =
   "    <method name='RevokeTemporaryAuthorizationById'>"
   "      <arg type='s' name='id' direction='in'/>"
   "    </method>"
+  "    <method name='GetMemoryUsage'>"
+  "      <arg type='a{s(tt)}' name='usage' direction='out'/>"
+  "    </method>"
+  "    <method name='GetStatistics'>"
+  "      <arg type='a{st}' name='statistics' direction='out'/>"
+  "    </method>"
+  "    <method name='GetImplicitAuthorizations'>"
+  "      <arg type='h' name='snapshot' direction='out'/>"
+  "    </method>"
   "    <signal name='Changed'/>"
   "    <property type='s' name='BackendName' access='read'/>"
   "    <property type='s' name='BackendVersion' access='read'/>"
@@ -675,47 +1048,106 @@ server_handle_enumerate_actions (Server                 *server,
                                  PolkitSubject          *caller,
                                  GDBusMethodInvocation  *invocation)
 {
-  GVariantBuilder builder;
   GError *error;
-  GList *actions;
-  GList *l;
+  GVariant *actions;
   const gchar *locale;
 
-  actions = NULL;
-
   g_variant_get (parameters, "(&s)", &locale);
 
   error = NULL;
-  actions = polkit_backend_authority_enumerate_actions (server->authority,
-                                                        caller,
-                                                        locale,
-                                                        &error);
-  if (error != NULL)
+  actions = polkit_backend_authority_enumerate_actions_as_gvariant (server->authority,
+                                                                    caller,
+                                                                    locale,
+                                                                    NULL, /* id_prefix */
+                                                                    NULL, /* annotation_key */
+                                                                    NULL, /* annotation_value */
+                                                                    0,    /* offset */
+                                                                    0,    /* limit */
+                                                                    NULL, /* out_num_matches */
+                                                                    &error);
+  if (actions == NULL)
     {
       g_dbus_method_invocation_return_gerror (invocation, error);
       g_error_free (error);
-      goto out;
     }
+  else
+    {
+      g_dbus_method_invocation_return_value (invocation, g_variant_new ("(@a(ssssssuuua{ss}))", actions));
+    }
+}
 
-  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssssssuuua{ss})"));
-  for (l = actions; l != NULL; l = l->next)
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+server_handle_enumerate_actions_with_options (Server                 *server,
+                                              GVariant               *parameters,
+                                              PolkitSubject          *caller,
+                                              GDBusMethodInvocation  *invocation)
+{
+  GError *error;
+  GVariant *actions;
+  GVariant *options;
+  const gchar *locale;
+  const gchar *id_prefix;
+  const gchar *annotation_key;
+  const gchar *annotation_value;
+  guint32 offset;
+  guint32 limit;
+  guint num_matches;
+
+  g_variant_get (parameters, "(&s@a{sv})", &locale, &options);
+
+  id_prefix = NULL;
+  annotation_key = NULL;
+  annotation_value = NULL;
+  offset = 0;
+  limit = 0;
+  g_variant_lookup (options, "id-prefix", "&s", &id_prefix);
+  g_variant_lookup (options, "annotation-key", "&s", &annotation_key);
+  g_variant_lookup (options, "annotation-value", "&s", &annotation_value);
+  g_variant_lookup (options, "offset", "u", &offset);
+  g_variant_lookup (options, "limit", "u", &limit);
+
+  error = NULL;
+  actions = polkit_backend_authority_enumerate_actions_as_gvariant (server->authority,
+                                                                    caller,
+                                                                    locale,
+                                                                    id_prefix,
+                                                                    annotation_key,
+                                                                    annotation_value,
+                                                                    offset,
+                                                                    limit,
+                                                                    &num_matches,
+                                                                    &error);
+  if (actions == NULL)
     {
-      PolkitActionDescription *ad = POLKIT_ACTION_DESCRIPTION (l->data);
-      g_variant_builder_add_value (&builder,
-                                   polkit_action_description_to_gvariant (ad)); /* A floating value */
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_error_free (error);
+      goto out;
     }
-  g_dbus_method_invocation_return_value (invocation, g_variant_new ("(a(ssssssuuua{ss}))", &builder));
+
+  g_dbus_method_invocation_return_value (invocation, g_variant_new ("(@a(ssssssuuua{ss})u)", actions, num_matches));
 
  out:
-  g_list_foreach (actions, (GFunc) g_object_unref, NULL);
-  g_list_free (actions);
+  g_variant_unref (options);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Cancellation ids are scoped by the sender. Peer connections have no
+ * bus names, but each has a server of its own.
+ */
+static const gchar *
+server_get_sender (Server      *server,
+                   const gchar *sender)
+{
+  return sender != NULL ? sender : "peer";
+}
+
 typedef struct
 {
   GDBusMethodInvocation *invocation;
+  /* %NULL once the server is gone, see server_cancel_peer_checks() */
   Server *server;
   PolkitSubject *caller;
   PolkitSubject *subject;
@@ -752,8 +1184,14 @@ check_auth_cb (GObject      *source_object,
                                                                 res,
                                                                 &error);
 
-  if (data->cancellation_id != NULL)
-    g_hash_table_remove (data->server->cancellation_id_to_check_auth_data, data->cancellation_id);
+  if (data->server != NULL && data->cancellation_id != NULL)
+    {
+      g_mutex_lock (&data->server->cancellation_lock);
+      g_hash_table_remove (data->server->cancellation_id_to_check_auth_data, data->cancellation_id);
+      g_mutex_unlock (&data->server->cancellation_lock);
+    }
+  if (data->server != NULL && data->server->peer_checks != NULL)
+    g_hash_table_remove (data->server->peer_checks, data);
 
   if (error != NULL)
     {
@@ -820,14 +1258,16 @@ server_handle_check_authorization (Server                 *server,
   if (strlen (cancellation_id) > 0)
     {
       data->cancellation_id = g_strdup_printf ("%s-%s",
-                                               g_dbus_method_invocation_get_sender (invocation),
+                                               server_get_sender (server, g_dbus_method_invocation_get_sender (invocation)),
                                                cancellation_id);
+      g_mutex_lock (&server->cancellation_lock);
       if (g_hash_table_lookup (server->cancellation_id_to_check_auth_data, data->cancellation_id) != NULL)
         {
+          g_mutex_unlock (&server->cancellation_lock);
           gchar *message;
           message = g_strdup_printf ("Given cancellation_id %s is already in use for name %s",
                                      cancellation_id,
-                                     g_dbus_method_invocation_get_sender (invocation));
+                                     server_get_sender (server, g_dbus_method_invocation_get_sender (invocation)));
           /* Don't want this error in our GError enum since libpolkit-gobject-1 users will never see it */
           g_dbus_method_invocation_return_dbus_error (invocation,
                                                       "org.freedesktop.PolicyKit1.Error.CancellationIdNotUnique",
@@ -841,6 +1281,14 @@ server_handle_check_authorization (Server                 *server,
       g_hash_table_insert (server->cancellation_id_to_check_auth_data,
                            data->cancellation_id,
                            data);
+      g_mutex_unlock (&server->cancellation_lock);
+    }
+
+  if (server->peer_checks != NULL)
+    {
+      if (data->cancellable == NULL)
+        data->cancellable = g_cancellable_new ();
+      g_hash_table_add (server->peer_checks, data);
     }
 
   polkit_backend_authority_check_authorization (server->authority,
@@ -864,46 +1312,142 @@ server_handle_check_authorization (Server                 *server,
     g_object_unref (subject);
 }
 
+/* Cancels the pending checks of a peer connection that is going away.
+ * They are still answered by check_auth_cb(), which must then leave
+ * the server alone.
+ */
+static void
+server_cancel_peer_checks (Server *server)
+{
+  GList *checks;
+  GList *l;
+
+  if (server->peer_checks == NULL)
+    return;
+
+  /* no CancelCheckAuthorization() can find them any more */
+  g_mutex_lock (&server->cancellation_lock);
+  g_hash_table_remove_all (server->cancellation_id_to_check_auth_data);
+  g_mutex_unlock (&server->cancellation_lock);
+
+  checks = g_hash_table_get_keys (server->peer_checks);
+  g_clear_pointer (&server->peer_checks, g_hash_table_unref);
+  for (l = checks; l != NULL; l = l->next)
+    {
+      CheckAuthData *data = l->data;
+
+      data->server = NULL;
+      g_cancellable_cancel (data->cancellable);
+    }
+  g_list_free (checks);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Returns a reference to the #GCancellable of the pending check, or
+ * %NULL. Safe to call from any thread.
+ */
+static GCancellable *
+server_lookup_cancellable (Server      *server,
+                           const gchar *sender,
+                           const gchar *cancellation_id)
+{
+  CheckAuthData *data;
+  GCancellable *cancellable;
+  gchar *full_cancellation_id;
+
+  cancellable = NULL;
+  full_cancellation_id = g_strdup_printf ("%s-%s", sender, cancellation_id);
+
+  g_mutex_lock (&server->cancellation_lock);
+  data = g_hash_table_lookup (server->cancellation_id_to_check_auth_data, full_cancellation_id);
+  if (data != NULL)
+    cancellable = g_object_ref (data->cancellable);
+  g_mutex_unlock (&server->cancellation_lock);
+
+  g_free (full_cancellation_id);
+  return cancellable;
+}
+
 static void
 server_handle_cancel_check_authorization (Server                 *server,
                                           GVariant               *parameters,
                                           PolkitSubject          *caller,
                                           GDBusMethodInvocation  *invocation)
 {
-  CheckAuthData *data;
+  GCancellable *cancellable;
   const gchar *cancellation_id;
-  gchar *full_cancellation_id;
 
   g_variant_get (parameters, "(&s)", &cancellation_id);
 
-  full_cancellation_id = g_strdup_printf ("%s-%s",
-                                          g_dbus_method_invocation_get_sender (invocation),
-                                          cancellation_id);
-
-  data = g_hash_table_lookup (server->cancellation_id_to_check_auth_data, full_cancellation_id);
-  if (data == NULL)
+  cancellable = server_lookup_cancellable (server,
+                                           server_get_sender (server, g_dbus_method_invocation_get_sender (invocation)),
+                                           cancellation_id);
+  if (cancellable == NULL)
     {
       g_dbus_method_invocation_return_error (invocation,
                                              POLKIT_ERROR,
                                              POLKIT_ERROR_FAILED,
                                              "No such cancellation_id `%s' for name %s",
                                              cancellation_id,
-                                             g_dbus_method_invocation_get_sender (invocation));
-      goto out;
+                                             server_get_sender (server, g_dbus_method_invocation_get_sender (invocation)));
+      return;
     }
 
-  g_cancellable_cancel (data->cancellable);
+  /* usually already done by server_filter_func() */
+  g_cancellable_cancel (cancellable);
+  g_object_unref (cancellable);
 
   g_dbus_method_invocation_return_value (invocation, g_variant_new ("()"));
-
- out:
-  g_free (full_cancellation_id);
 }
 
-/* ---------------------------------------------------------------------------------------------------- */
-
+/* Method calls are dispatched on the main loop, which is blocked while
+ * a check runs the rules or waits for polkit.spawn(), so a
+ * CancelCheckAuthorization() call queued behind it would only be seen
+ * once the work it was meant to stop is done. Filters run on the GDBus
+ * worker thread as messages arrive, so the cancellable is cancelled
+ * from here as well; everything connected to it must cope with that.
+ * The message is still dispatched as usual so the caller gets a reply.
+ */
+static GDBusMessage *
+server_filter_func (GDBusConnection *connection,
+                    GDBusMessage    *message,
+                    gboolean         incoming,
+                    gpointer         user_data)
+{
+  Server *server = user_data;
+  GCancellable *cancellable;
+  const gchar *cancellation_id;
+  GVariant *body;
+
+  if (!incoming ||
+      g_dbus_message_get_message_type (message) != G_DBUS_MESSAGE_TYPE_METHOD_CALL ||
+      g_strcmp0 (g_dbus_message_get_member (message), "CancelCheckAuthorization") != 0 ||
+      g_strcmp0 (g_dbus_message_get_interface (message), "org.freedesktop.PolicyKit1.Authority") != 0 ||
+      g_strcmp0 (g_dbus_message_get_path (message), server->object_path) != 0 ||
+      (server->peer_caller == NULL && g_dbus_message_get_sender (message) == NULL))
+    goto out;
+
+  body = g_dbus_message_get_body (message);
+  if (body == NULL || !g_variant_is_of_type (body, G_VARIANT_TYPE ("(s)")))
+    goto out;
+
+  g_variant_get (body, "(&s)", &cancellation_id);
+  cancellable = server_lookup_cancellable (server,
+                                           server_get_sender (server, g_dbus_message_get_sender (message)),
+                                           cancellation_id);
+  if (cancellable != NULL)
+    {
+      g_cancellable_cancel (cancellable);
+      g_object_unref (cancellable);
+    }
+
+ out:
+  return message;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static void
 server_handle_register_authentication_agent (Server                 *server,
                                              GVariant               *parameters,
@@ -1177,9 +1721,7 @@ server_handle_enumerate_temporary_authorizations (Server                 *server
   GVariant *subject_gvariant;
   GError *error;
   PolkitSubject *subject;
-  GList *authorizations;
-  GList *l;
-  GVariantBuilder builder;
+  GVariant *authorizations;
 
   subject = NULL;
 
@@ -1198,27 +1740,18 @@ server_handle_enumerate_temporary_authorizations (Server                 *server
     }
 
   error = NULL;
-  authorizations = polkit_backend_authority_enumerate_temporary_authorizations (server->authority,
-                                                                                caller,
-                                                                                subject,
-                                                                                &error);
-  if (error != NULL)
+  authorizations = polkit_backend_authority_enumerate_temporary_authorizations_as_gvariant (server->authority,
+                                                                                            caller,
+                                                                                            subject,
+                                                                                            &error);
+  if (authorizations == NULL)
     {
       g_dbus_method_invocation_return_gerror (invocation, error);
       g_error_free (error);
       goto out;
     }
 
-  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ss(sa{sv})tt)"));
-  for (l = authorizations; l != NULL; l = l->next)
-    {
-      PolkitTemporaryAuthorization *a = POLKIT_TEMPORARY_AUTHORIZATION (l->data);
-      g_variant_builder_add_value (&builder,
-                                   polkit_temporary_authorization_to_gvariant (a)); /* A floating value */
-    }
-  g_list_foreach (authorizations, (GFunc) g_object_unref, NULL);
-  g_list_free (authorizations);
-  g_dbus_method_invocation_return_value (invocation, g_variant_new ("(a(ss(sa{sv})tt))", &builder));
+  g_dbus_method_invocation_return_value (invocation, g_variant_new ("(@a(ss(sa{sv})tt))", authorizations));
 
  out:
   g_variant_unref (subject_gvariant);
@@ -1307,23 +1840,405 @@ server_handle_revoke_temporary_authorization_by_id (Server                 *serv
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static gboolean
+check_caller_is_root (PolkitSubject  *caller,
+                      GError        **error)
+{
+  PolkitUnixUser *user_of_caller;
+  gint uid;
+
+  /* on peer connections, the uid is the one the kernel vouched for */
+  if (POLKIT_IS_UNIX_PROCESS (caller))
+    {
+      uid = polkit_unix_process_get_uid (POLKIT_UNIX_PROCESS (caller));
+    }
+  else if (POLKIT_IS_SYSTEM_BUS_NAME (caller))
+    {
+      GError *local_error = NULL;
+
+      user_of_caller = polkit_system_bus_name_get_user_sync (POLKIT_SYSTEM_BUS_NAME (caller), NULL, &local_error);
+      if (user_of_caller == NULL)
+        {
+          if (local_error == NULL)
+            g_set_error (&local_error,
+                         POLKIT_ERROR,
+                         POLKIT_ERROR_FAILED,
+                         "Cannot determine the user of the caller");
+          g_propagate_error (error, local_error);
+          return FALSE;
+        }
+      uid = polkit_unix_user_get_uid (user_of_caller);
+      g_object_unref (user_of_caller);
+    }
+  else
+    {
+      uid = -1;
+    }
+
+  if (uid != 0)
+    {
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_NOT_AUTHORIZED,
+                   "Only uid 0 may use this method");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
 static void
-server_handle_method_call (GDBusConnection        *connection,
-                           const gchar            *sender,
-                           const gchar            *object_path,
-                           const gchar            *interface_name,
-                           const gchar            *method_name,
-                           GVariant               *parameters,
-                           GDBusMethodInvocation  *invocation,
-                           gpointer                user_data)
+server_handle_get_memory_usage (Server                 *server,
+                                GVariant               *parameters,
+                                PolkitSubject          *caller,
+                                GDBusMethodInvocation  *invocation)
 {
-  Server *server = user_data;
+  GVariantBuilder builder;
+  GVariantIter iter;
+  GVariant *usage;
+  GVariant *entry;
+  GError *error;
+
+  usage = NULL;
+
+  /* this is a debugging aid, only root gets to look */
+  error = NULL;
+  if (!check_caller_is_root (caller, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_error_free (error);
+      goto out;
+    }
+
+  usage = polkit_backend_authority_get_memory_usage (server->authority);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(tt)}"));
+  g_variant_iter_init (&iter, usage);
+  while ((entry = g_variant_iter_next_value (&iter)) != NULL)
+    {
+      g_variant_builder_add_value (&builder, entry);
+      g_variant_unref (entry);
+    }
+  /* the hash table has one node (hash, key, value) per pending check */
+  g_variant_builder_add (&builder, "{s(tt)}",
+                         "cancellation-ids",
+                         (guint64) g_hash_table_size (server->cancellation_id_to_check_auth_data),
+                         (guint64) g_hash_table_size (server->cancellation_id_to_check_auth_data) * (sizeof (guint) + 2 * sizeof (gpointer)));
+
+  g_dbus_method_invocation_return_value (invocation, g_variant_new ("(a{s(tt)})", &builder));
+
+ out:
+  if (usage != NULL)
+    g_variant_unref (usage);
+}
+
+static void
+server_handle_get_statistics (Server                 *server,
+                              GVariant               *parameters,
+                              PolkitSubject          *caller,
+                              GDBusMethodInvocation  *invocation)
+{
+  GVariant *statistics;
+  GError *error;
+
+  /* this is a debugging aid, only root gets to look */
+  error = NULL;
+  if (!check_caller_is_root (caller, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_error_free (error);
+      return;
+    }
+
+  statistics = polkit_backend_authority_get_statistics (server->authority);
+  if (server->scheduling)
+    {
+      GVariantBuilder builder;
+      GVariantIter iter;
+      const gchar *key;
+      guint64 value;
+
+      g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+      g_variant_iter_init (&iter, statistics);
+      while (g_variant_iter_next (&iter, "{&st}", &key, &value))
+        g_variant_builder_add (&builder, "{st}", key, value);
+      /* see server_schedule_method_call() */
+      g_variant_builder_add (&builder, "{st}", "calls-rejected", server->num_calls_rejected);
+      g_variant_builder_add (&builder, "{st}", "calls-queued-max", server->max_calls_queued);
+      g_variant_unref (statistics);
+      statistics = g_variant_ref_sink (g_variant_builder_end (&builder));
+    }
+  g_dbus_method_invocation_return_value (invocation, g_variant_new ("(@a{st})", statistics));
+  g_variant_unref (statistics);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  const gchar *action_id;
+  guint8 any;
+  guint8 inactive;
+  guint8 active;
+} SnapshotAction;
+
+static gint
+snapshot_action_cmp (gconstpointer a,
+                     gconstpointer b)
+{
+  return strcmp (((const SnapshotAction *) a)->action_id, ((const SnapshotAction *) b)->action_id);
+}
+
+static void
+server_invalidate_snapshot (Server *server)
+{
+  if (server->snapshot_header == NULL)
+    return;
+
+  /* tells clients holding the old snapshot to ask again */
+  g_atomic_int_set (&server->snapshot_header->current_generation, (gint) server->snapshot_generation + 1);
+
+  munmap (server->snapshot_header, server->snapshot_size);
+  close (server->snapshot_fd);
+  server->snapshot_header = NULL;
+  server->snapshot_size = 0;
+  server->snapshot_fd = -1;
+}
+
+/* Writes @decisions, of type a(syyy) as returned by
+ * polkit_backend_authority_get_implicit_authorizations(), into a
+ * sealed memfd laid out as described in polkitimplicitsnapshot.h.
+ *
+ * Returns the memfd, or -1 if @error is set. @out_header is a writable
+ * mapping of its @out_size bytes, to be unmapped by the caller.
+ */
+gint
+_polkit_backend_implicit_snapshot_new (GVariant                      *decisions,
+                                       guint32                        generation,
+                                       PolkitImplicitSnapshotHeader **out_header,
+                                       gsize                         *out_size,
+                                       GError                       **error)
+{
+#if defined(HAVE_MEMFD_CREATE) && defined(F_SEAL_FUTURE_WRITE)
+  PolkitImplicitSnapshotHeader *header;
+  PolkitImplicitSnapshotEntry *entries;
+  SnapshotAction *actions;
+  GVariantIter iter;
+  gsize num_actions;
+  gsize size;
+  gsize offset;
+  gpointer data;
+  gint ret;
+  gint fd;
+  guint n;
+
+  ret = -1;
+  fd = -1;
+
+  num_actions = g_variant_n_children (decisions);
+  actions = g_new (SnapshotAction, num_actions);
+  size = sizeof (PolkitImplicitSnapshotHeader) + num_actions * sizeof (PolkitImplicitSnapshotEntry);
+  g_variant_iter_init (&iter, decisions);
+  for (n = 0; n < num_actions; n++)
+    {
+      g_variant_iter_next (&iter, "(&syyy)",
+                           &actions[n].action_id,
+                           &actions[n].any,
+                           &actions[n].inactive,
+                           &actions[n].active);
+      size += strlen (actions[n].action_id) + 1;
+    }
+  /* so the last byte is NUL even without actions */
+  size += 1;
+  qsort (actions, num_actions, sizeof (SnapshotAction), snapshot_action_cmp);
+
+  fd = memfd_create ("polkit-implicit-authorizations", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0 || ftruncate (fd, size) != 0)
+    {
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_FAILED,
+                   "Error creating implicit authorization snapshot: %m");
+      goto out;
+    }
+
+  data = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED)
+    {
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_FAILED,
+                   "Error mapping implicit authorization snapshot: %m");
+      goto out;
+    }
+
+  header = data;
+  header->magic = POLKIT_IMPLICIT_SNAPSHOT_MAGIC;
+  header->version = POLKIT_IMPLICIT_SNAPSHOT_VERSION;
+  header->size = size;
+  header->num_actions = num_actions;
+  header->pid = getpid ();
+  header->generation = generation;
+  header->current_generation = (gint) generation;
+
+  entries = (PolkitImplicitSnapshotEntry *) (header + 1);
+  offset = sizeof (PolkitImplicitSnapshotHeader) + num_actions * sizeof (PolkitImplicitSnapshotEntry);
+  for (n = 0; n < num_actions; n++)
+    {
+      gsize len = strlen (actions[n].action_id) + 1;
+
+      entries[n].action_id_offset = offset;
+      entries[n].any = actions[n].any;
+      entries[n].inactive = actions[n].inactive;
+      entries[n].active = actions[n].active;
+      memcpy ((guint8 *) data + offset, actions[n].action_id, len);
+      offset += len;
+    }
+
+  /* our mapping stays writable so the header can be updated later,
+   * but nobody can write to it from now on
+   */
+  if (fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) != 0)
+    {
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_NOT_SUPPORTED,
+                   "Error sealing implicit authorization snapshot: %m");
+      munmap (data, size);
+      goto out;
+    }
+
+  *out_header = header;
+  *out_size = size;
+  ret = fd;
+  fd = -1;
+
+ out:
+  if (fd >= 0)
+    close (fd);
+  g_free (actions);
+  return ret;
+#else
+  g_set_error (error,
+               POLKIT_ERROR,
+               POLKIT_ERROR_NOT_SUPPORTED,
+               "Operation not supported");
+  return -1;
+#endif
+}
+
+static gboolean
+server_ensure_snapshot (Server  *server,
+                        GError **error)
+{
+  GVariant *decisions;
+  gint fd;
+
+  if (server->snapshot_header != NULL)
+    return TRUE;
+
+  decisions = polkit_backend_authority_get_implicit_authorizations (server->authority);
+  if (decisions == NULL)
+    {
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_NOT_SUPPORTED,
+                   "Operation not supported");
+      return FALSE;
+    }
+
+  fd = _polkit_backend_implicit_snapshot_new (decisions,
+                                              server->snapshot_generation + 1,
+                                              &server->snapshot_header,
+                                              &server->snapshot_size,
+                                              error);
+  g_variant_unref (decisions);
+  if (fd < 0)
+    return FALSE;
+
+  server->snapshot_generation++;
+  server->snapshot_fd = fd;
+  return TRUE;
+}
+
+static void
+server_handle_get_implicit_authorizations (Server                 *server,
+                                           GVariant               *parameters,
+                                           PolkitSubject          *caller,
+                                           GDBusMethodInvocation  *invocation)
+{
+  GUnixFDList *fd_list;
+  GError *error;
+  gint idx;
+
+  fd_list = NULL;
+
+  /* the snapshot reveals which actions have temporary authorizations,
+   * and only trusted callers may check other users anyway
+   */
+  error = NULL;
+  if (!check_caller_is_root (caller, &error) ||
+      !server_ensure_snapshot (server, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_error_free (error);
+      goto out;
+    }
+
+  fd_list = g_unix_fd_list_new ();
+  idx = g_unix_fd_list_append (fd_list, server->snapshot_fd, &error);
+  if (idx < 0)
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_error_free (error);
+      goto out;
+    }
+
+  g_dbus_method_invocation_return_value_with_unix_fd_list (invocation,
+                                                           g_variant_new ("(h)", idx),
+                                                           fd_list);
+
+ out:
+  if (fd_list != NULL)
+    g_object_unref (fd_list);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+server_dispatch_method_call (Server                 *server,
+                             GDBusMethodInvocation  *invocation)
+{
+  const gchar *method_name;
+  GVariant *parameters;
   PolkitSubject *caller;
 
-  caller = polkit_system_bus_name_new (g_dbus_method_invocation_get_sender (invocation));
+  method_name = g_dbus_method_invocation_get_method_name (invocation);
+  parameters = g_dbus_method_invocation_get_parameters (invocation);
+  if (server->peer_caller != NULL)
+    {
+      /* agents are tracked, and talked to, by their bus names */
+      if (g_str_has_prefix (method_name, "RegisterAuthenticationAgent") ||
+          g_strcmp0 (method_name, "UnregisterAuthenticationAgent") == 0)
+        {
+          g_dbus_method_invocation_return_error (invocation,
+                                                 POLKIT_ERROR,
+                                                 POLKIT_ERROR_NOT_SUPPORTED,
+                                                 "%s() is only available on the system bus",
+                                                 method_name);
+          return;
+        }
+      caller = g_object_ref (server->peer_caller);
+    }
+  else
+    {
+      caller = polkit_system_bus_name_new (g_dbus_method_invocation_get_sender (invocation));
+    }
 
   if (g_strcmp0 (method_name, "EnumerateActions") == 0)
     server_handle_enumerate_actions (server, parameters, caller, invocation);
+  else if (g_strcmp0 (method_name, "EnumerateActionsWithOptions") == 0)
+    server_handle_enumerate_actions_with_options (server, parameters, caller, invocation);
   else if (g_strcmp0 (method_name, "CheckAuthorization") == 0)
     server_handle_check_authorization (server, parameters, caller, invocation);
   else if (g_strcmp0 (method_name, "CancelCheckAuthorization") == 0)
@@ -1344,12 +2259,340 @@ server_handle_method_call (GDBusConnection        *connection,
     server_handle_revoke_temporary_authorizations (server, parameters, caller, invocation);
   else if (g_strcmp0 (method_name, "RevokeTemporaryAuthorizationById") == 0)
     server_handle_revoke_temporary_authorization_by_id (server, parameters, caller, invocation);
+  else if (g_strcmp0 (method_name, "GetMemoryUsage") == 0)
+    server_handle_get_memory_usage (server, parameters, caller, invocation);
+  else if (g_strcmp0 (method_name, "GetStatistics") == 0)
+    server_handle_get_statistics (server, parameters, caller, invocation);
+  else if (g_strcmp0 (method_name, "GetImplicitAuthorizations") == 0)
+    server_handle_get_implicit_authorizations (server, parameters, caller, invocation);
   else
     g_assert_not_reached ();
 
   g_object_unref (caller);
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Once polkit_backend_authority_set_scheduling() has been called,
+ * method calls are not dispatched in the order they arrive. Calls
+ * from priority callers, e.g. checks from logind, go first, and
+ * calls that are expensive to answer and not latency-critical, like
+ * EnumerateActions(), go last. Calls of the same class and caller are
+ * still answered in order; in particular CancelCheckAuthorization()
+ * never overtakes the check it cancels.
+ *
+ * Calls are queued as they arrive and dispatched one per main loop
+ * iteration, taking turns with the arriving calls, so a call that came
+ * in while the main loop was blocked, for example by a rules
+ * evaluation, competes with everything else that came in meanwhile.
+ */
+
+static ServerCallClass
+server_get_call_class (Server                *server,
+                       ServerCaller          *caller,
+                       GDBusMethodInvocation *invocation)
+{
+  const gchar *method_name;
+  guint n;
+
+  method_name = g_dbus_method_invocation_get_method_name (invocation);
+  if (g_strcmp0 (method_name, "EnumerateActions") == 0 ||
+      g_strcmp0 (method_name, "EnumerateActionsWithOptions") == 0 ||
+      g_strcmp0 (method_name, "EnumerateTemporaryAuthorizations") == 0)
+    return SERVER_CALL_CLASS_BULK;
+
+  if (caller->has_priority_uid)
+    return SERVER_CALL_CLASS_PRIORITY;
+
+  for (n = 0; n < server->priority_name_watches->len; n++)
+    {
+      ServerNameWatch *watch = g_ptr_array_index (server->priority_name_watches, n);
+      if (g_strcmp0 (watch->owner, caller->name) == 0)
+        return SERVER_CALL_CLASS_PRIORITY;
+    }
+
+  return SERVER_CALL_CLASS_DEFAULT;
+}
+
+static gboolean
+server_dispatch_queued_call (gpointer user_data)
+{
+  Server *server = user_data;
+  GDBusMethodInvocation *invocation;
+  guint n;
+
+  for (n = 0; n < SERVER_NUM_CALL_CLASSES; n++)
+    {
+      invocation = g_queue_pop_head (&server->queued_calls[n]);
+      if (invocation != NULL)
+        {
+          server_dispatch_method_call (server, invocation);
+          g_object_unref (invocation);
+          return G_SOURCE_CONTINUE;
+        }
+    }
+
+  server->dispatch_source_id = 0;
+  return G_SOURCE_REMOVE;
+}
+
+/* Takes ownership of @invocation */
+static void
+server_queue_call (Server                *server,
+                   ServerCaller          *caller,
+                   GDBusMethodInvocation *invocation)
+{
+  GQueue *queue;
+  guint num_queued;
+  guint n;
+
+  queue = &server->queued_calls[server_get_call_class (server, caller, invocation)];
+  if (server->max_queued_calls > 0 && g_queue_get_length (queue) >= server->max_queued_calls)
+    {
+      server->num_calls_rejected++;
+      g_dbus_method_invocation_return_error (invocation,
+                                             POLKIT_ERROR,
+                                             POLKIT_ERROR_FAILED,
+                                             "Too many requests are queued, try again later");
+      return;
+    }
+  g_queue_push_tail (queue, invocation);
+
+  num_queued = 0;
+  for (n = 0; n < SERVER_NUM_CALL_CLASSES; n++)
+    num_queued += g_queue_get_length (&server->queued_calls[n]);
+  server->max_calls_queued = MAX (server->max_calls_queued, num_queued);
+
+  /* at the priority incoming calls are handled at, so that a steady
+   * stream of them can't starve the queue
+   */
+  if (server->dispatch_source_id == 0)
+    server->dispatch_source_id = g_idle_add_full (G_PRIORITY_DEFAULT, server_dispatch_queued_call, server, NULL);
+}
+
+static void
+server_caller_free (ServerCaller *caller)
+{
+  GDBusMethodInvocation *invocation;
+
+  /* only left over if the caller went away while we asked for its uid */
+  while ((invocation = g_queue_pop_head (&caller->unresolved_calls)) != NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             POLKIT_ERROR,
+                                             POLKIT_ERROR_FAILED,
+                                             "Caller disconnected");
+    }
+  g_free (caller->name);
+  g_free (caller);
+}
+
+typedef struct
+{
+  Server *server;
+  gchar *name;
+} ServerCallerLookup;
+
+static void
+on_caller_uid (GObject      *source_object,
+               GAsyncResult *res,
+               gpointer      user_data)
+{
+  ServerCallerLookup *lookup = user_data;
+  Server *server;
+  ServerCaller *caller;
+  GDBusMethodInvocation *invocation;
+  GVariant *value;
+  GError *error;
+  const gchar *name;
+  guint32 uid;
+
+  error = NULL;
+  value = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+
+  /* don't touch the server if it is gone */
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    goto out;
+
+  server = lookup->server;
+  name = lookup->name;
+  caller = g_hash_table_lookup (server->callers, name);
+  if (caller == NULL)
+    goto out;
+
+  if (value != NULL)
+    {
+      g_variant_get (value, "(u)", &uid);
+      caller->has_priority_uid = g_hash_table_contains (server->priority_uids, GUINT_TO_POINTER (uid));
+    }
+  else
+    {
+      g_debug ("Error getting uid of %s: %s", name, error->message);
+    }
+  caller->resolved = TRUE;
+
+  while ((invocation = g_queue_pop_head (&caller->unresolved_calls)) != NULL)
+    server_queue_call (server, caller, invocation);
+
+ out:
+  if (value != NULL)
+    g_variant_unref (value);
+  if (error != NULL)
+    g_error_free (error);
+  g_free (lookup->name);
+  g_free (lookup);
+}
+
+static ServerCaller *
+server_get_caller (Server      *server,
+                   const gchar *name)
+{
+  ServerCaller *caller;
+
+  caller = g_hash_table_lookup (server->callers, name);
+  if (caller != NULL)
+    return caller;
+
+  caller = g_new0 (ServerCaller, 1);
+  caller->name = g_strdup (name);
+  g_queue_init (&caller->unresolved_calls);
+  g_hash_table_insert (server->callers, caller->name, caller);
+
+  /* unique names are never reused, so the answer is good until the caller goes away */
+  if (g_hash_table_size (server->priority_uids) > 0)
+    {
+      ServerCallerLookup *lookup;
+
+      lookup = g_new0 (ServerCallerLookup, 1);
+      lookup->server = server;
+      lookup->name = g_strdup (name);
+      g_dbus_connection_call (server->connection,
+                              "org.freedesktop.DBus",
+                              "/org/freedesktop/DBus",
+                              "org.freedesktop.DBus",
+                              "GetConnectionUnixUser",
+                              g_variant_new ("(s)", name),
+                              G_VARIANT_TYPE ("(u)"),
+                              G_DBUS_CALL_FLAGS_NONE,
+                              -1,
+                              server->cancellable,
+                              on_caller_uid,
+                              lookup);
+    }
+  else
+    {
+      caller->resolved = TRUE;
+    }
+
+  return caller;
+}
+
+static void
+on_caller_name_owner_changed (GDBusConnection *connection,
+                              const gchar     *sender_name,
+                              const gchar     *object_path,
+                              const gchar     *interface_name,
+                              const gchar     *signal_name,
+                              GVariant        *parameters,
+                              gpointer         user_data)
+{
+  Server *server = user_data;
+  const gchar *name;
+  const gchar *old_owner;
+  const gchar *new_owner;
+
+  g_variant_get (parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+  if (name[0] == ':' && new_owner[0] == '\0')
+    g_hash_table_remove (server->callers, name);
+}
+
+static void
+on_priority_name_appeared (GDBusConnection *connection,
+                           const gchar     *name,
+                           const gchar     *name_owner,
+                           gpointer         user_data)
+{
+  ServerNameWatch *watch = user_data;
+
+  g_free (watch->owner);
+  watch->owner = g_strdup (name_owner);
+}
+
+static void
+on_priority_name_vanished (GDBusConnection *connection,
+                           const gchar     *name,
+                           gpointer         user_data)
+{
+  ServerNameWatch *watch = user_data;
+
+  g_clear_pointer (&watch->owner, g_free);
+}
+
+static void
+server_name_watch_free (ServerNameWatch *watch)
+{
+  g_bus_unwatch_name (watch->watch_id);
+  g_free (watch->owner);
+  g_free (watch);
+}
+
+static void
+server_free_scheduling (Server *server)
+{
+  GDBusMethodInvocation *invocation;
+  guint n;
+
+  if (!server->scheduling)
+    return;
+
+  g_cancellable_cancel (server->cancellable);
+  g_object_unref (server->cancellable);
+
+  g_dbus_connection_signal_unsubscribe (server->connection, server->name_owner_changed_id);
+  g_ptr_array_unref (server->priority_name_watches);
+  g_hash_table_unref (server->priority_uids);
+  g_hash_table_unref (server->callers);
+
+  if (server->dispatch_source_id > 0)
+    g_source_remove (server->dispatch_source_id);
+  for (n = 0; n < SERVER_NUM_CALL_CLASSES; n++)
+    {
+      while ((invocation = g_queue_pop_head (&server->queued_calls[n])) != NULL)
+        g_object_unref (invocation);
+    }
+}
+
+static void
+server_schedule_method_call (Server                *server,
+                             GDBusMethodInvocation *invocation)
+{
+  ServerCaller *caller;
+
+  caller = server_get_caller (server, g_dbus_method_invocation_get_sender (invocation));
+  if (!caller->resolved)
+    g_queue_push_tail (&caller->unresolved_calls, g_object_ref (invocation));
+  else
+    server_queue_call (server, caller, g_object_ref (invocation));
+}
+
+static void
+server_handle_method_call (GDBusConnection        *connection,
+                           const gchar            *sender,
+                           const gchar            *object_path,
+                           const gchar            *interface_name,
+                           const gchar            *method_name,
+                           GVariant               *parameters,
+                           GDBusMethodInvocation  *invocation,
+                           gpointer                user_data)
+{
+  Server *server = user_data;
+
+  if (server->scheduling)
+    server_schedule_method_call (server, invocation);
+  else
+    server_dispatch_method_call (server, invocation);
+}
+
 static GVariant *
 server_handle_get_property (GDBusConnection  *connection,
                             const gchar      *sender,
@@ -1484,6 +2727,52 @@ polkit_backend_authority_unregister (gpointer registration_id)
   server_free (server);
 }
 
+/* The caller on a peer connection is the process that connected, as
+ * the kernel saw it when it did, rather than anything it claims.
+ */
+static PolkitSubject *
+server_new_peer_caller (GDBusConnection  *connection,
+                        GError          **error)
+{
+  GCredentials *credentials;
+  pid_t pid;
+  uid_t uid;
+
+  credentials = g_dbus_connection_get_peer_credentials (connection);
+  if (credentials == NULL)
+    {
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
+                   "Peer connection has no credentials");
+      return NULL;
+    }
+
+  uid = g_credentials_get_unix_user (credentials, error);
+  if (uid == (uid_t) -1)
+    return NULL;
+  pid = g_credentials_get_unix_pid (credentials, error);
+  if (pid == -1)
+    return NULL;
+
+#ifdef SO_PEERPIDFD
+  {
+    GIOStream *stream;
+    socklen_t len;
+    gint pidfd;
+
+    /* unlike the pid, it can't refer to another process later */
+    stream = g_dbus_connection_get_stream (connection);
+    len = sizeof pidfd;
+    if (G_IS_SOCKET_CONNECTION (stream) &&
+        getsockopt (g_socket_get_fd (g_socket_connection_get_socket (G_SOCKET_CONNECTION (stream))),
+                    SOL_SOCKET, SO_PEERPIDFD, &pidfd, &len) == 0 &&
+        len == sizeof pidfd)
+      return polkit_unix_process_new_pidfd (pidfd, uid, NULL);
+  }
+#endif
+
+  return polkit_unix_process_new_for_owner (pid, 0, uid);
+}
+
 /**
  * polkit_backend_authority_register:
  * @connection: The #GDBusConnection to register the authority on.
@@ -1493,6 +2782,11 @@ polkit_backend_authority_unregister (gpointer registration_id)
  *
  * Registers @authority on a #GDBusConnection.
  *
+ * If @connection is a peer-to-peer connection rather than a message
+ * bus connection, the process at the other end, as given by its
+ * credentials, is the caller of all method calls. Methods for
+ * authentication agents are not available on such connections.
+ *
  * Returns: A #gpointer that can be used with polkit_backend_authority_unregister() or %NULL if @error is set.
  */
 gpointer
@@ -1505,11 +2799,21 @@ polkit_backend_authority_register (PolkitBackendAuthority   *authority,
 
   server = g_new0 (Server, 1);
 
+  g_mutex_init (&server->cancellation_lock);
   server->cancellation_id_to_check_auth_data = g_hash_table_new (g_str_hash, g_str_equal);
+  server->snapshot_fd = -1;
 
   server->connection = g_object_ref (connection);
   server->object_path = g_strdup (object_path);
 
+  if (g_dbus_connection_get_unique_name (connection) == NULL)
+    {
+      server->peer_caller = server_new_peer_caller (connection, error);
+      if (server->peer_caller == NULL)
+        goto error;
+      server->peer_checks = g_hash_table_new (g_direct_hash, g_direct_equal);
+    }
+
   server->introspection_info = g_dbus_node_info_new_for_xml (server_introspection_data, error);
   if (server->introspection_info == NULL)
       goto error;
@@ -1526,16 +2830,20 @@ polkit_backend_authority_register (PolkitBackendAuthority   *authority,
       goto error;
     }
 
-  server->log_control_registration_id = g_dbus_connection_register_object (server->connection,
-                                                                           "/org/freedesktop/LogControl1",
-                                                                           g_dbus_node_info_lookup_interface (server->introspection_info, "org.freedesktop.LogControl1"),
-                                                                           &logcontrol_vtable,
-                                                                           server,
-                                                                           NULL,
-                                                                           error);
-  if (server->log_control_registration_id == 0)
+  /* the daemon is administered over the bus */
+  if (server->peer_caller == NULL)
     {
-      goto error;
+      server->log_control_registration_id = g_dbus_connection_register_object (server->connection,
+                                                                               "/org/freedesktop/LogControl1",
+                                                                               g_dbus_node_info_lookup_interface (server->introspection_info, "org.freedesktop.LogControl1"),
+                                                                               &logcontrol_vtable,
+                                                                               server,
+                                                                               NULL,
+                                                                               error);
+      if (server->log_control_registration_id == 0)
+        {
+          goto error;
+        }
     }
 
   server->authority = g_object_ref (authority);
@@ -1550,6 +2858,11 @@ polkit_backend_authority_register (PolkitBackendAuthority   *authority,
                                                                   G_CALLBACK (on_sessions_changed),
                                                                   server);
 
+  server->filter_id = g_dbus_connection_add_filter (server->connection,
+                                                    server_filter_func,
+                                                    server,
+                                                    (GDestroyNotify) server_free_filter_data);
+
   return server;
 
  error:
@@ -1557,6 +2870,355 @@ polkit_backend_authority_register (PolkitBackendAuthority   *authority,
   return NULL;
 }
 
+/**
+ * polkit_backend_authority_set_scheduling:
+ * @registration_id: A value returned by polkit_backend_authority_register().
+ * @priority_callers: (array zero-terminated=1) (nullable): Uids and bus names of callers whose method calls go first.
+ * @max_queued_calls: The most method calls of each class to keep waiting, or 0 for no limit.
+ *
+ * Makes the D-Bus interface dispatch method calls by class rather
+ * than in arrival order. Calls from @priority_callers, which are given
+ * as decimal uids or as well-known bus names, are dispatched before
+ * other calls, and calls that enumerate actions or temporary
+ * authorizations are dispatched after everything else. Calls of a
+ * class beyond @max_queued_calls fail with %POLKIT_ERROR_FAILED.
+ *
+ * May only be called once for each @registration_id.
+ *
+ * Since: 127
+ */
+void
+polkit_backend_authority_set_scheduling (gpointer             registration_id,
+                                         const gchar * const *priority_callers,
+                                         guint                max_queued_calls)
+{
+  Server *server = registration_id;
+  guint n;
+
+  g_return_if_fail (server != NULL);
+  g_return_if_fail (!server->scheduling);
+
+  server->scheduling = TRUE;
+  server->max_queued_calls = max_queued_calls;
+  server->priority_uids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  server->priority_name_watches = g_ptr_array_new_with_free_func ((GDestroyNotify) server_name_watch_free);
+  server->callers = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) server_caller_free);
+  server->cancellable = g_cancellable_new ();
+  for (n = 0; n < SERVER_NUM_CALL_CLASSES; n++)
+    g_queue_init (&server->queued_calls[n]);
+
+  for (n = 0; priority_callers != NULL && priority_callers[n] != NULL; n++)
+    {
+      const gchar *caller = priority_callers[n];
+      gchar *endp;
+      guint64 uid;
+
+      uid = g_ascii_strtoull (caller, &endp, 10);
+      if (g_ascii_isdigit (caller[0]) && *endp == '\0' && uid < G_MAXUINT32)
+        {
+          g_hash_table_add (server->priority_uids, GUINT_TO_POINTER ((guint) uid));
+        }
+      else if (g_dbus_is_name (caller) && !g_dbus_is_unique_name (caller))
+        {
+          ServerNameWatch *watch;
+
+          watch = g_new0 (ServerNameWatch, 1);
+          watch->watch_id = g_bus_watch_name_on_connection (server->connection,
+                                                            caller,
+                                                            G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                            on_priority_name_appeared,
+                                                            on_priority_name_vanished,
+                                                            watch,
+                                                            NULL);
+          g_ptr_array_add (server->priority_name_watches, watch);
+        }
+      else
+        {
+          g_warning ("Ignoring priority caller `%s', it is neither a uid nor a well-known bus name", caller);
+        }
+    }
+
+  server->name_owner_changed_id = g_dbus_connection_signal_subscribe (server->connection,
+                                                                      "org.freedesktop.DBus",   /* sender */
+                                                                      "org.freedesktop.DBus",   /* interface */
+                                                                      "NameOwnerChanged",       /* member */
+                                                                      "/org/freedesktop/DBus",  /* path */
+                                                                      NULL,                     /* arg0 */
+                                                                      G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                      on_caller_name_owner_changed,
+                                                                      server,
+                                                                      NULL);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  PolkitBackendAuthority *authority;
+  gchar *socket_path;
+  gchar *object_path;
+  /* of the socket we made, so we only ever remove that one */
+  dev_t socket_dev;
+  ino_t socket_ino;
+  GDBusServer *dbus_server;
+  /* maps from GDBusConnection* to Server* */
+  GHashTable *servers;
+  /* maps from uid to the number of connections it has open */
+  GHashTable *connections_per_uid;
+} PeerSocket;
+
+/* each connection costs a Server, so a single user can't have many */
+#define PEER_MAX_CONNECTIONS_PER_UID 64
+
+static gint
+peer_connection_get_uid (GDBusConnection *connection)
+{
+  GCredentials *credentials;
+
+  credentials = g_dbus_connection_get_peer_credentials (connection);
+  if (credentials == NULL)
+    return -1;
+  return g_credentials_get_unix_user (credentials, NULL);
+}
+
+static void
+on_peer_connection_closed (GDBusConnection *connection,
+                           gboolean         remote_peer_vanished,
+                           GError          *error,
+                           gpointer         user_data)
+{
+  PeerSocket *peer_socket = user_data;
+  gpointer key;
+  guint count;
+
+  g_signal_handlers_disconnect_by_func (connection, on_peer_connection_closed, peer_socket);
+  g_hash_table_remove (peer_socket->servers, connection);
+
+  key = GUINT_TO_POINTER (peer_connection_get_uid (connection));
+  count = GPOINTER_TO_UINT (g_hash_table_lookup (peer_socket->connections_per_uid, key));
+  if (count > 1)
+    g_hash_table_insert (peer_socket->connections_per_uid, key, GUINT_TO_POINTER (count - 1));
+  else
+    g_hash_table_remove (peer_socket->connections_per_uid, key);
+}
+
+static gboolean
+on_new_peer_connection (GDBusServer     *dbus_server,
+                        GDBusConnection *connection,
+                        gpointer         user_data)
+{
+  PeerSocket *peer_socket = user_data;
+  Server *server;
+  GError *error;
+  gint uid;
+  guint count;
+
+  uid = peer_connection_get_uid (connection);
+  if (uid == -1)
+    return FALSE;
+
+  /* returning FALSE makes the server close the connection; the client
+   * then uses the bus instead */
+  count = GPOINTER_TO_UINT (g_hash_table_lookup (peer_socket->connections_per_uid, GUINT_TO_POINTER (uid)));
+  if (count >= PEER_MAX_CONNECTIONS_PER_UID)
+    {
+      polkit_backend_authority_log (peer_socket->authority,
+                                    LOG_LEVEL_NOTICE,
+                                    "Refusing peer connection: uid %d already has %u open",
+                                    uid, count);
+      return FALSE;
+    }
+
+  error = NULL;
+  server = polkit_backend_authority_register (peer_socket->authority,
+                                              connection,
+                                              peer_socket->object_path,
+                                              &error);
+  if (server == NULL)
+    {
+      polkit_backend_authority_log (peer_socket->authority,
+                                    LOG_LEVEL_WARNING,
+                                    "Error registering authority on peer connection: %s",
+                                    error->message);
+      g_error_free (error);
+      return FALSE;
+    }
+
+  g_hash_table_insert (peer_socket->servers, connection, server);
+  g_hash_table_insert (peer_socket->connections_per_uid, GUINT_TO_POINTER (uid), GUINT_TO_POINTER (count + 1));
+  g_signal_connect (connection,
+                    "closed",
+                    G_CALLBACK (on_peer_connection_closed),
+                    peer_socket);
+
+  return TRUE;
+}
+
+/* EXTERNAL is the only mechanism that tells us who connected */
+static gboolean
+on_peer_allow_mechanism (GDBusAuthObserver *observer,
+                         const gchar       *mechanism,
+                         gpointer           user_data)
+{
+  return g_strcmp0 (mechanism, "EXTERNAL") == 0;
+}
+
+static gboolean
+on_peer_authorize_authenticated_peer (GDBusAuthObserver *observer,
+                                      GIOStream         *stream,
+                                      GCredentials      *credentials,
+                                      gpointer           user_data)
+{
+  return credentials != NULL;
+}
+
+static void
+peer_socket_free (PeerSocket *peer_socket)
+{
+  GHashTableIter iter;
+  GDBusConnection *connection;
+  struct stat statbuf;
+
+  if (peer_socket->dbus_server != NULL)
+    {
+      g_signal_handlers_disconnect_by_func (peer_socket->dbus_server, on_new_peer_connection, peer_socket);
+      g_dbus_server_stop (peer_socket->dbus_server);
+      g_object_unref (peer_socket->dbus_server);
+
+      /* a newer polkitd may already have replaced it */
+      if (stat (peer_socket->socket_path, &statbuf) == 0 &&
+          statbuf.st_dev == peer_socket->socket_dev &&
+          statbuf.st_ino == peer_socket->socket_ino)
+        unlink (peer_socket->socket_path);
+    }
+
+  g_hash_table_iter_init (&iter, peer_socket->servers);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &connection, NULL))
+    g_signal_handlers_disconnect_by_func (connection, on_peer_connection_closed, peer_socket);
+  g_hash_table_unref (peer_socket->servers);
+  g_hash_table_unref (peer_socket->connections_per_uid);
+
+  g_object_unref (peer_socket->authority);
+  g_free (peer_socket->socket_path);
+  g_free (peer_socket->object_path);
+  g_free (peer_socket);
+}
+
+/**
+ * polkit_backend_authority_register_peer_socket:
+ * @authority: A #PolkitBackendAuthority.
+ * @socket_path: Path of the unix socket to listen on.
+ * @object_path: Object path of the authority.
+ * @error: Return location for error.
+ *
+ * Serves @authority over peer-to-peer D-Bus on a unix socket at
+ * @socket_path, replacing any socket already there. Each connection
+ * gets the same interface as polkit_backend_authority_register()
+ * provides on the bus, with the connecting process as the caller, so
+ * neither method calls nor looking up who made them involve the bus
+ * daemon. Each uid can have at most 64 connections open; further ones
+ * are closed right away.
+ *
+ * Returns: A #gpointer that can be used with polkit_backend_authority_unregister_peer_socket() or %NULL if @error is set.
+ *
+ * Since: 127
+ */
+gpointer
+polkit_backend_authority_register_peer_socket (PolkitBackendAuthority  *authority,
+                                               const gchar             *socket_path,
+                                               const gchar             *object_path,
+                                               GError                 **error)
+{
+  PeerSocket *peer_socket;
+  GDBusAuthObserver *observer;
+  struct stat statbuf;
+  gchar *escaped_path;
+  gchar *address;
+  gchar *guid;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_AUTHORITY (authority), NULL);
+  g_return_val_if_fail (socket_path != NULL, NULL);
+  g_return_val_if_fail (object_path != NULL, NULL);
+
+  peer_socket = g_new0 (PeerSocket, 1);
+  peer_socket->authority = g_object_ref (authority);
+  peer_socket->socket_path = g_strdup (socket_path);
+  peer_socket->object_path = g_strdup (object_path);
+  peer_socket->servers = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) server_free);
+  peer_socket->connections_per_uid = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  /* left behind by an earlier polkitd */
+  if (unlink (socket_path) != 0 && errno != ENOENT)
+    {
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
+                   "Error removing %s: %m", socket_path);
+      goto error;
+    }
+
+  escaped_path = g_dbus_address_escape_value (socket_path);
+  address = g_strdup_printf ("unix:path=%s", escaped_path);
+  guid = g_dbus_generate_guid ();
+  observer = g_dbus_auth_observer_new ();
+  g_signal_connect (observer, "allow-mechanism", G_CALLBACK (on_peer_allow_mechanism), NULL);
+  g_signal_connect (observer, "authorize-authenticated-peer", G_CALLBACK (on_peer_authorize_authenticated_peer), NULL);
+  peer_socket->dbus_server = g_dbus_server_new_sync (address,
+                                                     G_DBUS_SERVER_FLAGS_NONE,
+                                                     guid,
+                                                     observer,
+                                                     NULL, /* GCancellable */
+                                                     error);
+  g_object_unref (observer);
+  g_free (guid);
+  g_free (address);
+  g_free (escaped_path);
+  if (peer_socket->dbus_server == NULL)
+    goto error;
+
+  /* anyone may check authorizations, just like on the bus */
+  if (chmod (socket_path, 0666) != 0 || stat (socket_path, &statbuf) != 0)
+    {
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
+                   "Error setting up %s: %m", socket_path);
+      goto error;
+    }
+  peer_socket->socket_dev = statbuf.st_dev;
+  peer_socket->socket_ino = statbuf.st_ino;
+
+  g_signal_connect (peer_socket->dbus_server,
+                    "new-connection",
+                    G_CALLBACK (on_new_peer_connection),
+                    peer_socket);
+  g_dbus_server_start (peer_socket->dbus_server);
+
+  return peer_socket;
+
+ error:
+  peer_socket_free (peer_socket);
+  return NULL;
+}
+
+/**
+ * polkit_backend_authority_unregister_peer_socket:
+ * @registration_id: A #gpointer obtained from polkit_backend_authority_register_peer_socket().
+ *
+ * Stops serving on the socket and closes all connections made to it.
+ *
+ * Since: 127
+ */
+void
+polkit_backend_authority_unregister_peer_socket (gpointer registration_id)
+{
+  PeerSocket *peer_socket = registration_id;
+  GHashTableIter iter;
+  GDBusConnection *connection;
+
+  g_hash_table_iter_init (&iter, peer_socket->servers);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &connection, NULL))
+    g_dbus_connection_close (connection, NULL, NULL, NULL);
+
+  peer_socket_free (peer_socket);
+}
+
 
 /**
  * polkit_backend_authority_get:
@@ -110,6 +110,26 @@ enum
  * authorization identified by id or %NULL if the backend doesn't support
  * the operation. See polkit_backend_authority_revoke_temporary_authorization_by_id()
  * for details.
+ * @add_memory_usage: Called to add entries describing memory used by
+ * the authority to a #GVariantBuilder of type
+ * <literal>a{s(tt)}</literal>. Subclasses should chain up. See
+ * polkit_backend_authority_get_memory_usage() for details.
+ * @get_implicit_authorizations: Called to get the decisions that can be
+ * made from implicit authorizations alone or %NULL if the backend
+ * doesn't support the operation. See
+ * polkit_backend_authority_get_implicit_authorizations() for details.
+ * @enumerate_temporary_authorizations_as_gvariant: Like
+ * @enumerate_temporary_authorizations but returns the serialized
+ * authorizations or %NULL to use @enumerate_temporary_authorizations.
+ * See polkit_backend_authority_enumerate_temporary_authorizations_as_gvariant()
+ * for details.
+ * @enumerate_actions_as_gvariant: Like @enumerate_actions but filters
+ * and serializes the actions or %NULL to use @enumerate_actions. See
+ * polkit_backend_authority_enumerate_actions_as_gvariant() for details.
+ * @add_statistics: Called to add counters describing the work done by
+ * the authority to a #GVariantBuilder of type <literal>a{st}</literal>.
+ * Subclasses should chain up. See
+ * polkit_backend_authority_get_statistics() for details.
  *
  * Class structure for #PolkitBackendAuthority.
  */
@@ -182,13 +202,32 @@ struct _PolkitBackendAuthorityClass
                                                     const gchar              *id,
                                                     GError                  **error);
 
+  void (*add_memory_usage) (PolkitBackendAuthority   *authority,
+                            GVariantBuilder          *builder);
+
+  GVariant *(*get_implicit_authorizations) (PolkitBackendAuthority *authority);
+
+  GVariant *(*enumerate_temporary_authorizations_as_gvariant) (PolkitBackendAuthority   *authority,
+                                                               PolkitSubject            *caller,
+                                                               PolkitSubject            *subject,
+                                                               GError                  **error);
+
+  GVariant *(*enumerate_actions_as_gvariant) (PolkitBackendAuthority   *authority,
+                                              PolkitSubject            *caller,
+                                              const gchar              *locale,
+                                              const gchar              *id_prefix,
+                                              const gchar              *annotation_key,
+                                              const gchar              *annotation_value,
+                                              guint                     offset,
+                                              guint                     limit,
+                                              guint                    *out_num_matches,
+                                              GError                  **error);
+
+  void (*add_statistics) (PolkitBackendAuthority   *authority,
+                          GVariantBuilder          *builder);
+
   /*< private >*/
   /* Padding for future expansion */
-  void (*_polkit_reserved1) (void);
-  void (*_polkit_reserved2) (void);
-  void (*_polkit_reserved3) (void);
-  void (*_polkit_reserved4) (void);
-  void (*_polkit_reserved5) (void);
   void (*_polkit_reserved6) (void);
   void (*_polkit_reserved7) (void);
   void (*_polkit_reserved8) (void);
@@ -239,6 +278,17 @@ GList   *polkit_backend_authority_enumerate_actions         (PolkitBackendAuthor
                                                              const gchar               *locale,
                                                              GError                   **error);
 
+GVariant *polkit_backend_authority_enumerate_actions_as_gvariant (PolkitBackendAuthority    *authority,
+                                                                  PolkitSubject             *caller,
+                                                                  const gchar               *locale,
+                                                                  const gchar               *id_prefix,
+                                                                  const gchar               *annotation_key,
+                                                                  const gchar               *annotation_value,
+                                                                  guint                      offset,
+                                                                  guint                      limit,
+                                                                  guint                     *out_num_matches,
+                                                                  GError                   **error);
+
 void     polkit_backend_authority_check_authorization       (PolkitBackendAuthority        *authority,
                                                              PolkitSubject                 *caller,
                                                              PolkitSubject                 *subject,
@@ -279,6 +329,11 @@ GList *polkit_backend_authority_enumerate_temporary_authorizations (PolkitBacken
                                                                     PolkitSubject            *subject,
                                                                     GError                  **error);
 
+GVariant *polkit_backend_authority_enumerate_temporary_authorizations_as_gvariant (PolkitBackendAuthority   *authority,
+                                                                                   PolkitSubject            *caller,
+                                                                                   PolkitSubject            *subject,
+                                                                                   GError                  **error);
+
 gboolean polkit_backend_authority_revoke_temporary_authorizations (PolkitBackendAuthority   *authority,
                                                                    PolkitSubject            *caller,
                                                                    PolkitSubject            *subject,
@@ -289,6 +344,12 @@ gboolean polkit_backend_authority_revoke_temporary_authorization_by_id (PolkitBa
                                                                         const gchar              *id,
                                                                         GError                  **error);
 
+GVariant *polkit_backend_authority_get_memory_usage (PolkitBackendAuthority *authority);
+
+GVariant *polkit_backend_authority_get_statistics (PolkitBackendAuthority *authority);
+
+GVariant *polkit_backend_authority_get_implicit_authorizations (PolkitBackendAuthority *authority);
+
 /* --- */
 
 PolkitBackendAuthority *polkit_backend_authority_get (void);
@@ -300,6 +361,17 @@ gpointer polkit_backend_authority_register (PolkitBackendAuthority   *authority,
 
 void polkit_backend_authority_unregister (gpointer registration_id);
 
+void polkit_backend_authority_set_scheduling (gpointer             registration_id,
+                                              const gchar * const *priority_callers,
+                                              guint                max_queued_calls);
+
+gpointer polkit_backend_authority_register_peer_socket (PolkitBackendAuthority  *authority,
+                                                        const gchar             *socket_path,
+                                                        const gchar             *object_path,
+                                                        GError                 **error);
+
+void polkit_backend_authority_unregister_peer_socket (gpointer registration_id);
+
 G_END_DECLS
 
 #endif /* __POLKIT_BACKEND_AUTHORITY_H */
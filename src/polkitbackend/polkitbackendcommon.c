@@ -19,6 +19,8 @@
  * Author: David Zeuthen <davidz@redhat.com>
  */
 
+#include <stdlib.h>
+
 #include "polkitbackendcommon.h"
 
 static void
@@ -113,10 +115,10 @@ utils_spawn_data_free (UtilsSpawnData *data)
       data->child_stderr_fd = -1;
     }
 
-  if (data->cancellable_handler_id > 0)
+  if (data->cancellable_source != NULL)
     {
-      g_cancellable_disconnect (data->cancellable, data->cancellable_handler_id);
-      data->cancellable_handler_id = 0;
+      g_source_destroy (data->cancellable_source);
+      data->cancellable_source = NULL;
     }
 
   if (data->main_context != NULL)
@@ -128,19 +130,42 @@ utils_spawn_data_free (UtilsSpawnData *data)
   g_slice_free (UtilsSpawnData, data);
 }
 
-/* called in the thread where @cancellable was cancelled */
+/* The child exiting, the timeout and cancellation may all happen before
+ * the result is delivered, but only the first one completes it
+ */
 static void
-utils_on_cancelled (GCancellable *cancellable,
+utils_spawn_complete (UtilsSpawnData *data)
+{
+  if (data->completed)
+    return;
+  data->completed = TRUE;
+
+  g_simple_async_result_complete_in_idle (data->simple);
+  g_object_unref (data->simple);
+}
+
+/* Runs in @main_context, like the other sources, whatever thread
+ * @cancellable was cancelled in
+ */
+static gboolean
+utils_cancelled_cb (GCancellable *cancellable,
                     gpointer      user_data)
 {
   UtilsSpawnData *data = (UtilsSpawnData *)user_data;
   GError *error;
 
-  error = NULL;
-  g_warn_if_fail (g_cancellable_set_error_if_cancelled (cancellable, &error));
-  g_simple_async_result_take_error (data->simple, error);
-  g_simple_async_result_complete_in_idle (data->simple);
-  g_object_unref (data->simple);
+  /* ok, cancellable source is history, make sure we don't free it in spawn_data_free() */
+  data->cancellable_source = NULL;
+
+  if (!data->completed)
+    {
+      error = NULL;
+      g_warn_if_fail (g_cancellable_set_error_if_cancelled (cancellable, &error));
+      g_simple_async_result_take_error (data->simple, error);
+      utils_spawn_complete (data);
+    }
+
+  return FALSE; /* remove source */
 }
 
 static gboolean
@@ -148,14 +173,14 @@ utils_timeout_cb (gpointer user_data)
 {
   UtilsSpawnData *data = (UtilsSpawnData *)user_data;
 
-  data->timed_out = TRUE;
+  if (!data->completed)
+    data->timed_out = TRUE;
 
   /* ok, timeout is history, make sure we don't free it in spawn_data_free() */
   data->timeout_source = NULL;
 
   /* we're done */
-  g_simple_async_result_complete_in_idle (data->simple);
-  g_object_unref (data->simple);
+  utils_spawn_complete (data);
 
   return FALSE; /* remove source */
 }
@@ -188,8 +213,7 @@ utils_child_watch_cb (GPid     pid,
   data->child_watch_source = NULL;
 
   /* we're done */
-  g_simple_async_result_complete_in_idle (data->simple);
-  g_object_unref (data->simple);
+  utils_spawn_complete (data);
 }
 
 static gboolean
@@ -258,15 +282,15 @@ polkit_backend_common_spawn (const gchar *const  *argv,
       if (g_cancellable_set_error_if_cancelled (data->cancellable, &error))
         {
           g_simple_async_result_take_error (data->simple, error);
-          g_simple_async_result_complete_in_idle (data->simple);
-          g_object_unref (data->simple);
+          utils_spawn_complete (data);
           goto out;
         }
 
-      data->cancellable_handler_id = g_cancellable_connect (data->cancellable,
-                                                            G_CALLBACK (utils_on_cancelled),
-                                                            data,
-                                                            NULL);
+      /* not a signal handler, which would run in the thread that cancels */
+      data->cancellable_source = g_cancellable_source_new (data->cancellable);
+      g_source_set_callback (data->cancellable_source, (GSourceFunc) utils_cancelled_cb, data, NULL);
+      g_source_attach (data->cancellable_source, data->main_context);
+      g_source_unref (data->cancellable_source);
     }
 
   error = NULL;
@@ -284,8 +308,7 @@ polkit_backend_common_spawn (const gchar *const  *argv,
     {
       g_prefix_error (&error, "Error spawning: ");
       g_simple_async_result_take_error (data->simple, error);
-      g_simple_async_result_complete_in_idle (data->simple);
-      g_object_unref (data->simple);
+      utils_spawn_complete (data);
       goto out;
     }
 
@@ -441,6 +464,8 @@ polkit_backend_common_js_authority_class_init_common (PolkitBackendJsAuthorityCl
   interactive_authority_class = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_CLASS (klass);
   interactive_authority_class->get_admin_identities     = polkit_backend_common_js_authority_get_admin_auth_identities;
   interactive_authority_class->check_authorization_sync = polkit_backend_common_js_authority_check_authorization_sync;
+  interactive_authority_class->check_authorization_and_get_admin_identities_sync =
+    polkit_backend_common_js_authority_check_authorization_and_get_admin_identities_sync;
 
   g_object_class_install_property (gobject_class,
                                    PROP_RULES_DIRS,
@@ -666,3 +691,198 @@ polkit_backend_common_pidfd_to_systemd_unit (gint      pidfd,
   if (error)
     g_error_free (error);
 }
+
+/* Gathers what the Subject object passed to rules describes, the same
+ * way for every JS backend. Free with
+ * polkit_backend_common_js_subject_info_clear().
+ */
+gboolean
+polkit_backend_common_js_subject_info_init (JsSubjectInfo   *info,
+                                            PolkitSubject   *subject,
+                                            PolkitIdentity  *user_for_subject,
+                                            GError         **error)
+{
+  gboolean ret = FALSE;
+  gboolean no_new_privs = FALSE;
+  gint pidfd = -1;
+  pid_t pid_early, pid_late;
+  uid_t uid;
+  PolkitSubject *process = NULL;
+  gchar *user_name = NULL;
+  GPtrArray *groups = NULL;
+  GArray *gids_from_dbus = NULL;
+  struct passwd *passwd;
+  char *seat_str = NULL;
+  char *session_str = NULL;
+  char *system_unit = NULL;
+
+  memset (info, 0, sizeof (JsSubjectInfo));
+
+  if (POLKIT_IS_UNIX_PROCESS (subject))
+    {
+      process = subject;
+    }
+  else if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
+    {
+      process = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (subject), NULL, error);
+      if (process == NULL)
+        goto out;
+    }
+  else
+    {
+      g_assert_not_reached ();
+    }
+
+  pid_early = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (process));
+  pidfd = polkit_unix_process_get_pidfd (POLKIT_UNIX_PROCESS (process));
+
+#ifdef HAVE_LIBSYSTEMD
+#if HAVE_SD_PIDFD_GET_SESSION
+  if (pidfd >= 0)
+    sd_pidfd_get_session (pidfd, &session_str);
+  else
+#endif /* HAVE_SD_PIDFD_GET_SESSION */
+    sd_pid_get_session (pid_early, &session_str);
+  if (session_str)
+    sd_session_get_seat (session_str, &seat_str);
+#endif /* HAVE_LIBSYSTEMD */
+
+  g_assert (POLKIT_IS_UNIX_USER (user_for_subject));
+  uid = polkit_unix_user_get_uid (POLKIT_UNIX_USER (user_for_subject));
+
+  groups = g_ptr_array_new_with_free_func (g_free);
+  gids_from_dbus = polkit_unix_process_get_gids (POLKIT_UNIX_PROCESS (process));
+
+passwd = getpwuid (uid);
+if (passwd == NULL)
+  {
+    user_name = g_strdup_printf ("%d", (gint) uid);
+    g_warning ("Error looking up info for uid %d: %m", (gint) uid);
+  }
+else
+  {
+    user_name = g_strdup (passwd->pw_name);
+  }
+
+  /* D-Bus will give us supplementary groups too, so prefer that to looking up
+   * the group from the uid. */
+  if (gids_from_dbus && gids_from_dbus->len > 0)
+    {
+      gint n;
+      for (n = 0; n < gids_from_dbus->len; n++)
+        {
+          struct group *group;
+          group = getgrgid (g_array_index (gids_from_dbus, gid_t, n));
+          if (group == NULL)
+            {
+              g_ptr_array_add (groups, g_strdup_printf ("%d", (gint) g_array_index (gids_from_dbus, gid_t, n)));
+            }
+          else
+            {
+              g_ptr_array_add (groups, g_strdup (group->gr_name));
+            }
+        }
+    }
+  else
+    {
+      if (passwd != NULL)
+        {
+          gid_t gids[512];
+          int num_gids = 512;
+
+          if (getgrouplist (passwd->pw_name,
+                            passwd->pw_gid,
+                            gids,
+                            &num_gids) < 0)
+            {
+              g_warning ("Error looking up groups for uid %d: %m", (gint) uid);
+            }
+          else
+            {
+              gint n;
+              for (n = 0; n < num_gids; n++)
+                {
+                  struct group *group;
+                  group = getgrgid (gids[n]);
+                  if (group == NULL)
+                    {
+                      g_ptr_array_add (groups, g_strdup_printf ("%d", (gint) gids[n]));
+                    }
+                  else
+                    {
+                      g_ptr_array_add (groups, g_strdup (group->gr_name));
+                    }
+                }
+            }
+        }
+    }
+
+  /* Query the unit, will work only if we got the pidfd from dbus-daemon/broker.
+   * Best-effort operation, will log on failure, but we don't bail here. But
+   * only do so if the pidfd was marked as safe, i.e.: we got it from D-Bus so
+   * it can be trusted end-to-end, with no reuse attack window.  */
+  if (polkit_unix_process_get_pidfd_is_safe (POLKIT_UNIX_PROCESS (process)))
+    polkit_backend_common_pidfd_to_systemd_unit (pidfd, &system_unit, &no_new_privs);
+
+  /* In case we are using PIDFDs, check that the PID still matches to avoid race
+   * conditions and PID recycle attacks.
+   */
+  pid_late = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (process));
+  if (pid_late != pid_early)
+    {
+      if (pid_late == -1)
+        {
+          g_warning ("Process %d terminated", (gint) pid_early);
+          g_set_error (error,
+                       POLKIT_ERROR,
+                       POLKIT_ERROR_FAILED,
+                       "Process %d terminated", (gint) pid_early);
+        }
+      else
+      {
+        g_warning ("Process changed pid from %d to %d", (gint) pid_early, (gint) pid_late);
+        g_set_error (error,
+                     POLKIT_ERROR,
+                     POLKIT_ERROR_FAILED,
+                     "Process changed pid from %d to %d", (gint) pid_early, (gint) pid_late);
+      }
+      goto out;
+    }
+
+  info->pid = pid_early;
+  info->user = g_steal_pointer (&user_name);
+  info->groups = g_steal_pointer (&groups);
+  info->seat = g_steal_pointer (&seat_str);
+  info->session = g_steal_pointer (&session_str);
+  info->system_unit = g_steal_pointer (&system_unit);
+  info->no_new_privileges = no_new_privs;
+
+  ret = TRUE;
+
+ out:
+  if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
+    g_object_unref (process);
+  free (session_str);
+  free (seat_str);
+  free (system_unit);
+  g_free (user_name);
+  if (groups != NULL)
+    g_ptr_array_unref (groups);
+  if (gids_from_dbus != NULL)
+    g_array_unref (gids_from_dbus);
+
+  return ret;
+}
+
+void
+polkit_backend_common_js_subject_info_clear (JsSubjectInfo *info)
+{
+  g_free (info->user);
+  if (info->groups != NULL)
+    g_ptr_array_unref (info->groups);
+  /* from sd-login and strdup() */
+  free (info->seat);
+  free (info->session);
+  free (info->system_unit);
+  memset (info, 0, sizeof (JsSubjectInfo));
+}
@@ -68,7 +68,10 @@ typedef struct
   GMainContext *main_context; /* may be NULL */
 
   GCancellable *cancellable;  /* may be NULL */
-  gulong cancellable_handler_id;
+  GSource *cancellable_source;
+
+  /* set once the result is completed, whatever came first */
+  gboolean completed;
 
   GPid child_pid;
   gint child_stdout_fd;
@@ -97,6 +100,20 @@ typedef struct
   GAsyncResult *res;
 } SpawnData;
 
+/* The properties of the Subject object passed to rules, other than
+ * the local and active ones the caller already has
+ */
+typedef struct
+{
+  gint32 pid;
+  gchar *user;
+  GPtrArray *groups;
+  gchar *seat;
+  gchar *session;
+  gchar *system_unit;
+  gboolean no_new_privileges;
+} JsSubjectInfo;
+
 void polkit_backend_common_spawn (const gchar *const  *argv,
                                   guint                timeout_seconds,
                                   GCancellable        *cancellable,
@@ -124,6 +141,12 @@ gint polkit_backend_common_rules_file_name_cmp (const gchar *a,
 
 const gchar *polkit_backend_common_get_signal_name (gint signal_number);
 
+gboolean polkit_backend_common_js_subject_info_init (JsSubjectInfo   *info,
+                                                     PolkitSubject   *subject,
+                                                     PolkitIdentity  *user_for_subject,
+                                                     GError         **error);
+void polkit_backend_common_js_subject_info_clear (JsSubjectInfo *info);
+
 /* To be provided by each JS backend, from here onwards  ---------------------------------------------- */
 
 void polkit_backend_common_reload_scripts (PolkitBackendJsAuthority *authority);
@@ -150,6 +173,17 @@ PolkitImplicitAuthorization polkit_backend_common_js_authority_check_authorizati
                                                                                          const gchar                       *action_id,
                                                                                          PolkitDetails                     *details,
                                                                                          PolkitImplicitAuthorization        implicit);
+PolkitImplicitAuthorization polkit_backend_common_js_authority_check_authorization_and_get_admin_identities_sync (PolkitBackendInteractiveAuthority *_authority,
+                                                                                                                  PolkitSubject                     *caller,
+                                                                                                                  PolkitSubject                     *subject,
+                                                                                                                  PolkitIdentity                    *user_for_subject,
+                                                                                                                  gboolean                           subject_is_local,
+                                                                                                                  gboolean                           subject_is_active,
+                                                                                                                  const gchar                       *action_id,
+                                                                                                                  PolkitDetails                     *details,
+                                                                                                                  PolkitImplicitAuthorization        implicit,
+                                                                                                                  GList                            **out_admin_identities,
+                                                                                                                  GCancellable                      *cancellable);
 void polkit_backend_common_pidfd_to_systemd_unit (gint      pid,
                                                   gchar   **ret_unit,
                                                   gboolean *ret_no_new_privs);
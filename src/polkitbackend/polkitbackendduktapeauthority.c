@@ -22,8 +22,10 @@
  */
 
 #include <pthread.h>
+#include <stdlib.h>
 
 #include "polkitbackendcommon.h"
+#include "polkitbackendprivate.h"
 
 #include "duktape.h"
 
@@ -50,7 +52,18 @@ struct _PolkitBackendJsAuthorityPrivate
 
   duk_context *cx;
 
+  /* bytes currently allocated by the Duktape heap, see heap_alloc() */
+  gsize heap_size;
+
+  /* see polkit_backend_js_authority_add_statistics() */
+  guint64 num_rule_evaluations_cancelled;
+
   pthread_t runaway_killer_thread;
+
+  /* of the check the JS running now is for, if any; the heap only runs
+   * one call at a time, see call_js_function_with_runaway_killer()
+   */
+  GCancellable *cancellable;
 };
 
 enum
@@ -62,6 +75,9 @@ enum
 
 static gboolean execute_script_with_runaway_killer(PolkitBackendJsAuthority *authority,
                                                    const gchar *filename);
+static gboolean call_js_function_with_runaway_killer(PolkitBackendJsAuthority *authority,
+                                                     duk_idx_t nargs,
+                                                     GCancellable *cancellable);
 
 /* ---------------------------------------------------------------------------------------------------- */
 
@@ -72,12 +88,14 @@ G_DEFINE_TYPE_WITH_PRIVATE (PolkitBackendJsAuthority, polkit_backend_js_authorit
 static duk_ret_t js_polkit_log (duk_context *cx);
 static duk_ret_t js_polkit_spawn (duk_context *cx);
 static duk_ret_t js_polkit_user_is_in_netgroup (duk_context *cx);
+static duk_ret_t js_polkit_is_cancelled (duk_context *cx);
 
 static const duk_function_list_entry js_polkit_functions[] =
 {
   { "log", js_polkit_log, 1 },
   { "spawn", js_polkit_spawn, 1 },
   { "_userIsInNetGroup", js_polkit_user_is_in_netgroup, 2 },
+  { "_isCancelled", js_polkit_is_cancelled, 0 },
   { NULL, NULL, 0 },
 };
 
@@ -91,6 +109,76 @@ static void report_error (void     *udata,
                                   (msg ? msg : "no message"));
 }
 
+/* Duktape has no API for querying its heap size so it is tracked by the
+ * allocator: each block is prefixed with its size, padded to keep the
+ * alignment malloc() guarantees.
+ */
+typedef union
+{
+  duk_size_t size;
+  void *p;
+  double d;
+  long double ld;
+  long long ll;
+} HeapBlockHeader;
+
+static void *
+heap_alloc (void       *udata,
+            duk_size_t  size)
+{
+  PolkitBackendJsAuthority *authority = udata;
+  HeapBlockHeader *header;
+
+  header = malloc (sizeof (HeapBlockHeader) + size);
+  if (header == NULL)
+    return NULL;
+  header->size = size;
+  authority->priv->heap_size += size;
+  return header + 1;
+}
+
+static void
+heap_free (void *udata,
+           void *ptr)
+{
+  PolkitBackendJsAuthority *authority = udata;
+  HeapBlockHeader *header;
+
+  if (ptr == NULL)
+    return;
+  header = ((HeapBlockHeader *) ptr) - 1;
+  authority->priv->heap_size -= header->size;
+  free (header);
+}
+
+static void *
+heap_realloc (void       *udata,
+              void       *ptr,
+              duk_size_t  size)
+{
+  PolkitBackendJsAuthority *authority = udata;
+  HeapBlockHeader *header;
+  duk_size_t old_size;
+
+  if (ptr == NULL)
+    return size == 0 ? NULL : heap_alloc (udata, size);
+
+  if (size == 0)
+    {
+      heap_free (udata, ptr);
+      return NULL;
+    }
+
+  header = ((HeapBlockHeader *) ptr) - 1;
+  old_size = header->size;
+  header = realloc (header, sizeof (HeapBlockHeader) + size);
+  if (header == NULL)
+    return NULL;
+  header->size = size;
+  authority->priv->heap_size = authority->priv->heap_size - old_size + size;
+  return header + 1;
+}
+
 static void
 polkit_backend_js_authority_init (PolkitBackendJsAuthority *authority)
 {
@@ -235,7 +323,7 @@ polkit_backend_common_js_authority_constructed (GObject *object)
   PolkitBackendJsAuthority *authority = POLKIT_BACKEND_JS_AUTHORITY (object);
   duk_context *cx;
 
-  cx = duk_create_heap (NULL, NULL, NULL, authority, report_error);
+  cx = duk_create_heap (heap_alloc, heap_realloc, heap_free, authority, report_error);
   if (cx == NULL)
     goto fail;
 
@@ -314,10 +402,108 @@ polkit_backend_common_js_authority_set_property (GObject      *object,
     }
 }
 
+static void
+polkit_backend_js_authority_add_memory_usage (PolkitBackendAuthority *authority,
+                                              GVariantBuilder        *builder)
+{
+  PolkitBackendJsAuthority *js_authority = POLKIT_BACKEND_JS_AUTHORITY (authority);
+
+  POLKIT_BACKEND_AUTHORITY_CLASS (polkit_backend_js_authority_parent_class)->add_memory_usage (authority, builder);
+
+  g_variant_builder_add (builder, "{s(tt)}",
+                         "duktape-heap",
+                         (guint64) 1,
+                         (guint64) js_authority->priv->heap_size);
+}
+
+/* Returns the number in polkit.@name */
+static guint64
+get_polkit_counter (PolkitBackendJsAuthority *authority,
+                    const gchar              *name)
+{
+  duk_context *cx = authority->priv->cx;
+  guint64 ret = 0;
+
+  if (duk_get_global_string (cx, "polkit"))
+    {
+      duk_get_prop_string (cx, -1, name);
+      if (duk_is_number (cx, -1))
+        ret = (guint64) duk_get_number (cx, -1);
+      duk_pop (cx);
+    }
+  duk_pop (cx);
+
+  return ret;
+}
+
+static void
+polkit_backend_js_authority_add_statistics (PolkitBackendAuthority *authority,
+                                            GVariantBuilder        *builder)
+{
+  PolkitBackendJsAuthority *js_authority = POLKIT_BACKEND_JS_AUTHORITY (authority);
+
+  POLKIT_BACKEND_AUTHORITY_CLASS (polkit_backend_js_authority_parent_class)->add_statistics (authority, builder);
+
+  /* runs of the rules whose check was cancelled while they ran, see js_polkit_is_cancelled() */
+  g_variant_builder_add (builder, "{st}",
+                         "rule-evaluations-cancelled",
+                         js_authority->priv->num_rule_evaluations_cancelled);
+
+  /* see polkit._runRules() in init.js */
+  g_variant_builder_add (builder, "{st}", "rule-cache-hits", get_polkit_counter (js_authority, "_cacheHits"));
+  g_variant_builder_add (builder, "{st}", "rule-cache-misses", get_polkit_counter (js_authority, "_cacheMisses"));
+}
+
+/* See polkit._rulesIgnoreSubject() in init.js; leaves @has_rules
+ * alone if the rules fail */
+static void
+polkit_backend_js_authority_has_authorization_rules (PolkitBackendInteractiveAuthority *_authority,
+                                                     const gchar * const               *action_ids,
+                                                     gboolean                          *has_rules)
+{
+  PolkitBackendJsAuthority *authority = POLKIT_BACKEND_JS_AUTHORITY (_authority);
+  duk_context *cx = authority->priv->cx;
+  guint n;
+
+  duk_set_top (cx, 0);
+  if (!duk_get_global_string (cx, "polkit"))
+    goto out;
+
+  duk_push_string (cx, "_rulesIgnoreSubject");
+  duk_push_array (cx);
+  for (n = 0; action_ids[n] != NULL; n++)
+    {
+      duk_push_string (cx, action_ids[n]);
+      duk_put_prop_index (cx, -2, n);
+    }
+  if (!call_js_function_with_runaway_killer (authority, 1, NULL))
+    goto out;
+
+  for (n = 0; action_ids[n] != NULL; n++)
+    {
+      duk_get_prop_index (cx, -1, n);
+      has_rules[n] = !duk_to_boolean (cx, -1);
+      duk_pop (cx);
+    }
+
+ out:
+  duk_set_top (cx, 0);
+}
+
 static void
 polkit_backend_js_authority_class_init (PolkitBackendJsAuthorityClass *klass)
 {
+  PolkitBackendAuthorityClass *authority_class;
+  PolkitBackendInteractiveAuthorityClass *interactive_authority_class;
+
   polkit_backend_common_js_authority_class_init_common (klass);
+
+  authority_class = POLKIT_BACKEND_AUTHORITY_CLASS (klass);
+  authority_class->add_memory_usage = polkit_backend_js_authority_add_memory_usage;
+  authority_class->add_statistics = polkit_backend_js_authority_add_statistics;
+
+  interactive_authority_class = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_CLASS (klass);
+  interactive_authority_class->has_authorization_rules = polkit_backend_js_authority_has_authorization_rules;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -374,184 +560,32 @@ push_subject (duk_context               *cx,
               gboolean                   subject_is_active,
               GError                   **error)
 {
-  gboolean ret = FALSE;
-  gboolean no_new_privs = FALSE;
-  gint pidfd = -1;
-  pid_t pid_early, pid_late;
-  uid_t uid;
-  PolkitSubject *process = NULL;
-  gchar *user_name = NULL;
-  GPtrArray *groups = NULL;
-  GArray *gids_from_dbus = NULL;
-  struct passwd *passwd;
-  char *seat_str = NULL;
-  char *session_str = NULL;
-  char *system_unit = NULL;
+  JsSubjectInfo info;
+
+  if (!polkit_backend_common_js_subject_info_init (&info, subject, user_for_subject, error))
+    return FALSE;
 
   if (!duk_get_global_string (cx, "Subject")) {
+    polkit_backend_common_js_subject_info_clear (&info);
     return FALSE;
   }
 
   duk_new (cx, 0);
 
-  if (POLKIT_IS_UNIX_PROCESS (subject))
-    {
-      process = subject;
-    }
-  else if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
-    {
-      process = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (subject), NULL, error);
-      if (process == NULL)
-        goto out;
-    }
-  else
-    {
-      g_assert_not_reached ();
-    }
-
-  pid_early = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (process));
-  pidfd = polkit_unix_process_get_pidfd (POLKIT_UNIX_PROCESS (process));
-
-#ifdef HAVE_LIBSYSTEMD
-#if HAVE_SD_PIDFD_GET_SESSION
-  if (pidfd >= 0)
-    sd_pidfd_get_session (pidfd, &session_str);
-  else
-#endif /* HAVE_SD_PIDFD_GET_SESSION */
-    sd_pid_get_session (pid_early, &session_str);
-  if (session_str)
-    sd_session_get_seat (session_str, &seat_str);
-#endif /* HAVE_LIBSYSTEMD */
-
-  g_assert (POLKIT_IS_UNIX_USER (user_for_subject));
-  uid = polkit_unix_user_get_uid (POLKIT_UNIX_USER (user_for_subject));
-
-  groups = g_ptr_array_new_with_free_func (g_free);
-  gids_from_dbus = polkit_unix_process_get_gids (POLKIT_UNIX_PROCESS (process));
-
-passwd = getpwuid (uid);
-if (passwd == NULL)
-  {
-    user_name = g_strdup_printf ("%d", (gint) uid);
-    g_warning ("Error looking up info for uid %d: %m", (gint) uid);
-  }
-else
-  {
-    user_name = g_strdup (passwd->pw_name);
-  }
-
-  /* D-Bus will give us supplementary groups too, so prefer that to looking up
-   * the group from the uid. */
-  if (gids_from_dbus && gids_from_dbus->len > 0)
-    {
-      gint n;
-      for (n = 0; n < gids_from_dbus->len; n++)
-        {
-          struct group *group;
-          group = getgrgid (g_array_index (gids_from_dbus, gid_t, n));
-          if (group == NULL)
-            {
-              g_ptr_array_add (groups, g_strdup_printf ("%d", (gint) g_array_index (gids_from_dbus, gid_t, n)));
-            }
-          else
-            {
-              g_ptr_array_add (groups, g_strdup (group->gr_name));
-            }
-        }
-    }
-  else
-    {
-      if (passwd != NULL)
-        {
-          gid_t gids[512];
-          int num_gids = 512;
-
-          if (getgrouplist (passwd->pw_name,
-                            passwd->pw_gid,
-                            gids,
-                            &num_gids) < 0)
-            {
-              g_warning ("Error looking up groups for uid %d: %m", (gint) uid);
-            }
-          else
-            {
-              gint n;
-              for (n = 0; n < num_gids; n++)
-                {
-                  struct group *group;
-                  group = getgrgid (gids[n]);
-                  if (group == NULL)
-                    {
-                      g_ptr_array_add (groups, g_strdup_printf ("%d", (gint) gids[n]));
-                    }
-                  else
-                    {
-                      g_ptr_array_add (groups, g_strdup (group->gr_name));
-                    }
-                }
-            }
-        }
-    }
-
-  /* Query the unit, will work only if we got the pidfd from dbus-daemon/broker.
-   * Best-effort operation, will log on failure, but we don't bail here. But
-   * only do so if the pidfd was marked as safe, i.e.: we got it from D-Bus so
-   * it can be trusted end-to-end, with no reuse attack window.  */
-  if (polkit_unix_process_get_pidfd_is_safe (POLKIT_UNIX_PROCESS (process)))
-    polkit_backend_common_pidfd_to_systemd_unit (pidfd, &system_unit, &no_new_privs);
-
-  /* In case we are using PIDFDs, check that the PID still matches to avoid race
-   * conditions and PID recycle attacks.
-   */
-  pid_late = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (process));
-  if (pid_late != pid_early)
-    {
-      if (pid_late == -1)
-        {
-          g_warning ("Process %d terminated", (gint) pid_early);
-          g_set_error (error,
-                       POLKIT_ERROR,
-                       POLKIT_ERROR_FAILED,
-                       "Process %d terminated", (gint) pid_early);
-        }
-      else
-      {
-        g_warning ("Process changed pid from %d to %d", (gint) pid_early, (gint) pid_late);
-        g_set_error (error,
-                     POLKIT_ERROR,
-                     POLKIT_ERROR_FAILED,
-                     "Process changed pid from %d to %d", (gint) pid_early, (gint) pid_late);
-      }
-      goto out;
-    }
-
-  set_property_int32 (cx, "pid", pid_early);
-  set_property_str (cx, "user", user_name);
-  set_property_strv (cx, "groups", groups);
-  set_property_str (cx, "seat", seat_str);
-  set_property_str (cx, "session", session_str);
-  set_property_str (cx, "system_unit", system_unit);
+  set_property_int32 (cx, "pid", info.pid);
+  set_property_str (cx, "user", info.user);
+  set_property_strv (cx, "groups", info.groups);
+  set_property_str (cx, "seat", info.seat);
+  set_property_str (cx, "session", info.session);
+  set_property_str (cx, "system_unit", info.system_unit);
   /* If we have a unit, also record if it has the NoNewPrivileges setting enabled */
-  if (system_unit)
-    set_property_bool (cx, "no_new_privileges", no_new_privs);
+  if (info.system_unit)
+    set_property_bool (cx, "no_new_privileges", info.no_new_privileges);
   set_property_bool (cx, "local", subject_is_local);
   set_property_bool (cx, "active", subject_is_active);
 
-  ret = TRUE;
-
- out:
-  if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
-    g_object_unref (process);
-  free (session_str);
-  free (seat_str);
-  free (system_unit);
-  g_free (user_name);
-  if (groups != NULL)
-    g_ptr_array_unref (groups);
-  if (gids_from_dbus != NULL)
-    g_array_unref (gids_from_dbus);
-
-  return ret;
+  polkit_backend_common_js_subject_info_clear (&info);
+  return TRUE;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -562,8 +596,9 @@ push_action_and_details (duk_context               *cx,
                          PolkitDetails             *details,
                          GError                   **error)
 {
-  gchar **keys;
-  guint n;
+  PolkitDetailsIter iter;
+  const gchar *key;
+  const gchar *value;
 
   if (!duk_get_global_string (cx, "Action")) {
     return FALSE;
@@ -573,26 +608,53 @@ push_action_and_details (duk_context               *cx,
 
   set_property_str (cx, "id", action_id);
 
-  keys = polkit_details_get_keys (details);
-  for (n = 0; keys != NULL && keys[n] != NULL; n++)
+  polkit_details_iter_init (&iter, details);
+  while (polkit_details_iter_next (&iter, &key, &value))
     {
-      gchar *key;
-      const gchar *value;
-      key = g_strdup_printf ("_detail_%s", keys[n]);
-      value = polkit_details_lookup (details, keys[n]);
-      set_property_str (cx, key, value);
-      g_free (key);
+      duk_push_string (cx, value);
+      duk_push_sprintf (cx, "_detail_%s", key);
+      duk_insert (cx, -2);
+      duk_put_prop (cx, -3);
     }
-  g_strfreev (keys);
 
   return TRUE;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Whether the check the rules are being run for has been cancelled,
+ * which may happen on another thread while they run.
+ */
+static gboolean
+rules_are_cancelled (PolkitBackendJsAuthority *authority)
+{
+  GCancellable *cancellable = authority->priv->cancellable;
+
+  return cancellable != NULL && g_cancellable_is_cancelled (cancellable);
+}
+
+#ifdef DUK_USE_EXEC_TIMEOUT_CHECK
+/* Duktape calls DUK_USE_EXEC_TIMEOUT_CHECK every so often while running
+ * JS, if its duk_config.h defines it. For a build that defines it as
+ * polkit_backend_js_authority_exec_timeout_check (udata), a cancelled
+ * check stops in the middle of a rule; @udata is the authority, see
+ * duk_create_heap() in polkit_backend_common_js_authority_constructed().
+ */
+duk_bool_t polkit_backend_js_authority_exec_timeout_check (void *udata);
+
+duk_bool_t
+polkit_backend_js_authority_exec_timeout_check (void *udata)
+{
+  return rules_are_cancelled (POLKIT_BACKEND_JS_AUTHORITY (udata));
+}
+#endif
+
 typedef struct {
   PolkitBackendJsAuthority *authority;
   const gchar *filename;
+  duk_idx_t nargs;
+  GCancellable *cancellable;
+  gboolean cancelled;
   pthread_cond_t cond;
   pthread_mutex_t mutex;
   gint ret;
@@ -696,12 +758,14 @@ runaway_killer_thread_call_js (gpointer user_data)
     goto err;
   }
 
-  if (duk_pcall_prop (cx, 0, 2) != DUK_EXEC_SUCCESS)
+  if (duk_pcall_prop (cx, 0, ctx->nargs) != DUK_EXEC_SUCCESS)
     {
-      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (ctx->authority),
-                                    LOG_LEVEL_ERROR,
-                                    "Error evaluating admin rules: %s",
-                                    duk_safe_to_string (cx, -1));
+      /* polkit.spawn() throws once the check is cancelled, which is expected */
+      if (!rules_are_cancelled (ctx->authority))
+        polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (ctx->authority),
+                                      LOG_LEVEL_ERROR,
+                                      "Error evaluating admin rules: %s",
+                                      duk_safe_to_string (cx, -1));
       goto err;
     }
 
@@ -758,11 +822,29 @@ end:
 #  define PK_CLOCK CLOCK_REALTIME
 #endif /* ! HAVE_PTHREAD_CONDATTR_SETCLOCK */
 
+#ifndef DUK_USE_EXEC_TIMEOUT_CHECK
+/* Wakes up runaway_killer_common(), possibly on another thread, to stop
+ * the JS the same way as if it had run away
+ */
+static void
+on_rules_cancelled (GCancellable *cancellable,
+                    gpointer      user_data)
+{
+  RunawayKillerCtx *ctx = user_data;
+
+  pthread_mutex_lock (&ctx->mutex);
+  ctx->cancelled = TRUE;
+  pthread_cond_signal (&ctx->cond);
+  pthread_mutex_unlock (&ctx->mutex);
+}
+#endif
+
 static gboolean
 runaway_killer_common(PolkitBackendJsAuthority *authority, RunawayKillerCtx *ctx, void *js_context_cb (void *user_data))
 {
   int pthread_err;
   gboolean cancel = FALSE;
+  gulong cancelled_id = 0;
 #ifdef HAVE_PTHREAD_CONDATTR_SETCLOCK
   pthread_condattr_t attr;
 #endif
@@ -819,20 +901,46 @@ runaway_killer_common(PolkitBackendJsAuthority *authority, RunawayKillerCtx *ctx
     goto err_clean_cond;
   }
 
+#ifndef DUK_USE_EXEC_TIMEOUT_CHECK
+  /* Without an interrupt hook in Duktape, the rules of a cancelled check
+   * can only be stopped like runaway ones. The handler takes the mutex,
+   * and runs right away if the check is already cancelled.
+   */
+  if (ctx->cancellable != NULL)
+    {
+      pthread_mutex_unlock (&ctx->mutex);
+      cancelled_id = g_cancellable_connect (ctx->cancellable, G_CALLBACK (on_rules_cancelled), ctx, NULL);
+      pthread_mutex_lock (&ctx->mutex);
+    }
+#endif
+
   while (ctx->ret == RUNAWAY_KILLER_THREAD_EXIT_STATUS_UNSET) /* loop to treat spurious wakeups */
-    if (pthread_cond_timedwait(&ctx->cond, &ctx->mutex, &abs_time) == ETIMEDOUT) {
-      cancel = TRUE;
+    {
+      if (ctx->cancelled) {
+        cancel = TRUE;
+        break;
+      }
 
-      /* Log that we are terminating the script */
-      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
-                                    LOG_LEVEL_WARNING,
-                                    "Terminating runaway script after %d seconds",
-                                    RUNAWAY_KILLER_TIMEOUT);
+      if (pthread_cond_timedwait(&ctx->cond, &ctx->mutex, &abs_time) == ETIMEDOUT) {
+        cancel = TRUE;
 
-      break;
+        /* Log that we are terminating the script */
+        polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                      LOG_LEVEL_WARNING,
+                                      "Terminating runaway script after %d seconds",
+                                      RUNAWAY_KILLER_TIMEOUT);
+
+        break;
+      }
     }
 
-  if ((pthread_err = pthread_mutex_unlock(&ctx->mutex))) {
+  pthread_err = pthread_mutex_unlock(&ctx->mutex);
+
+  /* without the mutex, as the handler may be waiting for it */
+  if (cancelled_id != 0)
+    g_cancellable_disconnect (ctx->cancellable, cancelled_id);
+
+  if (pthread_err) {
     polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
                                   LOG_LEVEL_ERROR,
                                   "Error unlocking mutex: %s",
@@ -881,50 +989,45 @@ execute_script_with_runaway_killer(PolkitBackendJsAuthority *authority,
   return runaway_killer_common(authority, &ctx, &runaway_killer_thread_execute_js);
 }
 
-/* Calls already stacked function and args. Blocking for at most
- * RUNAWAY_KILLER_TIMEOUT. If timeout is the case, ctx.ret will be
- * RUNAWAY_KILLER_THREAD_EXIT_STATUS_UNSET, thus returning FALSE.
+/* Calls already stacked function and @nargs args, for the check
+ * @cancellable belongs to if not %NULL. Blocking for at most
+ * RUNAWAY_KILLER_TIMEOUT, or until @cancellable is cancelled. If either
+ * is the case, ctx.ret will be RUNAWAY_KILLER_THREAD_EXIT_STATUS_UNSET,
+ * thus returning FALSE.
  */
 static gboolean
-call_js_function_with_runaway_killer(PolkitBackendJsAuthority *authority)
+call_js_function_with_runaway_killer(PolkitBackendJsAuthority *authority,
+                                     duk_idx_t nargs,
+                                     GCancellable *cancellable)
 {
-  RunawayKillerCtx ctx = {.authority = authority,
+  RunawayKillerCtx ctx = {.authority = authority, .nargs = nargs,
+                          .cancellable = cancellable,
                           .ret = RUNAWAY_KILLER_THREAD_EXIT_STATUS_UNSET,
                           .mutex = PTHREAD_MUTEX_INITIALIZER,
                           .cond = PTHREAD_COND_INITIALIZER};
+  gboolean ret;
+
+  authority->priv->cancellable = cancellable;
+  ret = runaway_killer_common(authority, &ctx, &runaway_killer_thread_call_js);
+  authority->priv->cancellable = NULL;
 
-  return runaway_killer_common(authority, &ctx, &runaway_killer_thread_call_js);
+  return ret;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-GList *
-polkit_backend_common_js_authority_get_admin_auth_identities (PolkitBackendInteractiveAuthority *_authority,
-                                                              PolkitSubject                     *caller,
-                                                              PolkitSubject                     *subject,
-                                                              PolkitIdentity                    *user_for_subject,
-                                                              gboolean                           subject_is_local,
-                                                              gboolean                           subject_is_active,
-                                                              const gchar                       *action_id,
-                                                              PolkitDetails                     *details)
+/* Pushes the Action and Subject objects every rule function takes */
+static gboolean
+push_rules_arguments (PolkitBackendJsAuthority *authority,
+                      PolkitSubject            *subject,
+                      PolkitIdentity           *user_for_subject,
+                      gboolean                  subject_is_local,
+                      gboolean                  subject_is_active,
+                      const gchar              *action_id,
+                      PolkitDetails            *details)
 {
-  PolkitBackendJsAuthority *authority = POLKIT_BACKEND_JS_AUTHORITY (_authority);
-  GList *ret = NULL;
-  guint n;
-  GError *error = NULL;
-  const char *ret_str = NULL;
-  gchar **ret_strs = NULL;
   duk_context *cx = authority->priv->cx;
-
-  duk_set_top (cx, 0);
-  if (!duk_get_global_string (cx, "polkit")) {
-      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
-                                    LOG_LEVEL_ERROR,
-                                    "Error deleting old rules, not loading new ones");
-      goto out;
-  }
-
-  duk_push_string (cx, "_runAdminRules");
+  GError *error = NULL;
 
   if (!push_action_and_details (cx, action_id, details, &error))
     {
@@ -933,7 +1036,7 @@ polkit_backend_common_js_authority_get_admin_auth_identities (PolkitBackendInter
                                     "Error converting action and details to JS object: %s",
                                     error->message);
       g_clear_error (&error);
-      goto out;
+      return FALSE;
     }
 
   if (!push_subject (cx, subject, user_for_subject, subject_is_local, subject_is_active, &error))
@@ -943,13 +1046,21 @@ polkit_backend_common_js_authority_get_admin_auth_identities (PolkitBackendInter
                                     "Error converting subject to JS object: %s",
                                     error->message);
       g_clear_error (&error);
-      goto out;
+      return FALSE;
     }
 
-  if (!call_js_function_with_runaway_killer (authority))
-    goto out;
+  return TRUE;
+}
 
-  ret_str = duk_require_string (cx, -1);
+/* Parses the comma-separated identities _runAdminRules() returns */
+static GList *
+admin_identities_from_string (PolkitBackendJsAuthority *authority,
+                              const gchar              *ret_str)
+{
+  GList *ret = NULL;
+  gchar **ret_strs;
+  GError *error = NULL;
+  guint n;
 
   ret_strs = g_strsplit (ret_str, ",", -1);
   for (n = 0; ret_strs != NULL && ret_strs[n] != NULL; n++)
@@ -972,10 +1083,74 @@ polkit_backend_common_js_authority_get_admin_auth_identities (PolkitBackendInter
           ret = g_list_prepend (ret, identity);
         }
     }
-  ret = g_list_reverse (ret);
+  g_strfreev (ret_strs);
+
+  return g_list_reverse (ret);
+}
+
+/* Parses the value _runRules() returned, at the top of the stack, into
+ * @inout_implicit; it is left alone if no rule handled the action.
+ */
+static gboolean
+rules_result_to_implicit_authorization (PolkitBackendJsAuthority    *authority,
+                                        PolkitImplicitAuthorization *inout_implicit)
+{
+  duk_context *cx = authority->priv->cx;
+  const gchar *ret_str;
+
+  /* this is fine, means there was no match, use implicit authorizations */
+  if (duk_is_null (cx, -1))
+    return TRUE;
+
+  ret_str = duk_require_string (cx, -1);
+  if (!polkit_implicit_authorization_from_string (ret_str, inout_implicit))
+    {
+      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                    LOG_LEVEL_WARNING,
+                                    "Returned result `%s' is not valid",
+                                    ret_str);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+GList *
+polkit_backend_common_js_authority_get_admin_auth_identities (PolkitBackendInteractiveAuthority *_authority,
+                                                              PolkitSubject                     *caller,
+                                                              PolkitSubject                     *subject,
+                                                              PolkitIdentity                    *user_for_subject,
+                                                              gboolean                           subject_is_local,
+                                                              gboolean                           subject_is_active,
+                                                              const gchar                       *action_id,
+                                                              PolkitDetails                     *details)
+{
+  PolkitBackendJsAuthority *authority = POLKIT_BACKEND_JS_AUTHORITY (_authority);
+  GList *ret = NULL;
+  duk_context *cx = authority->priv->cx;
+
+  duk_set_top (cx, 0);
+  if (!duk_get_global_string (cx, "polkit")) {
+      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                    LOG_LEVEL_ERROR,
+                                    "Error deleting old rules, not loading new ones");
+      goto out;
+  }
+
+  duk_push_string (cx, "_runAdminRules");
+
+  if (!push_rules_arguments (authority, subject, user_for_subject, subject_is_local, subject_is_active,
+                             action_id, details))
+    goto out;
+
+  if (!call_js_function_with_runaway_killer (authority, 2, NULL))
+    goto out;
+
+  ret = admin_identities_from_string (authority, duk_require_string (cx, -1));
 
  out:
-  g_strfreev (ret_strs);
   /* fallback to root password auth */
   if (ret == NULL)
     ret = g_list_prepend (ret, polkit_unix_user_new (0));
@@ -985,21 +1160,26 @@ polkit_backend_common_js_authority_get_admin_auth_identities (PolkitBackendInter
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-PolkitImplicitAuthorization
-polkit_backend_common_js_authority_check_authorization_sync (PolkitBackendInteractiveAuthority *_authority,
-                                                             PolkitSubject                     *caller,
-                                                             PolkitSubject                     *subject,
-                                                             PolkitIdentity                    *user_for_subject,
-                                                             gboolean                           subject_is_local,
-                                                             gboolean                           subject_is_active,
-                                                             const gchar                       *action_id,
-                                                             PolkitDetails                     *details,
-                                                             PolkitImplicitAuthorization        implicit)
+/* Runs the authorization rules and, if @out_admin_identities is not
+ * %NULL and the result is an admin challenge, the admin rules in a
+ * single call of polkit._runRulesAndAdminRules(), which returns both
+ * results. If the admin rules throw, the result of the authorization
+ * rules stands and root is the one to authenticate, as with
+ * polkit_backend_common_js_authority_get_admin_auth_identities().
+ */
+static PolkitImplicitAuthorization
+check_authorization (PolkitBackendJsAuthority    *authority,
+                     PolkitSubject               *subject,
+                     PolkitIdentity              *user_for_subject,
+                     gboolean                     subject_is_local,
+                     gboolean                     subject_is_active,
+                     const gchar                 *action_id,
+                     PolkitDetails               *details,
+                     PolkitImplicitAuthorization  implicit,
+                     GList                      **out_admin_identities,
+                     GCancellable                *cancellable)
 {
-  PolkitBackendJsAuthority *authority = POLKIT_BACKEND_JS_AUTHORITY (_authority);
   PolkitImplicitAuthorization ret = implicit;
-  GError *error = NULL;
-  gchar *ret_str = NULL;
   gboolean good = FALSE;
   duk_context *cx = authority->priv->cx;
 
@@ -1008,61 +1188,101 @@ polkit_backend_common_js_authority_check_authorization_sync (PolkitBackendIntera
       goto out;
   }
 
-  duk_push_string (cx, "_runRules");
+  duk_push_string (cx, out_admin_identities != NULL ? "_runRulesAndAdminRules" : "_runRules");
 
-  if (!push_action_and_details (cx, action_id, details, &error))
-    {
-      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
-                                    LOG_LEVEL_ERROR,
-                                    "Error converting action and details to JS object: %s",
-                                    error->message);
-      g_clear_error (&error);
-      goto out;
-    }
+  if (!push_rules_arguments (authority, subject, user_for_subject, subject_is_local, subject_is_active,
+                             action_id, details))
+    goto out;
 
-  if (!push_subject (cx, subject, user_for_subject, subject_is_local, subject_is_active, &error))
+  if (out_admin_identities == NULL)
     {
-      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
-                                    LOG_LEVEL_ERROR,
-                                    "Error converting subject to JS object: %s",
-                                    error->message);
-      g_clear_error (&error);
+      // If any error is the js context happened (ctx.ret ==
+      // RUNAWAY_KILLER_THREAD_EXIT_STATUS_FAILURE) or it never properly returned
+      // (runaway scripts, cancelled checks or ctx.ret ==
+      // RUNAWAY_KILLER_THREAD_EXIT_STATUS_UNSET), unauthorize
+      if (!call_js_function_with_runaway_killer (authority, 2, cancellable))
+        goto out;
+
+      good = rules_result_to_implicit_authorization (authority, &ret);
       goto out;
     }
 
-  // If any error is the js context happened (ctx.ret ==
-  // RUNAWAY_KILLER_THREAD_EXIT_STATUS_FAILURE) or it never properly returned
-  // (runaway scripts or ctx.ret == RUNAWAY_KILLER_THREAD_EXIT_STATUS_UNSET),
-  // unauthorize
-  if (!call_js_function_with_runaway_killer (authority))
+  duk_push_string (cx, polkit_implicit_authorization_to_string (implicit));
+  if (!call_js_function_with_runaway_killer (authority, 3, cancellable))
     goto out;
 
-  if (duk_is_null(cx, -1)) {
-    /* this is fine, means there was no match, use implicit authorizations */
-    good = TRUE;
+  /* [ret, adminRet] */
+  duk_get_prop_index (cx, -1, 0);
+  good = rules_result_to_implicit_authorization (authority, &ret);
+  duk_pop (cx);
+  if (!good)
     goto out;
-  }
-  ret_str = g_strdup (duk_require_string (cx, -1));
-  if (!polkit_implicit_authorization_from_string (ret_str, &ret))
-    {
-      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
-                                    LOG_LEVEL_WARNING,
-                                    "Returned result `%s' is not valid",
-                                    ret_str);
-      goto out;
-    }
 
-  good = TRUE;
+  if (ret != POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED &&
+      ret != POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED)
+    goto out;
+
+  duk_get_prop_index (cx, -1, 1);
+  if (duk_is_string (cx, -1))
+    *out_admin_identities = admin_identities_from_string (authority, duk_get_string (cx, -1));
+  duk_pop (cx);
+
+  /* fallback to root password auth */
+  if (*out_admin_identities == NULL)
+    *out_admin_identities = g_list_prepend (NULL, polkit_unix_user_new (0));
 
  out:
+  /* the caller throws the result away, and a rule may have caught
+   * the error it was stopped with
+   */
+  if (cancellable != NULL && g_cancellable_is_cancelled (cancellable))
+    {
+      authority->priv->num_rule_evaluations_cancelled++;
+      good = FALSE;
+    }
+
   if (!good)
     ret = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED;
-  if (ret_str != NULL)
-      g_free (ret_str);
 
   return ret;
 }
 
+PolkitImplicitAuthorization
+polkit_backend_common_js_authority_check_authorization_sync (PolkitBackendInteractiveAuthority *_authority,
+                                                             PolkitSubject                     *caller,
+                                                             PolkitSubject                     *subject,
+                                                             PolkitIdentity                    *user_for_subject,
+                                                             gboolean                           subject_is_local,
+                                                             gboolean                           subject_is_active,
+                                                             const gchar                       *action_id,
+                                                             PolkitDetails                     *details,
+                                                             PolkitImplicitAuthorization        implicit)
+{
+  return check_authorization (POLKIT_BACKEND_JS_AUTHORITY (_authority),
+                              subject, user_for_subject, subject_is_local, subject_is_active,
+                              action_id, details, implicit,
+                              NULL, NULL);
+}
+
+PolkitImplicitAuthorization
+polkit_backend_common_js_authority_check_authorization_and_get_admin_identities_sync (PolkitBackendInteractiveAuthority *_authority,
+                                                                                      PolkitSubject                     *caller,
+                                                                                      PolkitSubject                     *subject,
+                                                                                      PolkitIdentity                    *user_for_subject,
+                                                                                      gboolean                           subject_is_local,
+                                                                                      gboolean                           subject_is_active,
+                                                                                      const gchar                       *action_id,
+                                                                                      PolkitDetails                     *details,
+                                                                                      PolkitImplicitAuthorization        implicit,
+                                                                                      GList                            **out_admin_identities,
+                                                                                      GCancellable                      *cancellable)
+{
+  return check_authorization (POLKIT_BACKEND_JS_AUTHORITY (_authority),
+                              subject, user_for_subject, subject_is_local, subject_is_active,
+                              action_id, details, implicit,
+                              out_admin_identities, cancellable);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static duk_ret_t
@@ -1078,6 +1298,8 @@ js_polkit_log (duk_context *cx)
 static duk_ret_t
 js_polkit_spawn (duk_context *cx)
 {
+  PolkitBackendJsAuthority *authority;
+  duk_memory_functions funcs;
   duk_ret_t ret = DUK_RET_ERROR;
   gchar *standard_output = NULL;
   gchar *standard_error = NULL;
@@ -1094,6 +1316,9 @@ js_polkit_spawn (duk_context *cx)
   if (!duk_is_array (cx, 0))
     goto out;
 
+  duk_get_memory_functions (cx, &funcs);
+  authority = POLKIT_BACKEND_JS_AUTHORITY (funcs.udata);
+
   array_len = duk_get_length (cx, 0);
 
   argv = g_new0 (gchar*, array_len + 1);
@@ -1112,7 +1337,8 @@ js_polkit_spawn (duk_context *cx)
   data.loop = loop;
   polkit_backend_common_spawn ((const gchar *const *) argv,
                                10, /* timeout_seconds */
-                               NULL, /* cancellable */
+                               /* the helper is killed if the check is cancelled */
+                               authority->priv->cancellable,
                                polkit_backend_common_spawn_cb,
                                &data);
 
@@ -1205,3 +1431,20 @@ js_polkit_user_is_in_netgroup (duk_context *cx)
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
+
+/* Checked by polkit._runRules() and polkit._runAdminRules() between
+ * rules. A cancelled check is also stopped in the middle of a rule, by
+ * polkit_backend_js_authority_exec_timeout_check() or else like a
+ * runaway script; this just saves starting the next one.
+ */
+static duk_ret_t
+js_polkit_is_cancelled (duk_context *cx)
+{
+  duk_memory_functions funcs;
+
+  duk_get_memory_functions (cx, &funcs);
+  duk_push_boolean (cx, rules_are_cancelled (POLKIT_BACKEND_JS_AUTHORITY (funcs.udata)));
+  return 1;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
@@ -20,6 +20,7 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <pwd.h>
 #include <grp.h>
 #ifdef HAVE_NETGROUP_H
@@ -30,14 +31,18 @@
 #include <string.h>
 #include <glib/gstdio.h>
 #include <locale.h>
+#include <gio/gunixfdlist.h>
 
 #include <polkit/polkit.h>
 #include "polkitbackendinteractiveauthority.h"
 #include "polkitbackendactionpool.h"
 #include "polkitbackendcommon.h"
 #include "polkitbackendsessionmonitor.h"
+#include "polkitbackendprivate.h"
+#include "polkitbackendtrace.h"
 
 #include <polkit/polkitprivate.h>
+#include <polkit/polkitimplicitsnapshot.h>
 
 /**
  * SECTION:polkitbackendinteractiveauthority
@@ -69,6 +74,53 @@ static const gchar *temporary_authorization_store_add_authorization (TemporaryAu
 static void temporary_authorization_store_remove_authorizations_for_system_bus_name (TemporaryAuthorizationStore *store,
                                                                                      const gchar *name);
 
+static gboolean temporary_authorization_store_is_empty (TemporaryAuthorizationStore *store);
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Everything a check needs to know about a subject (or the caller). It
+ * is filled in once per request, so each piece of information is
+ * looked up at most once however many implied actions get checked.
+ */
+typedef struct
+{
+  /* the subject as passed in */
+  PolkitSubject *subject;
+
+  /* a #PolkitUnixProcess for @subject, or %NULL if it is not a process or
+   * bus name; for bus names this carries the uid, gids and pidfd obtained
+   * with a single GetConnectionCredentials() call
+   */
+  PolkitSubject *process;
+
+  /* @subject and @process resolved once, see polkit_backend_subject_init() */
+  PolkitBackendSubject subject_key;
+  PolkitBackendSubject process_key;
+
+  /* set by subject_context_ensure_user() */
+  PolkitIdentity *user;
+  gboolean user_matches;
+
+  /* set by subject_context_ensure_session() */
+  gboolean have_session;
+  PolkitSubject *session;
+  PolkitBackendSubject session_key;
+  gboolean session_is_local;
+  gboolean session_is_active;
+
+  /* error from resolving @process, if any */
+  GError *error;
+} SubjectContext;
+
+static SubjectContext *subject_context_new  (PolkitSubject *subject);
+static void            subject_context_free (SubjectContext *context);
+
+static gboolean subject_context_ensure_user    (PolkitBackendInteractiveAuthority *authority,
+                                                SubjectContext                    *context,
+                                                GError                           **error);
+static void     subject_context_ensure_session (PolkitBackendInteractiveAuthority *authority,
+                                                SubjectContext                    *context);
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 struct AuthenticationAgent;
@@ -94,13 +146,13 @@ static AuthenticationAgent *authentication_agent_ref   (AuthenticationAgent *age
 static void                 authentication_agent_unref (AuthenticationAgent *agent);
 
 static void                authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
-                                                                    PolkitSubject               *subject,
-                                                                    PolkitIdentity              *user_of_subject,
+                                                                    SubjectContext              *subject_context,
                                                                     PolkitBackendInteractiveAuthority *authority,
                                                                     const gchar                 *action_id,
                                                                     PolkitDetails               *details,
-                                                                    PolkitSubject               *caller,
+                                                                    SubjectContext              *caller_context,
                                                                     PolkitImplicitAuthorization  implicit_authorization,
+                                                                    GList                       *admin_identities,
                                                                     GCancellable                *cancellable,
                                                                     AuthenticationAgentCallback  callback,
                                                                     gpointer                     user_data);
@@ -108,7 +160,7 @@ static void                authentication_agent_initiate_challenge (Authenticati
 static PolkitSubject *authentication_agent_get_scope (AuthenticationAgent *agent);
 
 static AuthenticationAgent *get_authentication_agent_for_subject (PolkitBackendInteractiveAuthority *authority,
-                                                                  PolkitSubject *subject);
+                                                                  SubjectContext *subject_context);
 
 
 static AuthenticationSession *get_authentication_session_for_uid_and_cookie (PolkitBackendInteractiveAuthority *authority,
@@ -149,14 +201,20 @@ static PolkitAuthorizationResult *polkit_backend_interactive_authority_check_aut
 
 static PolkitAuthorizationResult *check_authorization_sync (PolkitBackendAuthority         *authority,
                                                             PolkitSubject                  *caller,
-                                                            PolkitSubject                  *subject,
+                                                            SubjectContext                 *subject_context,
                                                             const gchar                    *action_id,
                                                             PolkitDetails                  *details,
                                                             PolkitCheckAuthorizationFlags   flags,
                                                             PolkitImplicitAuthorization    *out_implicit_authorization,
+                                                            GList                         **out_admin_identities,
                                                             gboolean                        checking_imply,
+                                                            GCancellable                   *cancellable,
                                                             GError                        **error);
 
+static guint    check_authorization_request_hash  (gconstpointer request);
+static gboolean check_authorization_request_equal (gconstpointer a,
+                                                   gconstpointer b);
+
 static gboolean polkit_backend_interactive_authority_register_authentication_agent (PolkitBackendAuthority   *authority,
                                                                                     PolkitSubject            *caller,
                                                                                     PolkitSubject            *subject,
@@ -184,6 +242,11 @@ static GList *polkit_backend_interactive_authority_enumerate_temporary_authoriza
                                                                                        GError                  **error);
 
 
+static GVariant *polkit_backend_interactive_authority_enumerate_temporary_authorizations_as_gvariant (PolkitBackendAuthority   *authority,
+                                                                                                     PolkitSubject            *caller,
+                                                                                                     PolkitSubject            *subject,
+                                                                                                     GError                  **error);
+
 static gboolean polkit_backend_interactive_authority_revoke_temporary_authorizations (PolkitBackendAuthority   *authority,
                                                                                       PolkitSubject            *caller,
                                                                                       PolkitSubject            *subject,
@@ -194,11 +257,32 @@ static gboolean polkit_backend_interactive_authority_revoke_temporary_authorizat
                                                                                            const gchar              *id,
                                                                                            GError                  **error);
 
+static void polkit_backend_interactive_authority_add_statistics (PolkitBackendAuthority *authority,
+                                                                GVariantBuilder        *builder);
+
+static void polkit_backend_interactive_authority_add_memory_usage (PolkitBackendAuthority *authority,
+                                                                   GVariantBuilder        *builder);
+
+static GVariant *polkit_backend_interactive_authority_get_implicit_authorizations (PolkitBackendAuthority *authority);
+
+static GVariant *polkit_backend_interactive_authority_enumerate_actions_as_gvariant (PolkitBackendAuthority   *authority,
+                                                                                    PolkitSubject            *caller,
+                                                                                    const gchar              *locale,
+                                                                                    const gchar              *id_prefix,
+                                                                                    const gchar              *annotation_key,
+                                                                                    const gchar              *annotation_value,
+                                                                                    guint                     offset,
+                                                                                    guint                     limit,
+                                                                                    guint                    *out_num_matches,
+                                                                                    GError                  **error);
+
 
 /* ---------------------------------------------------------------------------------------------------- */
 
 typedef struct
 {
+  /* the directories to load actions from or %NULL for the system ones */
+  gchar **action_dirs;
   PolkitBackendActionPool *action_pool;
 
   PolkitBackendSessionMonitor *session_monitor;
@@ -221,10 +305,44 @@ typedef struct
   guint name_owner_changed_signal_id;
 
   guint64 agent_serial;
+
+  /* Maps from the first CheckAuthorizationRequest* of a
+   * CoalescedCheck* to the CoalescedCheck*, for checks whose
+   * evaluation has not started yet
+   */
+  GHashTable *coalesced_checks;
+
+  /* number of checks whose subject or caller is still being resolved,
+   * i.e. that may still join a CoalescedCheck
+   */
+  guint num_checks_resolving;
+
+  /* Maps from action id to GINT_TO_POINTER (1) if the rules ignore the
+   * subject for checks of it and all actions implying it, or
+   * GINT_TO_POINTER (2) if not; see action_is_subject_independent().
+   * Cleared on "changed".
+   */
+  GHashTable *subject_independent_actions;
+
+  /* see polkit_backend_interactive_authority_add_statistics() */
+  guint64 num_checks_cancelled;
+  guint64 num_rule_evaluations_skipped;
+  guint64 num_checks_coalesced;
+  guint64 max_checks_coalesced;
+  guint64 num_admin_identities_truncated;
+
+  /* see polkit_backend_interactive_authority_set_max_admin_identities() */
+  guint max_admin_identities;
 } PolkitBackendInteractiveAuthorityPrivate;
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+enum
+{
+  PROP_0,
+  PROP_ACTION_DIRS,
+};
+
 G_DEFINE_TYPE_WITH_PRIVATE (PolkitBackendInteractiveAuthority,
                             polkit_backend_interactive_authority,
                             POLKIT_BACKEND_TYPE_AUTHORITY);
@@ -246,6 +364,17 @@ action_pool_changed (PolkitBackendActionPool *action_pool,
   g_signal_emit_by_name (authority, "changed");
 }
 
+/* new rules or actions, see action_is_subject_independent() */
+static void
+on_changed (PolkitBackendInteractiveAuthority *authority,
+            gpointer                           user_data)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  priv = polkit_backend_interactive_authority_get_instance_private (authority);
+  g_hash_table_remove_all (priv->subject_independent_actions);
+}
+
 
 /* ---------------------------------------------------------------------------------------------------- */
 
@@ -291,32 +420,24 @@ polkit_backend_interactive_authority_init (PolkitBackendInteractiveAuthority *au
   PolkitBackendInteractiveAuthorityPrivate *priv;
   GError *error;
 
-  const gchar* directories[] = {
-    PACKAGE_SYSCONF_DIR "/polkit-1/actions",
-    "/run/polkit-1/actions",
-    "/usr/local/share/polkit-1/actions",
-    PACKAGE_DATA_DIR "/polkit-1/actions",
-    NULL
-  };
-
   /* Force registering error domain */
   (void)POLKIT_ERROR;
 
   priv = polkit_backend_interactive_authority_get_instance_private (authority);
 
-  priv->action_pool = polkit_backend_action_pool_new (directories);
-  g_signal_connect (priv->action_pool,
-                    "changed",
-                    (GCallback) action_pool_changed,
-                    authority);
-
   priv->temporary_authorization_store = temporary_authorization_store_new (authority);
 
-  priv->hash_scope_to_authentication_agent = g_hash_table_new_full ((GHashFunc) polkit_subject_hash,
-                                                                    (GEqualFunc) polkit_subject_equal,
-                                                                    (GDestroyNotify) g_object_unref,
+  /* keys are the scope_key of the agent they map to */
+  priv->hash_scope_to_authentication_agent = g_hash_table_new_full (polkit_backend_subject_hash_func,
+                                                                    polkit_backend_subject_equal_func,
+                                                                    NULL,
                                                                     (GDestroyNotify) authentication_agent_unref);
 
+  priv->coalesced_checks = g_hash_table_new (check_authorization_request_hash,
+                                             check_authorization_request_equal);
+  priv->subject_independent_actions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_signal_connect (authority, "changed", G_CALLBACK (on_changed), NULL);
+
   priv->session_monitor = polkit_backend_session_monitor_new ();
   g_signal_connect (priv->session_monitor,
                     "changed",
@@ -347,6 +468,60 @@ polkit_backend_interactive_authority_init (PolkitBackendInteractiveAuthority *au
     }
 }
 
+static void
+polkit_backend_interactive_authority_constructed (GObject *object)
+{
+  PolkitBackendInteractiveAuthority *authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  const gchar* directories[] = {
+    PACKAGE_SYSCONF_DIR "/polkit-1/actions",
+    "/run/polkit-1/actions",
+    "/usr/local/share/polkit-1/actions",
+    PACKAGE_DATA_DIR "/polkit-1/actions",
+    NULL
+  };
+
+  authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (object);
+  priv = polkit_backend_interactive_authority_get_instance_private (authority);
+
+  priv->action_pool = polkit_backend_action_pool_new (priv->action_dirs != NULL ?
+                                                      (const gchar **) priv->action_dirs :
+                                                      directories);
+  g_signal_connect (priv->action_pool,
+                    "changed",
+                    (GCallback) action_pool_changed,
+                    authority);
+
+  if (G_OBJECT_CLASS (polkit_backend_interactive_authority_parent_class)->constructed != NULL)
+    G_OBJECT_CLASS (polkit_backend_interactive_authority_parent_class)->constructed (object);
+}
+
+static void
+polkit_backend_interactive_authority_set_property (GObject      *object,
+                                                  guint         prop_id,
+                                                  const GValue *value,
+                                                  GParamSpec   *pspec)
+{
+  PolkitBackendInteractiveAuthority *authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (object);
+  priv = polkit_backend_interactive_authority_get_instance_private (authority);
+
+  switch (prop_id)
+    {
+    case PROP_ACTION_DIRS:
+      g_strfreev (priv->action_dirs);
+      priv->action_dirs = g_value_dup_boxed (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
 static void
 polkit_backend_interactive_authority_finalize (GObject *object)
 {
@@ -364,6 +539,7 @@ polkit_backend_interactive_authority_finalize (GObject *object)
 
   if (priv->action_pool != NULL)
     g_object_unref (priv->action_pool);
+  g_strfreev (priv->action_dirs);
 
   if (priv->session_monitor != NULL)
     g_object_unref (priv->session_monitor);
@@ -372,6 +548,10 @@ polkit_backend_interactive_authority_finalize (GObject *object)
 
   g_hash_table_unref (priv->hash_scope_to_authentication_agent);
 
+  /* pending checks keep a reference to us */
+  g_hash_table_unref (priv->coalesced_checks);
+  g_hash_table_unref (priv->subject_independent_actions);
+
   G_OBJECT_CLASS (polkit_backend_interactive_authority_parent_class)->finalize (object);
 }
 
@@ -402,7 +582,9 @@ polkit_backend_interactive_authority_class_init (PolkitBackendInteractiveAuthori
   gobject_class = G_OBJECT_CLASS (klass);
   authority_class = POLKIT_BACKEND_AUTHORITY_CLASS (klass);
 
-  gobject_class->finalize = polkit_backend_interactive_authority_finalize;
+  gobject_class->constructed  = polkit_backend_interactive_authority_constructed;
+  gobject_class->set_property = polkit_backend_interactive_authority_set_property;
+  gobject_class->finalize     = polkit_backend_interactive_authority_finalize;
 
   authority_class->get_name                        = polkit_backend_interactive_authority_get_name;
   authority_class->get_version                     = polkit_backend_interactive_authority_get_version;
@@ -416,6 +598,27 @@ polkit_backend_interactive_authority_class_init (PolkitBackendInteractiveAuthori
   authority_class->enumerate_temporary_authorizations = polkit_backend_interactive_authority_enumerate_temporary_authorizations;
   authority_class->revoke_temporary_authorizations = polkit_backend_interactive_authority_revoke_temporary_authorizations;
   authority_class->revoke_temporary_authorization_by_id = polkit_backend_interactive_authority_revoke_temporary_authorization_by_id;
+  authority_class->add_memory_usage                = polkit_backend_interactive_authority_add_memory_usage;
+  authority_class->get_implicit_authorizations     = polkit_backend_interactive_authority_get_implicit_authorizations;
+  authority_class->enumerate_temporary_authorizations_as_gvariant = polkit_backend_interactive_authority_enumerate_temporary_authorizations_as_gvariant;
+  authority_class->enumerate_actions_as_gvariant   = polkit_backend_interactive_authority_enumerate_actions_as_gvariant;
+  authority_class->add_statistics                  = polkit_backend_interactive_authority_add_statistics;
+
+  /**
+   * PolkitBackendInteractiveAuthority:action-dirs:
+   *
+   * The directories to load action description files from, or %NULL
+   * for the system directories.
+   *
+   * Since: 127
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_ACTION_DIRS,
+                                   g_param_spec_boxed ("action-dirs",
+                                                       NULL,
+                                                       NULL,
+                                                       G_TYPE_STRV,
+                                                       G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE));
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -438,6 +641,34 @@ polkit_backend_interactive_authority_enumerate_actions (PolkitBackendAuthority
   return actions;
 }
 
+static GVariant *
+polkit_backend_interactive_authority_enumerate_actions_as_gvariant (PolkitBackendAuthority   *authority,
+                                                                    PolkitSubject            *caller,
+                                                                    const gchar              *locale,
+                                                                    const gchar              *id_prefix,
+                                                                    const gchar              *annotation_key,
+                                                                    const gchar              *annotation_value,
+                                                                    guint                     offset,
+                                                                    guint                     limit,
+                                                                    guint                    *out_num_matches,
+                                                                    GError                  **error)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
+  priv = polkit_backend_interactive_authority_get_instance_private (interactive_authority);
+
+  return polkit_backend_action_pool_enumerate_actions (priv->action_pool,
+                                                       locale,
+                                                       id_prefix,
+                                                       annotation_key,
+                                                       annotation_value,
+                                                       offset,
+                                                       limit,
+                                                       out_num_matches);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 struct AuthenticationAgent
@@ -446,6 +677,7 @@ struct AuthenticationAgent
 
   uid_t creator_uid;
   PolkitSubject *scope;
+  PolkitBackendSubject scope_key;
   guint64 serial;
 
   gchar *locale;
@@ -456,7 +688,8 @@ struct AuthenticationAgent
   gchar *cookie_prefix;
   guint64  cookie_serial;
 
-  GDBusProxy *proxy;
+  /* the system bus, calls to the agent go to object_path at unique_system_bus_name */
+  GDBusConnection *connection;
 
   GList *active_sessions;
 };
@@ -838,6 +1071,249 @@ may_identity_check_authorization (PolkitBackendInteractiveAuthority   *interacti
   return ret;
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+static SubjectContext *
+subject_context_new (PolkitSubject *subject)
+{
+  SubjectContext *context;
+
+  context = g_new0 (SubjectContext, 1);
+  context->subject = g_object_ref (subject);
+  polkit_backend_subject_init (&context->subject_key, context->subject);
+  if (context->subject_key.kind == POLKIT_BACKEND_SUBJECT_KIND_UNIX_PROCESS)
+    {
+      context->process = g_object_ref (subject);
+      context->process_key = context->subject_key;
+    }
+
+  return context;
+}
+
+static void
+subject_context_free (SubjectContext *context)
+{
+  g_object_unref (context->subject);
+  g_clear_object (&context->process);
+  g_clear_object (&context->user);
+  g_clear_object (&context->session);
+  g_clear_error (&context->error);
+  g_free (context);
+}
+
+static gboolean
+subject_context_ensure_user (PolkitBackendInteractiveAuthority *authority,
+                             SubjectContext                    *context,
+                             GError                           **error)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv = polkit_backend_interactive_authority_get_instance_private (authority);
+  PolkitBackendStageTimer timer;
+
+  if (context->user != NULL)
+    return TRUE;
+
+  polkit_backend_stage_begin (&timer, POLKIT_BACKEND_STAGE_SUBJECT_RESOLUTION);
+  if (context->subject_key.kind == POLKIT_BACKEND_SUBJECT_KIND_SYSTEM_BUS_NAME && context->process != NULL)
+    {
+      /* the bus already told us the uid along with the process */
+      context->user = polkit_unix_user_new (context->process_key.u.process.uid);
+      context->user_matches = TRUE;
+    }
+  else
+    {
+      context->user = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor,
+                                                                           context->subject,
+                                                                           &context->user_matches,
+                                                                           error);
+    }
+  polkit_backend_stage_end (&timer);
+
+  return context->user != NULL;
+}
+
+static void
+subject_context_ensure_session (PolkitBackendInteractiveAuthority *authority,
+                                SubjectContext                    *context)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv = polkit_backend_interactive_authority_get_instance_private (authority);
+  PolkitBackendStageTimer timer;
+
+  if (context->have_session)
+    return;
+
+  polkit_backend_stage_begin (&timer, POLKIT_BACKEND_STAGE_SESSION_LOOKUP);
+  /* a subject *may* be in a session */
+  context->session = polkit_backend_session_monitor_get_session_for_subject (priv->session_monitor,
+                                                                             context->process != NULL ? context->process : context->subject,
+                                                                             NULL);
+  if (context->session != NULL)
+    {
+      polkit_backend_subject_init (&context->session_key, context->session);
+      context->session_is_local = polkit_backend_session_monitor_is_session_local (priv->session_monitor, context->session);
+      context->session_is_active = polkit_backend_session_monitor_is_session_active (priv->session_monitor, context->session);
+    }
+  context->have_session = TRUE;
+  polkit_backend_stage_end (&timer);
+}
+
+/* The subject to hand to rules, the temporary authorization store and
+ * friends; the resolved process avoids another bus round trip for bus
+ * names.
+ */
+static PolkitSubject *
+subject_context_get_resolved_subject (SubjectContext *context)
+{
+  return context->process != NULL ? context->process : context->subject;
+}
+
+static const PolkitBackendSubject *
+subject_context_get_resolved_key (SubjectContext *context)
+{
+  return context->process != NULL ? &context->process_key : &context->subject_key;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  PolkitBackendInteractiveAuthority *authority;
+  gchar *action_id;
+  PolkitDetails *details;
+  PolkitCheckAuthorizationFlags flags;
+  GCancellable *cancellable;
+  GSimpleAsyncResult *simple;
+
+  SubjectContext *caller_context;
+  SubjectContext *subject_context;
+
+  /* number of subject contexts still being resolved */
+  guint num_pending;
+
+  /* see check_authorization_request_coalesce() */
+  gboolean coalesce_by_user;
+  gulong coalesced_cancelled_id;
+} CheckAuthorizationRequest;
+
+static void
+check_authorization_request_free (CheckAuthorizationRequest *request)
+{
+  g_object_unref (request->authority);
+  g_free (request->action_id);
+  if (request->details != NULL)
+    g_object_unref (request->details);
+  if (request->cancellable != NULL)
+    {
+      if (request->coalesced_cancelled_id != 0)
+        g_cancellable_disconnect (request->cancellable, request->coalesced_cancelled_id);
+      g_object_unref (request->cancellable);
+    }
+  subject_context_free (request->caller_context);
+  subject_context_free (request->subject_context);
+  g_free (request);
+}
+
+static void check_authorization_resolved (CheckAuthorizationRequest *request);
+
+/* Cancellation is checked between the stages of a check, so that a
+ * cancelled check stops costing anything at the next one.
+ */
+static gboolean
+set_error_if_cancelled (GCancellable  *cancellable,
+                        GError       **error)
+{
+  if (cancellable == NULL || !g_cancellable_is_cancelled (cancellable))
+    return FALSE;
+
+  g_set_error_literal (error,
+                       POLKIT_ERROR,
+                       POLKIT_ERROR_CANCELLED,
+                       "The authorization check was cancelled");
+  return TRUE;
+}
+
+/* Only used before the rules are run */
+static gboolean
+check_authorization_request_complete_if_cancelled (CheckAuthorizationRequest *request)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  GError *error = NULL;
+
+  if (!set_error_if_cancelled (request->cancellable, &error))
+    return FALSE;
+
+  priv = polkit_backend_interactive_authority_get_instance_private (request->authority);
+  priv->num_checks_cancelled++;
+  priv->num_rule_evaluations_skipped++;
+
+  g_simple_async_result_take_error (request->simple, error);
+  g_simple_async_result_complete (request->simple);
+  g_object_unref (request->simple);
+  return TRUE;
+}
+
+static void
+resolve_process_in_thread_func (GSimpleAsyncResult *simple,
+                                GObject            *object,
+                                GCancellable       *cancellable)
+{
+  SubjectContext *context;
+  PolkitBackendStageTimer timer;
+
+  context = g_simple_async_result_get_op_res_gpointer (simple);
+  polkit_backend_stage_begin (&timer, POLKIT_BACKEND_STAGE_SUBJECT_RESOLUTION);
+  context->process = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (object),
+                                                              cancellable,
+                                                              &context->error);
+  polkit_backend_stage_end (&timer);
+}
+
+static void
+on_subject_context_resolved (GObject      *source_object,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+  CheckAuthorizationRequest *request = user_data;
+  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (res);
+  SubjectContext *context;
+
+  /* set if the request was cancelled before the thread ran */
+  context = g_simple_async_result_get_op_res_gpointer (simple);
+  if (context->process == NULL && context->error == NULL)
+    g_simple_async_result_propagate_error (simple, &context->error);
+  if (context->process != NULL)
+    polkit_backend_subject_init (&context->process_key, context->process);
+
+  g_assert (request->num_pending > 0);
+  if (--request->num_pending == 0)
+    check_authorization_resolved (request);
+}
+
+/* Bus names need a round trip to the bus to get at the process; that
+ * is done on a worker thread so that the caller and the subject are
+ * resolved concurrently.
+ */
+static void
+check_authorization_request_resolve (CheckAuthorizationRequest *request,
+                                     SubjectContext            *context)
+{
+  GSimpleAsyncResult *simple;
+
+  if (context->subject_key.kind != POLKIT_BACKEND_SUBJECT_KIND_SYSTEM_BUS_NAME)
+    return;
+
+  simple = g_simple_async_result_new (G_OBJECT (context->subject),
+                                      on_subject_context_resolved,
+                                      request,
+                                      check_authorization_request_resolve);
+  g_simple_async_result_set_op_res_gpointer (simple, context, NULL);
+  request->num_pending++;
+  g_simple_async_result_run_in_thread (simple,
+                                       resolve_process_in_thread_func,
+                                       G_PRIORITY_DEFAULT,
+                                       request->cancellable);
+  g_object_unref (simple);
+}
+
 static void
 polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority         *authority,
                                                           PolkitSubject                  *caller,
@@ -849,38 +1325,23 @@ polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority
                                                           GAsyncReadyCallback             callback,
                                                           gpointer                        user_data)
 {
-  PolkitBackendInteractiveAuthority *interactive_authority;
   PolkitBackendInteractiveAuthorityPrivate *priv;
+  CheckAuthorizationRequest *request;
   gchar *caller_str;
   gchar *subject_str;
-  PolkitIdentity *user_of_caller;
-  PolkitIdentity *user_of_subject;
-  gboolean user_of_subject_matches;
-  gchar *user_of_caller_str;
-  gchar *user_of_subject_str;
-  PolkitAuthorizationResult *result;
-  PolkitImplicitAuthorization implicit_authorization;
-  GError *error;
-  GSimpleAsyncResult *simple;
-  gboolean has_details;
-  gchar **detail_keys;
-
-  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
-  priv = polkit_backend_interactive_authority_get_instance_private (interactive_authority);
 
-  error = NULL;
-  caller_str = NULL;
-  subject_str = NULL;
-  user_of_caller = NULL;
-  user_of_subject = NULL;
-  user_of_caller_str = NULL;
-  user_of_subject_str = NULL;
-  result = NULL;
+  priv = polkit_backend_interactive_authority_get_instance_private (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority));
 
-  simple = g_simple_async_result_new (G_OBJECT (authority),
-                                      callback,
-                                      user_data,
-                                      polkit_backend_interactive_authority_check_authorization);
+  request = g_new0 (CheckAuthorizationRequest, 1);
+  request->authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (g_object_ref (authority));
+  request->action_id = g_strdup (action_id);
+  request->details = details != NULL ? g_object_ref (details) : NULL;
+  request->flags = flags;
+  request->cancellable = cancellable != NULL ? g_object_ref (cancellable) : NULL;
+  request->simple = g_simple_async_result_new (G_OBJECT (authority),
+                                               callback,
+                                               user_data,
+                                               polkit_backend_interactive_authority_check_authorization);
 
   /* handle being called from ourselves */
   if (caller == NULL)
@@ -889,10 +1350,17 @@ polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority
       GDBusConnection *system_bus;
       system_bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, NULL);
       caller = polkit_system_bus_name_new (g_dbus_connection_get_unique_name (system_bus));
+      request->caller_context = subject_context_new (caller);
+      g_object_unref (caller);
       g_object_unref (system_bus);
     }
+  else
+    {
+      request->caller_context = subject_context_new (caller);
+    }
+  request->subject_context = subject_context_new (subject);
 
-  caller_str = polkit_subject_to_string (caller);
+  caller_str = polkit_subject_to_string (request->caller_context->subject);
   subject_str = polkit_subject_to_string (subject);
 
   g_debug ("%s is inquiring whether %s is authorized for %s",
@@ -900,48 +1368,388 @@ polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority
            subject_str,
            action_id);
 
-  user_of_caller = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor,
-                                                                        caller, NULL,
-                                                                        &error);
-  if (error != NULL)
-    {
-      g_simple_async_result_set_from_error (simple, error);
-      g_simple_async_result_complete (simple);
-      g_object_unref (simple);
-      g_error_free (error);
-      goto out;
-    }
+  g_free (caller_str);
+  g_free (subject_str);
 
-  user_of_caller_str = polkit_identity_to_string (user_of_caller);
-  g_debug (" user of caller is %s", user_of_caller_str);
+  priv->num_checks_resolving++;
+  check_authorization_request_resolve (request, request->caller_context);
+  check_authorization_request_resolve (request, request->subject_context);
+  if (request->num_pending == 0)
+    check_authorization_resolved (request);
+}
 
-  user_of_subject = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor,
-                                                                         subject, &user_of_subject_matches,
-                                                                         &error);
-  if (error != NULL)
-    {
-      g_simple_async_result_set_from_error (simple, error);
-      g_simple_async_result_complete (simple);
-      g_object_unref (simple);
-      g_error_free (error);
-      goto out;
+/* Identical non-interactive checks that arrive together, e.g. from a
+ * batch of services started at once that all ask about the same
+ * action, are answered by one evaluation. While other checks are still
+ * being resolved, the evaluation is deferred to the next main loop
+ * iteration to give identical ones a chance to join.
+ *
+ * The caller doesn't matter, since it was already allowed to ask and
+ * the rules don't see it. Normally checks are only identical if they
+ * have the same subject process, since rules see subject.pid and
+ * subject.system_unit and temporary authorizations are per process.
+ * When neither can tell the processes apart, see
+ * check_authorization_request_coalesce(), the user and session
+ * are enough.
+ */
+static GList *get_actions_implying (PolkitBackendInteractiveAuthority *authority,
+                                    const gchar                       *action_id);
+
+typedef struct
+{
+  PolkitBackendInteractiveAuthority *authority;
+  /* of CheckAuthorizationRequest*, the first is used as the hash table key */
+  GPtrArray *requests;
+  /* cancelled once every request in @requests is */
+  GCancellable *cancellable;
+  guint num_cancelled;
+} CoalescedCheck;
+
+static guint
+details_get_count (PolkitDetails *details)
+{
+  return details != NULL ? polkit_details_get_count (details) : 0;
+}
+
+static gboolean
+details_equal (PolkitDetails *a,
+               PolkitDetails *b)
+{
+  gchar **keys;
+  gboolean ret;
+  guint n;
+
+  if (details_get_count (a) != details_get_count (b))
+    return FALSE;
+  if (details_get_count (a) == 0)
+    return TRUE;
+
+  ret = TRUE;
+  keys = polkit_details_get_keys (a);
+  for (n = 0; keys[n] != NULL && ret; n++)
+    ret = g_strcmp0 (polkit_details_lookup (a, keys[n]), polkit_details_lookup (b, keys[n])) == 0;
+  g_strfreev (keys);
+
+  return ret;
+}
+
+static guint
+check_authorization_request_hash (gconstpointer _request)
+{
+  const CheckAuthorizationRequest *request = _request;
+  guint hash;
+
+  hash = g_str_hash (request->action_id);
+  if (!request->coalesce_by_user)
+    hash = hash * 31 + polkit_backend_subject_hash (subject_context_get_resolved_key (request->subject_context));
+  else if (request->subject_context->session != NULL)
+    hash = hash * 31 + polkit_backend_subject_hash (&request->subject_context->session_key);
+  hash = hash * 31 + details_get_count (request->details);
+  hash = hash * 31 + request->flags;
+
+  return hash;
+}
+
+static gboolean
+check_authorization_request_equal (gconstpointer _a,
+                                   gconstpointer _b)
+{
+  const CheckAuthorizationRequest *a = _a;
+  const CheckAuthorizationRequest *b = _b;
+
+  if (a->flags != b->flags ||
+      a->coalesce_by_user != b->coalesce_by_user ||
+      g_strcmp0 (a->action_id, b->action_id) != 0 ||
+      !polkit_identity_equal (a->subject_context->user, b->subject_context->user) ||
+      !details_equal (a->details, b->details))
+    return FALSE;
+
+  if (!a->coalesce_by_user)
+    return polkit_backend_subject_equal (subject_context_get_resolved_key (a->subject_context),
+                                         subject_context_get_resolved_key (b->subject_context));
+
+  if (a->subject_context->session == NULL || b->subject_context->session == NULL)
+    return a->subject_context->session == b->subject_context->session;
+  return polkit_backend_subject_equal (&a->subject_context->session_key, &b->subject_context->session_key) &&
+         a->subject_context->session_is_local == b->subject_context->session_is_local &&
+         a->subject_context->session_is_active == b->subject_context->session_is_active;
+}
+
+/* Whether the rules ignore the subject for checks of @action_id
+ * without details, and for the actions implying it, so that only the
+ * user, the session and temporary authorizations matter. Asked once
+ * per action until the rules or actions change.
+ */
+static gboolean
+action_is_subject_independent (PolkitBackendInteractiveAuthority *authority,
+                               const gchar                       *action_id)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitBackendInteractiveAuthorityClass *klass;
+  GPtrArray *action_ids;
+  gboolean *has_rules;
+  GList *actions;
+  GList *l;
+  gboolean ret;
+  gint cached;
+  guint n;
+
+  priv = polkit_backend_interactive_authority_get_instance_private (authority);
+  klass = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_CLASS (authority);
+
+  cached = GPOINTER_TO_INT (g_hash_table_lookup (priv->subject_independent_actions, action_id));
+  if (cached != 0)
+    return cached == 1;
+
+  actions = get_actions_implying (authority, action_id);
+  action_ids = g_ptr_array_new ();
+  g_ptr_array_add (action_ids, (gpointer) action_id);
+  for (l = actions; l != NULL; l = l->next)
+    g_ptr_array_add (action_ids, (gpointer) polkit_action_description_get_action_id (POLKIT_ACTION_DESCRIPTION (l->data)));
+  g_ptr_array_add (action_ids, NULL);
+
+  has_rules = g_new (gboolean, action_ids->len);
+  for (n = 0; n < action_ids->len; n++)
+    has_rules[n] = klass->check_authorization_sync != NULL;
+  if (klass->has_authorization_rules != NULL)
+    klass->has_authorization_rules (authority, (const gchar * const *) action_ids->pdata, has_rules);
+
+  ret = TRUE;
+  for (n = 0; n + 1 < action_ids->len; n++)
+    ret = ret && !has_rules[n];
+
+  g_hash_table_insert (priv->subject_independent_actions, g_strdup (action_id), GINT_TO_POINTER (ret ? 1 : 2));
+
+  g_free (has_rules);
+  g_ptr_array_unref (action_ids);
+  g_list_free_full (actions, g_object_unref);
+
+  return ret;
+}
+
+static void
+on_coalesced_request_cancelled (GCancellable *cancellable,
+                                gpointer      user_data)
+{
+  CoalescedCheck *check = user_data;
+
+  if (++check->num_cancelled == check->requests->len)
+    g_cancellable_cancel (check->cancellable);
+}
+
+static gboolean
+coalesced_check_run (gpointer user_data)
+{
+  CoalescedCheck *check = user_data;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  CheckAuthorizationRequest *request;
+  PolkitAuthorizationResult *result;
+  PolkitImplicitAuthorization implicit_authorization;
+  GPtrArray *requests;
+  GError *error;
+  guint n;
+
+  priv = polkit_backend_interactive_authority_get_instance_private (check->authority);
+
+  g_hash_table_remove (priv->coalesced_checks, g_ptr_array_index (check->requests, 0));
+
+  requests = g_ptr_array_new ();
+  for (n = 0; n < check->requests->len; n++)
+    {
+      request = g_ptr_array_index (check->requests, n);
+      if (check_authorization_request_complete_if_cancelled (request))
+        check_authorization_request_free (request);
+      else
+        g_ptr_array_add (requests, request);
     }
+  if (requests->len == 0)
+    goto out;
 
-  user_of_subject_str = polkit_identity_to_string (user_of_subject);
-  g_debug (" user of subject is %s", user_of_subject_str);
+  if (requests->len > 1)
+    {
+      priv->num_checks_coalesced += requests->len - 1;
+      priv->max_checks_coalesced = MAX (priv->max_checks_coalesced, requests->len);
+    }
+
+  /* an evaluation others are waiting for is only cut short when all of them give up */
+  request = g_ptr_array_index (requests, 0);
+  error = NULL;
+  implicit_authorization = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED;
+  result = check_authorization_sync (POLKIT_BACKEND_AUTHORITY (check->authority),
+                                     request->caller_context->subject,
+                                     request->subject_context,
+                                     request->action_id,
+                                     request->details,
+                                     request->flags,
+                                     &implicit_authorization,
+                                     NULL,
+                                     FALSE, /* checking_imply */
+                                     check->cancellable,
+                                     &error);
+  if (g_error_matches (error, POLKIT_ERROR, POLKIT_ERROR_CANCELLED))
+    priv->num_checks_cancelled++;
 
-  has_details = FALSE;
-  if (details != NULL)
+  for (n = 0; n < requests->len; n++)
     {
-      detail_keys = polkit_details_get_keys (details);
-      if (detail_keys != NULL)
-        {
-          if (g_strv_length (detail_keys) > 0)
-            has_details = TRUE;
-          g_strfreev (detail_keys);
-        }
+      request = g_ptr_array_index (requests, n);
+      if (error != NULL)
+        g_simple_async_result_set_from_error (request->simple, error);
+      else
+        g_simple_async_result_set_op_res_gpointer (request->simple,
+                                                   g_object_ref (result),
+                                                   g_object_unref);
+      g_simple_async_result_complete (request->simple);
+      g_object_unref (request->simple);
+      check_authorization_request_free (request);
+    }
+
+  if (error != NULL)
+    g_error_free (error);
+  if (result != NULL)
+    g_object_unref (result);
+
+ out:
+  g_ptr_array_unref (requests);
+  g_ptr_array_unref (check->requests);
+  g_object_unref (check->cancellable);
+  g_object_unref (check->authority);
+  g_free (check);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+coalesced_check_add (CoalescedCheck            *check,
+                     CheckAuthorizationRequest *request)
+{
+  g_ptr_array_add (check->requests, request);
+  if (request->cancellable != NULL)
+    request->coalesced_cancelled_id = g_cancellable_connect (request->cancellable,
+                                                             G_CALLBACK (on_coalesced_request_cancelled),
+                                                             check,
+                                                             NULL);
+}
+
+/* Takes ownership of @request */
+static void
+check_authorization_request_coalesce (CheckAuthorizationRequest *request)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  CoalescedCheck *check;
+
+  priv = polkit_backend_interactive_authority_get_instance_private (request->authority);
+
+  /* Processes of the same user in the same session can only be told
+   * apart by rules that look at the subject, or by a temporary
+   * authorization one of them holds; the latter is only ruled out
+   * cheaply when there are none at all.
+   */
+  if (details_get_count (request->details) == 0 &&
+      temporary_authorization_store_is_empty (priv->temporary_authorization_store) &&
+      action_is_subject_independent (request->authority, request->action_id))
+    {
+      subject_context_ensure_session (request->authority, request->subject_context);
+      request->coalesce_by_user = TRUE;
+    }
+
+  check = g_hash_table_lookup (priv->coalesced_checks, request);
+  if (check != NULL)
+    {
+      coalesced_check_add (check, request);
+      return;
+    }
+
+  check = g_new0 (CoalescedCheck, 1);
+  check->authority = g_object_ref (request->authority);
+  check->requests = g_ptr_array_new ();
+  check->cancellable = g_cancellable_new ();
+  coalesced_check_add (check, request);
+
+  /* nothing else could join, so don't wait for it */
+  if (priv->num_checks_resolving == 0)
+    {
+      coalesced_check_run (check);
+      return;
+    }
+
+  g_hash_table_insert (priv->coalesced_checks, request, check);
+  g_idle_add_full (G_PRIORITY_DEFAULT, coalesced_check_run, check, NULL);
+}
+
+static void
+check_authorization_resolved (CheckAuthorizationRequest *request)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority = request->authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv = polkit_backend_interactive_authority_get_instance_private (interactive_authority);
+  SubjectContext *caller_context = request->caller_context;
+  SubjectContext *subject_context = request->subject_context;
+  const gchar *action_id = request->action_id;
+  PolkitDetails *details = request->details;
+  PolkitCheckAuthorizationFlags flags = request->flags;
+  GSimpleAsyncResult *simple = request->simple;
+  gchar *user_of_caller_str;
+  gchar *user_of_subject_str;
+  PolkitAuthorizationResult *result;
+  PolkitImplicitAuthorization implicit_authorization;
+  AuthenticationAgent *agent;
+  GList *admin_identities;
+  GError *error;
+  gboolean has_details;
+
+  error = NULL;
+  user_of_caller_str = NULL;
+  user_of_subject_str = NULL;
+  result = NULL;
+  agent = NULL;
+  admin_identities = NULL;
+
+  priv->num_checks_resolving--;
+
+  /* also covers bus names that were not resolved because of it */
+  if (check_authorization_request_complete_if_cancelled (request))
+    goto out;
+
+  if (caller_context->error != NULL)
+    {
+      g_simple_async_result_set_from_error (simple, caller_context->error);
+      g_simple_async_result_complete (simple);
+      g_object_unref (simple);
+      goto out;
+    }
+
+  if (!subject_context_ensure_user (interactive_authority, caller_context, &error))
+    {
+      g_simple_async_result_set_from_error (simple, error);
+      g_simple_async_result_complete (simple);
+      g_object_unref (simple);
+      g_error_free (error);
+      goto out;
+    }
+
+  user_of_caller_str = polkit_identity_to_string (caller_context->user);
+  g_debug (" user of caller is %s", user_of_caller_str);
+
+  if (subject_context->error != NULL)
+    {
+      g_simple_async_result_set_from_error (simple, subject_context->error);
+      g_simple_async_result_complete (simple);
+      g_object_unref (simple);
+      goto out;
+    }
+
+  if (!subject_context_ensure_user (interactive_authority, subject_context, &error))
+    {
+      g_simple_async_result_set_from_error (simple, error);
+      g_simple_async_result_complete (simple);
+      g_object_unref (simple);
+      g_error_free (error);
+      goto out;
     }
 
+  user_of_subject_str = polkit_identity_to_string (subject_context->user);
+  g_debug (" user of subject is %s", user_of_subject_str);
+
+  has_details = details != NULL && polkit_details_get_count (details) > 0;
+
   /* Not anyone is allowed to check that process XYZ is allowed to do ABC.
    * We allow this if, and only if,
    *
@@ -957,11 +1765,11 @@ polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority
    *    then any uid referenced by that annotation is also allowed to check
    *    anything and pass any details
    */
-  if (!user_of_subject_matches
-      || !polkit_identity_equal (user_of_caller, user_of_subject)
+  if (!subject_context->user_matches
+      || !polkit_identity_equal (caller_context->user, subject_context->user)
       || has_details)
     {
-      if (!may_identity_check_authorization (interactive_authority, action_id, user_of_caller))
+      if (!may_identity_check_authorization (interactive_authority, action_id, caller_context->user))
         {
           if (has_details)
             {
@@ -985,18 +1793,37 @@ polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority
         }
     }
 
+  if (check_authorization_request_complete_if_cancelled (request))
+    goto out;
+
+  /* checks that can't end in a challenge may share an evaluation */
+  if (!(flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION))
+    {
+      check_authorization_request_coalesce (request);
+      request = NULL;
+      goto out;
+    }
+
+  /* only worth evaluating admin rules up front if there is someone to challenge */
+  if (flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION)
+    agent = get_authentication_agent_for_subject (interactive_authority, subject_context);
+
   implicit_authorization = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED;
-  result = check_authorization_sync (authority,
-                                     caller,
-                                     subject,
+  result = check_authorization_sync (POLKIT_BACKEND_AUTHORITY (interactive_authority),
+                                     caller_context->subject,
+                                     subject_context,
                                      action_id,
                                      details,
                                      flags,
                                      &implicit_authorization,
+                                     agent != NULL ? &admin_identities : NULL,
                                      FALSE, /* checking_imply */
+                                     request->cancellable,
                                      &error);
   if (error != NULL)
     {
+      if (g_error_matches (error, POLKIT_ERROR, POLKIT_ERROR_CANCELLED))
+        priv->num_checks_cancelled++;
       g_simple_async_result_set_from_error (simple, error);
       g_simple_async_result_complete (simple);
       g_object_unref (simple);
@@ -1008,9 +1835,6 @@ polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority
   if (polkit_authorization_result_get_is_challenge (result) &&
       (flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION))
     {
-      AuthenticationAgent *agent;
-
-      agent = get_authentication_agent_for_subject (interactive_authority, subject);
       if (agent != NULL)
         {
           g_object_unref (result);
@@ -1019,16 +1843,17 @@ polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority
           g_debug (" using authentication agent for challenge");
 
           authentication_agent_initiate_challenge (agent,
-                                                   subject,
-                                                   user_of_subject,
+                                                   subject_context,
                                                    interactive_authority,
                                                    action_id,
                                                    details,
-                                                   caller,
+                                                   caller_context,
                                                    implicit_authorization,
-                                                   cancellable,
+                                                   admin_identities,
+                                                   request->cancellable,
                                                    check_authorization_challenge_cb,
                                                    simple);
+          admin_identities = NULL;
 
           /* keep going */
           goto out;
@@ -1045,47 +1870,91 @@ polkit_backend_interactive_authority_check_authorization (PolkitBackendAuthority
   g_object_unref (simple);
 
  out:
-
-  if (user_of_caller != NULL)
-    g_object_unref (user_of_caller);
-
-  if (user_of_subject != NULL)
-    g_object_unref (user_of_subject);
-
-  g_free (caller_str);
-  g_free (subject_str);
   g_free (user_of_caller_str);
   g_free (user_of_subject_str);
 
+  g_list_free_full (admin_identities, g_object_unref);
+
   if (result != NULL)
     g_object_unref (result);
+
+  if (request != NULL)
+    check_authorization_request_free (request);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Returns the actions whose org.freedesktop.policykit.imply annotation
+ * lists @action_id
+ *
+ * TODO: if this is slow, we can maintain a hash table for looking up what
+ * actions implies a given action
+ */
+static GList *
+get_actions_implying (PolkitBackendInteractiveAuthority *authority,
+                      const gchar                       *action_id)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  GList *actions;
+  GList *ret;
+  GList *l;
+
+  priv = polkit_backend_interactive_authority_get_instance_private (authority);
+
+  ret = NULL;
+  actions = polkit_backend_action_pool_get_all_actions (priv->action_pool, NULL);
+  for (l = actions; l != NULL; l = l->next)
+    {
+      PolkitActionDescription *imply_ad = POLKIT_ACTION_DESCRIPTION (l->data);
+      const gchar *imply;
+      gchar **tokens;
+      guint n;
+
+      imply = polkit_action_description_get_annotation (imply_ad, "org.freedesktop.policykit.imply");
+      if (imply == NULL)
+        continue;
+
+      tokens = g_strsplit (imply, " ", 0);
+      for (n = 0; tokens[n] != NULL; n++)
+        {
+          if (g_strcmp0 (tokens[n], action_id) == 0)
+            ret = g_list_prepend (ret, g_object_ref (imply_ad));
+        }
+      g_strfreev (tokens);
+    }
+  g_list_free_full (actions, g_object_unref);
+
+  return g_list_reverse (ret);
+}
+
 static PolkitAuthorizationResult *
 check_authorization_sync (PolkitBackendAuthority         *authority,
                           PolkitSubject                  *caller,
-                          PolkitSubject                  *subject,
+                          SubjectContext                 *subject_context,
                           const gchar                    *action_id,
                           PolkitDetails                  *details,
                           PolkitCheckAuthorizationFlags   flags,
                           PolkitImplicitAuthorization    *out_implicit_authorization,
+                          GList                         **out_admin_identities,
                           gboolean                        checking_imply,
+                          GCancellable                   *cancellable,
                           GError                        **error)
 {
   PolkitBackendInteractiveAuthority *interactive_authority;
   PolkitBackendInteractiveAuthorityPrivate *priv;
   PolkitAuthorizationResult *result;
+  PolkitSubject *subject;
   PolkitIdentity *user_of_subject;
-  PolkitSubject *session_for_subject;
   gchar *subject_str;
   GList *groups_of_user;
   PolkitActionDescription *action_desc;
   gboolean session_is_local;
   gboolean session_is_active;
   PolkitImplicitAuthorization implicit_authorization;
+  GList *admin_identities;
   const gchar *tmp_authz_id;
+  gboolean has_tmp_authz;
+  PolkitBackendStageTimer timer;
   GList *actions;
   GList *l;
 
@@ -1095,15 +1964,14 @@ check_authorization_sync (PolkitBackendAuthority         *authority,
   result = NULL;
 
   actions = NULL;
-  user_of_subject = NULL;
   groups_of_user = NULL;
   subject_str = NULL;
-  session_for_subject = NULL;
+  admin_identities = NULL;
 
-  session_is_local = FALSE;
-  session_is_active = FALSE;
+  /* resolved to a process for bus names, so nothing below needs the bus */
+  subject = subject_context_get_resolved_subject (subject_context);
 
-  subject_str = polkit_subject_to_string (subject);
+  subject_str = polkit_subject_to_string (subject_context->subject);
 
   g_debug ("checking whether %s is authorized for %s",
            subject_str,
@@ -1126,11 +1994,9 @@ check_authorization_sync (PolkitBackendAuthority         *authority,
 
   /* every subject has a user; this is supplied by the client, so we rely
    * on the caller to validate its acceptability. */
-  user_of_subject = polkit_backend_session_monitor_get_user_for_subject (priv->session_monitor,
-                                                                         subject, NULL,
-                                                                         error);
-  if (user_of_subject == NULL)
+  if (!subject_context_ensure_user (interactive_authority, subject_context, error))
       goto out;
+  user_of_subject = subject_context->user;
 
   /* special case: uid 0, root, is _always_ authorized for anything */
   if (!(flags & POLKIT_CHECK_AUTHORIZATION_FLAGS_ALWAYS_CHECK) && identity_is_root_user (user_of_subject))
@@ -1139,18 +2005,14 @@ check_authorization_sync (PolkitBackendAuthority         *authority,
       goto out;
     }
 
-  /* a subject *may* be in a session */
-  session_for_subject = polkit_backend_session_monitor_get_session_for_subject (priv->session_monitor,
-                                                                                subject,
-                                                                                NULL);
-  g_debug ("  %p", session_for_subject);
-  if (session_for_subject != NULL)
+  subject_context_ensure_session (interactive_authority, subject_context);
+  session_is_local = subject_context->session_is_local;
+  session_is_active = subject_context->session_is_active;
+  g_debug ("  %p", subject_context->session);
+  if (subject_context->session != NULL)
     {
-      session_is_local = polkit_backend_session_monitor_is_session_local (priv->session_monitor, session_for_subject);
-      session_is_active = polkit_backend_session_monitor_is_session_active (priv->session_monitor, session_for_subject);
-
       g_debug (" subject is in session %s (local=%d active=%d)",
-               polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (session_for_subject)),
+               polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (subject_context->session)),
                session_is_local,
                session_is_active);
     }
@@ -1168,16 +2030,55 @@ check_authorization_sync (PolkitBackendAuthority         *authority,
       implicit_authorization = polkit_action_description_get_implicit_any (action_desc);
     }
 
-  /* allow subclasses to rewrite implicit_authorization */
-  implicit_authorization = polkit_backend_interactive_authority_check_authorization_sync (interactive_authority,
-                                                                                          caller,
-                                                                                          subject,
-                                                                                          user_of_subject,
-                                                                                          session_is_local,
-                                                                                          session_is_active,
-                                                                                          action_id,
-                                                                                          details,
-                                                                                          implicit_authorization);
+  if (set_error_if_cancelled (cancellable, error))
+    {
+      priv->num_rule_evaluations_skipped++;
+      goto out;
+    }
+
+  /* the actions that, one level deep to avoid infinite recursion, imply
+   * this one
+   */
+  if (!checking_imply)
+    actions = get_actions_implying (interactive_authority, action_id);
+
+  /* Admin rules may only run once a challenge is certain. Unless a
+   * temporary authorization or an implying action can still authorize
+   * the subject, only the rules below decide that, so if the caller is
+   * going to challenge, the admin identities are worked out in the same
+   * go. Otherwise they are left to the challenge.
+   */
+  if (out_admin_identities != NULL &&
+      (actions != NULL ||
+       temporary_authorization_store_has_authorization_for_key (priv->temporary_authorization_store,
+                                                                subject_context_get_resolved_key (subject_context),
+                                                                action_id,
+                                                                NULL)))
+    out_admin_identities = NULL;
+
+  /* allow subclasses to rewrite implicit_authorization; they are
+   * handed the cancellable so they can stop the rules when the check
+   * is cancelled
+   */
+  polkit_backend_stage_begin (&timer, POLKIT_BACKEND_STAGE_RULES);
+  implicit_authorization =
+    polkit_backend_interactive_authority_check_authorization_and_get_admin_identities_sync (interactive_authority,
+                                                                                            caller,
+                                                                                            subject,
+                                                                                            user_of_subject,
+                                                                                            session_is_local,
+                                                                                            session_is_active,
+                                                                                            action_id,
+                                                                                            details,
+                                                                                            implicit_authorization,
+                                                                                            out_admin_identities != NULL ? &admin_identities : NULL,
+                                                                                            cancellable);
+  polkit_backend_stage_end (&timer);
+
+  /* the rules may have been cut short, so their answer can't be trusted */
+  if (set_error_if_cancelled (cancellable, error))
+    goto out;
+
   /* first see if there's an implicit authorization for subject available */
   if (implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED)
     {
@@ -1189,10 +2090,13 @@ check_authorization_sync (PolkitBackendAuthority         *authority,
     }
 
   /* then see if there's a temporary authorization for the subject */
-  if (temporary_authorization_store_has_authorization (priv->temporary_authorization_store,
-                                                       subject,
-                                                       action_id,
-                                                       &tmp_authz_id))
+  polkit_backend_stage_begin (&timer, POLKIT_BACKEND_STAGE_TEMPORARY_AUTHORIZATION_LOOKUP);
+  has_tmp_authz = temporary_authorization_store_has_authorization_for_key (priv->temporary_authorization_store,
+                                                                           subject_context_get_resolved_key (subject_context),
+                                                                           action_id,
+                                                                           &tmp_authz_id);
+  polkit_backend_stage_end (&timer);
+  if (has_tmp_authz)
     {
 
       g_debug (" is authorized (has temporary authorization)");
@@ -1201,61 +2105,41 @@ check_authorization_sync (PolkitBackendAuthority         *authority,
       goto out;
     }
 
-  /* then see if implied by another action that the subject is authorized for
-   * (but only one level deep to avoid infinite recursion)
-   *
-   * TODO: if this is slow, we can maintain a hash table for looking up what
-   * actions implies a given action
-   */
-  if (!checking_imply)
+  /* then see if implied by another action that the subject is authorized for */
+  for (l = actions; l != NULL; l = l->next)
     {
-      actions = polkit_backend_action_pool_get_all_actions (priv->action_pool, NULL);
-      for (l = actions; l != NULL; l = l->next)
+      PolkitActionDescription *imply_ad = POLKIT_ACTION_DESCRIPTION (l->data);
+      PolkitAuthorizationResult *implied_result = NULL;
+      PolkitImplicitAuthorization implied_implicit_authorization;
+      GError *implied_error = NULL;
+      const gchar *imply_action_id;
+
+      imply_action_id = polkit_action_description_get_action_id (imply_ad);
+
+      /* g_debug ("%s is implied by %s, checking", action_id, imply_action_id); */
+      implied_result = check_authorization_sync (authority, caller, subject_context,
+                                                 imply_action_id,
+                                                 details, flags,
+                                                 &implied_implicit_authorization, NULL, TRUE,
+                                                 cancellable,
+                                                 &implied_error);
+      if (implied_result != NULL)
         {
-          PolkitActionDescription *imply_ad = POLKIT_ACTION_DESCRIPTION (l->data);
-          const gchar *imply;
-          imply = polkit_action_description_get_annotation (imply_ad, "org.freedesktop.policykit.imply");
-          if (imply != NULL)
+          if (polkit_authorization_result_get_is_authorized (implied_result))
             {
-              gchar **tokens;
-              guint n;
-              tokens = g_strsplit (imply, " ", 0);
-              for (n = 0; tokens[n] != NULL; n++)
-                {
-                  if (g_strcmp0 (tokens[n], action_id) == 0)
-                    {
-                      PolkitAuthorizationResult *implied_result = NULL;
-                      PolkitImplicitAuthorization implied_implicit_authorization;
-                      GError *implied_error = NULL;
-                      const gchar *imply_action_id;
-
-                      imply_action_id = polkit_action_description_get_action_id (imply_ad);
-
-                      /* g_debug ("%s is implied by %s, checking", action_id, imply_action_id); */
-                      implied_result = check_authorization_sync (authority, caller, subject,
-                                                                 imply_action_id,
-                                                                 details, flags,
-                                                                 &implied_implicit_authorization, TRUE,
-                                                                 &implied_error);
-                      if (implied_result != NULL)
-                        {
-                          if (polkit_authorization_result_get_is_authorized (implied_result))
-                            {
-                              g_debug (" is authorized (implied by %s)", imply_action_id);
-                              result = implied_result;
-                              /* cleanup */
-                              g_strfreev (tokens);
-                              goto out;
-                            }
-                          g_object_unref (implied_result);
-                        }
-                      if (implied_error != NULL)
-                        g_error_free (implied_error);
-                    }
-                }
-              g_strfreev (tokens);
+              g_debug (" is authorized (implied by %s)", imply_action_id);
+              result = implied_result;
+              goto out;
             }
+          g_object_unref (implied_result);
         }
+      if (g_error_matches (implied_error, POLKIT_ERROR, POLKIT_ERROR_CANCELLED))
+        {
+          g_propagate_error (error, implied_error);
+          goto out;
+        }
+      if (implied_error != NULL)
+        g_error_free (implied_error);
     }
 
   if (implicit_authorization != POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED)
@@ -1271,6 +2155,13 @@ check_authorization_sync (PolkitBackendAuthority         *authority,
       /* return implicit_authorization so the caller can use an authentication agent if applicable */
       if (out_implicit_authorization != NULL)
         *out_implicit_authorization = implicit_authorization;
+      if (out_admin_identities != NULL &&
+          (implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED ||
+           implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED))
+        {
+          *out_admin_identities = admin_identities;
+          admin_identities = NULL;
+        }
 
       g_debug (" challenge (implicit_authorization = %s)",
                polkit_implicit_authorization_to_string (implicit_authorization));
@@ -1284,17 +2175,13 @@ check_authorization_sync (PolkitBackendAuthority         *authority,
   g_list_foreach (actions, (GFunc) g_object_unref, NULL);
   g_list_free (actions);
 
+  g_list_free_full (admin_identities, g_object_unref);
+
   g_free (subject_str);
 
   g_list_foreach (groups_of_user, (GFunc) g_object_unref, NULL);
   g_list_free (groups_of_user);
 
-  if (user_of_subject != NULL)
-    g_object_unref (user_of_subject);
-
-  if (session_for_subject != NULL)
-    g_object_unref (session_for_subject);
-
   if (action_desc != NULL)
     g_object_unref (action_desc);
 
@@ -1411,10 +2298,94 @@ polkit_backend_interactive_authority_check_authorization_sync (PolkitBackendInte
 }
 
 /**
- * polkit_backend_interactive_authority_reload:
+ * polkit_backend_interactive_authority_check_authorization_and_get_admin_identities_sync:
  * @authority: A #PolkitBackendInteractiveAuthority.
+ * @caller: The subject that is inquiring whether @subject is authorized.
+ * @subject: The subject we are checking an authorization for.
+ * @user_for_subject: The user of the subject we are checking an authorization for.
+ * @subject_is_local: %TRUE if the session for @subject is local.
+ * @subject_is_active: %TRUE if the session for @subject is active.
+ * @action_id: The action we are checking an authorization for.
+ * @details: Details about the action.
+ * @implicit: A #PolkitImplicitAuthorization value computed from the policy file and @subject.
+ * @out_admin_identities: (out) (optional): Return location for the identities to use for administrator authentication, or %NULL.
+ * @cancellable: (nullable): The #GCancellable of the authorization check, or %NULL.
  *
- * Reload configuration files.
+ * Like polkit_backend_interactive_authority_check_authorization_sync()
+ * but, if @out_admin_identities is not %NULL and the result is an
+ * administrator challenge, also returns what
+ * polkit_backend_interactive_authority_get_admin_identities() would
+ * for the same arguments. This is only asked for when nothing but the
+ * result decides whether the subject is challenged, so subclasses can
+ * work out both in one go. If working out the identities fails, the
+ * result still stands and they fall back to root.
+ *
+ * Subclasses may stop evaluating the check as soon as @cancellable is
+ * cancelled, which may happen on another thread; the result is then
+ * thrown away.
+ *
+ * The default implementation calls
+ * polkit_backend_interactive_authority_check_authorization_sync() and
+ * sets @out_admin_identities to %NULL.
+ *
+ * Returns: A #PolkitImplicitAuthorization that specifies if the subject is authorized or whether
+ *     authentication is required. If given, @out_admin_identities is set to a list of #PolkitIdentity
+ *     objects, or %NULL if they were not worked out. Free each element with
+ *     g_object_unref(), then free the list with g_list_free().
+ *
+ * Since: 127
+ */
+PolkitImplicitAuthorization
+polkit_backend_interactive_authority_check_authorization_and_get_admin_identities_sync (PolkitBackendInteractiveAuthority *authority,
+                                                                                        PolkitSubject                     *caller,
+                                                                                        PolkitSubject                     *subject,
+                                                                                        PolkitIdentity                    *user_for_subject,
+                                                                                        gboolean                           subject_is_local,
+                                                                                        gboolean                           subject_is_active,
+                                                                                        const gchar                       *action_id,
+                                                                                        PolkitDetails                     *details,
+                                                                                        PolkitImplicitAuthorization        implicit,
+                                                                                        GList                            **out_admin_identities,
+                                                                                        GCancellable                      *cancellable)
+{
+  PolkitBackendInteractiveAuthorityClass *klass;
+
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+
+  klass = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_CLASS (authority);
+
+  if (out_admin_identities != NULL)
+    *out_admin_identities = NULL;
+
+  if (klass->check_authorization_and_get_admin_identities_sync == NULL)
+    return polkit_backend_interactive_authority_check_authorization_sync (authority,
+                                                                          caller,
+                                                                          subject,
+                                                                          user_for_subject,
+                                                                          subject_is_local,
+                                                                          subject_is_active,
+                                                                          action_id,
+                                                                          details,
+                                                                          implicit);
+
+  return klass->check_authorization_and_get_admin_identities_sync (authority,
+                                                                   caller,
+                                                                   subject,
+                                                                   user_for_subject,
+                                                                   subject_is_local,
+                                                                   subject_is_active,
+                                                                   action_id,
+                                                                   details,
+                                                                   implicit,
+                                                                   out_admin_identities,
+                                                                   cancellable);
+}
+
+/**
+ * polkit_backend_interactive_authority_reload:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ *
+ * Reload configuration files.
  */
 void
 polkit_backend_interactive_authority_reload (PolkitBackendInteractiveAuthority *authority)
@@ -1454,6 +2425,9 @@ struct AuthenticationSession
 
   PolkitDetails               *details;
 
+  /* %NULL if the caller is not on the bus, e.g. on a peer connection,
+   * where the check is cancelled when the connection closes instead
+   */
   gchar                       *initiated_by_system_bus_unique_name;
 
   PolkitImplicitAuthorization  implicit_authorization;
@@ -1469,14 +2443,20 @@ struct AuthenticationSession
 
   GCancellable                *cancellable;
 
-  gulong                       cancellable_signal_handler_id;
+  GSource                     *cancellable_source;
 };
 
-static void
+/* The cancellable may be cancelled from the GDBus worker thread, so
+ * this is dispatched through a #GSource rather than the signal.
+ */
+static gboolean
 authentication_session_cancelled_cb (GCancellable *cancellable,
-                                     AuthenticationSession *session)
+                                     gpointer      user_data)
 {
+  AuthenticationSession *session = user_data;
+
   authentication_session_cancel (session);
+  return G_SOURCE_REMOVE;
 }
 
 /* We're not calling this a UUID, but it's basically
@@ -1561,10 +2541,12 @@ authentication_session_new (AuthenticationAgent         *agent,
 
   if (session->cancellable != NULL)
     {
-      session->cancellable_signal_handler_id = g_signal_connect (session->cancellable,
-                                                                 "cancelled",
-                                                                 G_CALLBACK (authentication_session_cancelled_cb),
-                                                                 session);
+      session->cancellable_source = g_cancellable_source_new (session->cancellable);
+      g_source_set_callback (session->cancellable_source,
+                             (GSourceFunc) authentication_session_cancelled_cb,
+                             session,
+                             NULL);
+      g_source_attach (session->cancellable_source, g_main_context_get_thread_default ());
     }
 
   return session;
@@ -1584,8 +2566,11 @@ authentication_session_free (AuthenticationSession *session)
   g_free (session->action_id);
   g_object_unref (session->details);
   g_free (session->initiated_by_system_bus_unique_name);
-  if (session->cancellable_signal_handler_id > 0)
-    g_signal_handler_disconnect (session->cancellable, session->cancellable_signal_handler_id);
+  if (session->cancellable_source != NULL)
+    {
+      g_source_destroy (session->cancellable_source);
+      g_source_unref (session->cancellable_source);
+    }
   if (session->authenticated_identity != NULL)
     g_object_unref (session->authenticated_identity);
   if (session->cancellable != NULL)
@@ -1632,8 +2617,7 @@ authentication_agent_unref (AuthenticationAgent *agent)
 {
   if (g_atomic_int_dec_and_test (&agent->ref_count))
     {
-      if (agent->proxy != NULL)
-        g_object_unref (agent->proxy);
+      g_object_unref (agent->connection);
       g_object_unref (agent->scope);
       g_free (agent->locale);
       g_free (agent->object_path);
@@ -1647,7 +2631,8 @@ authentication_agent_unref (AuthenticationAgent *agent)
 }
 
 static AuthenticationAgent *
-authentication_agent_new (guint64      serial,
+authentication_agent_new (GDBusConnection *connection,
+                          guint64      serial,
                           PolkitSubject *scope,
                           PolkitIdentity *creator,
                           const gchar *unique_system_bus_name,
@@ -1657,7 +2642,6 @@ authentication_agent_new (guint64      serial,
                           GError     **error)
 {
   AuthenticationAgent *agent;
-  GDBusProxy *proxy;
   PolkitUnixUser *creator_user;
 
   g_assert (POLKIT_IS_UNIX_USER (creator));
@@ -1670,18 +2654,11 @@ authentication_agent_new (guint64      serial,
       return NULL;
     }
 
-  proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-                                         G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
-                                         G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
-                                         NULL, /* GDBusInterfaceInfo* */
-                                         unique_system_bus_name,
-                                         object_path,
-                                         "org.freedesktop.PolicyKit1.AuthenticationAgent",
-                                         NULL, /* GCancellable* */
-                                         error);
-  if (proxy == NULL)
+  /* no bus I/O here, registering is pure bookkeeping */
+  if (connection == NULL)
     {
-      g_prefix_error (error, "Failed to construct proxy for agent: " );
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED,
+                   "Not connected to the system bus");
       return NULL;
     }
 
@@ -1689,12 +2666,13 @@ authentication_agent_new (guint64      serial,
   agent->ref_count = 1;
   agent->serial = serial;
   agent->scope = g_object_ref (scope);
+  polkit_backend_subject_init (&agent->scope_key, agent->scope);
   agent->creator_uid = (uid_t)polkit_unix_user_get_uid (creator_user);
   agent->object_path = g_strdup (object_path);
   agent->unique_system_bus_name = g_strdup (unique_system_bus_name);
   agent->locale = g_strdup (locale);
   agent->registration_options = registration_options != NULL ? g_variant_ref (registration_options) : NULL;
-  agent->proxy = proxy;
+  agent->connection = g_object_ref (connection);
 
   {
     GString *cookie_prefix = g_string_new ("");
@@ -1720,30 +2698,21 @@ authentication_agent_new (guint64      serial,
 
 static AuthenticationAgent *
 get_authentication_agent_for_subject (PolkitBackendInteractiveAuthority *authority,
-                                      PolkitSubject *subject)
+                                      SubjectContext *subject_context)
 {
   PolkitBackendInteractiveAuthorityPrivate *priv;
-  PolkitSubject *session_for_subject = NULL;
   AuthenticationAgent *agent = NULL;
   AuthenticationAgent *agent_fallback = NULL;
   gboolean fallback = FALSE;
 
   priv = polkit_backend_interactive_authority_get_instance_private (authority);
 
-  agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, subject);
+  agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, &subject_context->subject_key);
 
-  if (agent == NULL && POLKIT_IS_SYSTEM_BUS_NAME (subject))
-    {
-      PolkitSubject *process;
-      process = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (subject),
-                                                         NULL,
-                                                         NULL);
-      if (process != NULL)
-        {
-          agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, process);
-          g_object_unref (process);
-        }
-    }
+  if (agent == NULL &&
+      subject_context->subject_key.kind == POLKIT_BACKEND_SUBJECT_KIND_SYSTEM_BUS_NAME &&
+      subject_context->process != NULL)
+    agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, &subject_context->process_key);
 
   if (agent != NULL)
     {
@@ -1768,22 +2737,17 @@ get_authentication_agent_for_subject (PolkitBackendInteractiveAuthority *authori
    * and UnixSession subjects!
    */
 
-  session_for_subject = polkit_backend_session_monitor_get_session_for_subject (priv->session_monitor,
-                                                                                subject,
-                                                                                NULL);
-  if (session_for_subject == NULL)
+  subject_context_ensure_session (authority, subject_context);
+  if (subject_context->session == NULL)
     goto out;
 
-  agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, session_for_subject);
+  agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, &subject_context->session_key);
 
   /* use fallback, if available */
   if (agent == NULL && agent_fallback != NULL)
     agent = agent_fallback;
 
  out:
-  if (session_for_subject != NULL)
-    g_object_unref (session_for_subject);
-
   return agent;
 }
 
@@ -1865,7 +2829,7 @@ get_authentication_sessions_initiated_by_system_bus_unique_name (PolkitBackendIn
         {
           AuthenticationSession *session = l->data;
 
-          if (strcmp (session->initiated_by_system_bus_unique_name, system_bus_unique_name) == 0)
+          if (g_strcmp0 (session->initiated_by_system_bus_unique_name, system_bus_unique_name) == 0)
             {
               result = g_list_prepend (result, session);
             }
@@ -1936,9 +2900,9 @@ get_authentication_agent_by_unique_system_bus_name (PolkitBackendInteractiveAuth
 }
 
 static void
-authentication_agent_begin_cb (GDBusProxy   *proxy,
-                               GAsyncResult *res,
-                               gpointer      user_data)
+authentication_agent_begin_cb (GDBusConnection *connection,
+                               GAsyncResult    *res,
+                               gpointer         user_data)
 {
   AuthenticationSession *session = user_data;
   gboolean gained_authorization;
@@ -1950,7 +2914,7 @@ authentication_agent_begin_cb (GDBusProxy   *proxy,
   gained_authorization = FALSE;
 
   error = NULL;
-  result = g_dbus_proxy_call_finish (proxy, res, &error);
+  result = g_dbus_connection_call_finish (connection, res, &error);
   if (result == NULL)
     {
       g_printerr ("Error performing authentication: %s (%s %d)\n",
@@ -2154,50 +3118,56 @@ get_localized_data_for_challenge (PolkitBackendInteractiveAuthority *authority,
 }
 
 static void
-add_pid (PolkitDetails *details,
-         PolkitSubject *subject,
-         const gchar   *key)
+add_pid (PolkitDetails              *details,
+         const PolkitBackendSubject *subject,
+         const gchar                *key)
 {
   gchar buf[32];
   gint pid;
 
-  if (POLKIT_IS_UNIX_PROCESS (subject))
-    {
-      pid = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (subject));
-    }
-  else if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
+  switch (subject->kind)
     {
-      PolkitSubject *process;
-      GError *error;
+    case POLKIT_BACKEND_SUBJECT_KIND_UNIX_PROCESS:
+      pid = subject->u.process.pid;
+      break;
 
-      error = NULL;
-      process = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (subject),
-                                                         NULL,
-                                                         &error);
-      if (process == NULL)
-        {
-          g_printerr ("Error getting process for system bus name `%s': %s\n",
-                      polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (subject)),
-                      error->message);
-          g_error_free (error);
-          goto out;
-        }
-      pid = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (process));
-      g_object_unref (process);
-    }
-  else if (POLKIT_IS_UNIX_SESSION (subject))
-    {
-      goto out;
-    }
-  else
-    {
-      gchar *s;
-      s = polkit_subject_to_string (subject);
-      g_printerr ("Don't know how to get pid from subject of type %s: %s\n",
-                  g_type_name (G_TYPE_FROM_INSTANCE (subject)),
-                  s);
-      g_free (s);
+    case POLKIT_BACKEND_SUBJECT_KIND_SYSTEM_BUS_NAME:
+      {
+        PolkitSubject *process;
+        GError *error;
+
+        /* only if resolving the subject context failed */
+        error = NULL;
+        process = polkit_system_bus_name_get_process_sync (POLKIT_SYSTEM_BUS_NAME (subject->object),
+                                                           NULL,
+                                                           &error);
+        if (process == NULL)
+          {
+            g_printerr ("Error getting process for system bus name `%s': %s\n",
+                        subject->u.system_bus_name,
+                        error->message);
+            g_error_free (error);
+            goto out;
+          }
+        pid = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (process));
+        g_object_unref (process);
+      }
+      break;
+
+    case POLKIT_BACKEND_SUBJECT_KIND_UNIX_SESSION:
       goto out;
+
+    case POLKIT_BACKEND_SUBJECT_KIND_OTHER:
+    default:
+      {
+        gchar *s;
+        s = polkit_subject_to_string (subject->object);
+        g_printerr ("Don't know how to get pid from subject of type %s: %s\n",
+                    g_type_name (G_TYPE_FROM_INSTANCE (subject->object)),
+                    s);
+        g_free (s);
+        goto out;
+      }
     }
 
   g_snprintf (buf, sizeof (buf), "%d", pid);
@@ -2211,19 +3181,87 @@ add_pid (PolkitDetails *details,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static GList *
-get_users_in_group (PolkitIdentity                    *group,
+struct _PolkitBackendUserSet
+{
+  /* of uid */
+  GHashTable *uids;
+  /* of owned PolkitIdentity, in the order added */
+  GQueue users;
+  guint max_users;
+  gboolean truncated;
+};
+
+PolkitBackendUserSet *
+_polkit_backend_user_set_new (guint max_users)
+{
+  PolkitBackendUserSet *set;
+
+  set = g_new0 (PolkitBackendUserSet, 1);
+  set->uids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  g_queue_init (&set->users);
+  set->max_users = max_users;
+  return set;
+}
+
+void
+_polkit_backend_user_set_free (PolkitBackendUserSet *set)
+{
+  g_hash_table_unref (set->uids);
+  g_list_free_full (set->users.head, g_object_unref);
+  g_free (set);
+}
+
+/* Returns %TRUE if @user was not in @set yet and has been added */
+gboolean
+_polkit_backend_user_set_add (PolkitBackendUserSet *set,
+                              PolkitIdentity       *user)
+{
+  gpointer key;
+
+  key = GINT_TO_POINTER (polkit_unix_user_get_uid (POLKIT_UNIX_USER (user)));
+  if (g_hash_table_contains (set->uids, key))
+    return FALSE;
+
+  if (set->max_users > 0 && set->users.length >= set->max_users)
+    {
+      set->truncated = TRUE;
+      return FALSE;
+    }
+
+  g_hash_table_add (set->uids, key);
+  g_queue_push_tail (&set->users, g_object_ref (user));
+  return TRUE;
+}
+
+gboolean
+_polkit_backend_user_set_is_truncated (PolkitBackendUserSet *set)
+{
+  return set->truncated;
+}
+
+/* Returns the users in @set, which is left empty */
+GList *
+_polkit_backend_user_set_steal_users (PolkitBackendUserSet *set)
+{
+  GList *ret;
+
+  ret = set->users.head;
+  g_queue_init (&set->users);
+  g_hash_table_remove_all (set->uids);
+  return ret;
+}
+
+static void
+add_users_in_group (PolkitBackendUserSet              *set,
+                    PolkitIdentity                    *group,
                     PolkitIdentity                    *user_of_subject,
                     gboolean                           include_root)
 {
   gid_t gid;
   uid_t uid_of_subject;
   struct group *grp;
-  GList *ret;
   guint n;
 
-  ret = NULL;
-
   gid = polkit_unix_group_get_gid (POLKIT_UNIX_GROUP (group));
 
   /* Check if group is subject's primary group. */
@@ -2234,7 +3272,7 @@ get_users_in_group (PolkitIdentity                    *group,
 
       pwd = getpwuid (uid_of_subject);
       if (pwd != NULL && pwd->pw_gid == gid)
-        ret = g_list_prepend (ret, g_object_ref (user_of_subject));
+        _polkit_backend_user_set_add (set, user_of_subject);
     }
 
   /* Add supplemental group members. */
@@ -2245,7 +3283,9 @@ get_users_in_group (PolkitIdentity                    *group,
       goto out;
     }
 
-  for (n = 0; grp->gr_mem != NULL && grp->gr_mem[n] != NULL; n++)
+  for (n = 0;
+       grp->gr_mem != NULL && grp->gr_mem[n] != NULL && !_polkit_backend_user_set_is_truncated (set);
+       n++)
     {
       PolkitIdentity *user;
       GError *error;
@@ -2262,24 +3302,22 @@ get_users_in_group (PolkitIdentity                    *group,
         }
       else
         {
-          ret = g_list_prepend (ret, user);
+          _polkit_backend_user_set_add (set, user);
+          g_object_unref (user);
         }
     }
 
-  ret = g_list_reverse (ret);
-
  out:
-  return ret;
+  ;
 }
 
-static GList *
-get_users_in_net_group (PolkitIdentity                    *group,
+static void
+add_users_in_net_group (PolkitBackendUserSet              *set,
+                        PolkitIdentity                    *group,
                         gboolean                           include_root)
 {
   const gchar *name;
-  GList *ret;
 
-  ret = NULL;
 #ifdef HAVE_SETNETGRENT
   name = polkit_unix_netgroup_get_name (POLKIT_UNIX_NETGROUP (group));
 
@@ -2293,7 +3331,7 @@ get_users_in_net_group (PolkitIdentity                    *group,
   setnetgrent (name);
 # endif /* HAVE_SETNETGRENT_RETURN */
 
-  for (;;)
+  while (!_polkit_backend_user_set_is_truncated (set))
     {
 # if defined(HAVE_NETBSD) || defined(HAVE_OPENBSD)
       const char *hostname, *username, *domainname;
@@ -2322,34 +3360,34 @@ get_users_in_net_group (PolkitIdentity                    *group,
         }
       else
         {
-          ret = g_list_prepend (ret, user);
+          _polkit_backend_user_set_add (set, user);
+          g_object_unref (user);
         }
     }
 
-  ret = g_list_reverse (ret);
-
  out:
   endnetgrent ();
 #endif /* HAVE_SETNETGRENT */
-  return ret;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
 authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
-                                         PolkitSubject               *subject,
-                                         PolkitIdentity              *user_of_subject,
+                                         SubjectContext              *subject_context,
                                          PolkitBackendInteractiveAuthority *authority,
                                          const gchar                 *action_id,
                                          PolkitDetails               *details,
-                                         PolkitSubject               *caller,
+                                         SubjectContext              *caller_context,
                                          PolkitImplicitAuthorization  implicit_authorization,
+                                         GList                       *admin_identities,
                                          GCancellable                *cancellable,
                                          AuthenticationAgentCallback  callback,
                                          gpointer                     user_data)
 {
-  PolkitBackendInteractiveAuthorityPrivate *priv = polkit_backend_interactive_authority_get_instance_private (authority);
+  PolkitSubject *subject = subject_context->subject;
+  PolkitIdentity *user_of_subject = subject_context->user;
+  PolkitSubject *caller = caller_context->subject;
   AuthenticationSession *session;
   GList *l;
   GList *identities;
@@ -2357,12 +3395,20 @@ authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
   gchar *localized_icon_name;
   PolkitDetails *localized_details;
   GList *user_identities = NULL;
+  PolkitBackendUserSet *user_set;
   GVariantBuilder identities_builder;
   GVariant *parameters;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitBackendStageTimer timer;
+
+  priv = polkit_backend_interactive_authority_get_instance_private (authority);
+
+  /* the work of starting the challenge, not the wait for the user */
+  polkit_backend_stage_begin (&timer, POLKIT_BACKEND_STAGE_CHALLENGE);
 
   get_localized_data_for_challenge (authority,
-                                    caller,
-                                    subject,
+                                    subject_context_get_resolved_subject (caller_context),
+                                    subject_context_get_resolved_subject (subject_context),
                                     user_of_subject,
                                     action_id,
                                     details,
@@ -2374,59 +3420,62 @@ authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
   identities = NULL;
 
   /* select admin user if required by the implicit authorization */
-  if (implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED ||
-      implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED)
+  if (admin_identities != NULL)
     {
-      gboolean is_local = FALSE;
-      gboolean is_active = FALSE;
-      PolkitSubject *session_for_subject = NULL;
-
-      session_for_subject = polkit_backend_session_monitor_get_session_for_subject (priv->session_monitor,
-                                                                                    subject,
-                                                                                    NULL);
-      if (session_for_subject != NULL)
-        {
-          is_local = polkit_backend_session_monitor_is_session_local (priv->session_monitor, session_for_subject);
-          is_active = polkit_backend_session_monitor_is_session_active (priv->session_monitor, session_for_subject);
-        }
-
+      /* already evaluated along with the authorization rules */
+      identities = admin_identities;
+    }
+  else if (implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED ||
+           implicit_authorization == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED)
+    {
+      subject_context_ensure_session (authority, subject_context);
       identities = polkit_backend_interactive_authority_get_admin_identities (authority,
                                                                               caller,
-                                                                              subject,
+                                                                              subject_context_get_resolved_subject (subject_context),
                                                                               user_of_subject,
-                                                                              is_local,
-                                                                              is_active,
+                                                                              subject_context->session_is_local,
+                                                                              subject_context->session_is_active,
                                                                               action_id,
                                                                               details);
-      g_clear_object (&session_for_subject);
     }
   else
     {
       identities = g_list_prepend (identities, g_object_ref (user_of_subject));
     }
 
-  /* expand groups/netgroups to users */
-  user_identities = NULL;
-  for (l = identities; l != NULL; l = l->next)
+  /* expand groups/netgroups to users, each of them once */
+  user_set = _polkit_backend_user_set_new (priv->max_admin_identities);
+  for (l = identities; l != NULL && !_polkit_backend_user_set_is_truncated (user_set); l = l->next)
     {
       PolkitIdentity *identity = POLKIT_IDENTITY (l->data);
       if (POLKIT_IS_UNIX_USER (identity))
         {
-          user_identities = g_list_append (user_identities, g_object_ref (identity));
+          _polkit_backend_user_set_add (user_set, identity);
         }
       else if (POLKIT_IS_UNIX_GROUP (identity))
         {
-          user_identities = g_list_concat (user_identities, get_users_in_group (identity, user_of_subject, FALSE));
+          add_users_in_group (user_set, identity, user_of_subject, FALSE);
         }
       else if (POLKIT_IS_UNIX_NETGROUP (identity))
         {
-          user_identities =  g_list_concat (user_identities, get_users_in_net_group (identity, FALSE));
+          add_users_in_net_group (user_set, identity, FALSE);
         }
       else
         {
           g_warning ("Unsupported identity");
         }
     }
+  if (_polkit_backend_user_set_is_truncated (user_set))
+    {
+      priv->num_admin_identities_truncated++;
+      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                    LOG_LEVEL_NOTICE,
+                                    "Offering only the first %u administrator identities for action %s",
+                                    priv->max_admin_identities,
+                                    action_id);
+    }
+  user_identities = _polkit_backend_user_set_steal_users (user_set);
+  _polkit_backend_user_set_free (user_set);
 
   /* Fall back to uid 0 if no users are available (rhbz #834494) */
   if (user_identities == NULL)
@@ -2440,7 +3489,9 @@ authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
                                         user_identities,
                                         action_id,
                                         details,
-                                        polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (caller)),
+                                        POLKIT_IS_SYSTEM_BUS_NAME (caller) ?
+                                          polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (caller)) :
+                                          NULL,
                                         implicit_authorization,
                                         cancellable,
                                         callback,
@@ -2450,8 +3501,8 @@ authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
 
   if (localized_details == NULL)
     localized_details = polkit_details_new ();
-  add_pid (localized_details, caller, "polkit.caller-pid");
-  add_pid (localized_details, subject, "polkit.subject-pid");
+  add_pid (localized_details, subject_context_get_resolved_key (caller_context), "polkit.caller-pid");
+  add_pid (localized_details, subject_context_get_resolved_key (subject_context), "polkit.subject-pid");
 
   g_variant_builder_init (&identities_builder, G_VARIANT_TYPE ("a(sa{sv})"));
   for (l = user_identities; l != NULL; l = l->next)
@@ -2469,14 +3520,18 @@ authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
                               session->cookie,
                               &identities_builder);
 
-  g_dbus_proxy_call (agent->proxy,
-                     "BeginAuthentication",
-                     parameters, /* consumes the floating GVariant */
-                     G_DBUS_CALL_FLAGS_NONE,
-                     G_MAXINT, /* timeout_msec - no timeout */
-                     session->cancellable,
-                     (GAsyncReadyCallback) authentication_agent_begin_cb,
-                     session);
+  g_dbus_connection_call (agent->connection,
+                          agent->unique_system_bus_name,
+                          agent->object_path,
+                          "org.freedesktop.PolicyKit1.AuthenticationAgent",
+                          "BeginAuthentication",
+                          parameters, /* consumes the floating GVariant */
+                          NULL, /* reply_type */
+                          G_DBUS_CALL_FLAGS_NONE,
+                          G_MAXINT, /* timeout_msec - no timeout */
+                          session->cancellable,
+                          (GAsyncReadyCallback) authentication_agent_begin_cb,
+                          session);
 
   g_list_free_full (user_identities, g_object_unref);
   g_list_foreach (identities, (GFunc) g_object_unref, NULL);
@@ -2486,18 +3541,20 @@ authentication_agent_initiate_challenge (AuthenticationAgent         *agent,
   g_free (localized_icon_name);
   if (localized_details != NULL)
     g_object_unref (localized_details);
+
+  polkit_backend_stage_end (&timer);
 }
 
 static void
-authentication_agent_cancel_cb (GDBusProxy   *proxy,
-                                GAsyncResult *res,
-                                gpointer      user_data)
+authentication_agent_cancel_cb (GDBusConnection *connection,
+                                GAsyncResult    *res,
+                                gpointer         user_data)
 {
   GVariant *result;
   GError *error;
 
   error = NULL;
-  result = g_dbus_proxy_call_finish (proxy, res, &error);
+  result = g_dbus_connection_call_finish (connection, res, &error);
   if (result == NULL)
     {
       g_printerr ("Error cancelling authentication: %s\n", error->message);
@@ -2510,14 +3567,18 @@ authentication_agent_cancel_cb (GDBusProxy   *proxy,
 static void
 authentication_session_cancel (AuthenticationSession *session)
 {
-  g_dbus_proxy_call (session->agent->proxy,
-                     "CancelAuthentication",
-                     g_variant_new ("(s)", session->cookie),
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1, /* timeout_msec */
-                     NULL, /* GCancellable* */
-                     (GAsyncReadyCallback) authentication_agent_cancel_cb,
-                     NULL);
+  g_dbus_connection_call (session->agent->connection,
+                          session->agent->unique_system_bus_name,
+                          session->agent->object_path,
+                          "org.freedesktop.PolicyKit1.AuthenticationAgent",
+                          "CancelAuthentication",
+                          g_variant_new ("(s)", session->cookie),
+                          NULL, /* reply_type */
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1, /* timeout_msec */
+                          NULL, /* GCancellable* */
+                          (GAsyncReadyCallback) authentication_agent_cancel_cb,
+                          NULL);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -2537,6 +3598,7 @@ polkit_backend_interactive_authority_register_authentication_agent (PolkitBacken
   PolkitIdentity *user_of_caller;
   PolkitIdentity *user_of_subject;
   gboolean user_of_subject_matches;
+  PolkitBackendSubject subject_key;
   AuthenticationAgent *agent;
   gboolean ret;
   gchar *caller_cmdline;
@@ -2624,8 +3686,25 @@ polkit_backend_interactive_authority_register_authentication_agent (PolkitBacken
         }
     }
 
-  agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, subject);
-  if (agent != NULL)
+  polkit_backend_subject_init (&subject_key, subject);
+  agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, &subject_key);
+  if (agent != NULL &&
+      g_strcmp0 (agent->unique_system_bus_name, polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (caller))) == 0 &&
+      g_strcmp0 (agent->object_path, object_path) == 0)
+    {
+      /* the agent registering again, e.g. because it saw the daemon
+       * restart without knowing its registration was carried over, see
+       * polkit_backend_interactive_authority_restore_state()
+       */
+      g_free (agent->locale);
+      agent->locale = g_strdup (locale);
+      if (agent->registration_options != NULL)
+        g_variant_unref (agent->registration_options);
+      agent->registration_options = options != NULL ? g_variant_ref (options) : NULL;
+      ret = TRUE;
+      goto out;
+    }
+  else if (agent != NULL)
     {
       g_set_error (error,
                    POLKIT_ERROR,
@@ -2635,7 +3714,8 @@ polkit_backend_interactive_authority_register_authentication_agent (PolkitBacken
     }
 
   priv->agent_serial++;
-  agent = authentication_agent_new (priv->agent_serial,
+  agent = authentication_agent_new (priv->system_bus_connection,
+                                    priv->agent_serial,
                                     subject,
                                     user_of_subject,/*fix pkexec fails with No session for cookie,
                                     upstream issue:https://gitlab.freedesktop.org/polkit/polkit/issues/17*/
@@ -2648,7 +3728,7 @@ polkit_backend_interactive_authority_register_authentication_agent (PolkitBacken
     goto out;
 
   g_hash_table_insert (priv->hash_scope_to_authentication_agent,
-                       g_object_ref (subject),
+                       &agent->scope_key,
                        agent);
 
   caller_cmdline = _polkit_subject_get_cmdline (caller);
@@ -2704,6 +3784,7 @@ polkit_backend_interactive_authority_unregister_authentication_agent (PolkitBack
   PolkitIdentity *user_of_caller;
   PolkitIdentity *user_of_subject;
   gboolean user_of_subject_matches;
+  PolkitBackendSubject subject_key;
   AuthenticationAgent *agent;
   gboolean ret;
   gchar *scope_str;
@@ -2787,7 +3868,8 @@ polkit_backend_interactive_authority_unregister_authentication_agent (PolkitBack
         }
     }
 
-  agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, subject);
+  polkit_backend_subject_init (&subject_key, subject);
+  agent = g_hash_table_lookup (priv->hash_scope_to_authentication_agent, &subject_key);
   if (agent == NULL)
     {
       g_set_error (error,
@@ -2835,7 +3917,7 @@ polkit_backend_interactive_authority_unregister_authentication_agent (PolkitBack
   authentication_agent_cancel_all_sessions (agent);
   /* this works because we have exactly one agent per session */
   /* this frees agent... */
-  g_hash_table_remove (priv->hash_scope_to_authentication_agent, agent->scope);
+  g_hash_table_remove (priv->hash_scope_to_authentication_agent, &agent->scope_key);
 
   g_signal_emit_by_name (authority, "changed");
 
@@ -2988,7 +4070,7 @@ polkit_backend_interactive_authority_system_bus_name_owner_changed (PolkitBacken
           authentication_agent_cancel_all_sessions (agent);
           /* this works because we have exactly one agent per session */
           /* this frees agent... */
-          g_hash_table_remove (priv->hash_scope_to_authentication_agent, agent->scope);
+          g_hash_table_remove (priv->hash_scope_to_authentication_agent, &agent->scope_key);
 
           g_signal_emit_by_name (authority, "changed");
         }
@@ -3029,11 +4111,24 @@ typedef struct TemporaryAuthorization TemporaryAuthorization;
 
 struct TemporaryAuthorizationStore
 {
+  /* most recently used first */
   GList *authorizations;
+  /* indexes into @authorizations, see temporary_authorization_store_link() */
+  GHashTable *id_to_authorization;
+  GHashTable *subject_hash_to_authorizations;
+  GHashTable *scope_hash_to_authorizations;
   PolkitBackendInteractiveAuthority *authority;
   guint64 serial;
+  /* 0 means no limit */
+  guint max_authorizations;
 };
 
+static gboolean
+temporary_authorization_store_is_empty (TemporaryAuthorizationStore *store)
+{
+  return store->authorizations == NULL;
+}
+
 struct TemporaryAuthorization
 {
   TemporaryAuthorizationStore *store;
@@ -3048,6 +4143,13 @@ struct TemporaryAuthorization
   gint64 time_expires;
   guint expiration_timeout_id;
   guint check_vanished_timeout_id;
+  /* our element of store->authorizations */
+  GList *link;
+  /* @subject and @scope resolved when they were added; this also pins
+   * the hash, which for a process changes once it exits
+   */
+  PolkitBackendSubject subject_key;
+  PolkitBackendSubject scope_key;
 };
 
 static void
@@ -3072,6 +4174,11 @@ temporary_authorization_store_new (PolkitBackendInteractiveAuthority *authority)
   store = g_new0 (TemporaryAuthorizationStore, 1);
   store->authority = authority;
   store->authorizations = NULL;
+  store->id_to_authorization = g_hash_table_new (g_str_hash, g_str_equal);
+  store->subject_hash_to_authorizations = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                                 NULL, (GDestroyNotify) g_ptr_array_unref);
+  store->scope_hash_to_authorizations = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                               NULL, (GDestroyNotify) g_ptr_array_unref);
 
   return store;
 }
@@ -3079,11 +4186,88 @@ temporary_authorization_store_new (PolkitBackendInteractiveAuthority *authority)
 static void
 temporary_authorization_store_free (TemporaryAuthorizationStore *store)
 {
+  g_hash_table_unref (store->id_to_authorization);
+  g_hash_table_unref (store->subject_hash_to_authorizations);
+  g_hash_table_unref (store->scope_hash_to_authorizations);
   g_list_foreach (store->authorizations, (GFunc) temporary_authorization_free, NULL);
   g_list_free (store->authorizations);
   g_free (store);
 }
 
+static void
+authorization_index_add (GHashTable             *index,
+                         guint                   hash,
+                         TemporaryAuthorization *authorization)
+{
+  GPtrArray *authorizations;
+
+  authorizations = g_hash_table_lookup (index, GUINT_TO_POINTER (hash));
+  if (authorizations == NULL)
+    {
+      authorizations = g_ptr_array_new ();
+      g_hash_table_insert (index, GUINT_TO_POINTER (hash), authorizations);
+    }
+  g_ptr_array_add (authorizations, authorization);
+}
+
+static void
+authorization_index_remove (GHashTable             *index,
+                            guint                   hash,
+                            TemporaryAuthorization *authorization)
+{
+  GPtrArray *authorizations;
+
+  authorizations = g_hash_table_lookup (index, GUINT_TO_POINTER (hash));
+  g_ptr_array_remove_fast (authorizations, authorization);
+  if (authorizations->len == 0)
+    g_hash_table_remove (index, GUINT_TO_POINTER (hash));
+}
+
+/* Returns the authorizations whose scope may be @scope, or %NULL */
+static GPtrArray *
+temporary_authorization_store_lookup_scope (TemporaryAuthorizationStore *store,
+                                            const PolkitBackendSubject  *scope)
+{
+  return g_hash_table_lookup (store->scope_hash_to_authorizations,
+                              GUINT_TO_POINTER (polkit_backend_subject_hash (scope)));
+}
+
+/* Adds @authorization as the most recently used one */
+static void
+temporary_authorization_store_link (TemporaryAuthorizationStore *store,
+                                    TemporaryAuthorization      *authorization)
+{
+  store->authorizations = g_list_prepend (store->authorizations, authorization);
+  authorization->link = store->authorizations;
+
+  polkit_backend_subject_init (&authorization->subject_key, authorization->subject);
+  polkit_backend_subject_init (&authorization->scope_key, authorization->scope);
+  g_hash_table_insert (store->id_to_authorization, authorization->id, authorization);
+  authorization_index_add (store->subject_hash_to_authorizations,
+                           polkit_backend_subject_hash (&authorization->subject_key),
+                           authorization);
+  authorization_index_add (store->scope_hash_to_authorizations,
+                           polkit_backend_subject_hash (&authorization->scope_key),
+                           authorization);
+}
+
+/* Removes @authorization from @store without freeing it */
+static void
+temporary_authorization_store_unlink (TemporaryAuthorizationStore *store,
+                                      TemporaryAuthorization      *authorization)
+{
+  store->authorizations = g_list_delete_link (store->authorizations, authorization->link);
+  authorization->link = NULL;
+
+  g_hash_table_remove (store->id_to_authorization, authorization->id);
+  authorization_index_remove (store->subject_hash_to_authorizations,
+                              polkit_backend_subject_hash (&authorization->subject_key),
+                              authorization);
+  authorization_index_remove (store->scope_hash_to_authorizations,
+                              polkit_backend_subject_hash (&authorization->scope_key),
+                              authorization);
+}
+
 /* XXX: for now, prefer to store the process; see
  * https://bugs.freedesktop.org/show_bug.cgi?id=23867
  */
@@ -3118,83 +4302,103 @@ convert_temporary_authorization_subject (PolkitSubject *subject)
 
 /* See the comment at the top of polkitunixprocess.c */
 static gboolean
-subject_equal_for_authz (PolkitSubject *a,
-                         PolkitSubject *b)
+subject_equal_for_authz (const PolkitBackendSubject *a,
+                         const PolkitBackendSubject *b)
 {
-  if (!polkit_subject_equal (a, b))
+  if (!polkit_backend_subject_equal (a, b))
     return FALSE;
 
   /* Now special case unix processes, as we want to protect against
    * pid reuse by including the PID FDs or UIDs as a fallback.
    */
-  if (POLKIT_IS_UNIX_PROCESS (a) && POLKIT_IS_UNIX_PROCESS (b)) {
-    /* If both objects are tracking via PID FD then we can rely on that,
-     * as the PID is resolved on-the-fly via the pinned file descriptor,
-     * and it will be -1 if the process exited in the meanwhile. */
-    if (polkit_unix_process_get_pidfd ((PolkitUnixProcess*)a) >= 0 &&
-        polkit_unix_process_get_pidfd ((PolkitUnixProcess*)b) >= 0)
-      {
-        int pid_a = polkit_unix_process_get_pid ((PolkitUnixProcess*)a);
-        int pid_b = polkit_unix_process_get_pid ((PolkitUnixProcess*)b);
-
-        return pid_a > 0 && pid_b > 0 && pid_a == pid_b;
-      }
+  if (a->kind == POLKIT_BACKEND_SUBJECT_KIND_UNIX_PROCESS)
+    {
+      /* If both objects are tracking via PID FD then we can rely on that,
+       * as the PID is resolved on-the-fly via the pinned file descriptor,
+       * and it will be -1 if the process exited in the meanwhile. */
+      if (a->u.process.pidfd >= 0 && b->u.process.pidfd >= 0)
+        {
+          int pid_a = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (a->object));
+          int pid_b = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (b->object));
 
-    int uid_a = polkit_unix_process_get_uid ((PolkitUnixProcess*)a);
-    int uid_b = polkit_unix_process_get_uid ((PolkitUnixProcess*)b);
+          return pid_a > 0 && pid_b > 0 && pid_a == pid_b;
+        }
 
-    if (uid_a != -1 && uid_b != -1)
-      {
-        if (uid_a == uid_b)
-          {
-            return TRUE;
-          }
-        else
-          {
-            g_printerr ("denying slowfork; pid %d uid %d != %d!\n",
-                        polkit_unix_process_get_pid ((PolkitUnixProcess*)a),
-                        uid_a, uid_b);
-            return FALSE;
-          }
-      }
-    /* Fall through; one of the uids is unset so we can't reliably compare */
-  }
+      if (a->u.process.uid != -1 && b->u.process.uid != -1)
+        {
+          if (a->u.process.uid == b->u.process.uid)
+            {
+              return TRUE;
+            }
+          else
+            {
+              g_printerr ("denying slowfork; pid %d uid %d != %d!\n",
+                          a->u.process.pid,
+                          a->u.process.uid, b->u.process.uid);
+              return FALSE;
+            }
+        }
+      /* Fall through; one of the uids is unset so we can't reliably compare */
+    }
 
   return TRUE;
 }
 
+/* Like temporary_authorization_store_has_authorization() but for a
+ * subject that is already resolved, as the ones in a #SubjectContext are.
+ */
+static gboolean
+temporary_authorization_store_has_authorization_for_key (TemporaryAuthorizationStore *store,
+                                                         const PolkitBackendSubject  *subject,
+                                                         const gchar                 *action_id,
+                                                         const gchar                **out_tmp_authz_id)
+{
+  GPtrArray *authorizations;
+  guint n;
+
+  /* subject_equal_for_authz() implies equal keys so only authorizations
+   * with the same hash can match
+   */
+  authorizations = g_hash_table_lookup (store->subject_hash_to_authorizations,
+                                        GUINT_TO_POINTER (polkit_backend_subject_hash (subject)));
+  for (n = 0; authorizations != NULL && n < authorizations->len; n++)
+    {
+      TemporaryAuthorization *authorization = authorizations->pdata[n];
+
+      if (strcmp (action_id, authorization->action_id) == 0 &&
+          subject_equal_for_authz (subject, &authorization->subject_key))
+        {
+          if (out_tmp_authz_id != NULL)
+            *out_tmp_authz_id = authorization->id;
+          /* keep the list in LRU order for temporary_authorization_store_trim() */
+          store->authorizations = g_list_remove_link (store->authorizations, authorization->link);
+          store->authorizations = g_list_concat (authorization->link, store->authorizations);
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
 static gboolean
 temporary_authorization_store_has_authorization (TemporaryAuthorizationStore *store,
                                                  PolkitSubject               *subject,
                                                  const gchar                 *action_id,
                                                  const gchar                **out_tmp_authz_id)
 {
-  GList *l;
-  gboolean ret;
+  PolkitBackendSubject subject_key;
   PolkitSubject *subject_to_use;
+  gboolean ret;
 
   g_return_val_if_fail (store != NULL, FALSE);
   g_return_val_if_fail (POLKIT_IS_SUBJECT (subject), FALSE);
   g_return_val_if_fail (action_id != NULL, FALSE);
 
   subject_to_use = convert_temporary_authorization_subject (subject);
+  polkit_backend_subject_init (&subject_key, subject_to_use);
 
-  ret = FALSE;
-
-  for (l = store->authorizations; l != NULL; l = l->next) {
-    TemporaryAuthorization *authorization = l->data;
+  ret = temporary_authorization_store_has_authorization_for_key (store, &subject_key, action_id, out_tmp_authz_id);
 
-    if (strcmp (action_id, authorization->action_id) == 0 &&
-        subject_equal_for_authz (subject_to_use, authorization->subject))
-      {
-        ret = TRUE;
-        if (out_tmp_authz_id != NULL)
-          *out_tmp_authz_id = authorization->id;
-        goto out;
-      }
-  }
-
- out:
   g_object_unref (subject_to_use);
   return ret;
 }
@@ -3213,8 +4417,7 @@ on_expiration_timeout (gpointer user_data)
            s);
   g_free (s);
 
-  authorization->store->authorizations = g_list_remove (authorization->store->authorizations,
-                                                        authorization);
+  temporary_authorization_store_unlink (authorization->store, authorization);
   authorization->expiration_timeout_id = 0;
   g_signal_emit_by_name (authorization->store->authority, "changed");
   temporary_authorization_free (authorization);
@@ -3252,8 +4455,7 @@ on_unix_process_check_vanished_timeout (gpointer user_data)
                    s);
           g_free (s);
 
-          authorization->store->authorizations = g_list_remove (authorization->store->authorizations,
-                                                                authorization);
+          temporary_authorization_store_unlink (authorization->store, authorization);
           g_signal_emit_by_name (authorization->store->authority, "changed");
           temporary_authorization_free (authorization);
         }
@@ -3278,10 +4480,10 @@ temporary_authorization_store_remove_authorizations_for_system_bus_name (Tempora
 
       ll = l->next;
 
-      if (!POLKIT_IS_SYSTEM_BUS_NAME (ta->subject))
+      if (ta->subject_key.kind != POLKIT_BACKEND_SUBJECT_KIND_SYSTEM_BUS_NAME)
         continue;
 
-      if (g_strcmp0 (name, polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (ta->subject))) != 0)
+      if (g_strcmp0 (name, ta->subject_key.u.system_bus_name) != 0)
         continue;
 
 
@@ -3293,7 +4495,7 @@ temporary_authorization_store_remove_authorizations_for_system_bus_name (Tempora
                s);
       g_free (s);
 
-      store->authorizations = g_list_remove (store->authorizations, ta);
+      temporary_authorization_store_unlink (store, ta);
       temporary_authorization_free (ta);
 
       num_removed++;
@@ -3303,43 +4505,103 @@ temporary_authorization_store_remove_authorizations_for_system_bus_name (Tempora
     g_signal_emit_by_name (store->authority, "changed");
 }
 
-static const gchar *
-temporary_authorization_store_add_authorization (TemporaryAuthorizationStore *store,
-                                                 PolkitSubject               *subject,
-                                                 PolkitSubject               *scope,
-                                                 const gchar                 *action_id)
+/* Removes the least recently used authorizations until there are at most
+ * @store->max_authorizations left. Returns the number removed.
+ */
+static guint
+temporary_authorization_store_trim (TemporaryAuthorizationStore *store)
 {
-  TemporaryAuthorization *authorization;
-  guint expiration_seconds;
-  PolkitSubject *subject_to_use;
+  guint num_authorizations;
+  guint num_removed;
+  GList *l;
 
-  g_return_val_if_fail (store != NULL, NULL);
-  g_return_val_if_fail (POLKIT_IS_SUBJECT (subject), NULL);
-  g_return_val_if_fail (action_id != NULL, NULL);
-  g_return_val_if_fail (!temporary_authorization_store_has_authorization (store, subject, action_id, NULL), NULL);
+  if (store->max_authorizations == 0)
+    return 0;
 
-  subject_to_use = convert_temporary_authorization_subject (subject);
+  num_removed = 0;
+  num_authorizations = g_list_length (store->authorizations);
+  while (num_authorizations > store->max_authorizations)
+    {
+      TemporaryAuthorization *ta;
+      gchar *s;
 
-  /* TODO: right now the time the temporary authorization is kept is hard-coded - we
-   *       could make it a propery on the PolkitBackendInteractiveAuthority class (so
-   *       the local authority could read it from a config file) or a vfunc
-   *       (so the local authority could read it from an annotation on the action).
-   */
-  expiration_seconds = 5 * 60;
+      l = g_list_last (store->authorizations);
+      ta = l->data;
 
-  authorization = g_new0 (TemporaryAuthorization, 1);
-  authorization->id = g_strdup_printf ("tmpauthz%" G_GUINT64_FORMAT, store->serial++);
-  authorization->store = store;
-  authorization->subject = g_object_ref (subject_to_use);
-  authorization->scope = g_object_ref (scope);
-  authorization->action_id = g_strdup (action_id);
-  /* store monotonic time and convert to secs-since-epoch when returning TemporaryAuthorization structs */
-  authorization->time_granted = g_get_monotonic_time ();
-  authorization->time_expires = authorization->time_granted + expiration_seconds * G_USEC_PER_SEC;
-  /* g_timeout_add() is using monotonic time since 2.28 */
-  authorization->expiration_timeout_id = g_timeout_add (expiration_seconds * 1000,
-                                                        on_expiration_timeout,
-                                                        authorization);
+      s = polkit_subject_to_string (ta->subject);
+      g_debug ("Removing tempoary authorization with id `%s' for action-id `%s' for subject `%s': "
+               "too many temporary authorizations",
+               ta->id,
+               ta->action_id,
+               s);
+      g_free (s);
+
+      temporary_authorization_store_unlink (store, ta);
+      temporary_authorization_free (ta);
+
+      num_authorizations--;
+      num_removed++;
+    }
+
+  return num_removed;
+}
+
+/* Approximate number of bytes used by @store, not counting the subjects */
+static gsize
+temporary_authorization_store_get_memory_usage (TemporaryAuthorizationStore *store,
+                                                guint                       *out_num_authorizations)
+{
+  guint num_authorizations;
+  gsize ret;
+  GList *l;
+
+  ret = sizeof (TemporaryAuthorizationStore);
+  num_authorizations = 0;
+  for (l = store->authorizations; l != NULL; l = l->next)
+    {
+      TemporaryAuthorization *ta = l->data;
+
+      ret += sizeof (GList) + sizeof (TemporaryAuthorization);
+      ret += strlen (ta->id) + 1;
+      ret += strlen (ta->action_id) + 1;
+      num_authorizations++;
+    }
+
+  *out_num_authorizations = num_authorizations;
+  return ret;
+}
+
+/* @id may be %NULL to pick a new one */
+static TemporaryAuthorization *
+temporary_authorization_store_insert (TemporaryAuthorizationStore *store,
+                                      PolkitSubject               *subject,
+                                      PolkitSubject               *scope,
+                                      const gchar                 *action_id,
+                                      const gchar                 *id,
+                                      gint64                       time_granted,
+                                      gint64                       time_expires)
+{
+  TemporaryAuthorization *authorization;
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+
+  authorization = g_new0 (TemporaryAuthorization, 1);
+  if (id != NULL)
+    authorization->id = g_strdup (id);
+  else
+    authorization->id = g_strdup_printf ("tmpauthz%" G_GUINT64_FORMAT, store->serial++);
+  authorization->store = store;
+  authorization->subject = g_object_ref (subject);
+  authorization->scope = g_object_ref (scope);
+  authorization->action_id = g_strdup (action_id);
+  /* store monotonic time and convert to secs-since-epoch when returning TemporaryAuthorization structs */
+  authorization->time_granted = time_granted;
+  authorization->time_expires = time_expires;
+  /* g_timeout_add() is using monotonic time since 2.28 */
+  authorization->expiration_timeout_id = g_timeout_add (MAX (time_expires - now, 0) / 1000,
+                                                        on_expiration_timeout,
+                                                        authorization);
 
   if (POLKIT_IS_UNIX_PROCESS (authorization->subject))
     {
@@ -3371,7 +4633,47 @@ temporary_authorization_store_add_authorization (TemporaryAuthorizationStore *st
 #endif
 
 
-  store->authorizations = g_list_prepend (store->authorizations, authorization);
+  temporary_authorization_store_link (store, authorization);
+
+  /* the new authorization is the most recently used, so it is never the one removed */
+  temporary_authorization_store_trim (store);
+
+  return authorization;
+}
+
+static const gchar *
+temporary_authorization_store_add_authorization (TemporaryAuthorizationStore *store,
+                                                 PolkitSubject               *subject,
+                                                 PolkitSubject               *scope,
+                                                 const gchar                 *action_id)
+{
+  TemporaryAuthorization *authorization;
+  guint expiration_seconds;
+  PolkitSubject *subject_to_use;
+  gint64 now;
+
+  g_return_val_if_fail (store != NULL, NULL);
+  g_return_val_if_fail (POLKIT_IS_SUBJECT (subject), NULL);
+  g_return_val_if_fail (action_id != NULL, NULL);
+  g_return_val_if_fail (!temporary_authorization_store_has_authorization (store, subject, action_id, NULL), NULL);
+
+  subject_to_use = convert_temporary_authorization_subject (subject);
+
+  /* TODO: right now the time the temporary authorization is kept is hard-coded - we
+   *       could make it a propery on the PolkitBackendInteractiveAuthority class (so
+   *       the local authority could read it from a config file) or a vfunc
+   *       (so the local authority could read it from an annotation on the action).
+   */
+  expiration_seconds = 5 * 60;
+
+  now = g_get_monotonic_time ();
+  authorization = temporary_authorization_store_insert (store,
+                                                        subject_to_use,
+                                                        scope,
+                                                        action_id,
+                                                        NULL,
+                                                        now,
+                                                        now + expiration_seconds * G_USEC_PER_SEC);
 
   g_object_unref (subject_to_use);
 
@@ -3380,24 +4682,17 @@ temporary_authorization_store_add_authorization (TemporaryAuthorizationStore *st
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static GList *
-polkit_backend_interactive_authority_enumerate_temporary_authorizations (PolkitBackendAuthority   *authority,
-                                                                         PolkitSubject            *caller,
-                                                                         PolkitSubject            *subject,
-                                                                         GError                  **error)
+/* Checks that @caller may look at the temporary authorizations of @subject */
+static gboolean
+check_temporary_authorization_scope (PolkitBackendInteractiveAuthorityPrivate  *priv,
+                                     PolkitSubject                             *caller,
+                                     PolkitSubject                             *subject,
+                                     GError                                   **error)
 {
-  PolkitBackendInteractiveAuthority *interactive_authority;
-  PolkitBackendInteractiveAuthorityPrivate *priv;
   PolkitSubject *session_for_caller;
-  GList *ret;
-  GList *l;
-  gint64 monotonic_now;
-  gint64 real_now;
-
-  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
-  priv = polkit_backend_interactive_authority_get_instance_private (interactive_authority);
+  gboolean ret;
 
-  ret = NULL;
+  ret = FALSE;
   session_for_caller = NULL;
 
   if (!POLKIT_IS_UNIX_SESSION (subject))
@@ -3430,21 +4725,65 @@ polkit_backend_interactive_authority_enumerate_temporary_authorizations (PolkitB
       goto out;
     }
 
+  ret = TRUE;
+
+ out:
+  if (session_for_caller != NULL)
+    g_object_unref (session_for_caller);
+
+  return ret;
+}
+
+static void
+temporary_authorization_get_real_times (TemporaryAuthorization *ta,
+                                        gint64                  monotonic_now,
+                                        gint64                  real_now,
+                                        guint64                *out_real_granted,
+                                        guint64                *out_real_expires)
+{
+  *out_real_granted = (ta->time_granted - monotonic_now) / G_USEC_PER_SEC + real_now;
+  *out_real_expires = (ta->time_expires - monotonic_now) / G_USEC_PER_SEC + real_now;
+}
+
+static GList *
+polkit_backend_interactive_authority_enumerate_temporary_authorizations (PolkitBackendAuthority   *authority,
+                                                                         PolkitSubject            *caller,
+                                                                         PolkitSubject            *subject,
+                                                                         GError                  **error)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitBackendSubject scope_key;
+  GPtrArray *authorizations;
+  GList *ret;
+  gint64 monotonic_now;
+  gint64 real_now;
+  guint n;
+
+  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
+  priv = polkit_backend_interactive_authority_get_instance_private (interactive_authority);
+
+  ret = NULL;
+
+  if (!check_temporary_authorization_scope (priv, caller, subject, error))
+    goto out;
+
   monotonic_now = g_get_monotonic_time ();
   real_now = g_get_real_time () / G_TIME_SPAN_SECOND;
 
-  for (l = priv->temporary_authorization_store->authorizations; l != NULL; l = l->next)
+  polkit_backend_subject_init (&scope_key, subject);
+  authorizations = temporary_authorization_store_lookup_scope (priv->temporary_authorization_store, &scope_key);
+  for (n = 0; authorizations != NULL && n < authorizations->len; n++)
     {
-      TemporaryAuthorization *ta = l->data;
+      TemporaryAuthorization *ta = authorizations->pdata[n];
       PolkitTemporaryAuthorization *tmp_authz;
       guint64 real_granted;
       guint64 real_expires;
 
-      if (!polkit_subject_equal (ta->scope, subject))
+      if (!polkit_backend_subject_equal (&ta->scope_key, &scope_key))
         continue;
 
-      real_granted = (ta->time_granted - monotonic_now) / G_USEC_PER_SEC + real_now;
-      real_expires = (ta->time_expires - monotonic_now) / G_USEC_PER_SEC + real_now;
+      temporary_authorization_get_real_times (ta, monotonic_now, real_now, &real_granted, &real_expires);
 
       tmp_authz = polkit_temporary_authorization_new (ta->id,
                                                       ta->action_id,
@@ -3456,12 +4795,62 @@ polkit_backend_interactive_authority_enumerate_temporary_authorizations (PolkitB
     }
 
  out:
-  if (session_for_caller != NULL)
-    g_object_unref (session_for_caller);
-
   return ret;
 }
 
+/* Like polkit_backend_interactive_authority_enumerate_temporary_authorizations()
+ * but serializes straight from the store, without creating a
+ * PolkitTemporaryAuthorization for every entry.
+ */
+static GVariant *
+polkit_backend_interactive_authority_enumerate_temporary_authorizations_as_gvariant (PolkitBackendAuthority   *authority,
+                                                                                     PolkitSubject            *caller,
+                                                                                     PolkitSubject            *subject,
+                                                                                     GError                  **error)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitBackendSubject scope_key;
+  GPtrArray *authorizations;
+  GVariantBuilder builder;
+  gint64 monotonic_now;
+  gint64 real_now;
+  guint n;
+
+  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
+  priv = polkit_backend_interactive_authority_get_instance_private (interactive_authority);
+
+  if (!check_temporary_authorization_scope (priv, caller, subject, error))
+    return NULL;
+
+  monotonic_now = g_get_monotonic_time ();
+  real_now = g_get_real_time () / G_TIME_SPAN_SECOND;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ss(sa{sv})tt)"));
+  polkit_backend_subject_init (&scope_key, subject);
+  authorizations = temporary_authorization_store_lookup_scope (priv->temporary_authorization_store, &scope_key);
+  for (n = 0; authorizations != NULL && n < authorizations->len; n++)
+    {
+      TemporaryAuthorization *ta = authorizations->pdata[n];
+      guint64 real_granted;
+      guint64 real_expires;
+
+      if (!polkit_backend_subject_equal (&ta->scope_key, &scope_key))
+        continue;
+
+      temporary_authorization_get_real_times (ta, monotonic_now, real_now, &real_granted, &real_expires);
+
+      g_variant_builder_add (&builder, "(ss@(sa{sv})tt)",
+                             ta->id,
+                             ta->action_id,
+                             polkit_subject_to_gvariant (ta->subject),
+                             real_granted,
+                             real_expires);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static gboolean
@@ -3472,60 +4861,42 @@ polkit_backend_interactive_authority_revoke_temporary_authorizations (PolkitBack
 {
   PolkitBackendInteractiveAuthority *interactive_authority;
   PolkitBackendInteractiveAuthorityPrivate *priv;
-  PolkitSubject *session_for_caller;
+  PolkitBackendSubject scope_key;
+  GPtrArray *authorizations;
   gboolean ret;
-  GList *l;
-  GList *ll;
   guint num_removed;
+  guint n;
 
   interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
   priv = polkit_backend_interactive_authority_get_instance_private (interactive_authority);
 
   ret = FALSE;
-  session_for_caller = NULL;
-
-  if (!POLKIT_IS_UNIX_SESSION (subject))
-    {
-      g_set_error (error,
-                   POLKIT_ERROR,
-                   POLKIT_ERROR_FAILED,
-                   "Can only handle PolkitUnixSession objects for now.");
-      goto out;
-    }
-
-  session_for_caller = polkit_backend_session_monitor_get_session_for_subject (priv->session_monitor,
-                                                                               caller,
-                                                                               NULL);
-  if (session_for_caller == NULL)
-    {
-      g_set_error (error,
-                   POLKIT_ERROR,
-                   POLKIT_ERROR_FAILED,
-                   "Cannot determine session the caller is in");
-      goto out;
-    }
 
-  if (!polkit_subject_equal (session_for_caller, subject))
-    {
-      g_set_error (error,
-                   POLKIT_ERROR,
-                   POLKIT_ERROR_FAILED,
-                   "Passed session and the session the caller is in differs. They must be equal for now.");
-      goto out;
-    }
+  if (!check_temporary_authorization_scope (priv, caller, subject, error))
+    goto out;
 
   num_removed = 0;
-  for (l = priv->temporary_authorization_store->authorizations; l != NULL; l = ll)
+  polkit_backend_subject_init (&scope_key, subject);
+  authorizations = temporary_authorization_store_lookup_scope (priv->temporary_authorization_store, &scope_key);
+  n = 0;
+  /* unlinking the last authorization in the bucket frees @authorizations */
+  while (authorizations != NULL && n < authorizations->len)
     {
-      TemporaryAuthorization *ta = l->data;
-
-      ll = l->next;
+      TemporaryAuthorization *ta = authorizations->pdata[n];
+      gboolean last;
 
-      if (!polkit_subject_equal (ta->scope, subject))
-        continue;
+      if (!polkit_backend_subject_equal (&ta->scope_key, &scope_key))
+        {
+          n++;
+          continue;
+        }
 
-      priv->temporary_authorization_store->authorizations = g_list_remove (priv->temporary_authorization_store->authorizations, ta);
+      /* unlinking moves the last element of the bucket to @n */
+      last = authorizations->len == 1;
+      temporary_authorization_store_unlink (priv->temporary_authorization_store, ta);
       temporary_authorization_free (ta);
+      if (last)
+        authorizations = NULL;
 
       num_removed++;
     }
@@ -3536,9 +4907,6 @@ polkit_backend_interactive_authority_revoke_temporary_authorizations (PolkitBack
   ret = TRUE;
 
  out:
-  if (session_for_caller != NULL)
-    g_object_unref (session_for_caller);
-
   return ret;
 }
 
@@ -3553,9 +4921,8 @@ polkit_backend_interactive_authority_revoke_temporary_authorization_by_id (Polki
   PolkitBackendInteractiveAuthority *interactive_authority;
   PolkitBackendInteractiveAuthorityPrivate *priv;
   PolkitSubject *session_for_caller;
+  TemporaryAuthorization *ta;
   gboolean ret;
-  GList *l;
-  GList *ll;
   guint num_removed;
 
   interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
@@ -3577,15 +4944,9 @@ polkit_backend_interactive_authority_revoke_temporary_authorization_by_id (Polki
     }
 
   num_removed = 0;
-  for (l = priv->temporary_authorization_store->authorizations; l != NULL; l = ll)
+  ta = g_hash_table_lookup (priv->temporary_authorization_store->id_to_authorization, id);
+  if (ta != NULL)
     {
-      TemporaryAuthorization *ta = l->data;
-
-      ll = l->next;
-
-      if (strcmp (ta->id, id) != 0)
-        continue;
-
       if (!polkit_subject_equal (session_for_caller, ta->scope))
         {
           g_set_error (error,
@@ -3595,7 +4956,7 @@ polkit_backend_interactive_authority_revoke_temporary_authorization_by_id (Polki
           goto out;
         }
 
-      priv->temporary_authorization_store->authorizations = g_list_remove (priv->temporary_authorization_store->authorizations, ta);
+      temporary_authorization_store_unlink (priv->temporary_authorization_store, ta);
       temporary_authorization_free (ta);
 
       num_removed++;
@@ -3625,3 +4986,673 @@ polkit_backend_interactive_authority_revoke_temporary_authorization_by_id (Polki
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
+
+static void
+polkit_backend_interactive_authority_add_statistics (PolkitBackendAuthority *authority,
+                                                     GVariantBuilder        *builder)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
+  priv = polkit_backend_interactive_authority_get_instance_private (interactive_authority);
+
+  /* checks that ended early because the caller cancelled them */
+  g_variant_builder_add (builder, "{st}", "check-authorization-cancelled", priv->num_checks_cancelled);
+  /* runs of the rules that were left out because the check had been cancelled */
+  g_variant_builder_add (builder, "{st}", "rule-evaluations-skipped", priv->num_rule_evaluations_skipped);
+  /* checks answered by the evaluation of an identical one, see CoalescedCheck */
+  g_variant_builder_add (builder, "{st}", "check-authorization-coalesced", priv->num_checks_coalesced);
+  /* the most checks answered by a single evaluation */
+  g_variant_builder_add (builder, "{st}", "check-authorization-coalesced-max", priv->max_checks_coalesced);
+  /* challenges offering fewer administrators than the rules allowed */
+  g_variant_builder_add (builder, "{st}", "admin-identities-truncated", priv->num_admin_identities_truncated);
+
+  /* see polkit_backend_interactive_authority_set_latency_sampling() */
+  _polkit_backend_trace_add_statistics (builder);
+}
+
+static void
+polkit_backend_interactive_authority_add_memory_usage (PolkitBackendAuthority *authority,
+                                                       GVariantBuilder        *builder)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  GHashTableIter hash_iter;
+  AuthenticationAgent *agent;
+  guint num_entries;
+  gsize size;
+
+  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
+  priv = polkit_backend_interactive_authority_get_instance_private (interactive_authority);
+
+  size = polkit_backend_action_pool_get_memory_usage (priv->action_pool, &num_entries);
+  g_variant_builder_add (builder, "{s(tt)}", "actions", (guint64) num_entries, (guint64) size);
+
+  size = polkit_backend_action_pool_get_cache_usage (priv->action_pool, &num_entries);
+  g_variant_builder_add (builder, "{s(tt)}", "action-descriptions", (guint64) num_entries, (guint64) size);
+
+  size = temporary_authorization_store_get_memory_usage (priv->temporary_authorization_store, &num_entries);
+  g_variant_builder_add (builder, "{s(tt)}", "temporary-authorizations", (guint64) num_entries, (guint64) size);
+
+  /* agents are not a cache, they live as long as their process, so they are just counted */
+  size = 0;
+  g_hash_table_iter_init (&hash_iter, priv->hash_scope_to_authentication_agent);
+  while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer) &agent))
+    {
+      size += sizeof (guint) + 2 * sizeof (gpointer);
+      size += sizeof (AuthenticationAgent);
+      size += strlen (agent->object_path) + 1;
+      size += strlen (agent->unique_system_bus_name) + 1;
+      if (agent->locale != NULL)
+        size += strlen (agent->locale) + 1;
+      size += g_list_length (agent->active_sessions) * (sizeof (GList) + sizeof (AuthenticationSession));
+    }
+  num_entries = g_hash_table_size (priv->hash_scope_to_authentication_agent);
+  g_variant_builder_add (builder, "{s(tt)}", "authentication-agents", (guint64) num_entries, (guint64) size);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static guint8
+implicit_to_snapshot_decision (PolkitImplicitAuthorization  implicit_authorization,
+                               gboolean                     can_be_overridden)
+{
+  switch (implicit_authorization)
+    {
+    case POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED:
+      return POLKIT_IMPLICIT_SNAPSHOT_AUTHORIZED;
+    case POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED:
+      /* a temporary authorization or an implying action may still say yes */
+      return can_be_overridden ? POLKIT_IMPLICIT_SNAPSHOT_ASK_AUTHORITY : POLKIT_IMPLICIT_SNAPSHOT_NOT_AUTHORIZED;
+    default:
+      /* needs authentication, which only polkitd can start */
+      return POLKIT_IMPLICIT_SNAPSHOT_ASK_AUTHORITY;
+    }
+}
+
+static GVariant *
+polkit_backend_interactive_authority_get_implicit_authorizations (PolkitBackendAuthority *authority)
+{
+  PolkitBackendInteractiveAuthority *interactive_authority;
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  PolkitBackendInteractiveAuthorityClass *klass;
+  GHashTable *overridable;
+  GVariantBuilder builder;
+  GList *actions;
+  GList *l;
+  GPtrArray *action_ids;
+  gboolean *has_rules;
+  guint n;
+
+  interactive_authority = POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority);
+  priv = polkit_backend_interactive_authority_get_instance_private (interactive_authority);
+  klass = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_GET_CLASS (interactive_authority);
+
+  actions = polkit_backend_action_pool_get_all_actions (priv->action_pool, NULL);
+
+  overridable = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  for (l = actions; l != NULL; l = l->next)
+    {
+      const gchar *imply;
+      gchar **tokens;
+      guint n;
+
+      imply = polkit_action_description_get_annotation (POLKIT_ACTION_DESCRIPTION (l->data),
+                                                        "org.freedesktop.policykit.imply");
+      if (imply == NULL)
+        continue;
+      tokens = g_strsplit (imply, " ", 0);
+      for (n = 0; tokens[n] != NULL; n++)
+        g_hash_table_add (overridable, tokens[n]);
+      /* the strings are owned by the hash table now */
+      g_free (tokens);
+    }
+  for (l = priv->temporary_authorization_store->authorizations; l != NULL; l = l->next)
+    {
+      TemporaryAuthorization *authorization = l->data;
+      g_hash_table_add (overridable, g_strdup (authorization->action_id));
+    }
+
+  /* rules can rewrite the implicit authorization of an action
+   * depending on the subject, so then the action is still listed
+   * (clients answer for uid 0 on their own) but nothing else can
+   * be decided without us; ask about all actions at once
+   */
+  action_ids = g_ptr_array_new ();
+  for (l = actions; l != NULL; l = l->next)
+    g_ptr_array_add (action_ids, (gpointer) polkit_action_description_get_action_id (POLKIT_ACTION_DESCRIPTION (l->data)));
+  g_ptr_array_add (action_ids, NULL);
+  has_rules = g_new (gboolean, action_ids->len);
+  for (n = 0; n < action_ids->len; n++)
+    has_rules[n] = klass->check_authorization_sync != NULL;
+  if (klass->has_authorization_rules != NULL)
+    klass->has_authorization_rules (interactive_authority,
+                                    (const gchar * const *) action_ids->pdata,
+                                    has_rules);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(syyy)"));
+  for (l = actions, n = 0; l != NULL; l = l->next, n++)
+    {
+      PolkitActionDescription *action_desc = POLKIT_ACTION_DESCRIPTION (l->data);
+      const gchar *action_id;
+      gboolean can_be_overridden;
+
+      action_id = polkit_action_description_get_action_id (action_desc);
+
+      if (has_rules[n])
+        {
+          g_variant_builder_add (&builder, "(syyy)", action_id,
+                                 POLKIT_IMPLICIT_SNAPSHOT_ASK_AUTHORITY,
+                                 POLKIT_IMPLICIT_SNAPSHOT_ASK_AUTHORITY,
+                                 POLKIT_IMPLICIT_SNAPSHOT_ASK_AUTHORITY);
+          continue;
+        }
+
+      can_be_overridden = g_hash_table_contains (overridable, action_id);
+      g_variant_builder_add (&builder, "(syyy)", action_id,
+                             implicit_to_snapshot_decision (polkit_action_description_get_implicit_any (action_desc),
+                                                            can_be_overridden),
+                             implicit_to_snapshot_decision (polkit_action_description_get_implicit_inactive (action_desc),
+                                                            can_be_overridden),
+                             implicit_to_snapshot_decision (polkit_action_description_get_implicit_active (action_desc),
+                                                            can_be_overridden));
+    }
+
+  g_free (has_rules);
+  g_ptr_array_unref (action_ids);
+  g_hash_table_unref (overridable);
+  g_list_free_full (actions, g_object_unref);
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * polkit_backend_interactive_authority_set_cache_limits:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @max_temporary_authorizations: The maximum number of temporary authorizations or 0 for no limit.
+ * @max_action_descriptions: The maximum number of cached action descriptions or 0 for no limit.
+ *
+ * Limits the number of entries kept around. When a limit is exceeded
+ * the least recently used entries are dropped; for temporary
+ * authorizations this means the user will have to authenticate again.
+ *
+ * Since: 127
+ */
+void
+polkit_backend_interactive_authority_set_cache_limits (PolkitBackendInteractiveAuthority *authority,
+                                                       guint                              max_temporary_authorizations,
+                                                       guint                              max_action_descriptions)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  g_return_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority));
+
+  priv = polkit_backend_interactive_authority_get_instance_private (authority);
+
+  priv->temporary_authorization_store->max_authorizations = max_temporary_authorizations;
+  if (temporary_authorization_store_trim (priv->temporary_authorization_store) > 0)
+    g_signal_emit_by_name (authority, "changed");
+
+  polkit_backend_action_pool_set_max_cached_descriptions (priv->action_pool, max_action_descriptions);
+}
+
+/**
+ * polkit_backend_interactive_authority_set_max_admin_identities:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @max_admin_identities: The maximum number of users or 0 for no limit.
+ *
+ * Limits the number of users an authentication agent is asked to
+ * choose from when administrator authentication is required. Users
+ * are offered in the order the administrator identities (and the
+ * members of the groups among them) are listed.
+ *
+ * Since: 127
+ */
+void
+polkit_backend_interactive_authority_set_max_admin_identities (PolkitBackendInteractiveAuthority *authority,
+                                                               guint                              max_admin_identities)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+
+  g_return_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority));
+
+  priv = polkit_backend_interactive_authority_get_instance_private (authority);
+  priv->max_admin_identities = max_admin_identities;
+}
+
+/**
+ * polkit_backend_interactive_authority_set_latency_sampling:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @sample_interval: Sample 1 in @sample_interval runs of each stage, or 0 to not sample.
+ *
+ * Makes polkitd measure how long the stages of authorization checks
+ * (subject resolution, session lookup, rules, temporary authorization
+ * lookup and starting a challenge) take. The measurements are added to
+ * the statistics as histograms, with entries like
+ * <literal>latency-rules-lt-64us</literal> counting the runs of the
+ * rules that took less than 64 microseconds but at least 32.
+ *
+ * Must be called before any authorization check is made.
+ *
+ * Since: 127
+ */
+void
+polkit_backend_interactive_authority_set_latency_sampling (PolkitBackendInteractiveAuthority *authority,
+                                                           guint                              sample_interval)
+{
+  g_return_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority));
+
+  _polkit_backend_trace_set_sample_interval (sample_interval);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Version of the state handed from one polkitd to the next, see
+ * polkit_backend_interactive_authority_save_state()
+ */
+#define STATE_VERSION 1
+
+/* Subjects are saved as (kind, name, pid, start-time, uid, pidfd) where
+ * pidfd is an index into the fd list or -1.
+ */
+static GVariant *
+save_subject (PolkitSubject *subject,
+              GUnixFDList   *fd_list,
+              GHashTable    *fd_to_index)
+{
+  if (POLKIT_IS_UNIX_PROCESS (subject))
+    {
+      PolkitUnixProcess *process = POLKIT_UNIX_PROCESS (subject);
+      gint pidfd;
+      gint idx;
+
+      /* only pidfds we got from the bus are trusted as such, see
+       * polkit_unix_process_get_pidfd_is_safe(); the others are opened
+       * again from the pid on restore
+       */
+      idx = -1;
+      pidfd = polkit_unix_process_get_pidfd (process);
+      if (pidfd >= 0 && polkit_unix_process_get_pidfd_is_safe (process))
+        {
+          gpointer value;
+
+          if (g_hash_table_lookup_extended (fd_to_index, GINT_TO_POINTER (pidfd), NULL, &value))
+            {
+              idx = GPOINTER_TO_INT (value);
+            }
+          else
+            {
+              idx = g_unix_fd_list_append (fd_list, pidfd, NULL);
+              if (idx >= 0)
+                g_hash_table_insert (fd_to_index, GINT_TO_POINTER (pidfd), GINT_TO_POINTER (idx));
+            }
+        }
+
+      return g_variant_new ("(ssutih)",
+                            "unix-process",
+                            "",
+                            (guint32) polkit_unix_process_get_pid (process),
+                            polkit_unix_process_get_start_time (process),
+                            (gint32) polkit_unix_process_get_uid (process),
+                            idx);
+    }
+  else if (POLKIT_IS_UNIX_SESSION (subject))
+    {
+      return g_variant_new ("(ssutih)",
+                            "unix-session",
+                            polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (subject)),
+                            0, (guint64) 0, -1, -1);
+    }
+  else if (POLKIT_IS_SYSTEM_BUS_NAME (subject))
+    {
+      return g_variant_new ("(ssutih)",
+                            "system-bus-name",
+                            polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (subject)),
+                            0, (guint64) 0, -1, -1);
+    }
+
+  return NULL;
+}
+
+/* Returns %NULL unless the subject still exists */
+static PolkitSubject *
+restore_subject (GVariant   *value,
+                 const gint *fds,
+                 guint       num_fds)
+{
+  PolkitSubject *ret;
+  const gchar *kind;
+  const gchar *name;
+  guint32 pid;
+  guint64 start_time;
+  gint32 uid;
+  gint32 idx;
+
+  ret = NULL;
+
+  g_variant_get (value, "(&s&sutih)", &kind, &name, &pid, &start_time, &uid, &idx);
+
+  if (g_strcmp0 (kind, "unix-process") == 0)
+    {
+      if (idx >= 0 && (guint) idx < num_fds && fds[idx] >= 0)
+        {
+          gint pidfd;
+
+          pidfd = fcntl (fds[idx], F_DUPFD_CLOEXEC, 3);
+          if (pidfd >= 0)
+            {
+              ret = polkit_unix_process_new_pidfd (pidfd, uid, NULL);
+              /* the pidfd pins the process, so this can only differ if
+               * something is badly wrong
+               */
+              if (polkit_unix_process_get_start_time (POLKIT_UNIX_PROCESS (ret)) != start_time)
+                g_clear_object (&ret);
+            }
+        }
+      else if (pid > 0)
+        {
+          GError *error = NULL;
+
+          ret = polkit_unix_process_new_for_owner (pid, start_time, uid);
+          /* also fails if the pid now belongs to a process with another start time */
+          if (polkit_unix_process_get_racy_uid__ (POLKIT_UNIX_PROCESS (ret), &error) != uid || error != NULL)
+            g_clear_object (&ret);
+          g_clear_error (&error);
+        }
+    }
+  else if (g_strcmp0 (kind, "unix-session") == 0)
+    {
+      ret = polkit_unix_session_new (name);
+    }
+  else if (g_strcmp0 (kind, "system-bus-name") == 0 && g_dbus_is_unique_name (name))
+    {
+      ret = polkit_system_bus_name_new (name);
+    }
+
+  if (ret != NULL && !polkit_subject_exists_sync (ret, NULL, NULL))
+    g_clear_object (&ret);
+
+  return ret;
+}
+
+/**
+ * polkit_backend_interactive_authority_save_state:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @fd_list: A #GUnixFDList to append file descriptors referenced by the state to.
+ *
+ * Serializes the registered authentication agents and the temporary
+ * authorizations of @authority so a new instance of the daemon can
+ * pick them up using polkit_backend_interactive_authority_restore_state()
+ * instead of having every agent register again and every user
+ * authenticate again.
+ *
+ * Authentication sessions in progress are not saved.
+ *
+ * Returns: A new floating #GVariant.
+ *
+ * Since: 127
+ */
+GVariant *
+polkit_backend_interactive_authority_save_state (PolkitBackendInteractiveAuthority *authority,
+                                                 GUnixFDList                       *fd_list)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  GVariantBuilder agents_builder;
+  GVariantBuilder authorizations_builder;
+  GHashTableIter hash_iter;
+  AuthenticationAgent *agent;
+  GHashTable *fd_to_index;
+  GList *l;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority), NULL);
+  g_return_val_if_fail (G_IS_UNIX_FD_LIST (fd_list), NULL);
+
+  priv = polkit_backend_interactive_authority_get_instance_private (authority);
+
+  /* subjects are shared between agents and authorizations, so don't
+   * pass the same pidfd twice
+   */
+  fd_to_index = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  g_variant_builder_init (&agents_builder, G_VARIANT_TYPE ("a((ssutih)usssa{sv})"));
+  g_hash_table_iter_init (&hash_iter, priv->hash_scope_to_authentication_agent);
+  while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer) &agent))
+    {
+      GVariant *scope;
+      GVariant *options;
+
+      scope = save_subject (agent->scope, fd_list, fd_to_index);
+      if (scope == NULL)
+        continue;
+
+      options = agent->registration_options;
+      if (options == NULL || !g_variant_is_of_type (options, G_VARIANT_TYPE_VARDICT))
+        options = g_variant_new ("a{sv}", NULL);
+
+      g_variant_builder_add (&agents_builder, "(@(ssutih)usss@a{sv})",
+                             scope,
+                             (guint32) agent->creator_uid,
+                             agent->unique_system_bus_name,
+                             agent->object_path,
+                             agent->locale != NULL ? agent->locale : "",
+                             options);
+    }
+
+  g_variant_builder_init (&authorizations_builder, G_VARIANT_TYPE ("a((ssutih)(ssutih)ssxx)"));
+  /* oldest first, so they end up in the same order when added again */
+  for (l = g_list_last (priv->temporary_authorization_store->authorizations); l != NULL; l = l->prev)
+    {
+      TemporaryAuthorization *authorization = l->data;
+      GVariant *subject;
+      GVariant *scope;
+
+      subject = save_subject (authorization->subject, fd_list, fd_to_index);
+      scope = save_subject (authorization->scope, fd_list, fd_to_index);
+      if (subject == NULL || scope == NULL)
+        {
+          if (subject != NULL)
+            g_variant_unref (g_variant_ref_sink (subject));
+          if (scope != NULL)
+            g_variant_unref (g_variant_ref_sink (scope));
+          continue;
+        }
+
+      g_variant_builder_add (&authorizations_builder, "(@(ssutih)@(ssutih)ssxx)",
+                             subject,
+                             scope,
+                             authorization->id,
+                             authorization->action_id,
+                             authorization->time_granted,
+                             authorization->time_expires);
+    }
+
+  g_hash_table_unref (fd_to_index);
+
+  return g_variant_new ("(u@a((ssutih)usssa{sv})t@a((ssutih)(ssutih)ssxx))",
+                        (guint32) STATE_VERSION,
+                        g_variant_builder_end (&agents_builder),
+                        priv->temporary_authorization_store->serial,
+                        g_variant_builder_end (&authorizations_builder));
+}
+
+/**
+ * polkit_backend_interactive_authority_restore_state:
+ * @authority: A #PolkitBackendInteractiveAuthority.
+ * @state: A #GVariant returned by polkit_backend_interactive_authority_save_state().
+ * @fds: (array length=num_fds): The file descriptors of the #GUnixFDList passed to
+ *   polkit_backend_interactive_authority_save_state(), -1 for ones that were lost.
+ * @num_fds: The number of elements in @fds.
+ *
+ * Adds the authentication agents and temporary authorizations saved in
+ * @state to @authority. Anything whose subject, scope or agent has gone
+ * away in the meantime is skipped, as are expired temporary
+ * authorizations. Processes whose pidfd was lost are identified by pid
+ * and start time instead. The file descriptors in @fds are not closed.
+ *
+ * Returns: %TRUE if @state could be used, %FALSE if @error is set.
+ *
+ * Since: 127
+ */
+gboolean
+polkit_backend_interactive_authority_restore_state (PolkitBackendInteractiveAuthority  *authority,
+                                                    GVariant                           *state,
+                                                    const gint                         *fds,
+                                                    guint                               num_fds,
+                                                    GError                            **error)
+{
+  PolkitBackendInteractiveAuthorityPrivate *priv;
+  TemporaryAuthorizationStore *store;
+  GVariant *agents;
+  GVariant *authorizations;
+  GVariantIter iter;
+  GVariant *scope_value;
+  GVariant *subject_value;
+  GVariant *options;
+  const gchar *unique_system_bus_name;
+  const gchar *object_path;
+  const gchar *locale;
+  const gchar *id;
+  const gchar *action_id;
+  guint32 version;
+  guint32 creator_uid;
+  guint64 serial;
+  gint64 time_granted;
+  gint64 time_expires;
+  gint64 now;
+  guint num_agents;
+  guint num_authorizations;
+
+  g_return_val_if_fail (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority), FALSE);
+  g_return_val_if_fail (state != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  priv = polkit_backend_interactive_authority_get_instance_private (authority);
+  store = priv->temporary_authorization_store;
+
+  if (!g_variant_is_of_type (state, G_VARIANT_TYPE ("(ua((ssutih)usssa{sv})ta((ssutih)(ssutih)ssxx))")))
+    {
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_FAILED,
+                   "Saved state has unexpected type `%s'",
+                   g_variant_get_type_string (state));
+      return FALSE;
+    }
+
+  g_variant_get (state, "(u@a((ssutih)usssa{sv})t@a((ssutih)(ssutih)ssxx))",
+                 &version, &agents, &serial, &authorizations);
+  if (version != STATE_VERSION)
+    {
+      g_set_error (error,
+                   POLKIT_ERROR,
+                   POLKIT_ERROR_FAILED,
+                   "Saved state has unsupported version %u",
+                   version);
+      g_variant_unref (agents);
+      g_variant_unref (authorizations);
+      return FALSE;
+    }
+
+  num_agents = 0;
+  g_variant_iter_init (&iter, agents);
+  while (g_variant_iter_next (&iter, "(@(ssutih)u&s&s&s@a{sv})",
+                              &scope_value, &creator_uid, &unique_system_bus_name,
+                              &object_path, &locale, &options))
+    {
+      AuthenticationAgent *agent;
+      PolkitSubject *scope;
+      PolkitBackendSubject scope_key;
+      PolkitSubject *bus_name;
+      PolkitIdentity *creator;
+
+      scope = restore_subject (scope_value, fds, num_fds);
+      bus_name = g_dbus_is_unique_name (unique_system_bus_name) ? polkit_system_bus_name_new (unique_system_bus_name) : NULL;
+      agent = NULL;
+      if (scope != NULL)
+        polkit_backend_subject_init (&scope_key, scope);
+
+      if (scope != NULL && bus_name != NULL &&
+          polkit_subject_exists_sync (bus_name, NULL, NULL) &&
+          !g_hash_table_contains (priv->hash_scope_to_authentication_agent, &scope_key))
+        {
+          creator = polkit_unix_user_new (creator_uid);
+          priv->agent_serial++;
+          agent = authentication_agent_new (priv->system_bus_connection,
+                                            priv->agent_serial,
+                                            scope,
+                                            creator,
+                                            unique_system_bus_name,
+                                            locale[0] != '\0' ? locale : NULL,
+                                            object_path,
+                                            options,
+                                            NULL);
+          g_object_unref (creator);
+        }
+
+      if (agent != NULL)
+        {
+          g_hash_table_insert (priv->hash_scope_to_authentication_agent,
+                               &agent->scope_key,
+                               agent);
+          num_agents++;
+        }
+
+      if (scope != NULL)
+        g_object_unref (scope);
+      if (bus_name != NULL)
+        g_object_unref (bus_name);
+      g_variant_unref (scope_value);
+      g_variant_unref (options);
+    }
+
+  store->serial = MAX (store->serial, serial);
+
+  now = g_get_monotonic_time ();
+  num_authorizations = 0;
+  g_variant_iter_init (&iter, authorizations);
+  while (g_variant_iter_next (&iter, "(@(ssutih)@(ssutih)&s&sxx)",
+                              &subject_value, &scope_value, &id, &action_id,
+                              &time_granted, &time_expires))
+    {
+      PolkitSubject *subject;
+      PolkitSubject *scope;
+
+      /* the monotonic clock is the same for every process on the system */
+      subject = NULL;
+      scope = NULL;
+      if (time_expires > now)
+        {
+          subject = restore_subject (subject_value, fds, num_fds);
+          scope = restore_subject (scope_value, fds, num_fds);
+        }
+
+      if (subject != NULL && scope != NULL &&
+          !temporary_authorization_store_has_authorization (store, subject, action_id, NULL))
+        {
+          temporary_authorization_store_insert (store, subject, scope, action_id, id,
+                                                time_granted, time_expires);
+          num_authorizations++;
+        }
+
+      if (subject != NULL)
+        g_object_unref (subject);
+      if (scope != NULL)
+        g_object_unref (scope);
+      g_variant_unref (subject_value);
+      g_variant_unref (scope_value);
+    }
+
+  g_variant_unref (agents);
+  g_variant_unref (authorizations);
+
+  polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                LOG_LEVEL_NOTICE,
+                                "Restored %u authentication agents and %u temporary authorizations",
+                                num_agents, num_authorizations);
+
+  if (num_agents > 0 || num_authorizations > 0)
+    g_signal_emit_by_name (authority, "changed");
+
+  return TRUE;
+}
@@ -27,6 +27,7 @@
 #define __POLKIT_BACKEND_INTERACTIVE_AUTHORITY_H
 
 #include <glib-object.h>
+#include <gio/gunixfdlist.h>
 #include <polkitbackend/polkitbackendtypes.h>
 #include <polkitbackend/polkitbackendauthority.h>
 
@@ -59,6 +60,17 @@ struct _PolkitBackendInteractiveAuthority
  *   implementation. See polkit_backend_interactive_authority_get_admin_identities() for details.
  * @check_authorization_sync: Checks for an authorization or %NULL to use the default implementation.
  *  See polkit_backend_interactive_authority_check_authorization_sync() for details.
+ * @has_authorization_rules: Sets @has_rules[n] to whether @check_authorization_sync
+ *  may currently return something other than the implicit authorization it is passed
+ *  for a check of the n-th of the %NULL-terminated @action_ids without details,
+ *  depending on the subject, or %NULL if that is the case whenever
+ *  @check_authorization_sync is set.
+ * @check_authorization_and_get_admin_identities_sync: Like @check_authorization_sync
+ *  but takes the #GCancellable of the check and, if asked to, also returns the identities
+ *  for administrator authentication when the result is an administrator challenge, or
+ *  %NULL to call @check_authorization_sync and @get_admin_identities separately. See
+ *  polkit_backend_interactive_authority_check_authorization_and_get_admin_identities_sync()
+ *  for details. Since: 127.
  *
  * Class structure for #PolkitBackendInteractiveAuthority.
  */
@@ -87,10 +99,24 @@ struct _PolkitBackendInteractiveAuthorityClass
                                                            PolkitDetails                     *details,
                                                            PolkitImplicitAuthorization        implicit);
 
+  void     (*has_authorization_rules) (PolkitBackendInteractiveAuthority *authority,
+                                       const gchar * const               *action_ids,
+                                       gboolean                          *has_rules);
+
+  PolkitImplicitAuthorization (*check_authorization_and_get_admin_identities_sync) (PolkitBackendInteractiveAuthority *authority,
+                                                                                     PolkitSubject                     *caller,
+                                                                                     PolkitSubject                     *subject,
+                                                                                     PolkitIdentity                    *user_for_subject,
+                                                                                     gboolean                           subject_is_local,
+                                                                                     gboolean                           subject_is_active,
+                                                                                     const gchar                       *action_id,
+                                                                                     PolkitDetails                     *details,
+                                                                                     PolkitImplicitAuthorization        implicit,
+                                                                                     GList                            **out_admin_identities,
+                                                                                     GCancellable                      *cancellable);
+
   /*< private >*/
   /* Padding for future expansion */
-  void (*_polkit_reserved1) (void);
-  void (*_polkit_reserved2) (void);
   void (*_polkit_reserved3) (void);
   void (*_polkit_reserved4) (void);
   void (*_polkit_reserved5) (void);
@@ -143,7 +169,33 @@ PolkitImplicitAuthorization polkit_backend_interactive_authority_check_authoriza
                                                           const gchar                       *action_id,
                                                           PolkitDetails                     *details,
                                                           PolkitImplicitAuthorization        implicit);
+PolkitImplicitAuthorization polkit_backend_interactive_authority_check_authorization_and_get_admin_identities_sync (
+                                                          PolkitBackendInteractiveAuthority *authority,
+                                                          PolkitSubject                     *caller,
+                                                          PolkitSubject                     *subject,
+                                                          PolkitIdentity                    *user_for_subject,
+                                                          gboolean                           subject_is_local,
+                                                          gboolean                           subject_is_active,
+                                                          const gchar                       *action_id,
+                                                          PolkitDetails                     *details,
+                                                          PolkitImplicitAuthorization        implicit,
+                                                          GList                            **out_admin_identities,
+                                                          GCancellable                      *cancellable);
 void polkit_backend_interactive_authority_reload (PolkitBackendInteractiveAuthority *authority);
+void polkit_backend_interactive_authority_set_cache_limits (PolkitBackendInteractiveAuthority *authority,
+                                                            guint                              max_temporary_authorizations,
+                                                            guint                              max_action_descriptions);
+void polkit_backend_interactive_authority_set_max_admin_identities (PolkitBackendInteractiveAuthority *authority,
+                                                                    guint                              max_admin_identities);
+void polkit_backend_interactive_authority_set_latency_sampling (PolkitBackendInteractiveAuthority *authority,
+                                                                guint                              sample_interval);
+GVariant *polkit_backend_interactive_authority_save_state (PolkitBackendInteractiveAuthority *authority,
+                                                           GUnixFDList                       *fd_list);
+gboolean polkit_backend_interactive_authority_restore_state (PolkitBackendInteractiveAuthority  *authority,
+                                                             GVariant                           *state,
+                                                             const gint                         *fds,
+                                                             guint                               num_fds,
+                                                             GError                            **error);
 
 G_END_DECLS
 
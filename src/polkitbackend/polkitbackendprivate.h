@@ -26,4 +26,161 @@
 #ifndef __POLKIT_BACKEND_PRIVATE_H
 #define __POLKIT_BACKEND_PRIVATE_H
 
+#include <string.h>
+#include <gio/gio.h>
+#include <polkit/polkit.h>
+#include <polkit/polkitimplicitsnapshot.h>
+#include "polkitbackendtypes.h"
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* A #PolkitSubject resolved into a plain struct once, so that hot paths
+ * can switch on the kind and hash or compare subjects without going
+ * through GType checks and #PolkitSubjectIface. Strings are borrowed
+ * from @object, which must outlive the struct.
+ */
+
+typedef enum
+{
+  POLKIT_BACKEND_SUBJECT_KIND_OTHER,
+  POLKIT_BACKEND_SUBJECT_KIND_UNIX_PROCESS,
+  POLKIT_BACKEND_SUBJECT_KIND_SYSTEM_BUS_NAME,
+  POLKIT_BACKEND_SUBJECT_KIND_UNIX_SESSION
+} PolkitBackendSubjectKind;
+
+typedef struct
+{
+  PolkitBackendSubjectKind kind;
+  guint hash;
+  PolkitSubject *object;
+  union
+  {
+    struct
+    {
+      gint pid;
+      gint pidfd;
+      guint64 start_time;
+      gint uid;
+    } process;
+    const gchar *system_bus_name;
+    const gchar *session_id;
+  } u;
+} PolkitBackendSubject;
+
+static inline void
+polkit_backend_subject_init (PolkitBackendSubject *subject,
+                             PolkitSubject        *object)
+{
+  memset (subject, 0, sizeof (PolkitBackendSubject));
+  subject->object = object;
+
+  if (POLKIT_IS_UNIX_PROCESS (object))
+    {
+      PolkitUnixProcess *process = POLKIT_UNIX_PROCESS (object);
+
+      subject->kind = POLKIT_BACKEND_SUBJECT_KIND_UNIX_PROCESS;
+      subject->u.process.pid = polkit_unix_process_get_pid (process);
+      subject->u.process.pidfd = polkit_unix_process_get_pidfd (process);
+      subject->u.process.start_time = polkit_unix_process_get_start_time (process);
+      subject->u.process.uid = polkit_unix_process_get_uid (process);
+      /* the same as polkit_subject_hash() while the process is alive */
+      subject->hash = g_direct_hash (GSIZE_TO_POINTER (subject->u.process.pid + subject->u.process.start_time));
+    }
+  else if (POLKIT_IS_SYSTEM_BUS_NAME (object))
+    {
+      subject->kind = POLKIT_BACKEND_SUBJECT_KIND_SYSTEM_BUS_NAME;
+      subject->u.system_bus_name = polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (object));
+      subject->hash = g_str_hash (subject->u.system_bus_name);
+    }
+  else if (POLKIT_IS_UNIX_SESSION (object))
+    {
+      subject->kind = POLKIT_BACKEND_SUBJECT_KIND_UNIX_SESSION;
+      subject->u.session_id = polkit_unix_session_get_session_id (POLKIT_UNIX_SESSION (object));
+      subject->hash = subject->u.session_id != NULL ? g_str_hash (subject->u.session_id) : 0;
+    }
+  else
+    {
+      subject->kind = POLKIT_BACKEND_SUBJECT_KIND_OTHER;
+      subject->hash = polkit_subject_hash (object);
+    }
+}
+
+static inline guint
+polkit_backend_subject_hash (const PolkitBackendSubject *subject)
+{
+  return subject->hash;
+}
+
+static inline gboolean
+polkit_backend_subject_equal (const PolkitBackendSubject *a,
+                              const PolkitBackendSubject *b)
+{
+  if (a->kind != b->kind || a->hash != b->hash)
+    return FALSE;
+
+  switch (a->kind)
+    {
+    case POLKIT_BACKEND_SUBJECT_KIND_UNIX_PROCESS:
+      /* polkit_subject_equal() relies on the pidfd to notice pid reuse,
+       * which costs a syscall; matching start times say the same
+       */
+      if (a->u.process.start_time == 0 || b->u.process.start_time == 0)
+        return polkit_subject_equal (a->object, b->object);
+      return a->u.process.pid > 0 &&
+             a->u.process.pid == b->u.process.pid &&
+             a->u.process.start_time == b->u.process.start_time;
+
+    case POLKIT_BACKEND_SUBJECT_KIND_SYSTEM_BUS_NAME:
+      return strcmp (a->u.system_bus_name, b->u.system_bus_name) == 0;
+
+    case POLKIT_BACKEND_SUBJECT_KIND_UNIX_SESSION:
+      return g_strcmp0 (a->u.session_id, b->u.session_id) == 0;
+
+    case POLKIT_BACKEND_SUBJECT_KIND_OTHER:
+    default:
+      return polkit_subject_equal (a->object, b->object);
+    }
+}
+
+/* For use as GHashFunc and GEqualFunc on PolkitBackendSubject pointers */
+static inline guint
+polkit_backend_subject_hash_func (gconstpointer subject)
+{
+  return polkit_backend_subject_hash (subject);
+}
+
+static inline gboolean
+polkit_backend_subject_equal_func (gconstpointer a,
+                                   gconstpointer b)
+{
+  return polkit_backend_subject_equal (a, b);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* The #PolkitUnixUser identities offered to an authentication agent,
+ * each uid at most once and in the order first added. Adding fails
+ * once @max_users (0 for no limit) users are in the set, after which
+ * the set is truncated.
+ */
+typedef struct _PolkitBackendUserSet PolkitBackendUserSet;
+
+PolkitBackendUserSet *_polkit_backend_user_set_new (guint max_users);
+void _polkit_backend_user_set_free (PolkitBackendUserSet *set);
+gboolean _polkit_backend_user_set_add (PolkitBackendUserSet *set,
+                                       PolkitIdentity       *user);
+gboolean _polkit_backend_user_set_is_truncated (PolkitBackendUserSet *set);
+GList *_polkit_backend_user_set_steal_users (PolkitBackendUserSet *set);
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* The memfd handed out by GetImplicitAuthorizations(), see
+ * polkitbackendauthority.c
+ */
+gint _polkit_backend_implicit_snapshot_new (GVariant                      *decisions,
+                                            guint32                        generation,
+                                            PolkitImplicitSnapshotHeader **out_header,
+                                            gsize                         *out_size,
+                                            GError                       **error);
+
 #endif /* __POLKIT_BACKEND_PRIVATE_H */
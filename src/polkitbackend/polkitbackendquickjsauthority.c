@@ -0,0 +1,1244 @@
+/*
+ * Copyright (C) 2008-2012 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: David Zeuthen <davidz@redhat.com>
+ */
+
+#include <stdlib.h>
+
+#include "polkitbackendcommon.h"
+#include "polkitbackendprivate.h"
+
+#include <quickjs/quickjs.h>
+
+/* Built source and not too big to worry about deduplication */
+#include "initjs.h" /* init.js */
+
+/**
+ * SECTION:polkitbackendjsauthority
+ * @title: PolkitBackendJsAuthority
+ * @short_description: JS Authority
+ * @stability: Unstable
+ *
+ * An (QuickJS-based) implementation of #PolkitBackendAuthority that reads and
+ * evaluates Javascript files and supports interaction with authentication
+ * agents (virtue of being based on #PolkitBackendInteractiveAuthority).
+ */
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+struct _PolkitBackendJsAuthorityPrivate
+{
+  gchar **rules_dirs;
+  GFileMonitor **dir_monitors; /* NULL-terminated array of GFileMonitor instances */
+
+  JSRuntime *rt;
+  JSContext *cx;
+
+  /* when the JS running now is terminated, see interrupt_handler() */
+  gint64 deadline;
+  gboolean timed_out;
+
+  /* of the check the JS running now is for, if any; a JSContext only
+   * runs one call at a time, see call_js_function_with_runaway_killer()
+   */
+  GCancellable *cancellable;
+
+  /* see polkit_backend_js_authority_add_statistics() */
+  guint64 num_rule_evaluations_cancelled;
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+G_DEFINE_TYPE_WITH_PRIVATE (PolkitBackendJsAuthority, polkit_backend_js_authority, POLKIT_BACKEND_TYPE_INTERACTIVE_AUTHORITY);
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static JSValue js_polkit_log (JSContext *cx, JSValueConst this_val, int argc, JSValueConst *argv);
+static JSValue js_polkit_spawn (JSContext *cx, JSValueConst this_val, int argc, JSValueConst *argv);
+static JSValue js_polkit_user_is_in_netgroup (JSContext *cx, JSValueConst this_val, int argc, JSValueConst *argv);
+static JSValue js_polkit_is_cancelled (JSContext *cx, JSValueConst this_val, int argc, JSValueConst *argv);
+
+static const JSCFunctionListEntry js_polkit_functions[] =
+{
+  JS_CFUNC_DEF ("log", 1, js_polkit_log),
+  JS_CFUNC_DEF ("spawn", 1, js_polkit_spawn),
+  JS_CFUNC_DEF ("_userIsInNetGroup", 2, js_polkit_user_is_in_netgroup),
+  JS_CFUNC_DEF ("_isCancelled", 0, js_polkit_is_cancelled),
+};
+
+static void
+polkit_backend_js_authority_init (PolkitBackendJsAuthority *authority)
+{
+  authority->priv = polkit_backend_js_authority_get_instance_private (authority);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Whether the check the rules are being run for has been cancelled,
+ * which may happen on another thread while they run.
+ */
+static gboolean
+rules_are_cancelled (PolkitBackendJsAuthority *authority)
+{
+  GCancellable *cancellable = authority->priv->cancellable;
+
+  return cancellable != NULL && g_cancellable_is_cancelled (cancellable);
+}
+
+/* QuickJS calls this every so often while running JS, so unlike with
+ * Duktape there is no need for a runaway killer thread: JS that runs
+ * for longer than RUNAWAY_KILLER_TIMEOUT, or whose check is cancelled,
+ * is terminated with an exception scripts can't catch.
+ */
+static int
+interrupt_handler (JSRuntime *rt,
+                   void      *opaque)
+{
+  PolkitBackendJsAuthority *authority = opaque;
+
+  if (authority->priv->deadline == 0)
+    return 0;
+
+  if (rules_are_cancelled (authority))
+    return 1;
+
+  if (g_get_monotonic_time () >= authority->priv->deadline)
+    {
+      authority->priv->timed_out = TRUE;
+      return 1;
+    }
+
+  return 0;
+}
+
+static void
+log_exception (PolkitBackendJsAuthority *authority,
+               const gchar              *what)
+{
+  JSContext *cx = authority->priv->cx;
+  JSValue exception;
+  const char *str;
+
+  exception = JS_GetException (cx);
+  if (authority->priv->timed_out)
+    {
+      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                    LOG_LEVEL_WARNING,
+                                    "Terminating runaway script after %d seconds",
+                                    RUNAWAY_KILLER_TIMEOUT);
+    }
+  else if (!rules_are_cancelled (authority))
+    {
+      /* polkit.spawn() throws once the check is cancelled, which is expected */
+      str = JS_ToCString (cx, exception);
+      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                    LOG_LEVEL_ERROR,
+                                    "%s: %s",
+                                    what,
+                                    str != NULL ? str : "no message");
+      JS_FreeCString (cx, str);
+    }
+  JS_FreeValue (cx, exception);
+}
+
+/* Blocking for at most RUNAWAY_KILLER_TIMEOUT */
+static gboolean
+execute_script_with_runaway_killer (PolkitBackendJsAuthority *authority,
+                                    const gchar              *filename)
+{
+  JSContext *cx = authority->priv->cx;
+  JSValue result;
+  gchar *contents;
+  gsize len;
+  gchar *what;
+
+  if (!g_file_get_contents (filename, &contents, &len, NULL))
+    {
+      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                    LOG_LEVEL_ERROR,
+                                    "Error loading script %s", filename);
+      return FALSE;
+    }
+
+  authority->priv->deadline = g_get_monotonic_time () + RUNAWAY_KILLER_TIMEOUT * G_USEC_PER_SEC;
+  authority->priv->timed_out = FALSE;
+  result = JS_Eval (cx, contents, len, filename, JS_EVAL_TYPE_GLOBAL);
+  authority->priv->deadline = 0;
+  g_free (contents);
+
+  if (JS_IsException (result))
+    {
+      what = g_strdup_printf ("Error compiling script %s", filename);
+      log_exception (authority, what);
+      g_free (what);
+      return FALSE;
+    }
+
+  JS_FreeValue (cx, result);
+  return TRUE;
+}
+
+/* Calls @func with @this_val and @argc @argv, blocking for at most
+ * RUNAWAY_KILLER_TIMEOUT, or until @cancellable is cancelled. Returns
+ * JS_EXCEPTION on failure, after logging it.
+ */
+static JSValue
+call_js_function_with_runaway_killer (PolkitBackendJsAuthority *authority,
+                                      JSValueConst              func,
+                                      JSValueConst              this_val,
+                                      int                       argc,
+                                      JSValueConst             *argv,
+                                      GCancellable             *cancellable)
+{
+  JSValue result;
+
+  authority->priv->cancellable = cancellable;
+  authority->priv->deadline = g_get_monotonic_time () + RUNAWAY_KILLER_TIMEOUT * G_USEC_PER_SEC;
+  authority->priv->timed_out = FALSE;
+  result = JS_Call (authority->priv->cx, func, this_val, argc, argv);
+  authority->priv->deadline = 0;
+
+  if (JS_IsException (result))
+    log_exception (authority, "Error evaluating rules");
+  authority->priv->cancellable = NULL;
+
+  return result;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+load_scripts (PolkitBackendJsAuthority  *authority)
+{
+  GList *files = NULL;
+  GList *l;
+  guint num_scripts = 0;
+  GError *error = NULL;
+  guint n;
+
+  files = NULL;
+
+  for (n = 0; authority->priv->rules_dirs != NULL && authority->priv->rules_dirs[n] != NULL; n++)
+    {
+      const gchar *dir_name = authority->priv->rules_dirs[n];
+      GDir *dir = NULL;
+
+      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                    LOG_LEVEL_NOTICE,
+                                    "Loading rules from directory %s",
+                                    dir_name);
+
+      dir = g_dir_open (dir_name,
+                        0,
+                        &error);
+      if (dir != NULL)
+        {
+          const gchar *name;
+          while ((name = g_dir_read_name (dir)) != NULL)
+            {
+              if (g_str_has_suffix (name, ".rules"))
+                files = g_list_prepend (files, g_strdup_printf ("%s/%s", dir_name, name));
+            }
+          g_dir_close (dir);
+        }
+      else
+        {
+          polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                        LOG_LEVEL_NOTICE,
+                                        "Error opening rules directory: %s (%s, %d)",
+                                        error->message, g_quark_to_string (error->domain), error->code);
+          g_clear_error (&error);
+        }
+    }
+
+  files = g_list_sort (files, (GCompareFunc) polkit_backend_common_rules_file_name_cmp);
+
+  for (l = files; l != NULL; l = l->next)
+    {
+      const gchar *filename = (gchar *)l->data;
+
+      if (!execute_script_with_runaway_killer (authority, filename))
+          continue;
+      num_scripts++;
+      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                      LOG_LEVEL_DEBUG,
+                                      "Loaded and executed script in file %s",
+                                      filename);
+    }
+
+  polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                LOG_LEVEL_NOTICE,
+                                "Finished loading, compiling and executing %d rules",
+                                num_scripts);
+  g_list_free_full (files, g_free);
+}
+
+/* Calls polkit.@name() without arguments, for its side effects */
+static gboolean
+call_polkit_method (PolkitBackendJsAuthority *authority,
+                    const gchar              *name)
+{
+  JSContext *cx = authority->priv->cx;
+  JSValue global;
+  JSValue polkit;
+  JSValue func;
+  JSValue result;
+  gboolean ret;
+
+  global = JS_GetGlobalObject (cx);
+  polkit = JS_GetPropertyStr (cx, global, "polkit");
+  func = JS_GetPropertyStr (cx, polkit, name);
+  result = JS_Call (cx, func, polkit, 0, NULL);
+  ret = !JS_IsException (result);
+  if (!ret)
+    JS_FreeValue (cx, JS_GetException (cx));
+  JS_FreeValue (cx, result);
+  JS_FreeValue (cx, func);
+  JS_FreeValue (cx, polkit);
+  JS_FreeValue (cx, global);
+
+  return ret;
+}
+
+void
+polkit_backend_common_reload_scripts (PolkitBackendJsAuthority *authority)
+{
+  if (!call_polkit_method (authority, "_deleteRules"))
+    {
+      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                    LOG_LEVEL_ERROR,
+                                    "Error deleting old rules, not loading new ones");
+      return;
+    }
+
+  polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                LOG_LEVEL_NOTICE,
+                                "Collecting garbage unconditionally...");
+  JS_RunGC (authority->priv->rt);
+
+  load_scripts (authority);
+
+  /* Let applications know we have new rules... */
+  g_signal_emit_by_name (authority, "changed");
+}
+
+static void
+setup_file_monitors (PolkitBackendJsAuthority *authority)
+{
+  guint n;
+  GPtrArray *p;
+
+  p = g_ptr_array_new ();
+  for (n = 0; authority->priv->rules_dirs != NULL && authority->priv->rules_dirs[n] != NULL; n++)
+    {
+      GFile *file;
+      GError *error;
+      GFileMonitor *monitor;
+
+      file = g_file_new_for_path (authority->priv->rules_dirs[n]);
+      error = NULL;
+      monitor = g_file_monitor_directory (file,
+                                          G_FILE_MONITOR_NONE,
+                                          NULL,
+                                          &error);
+      g_object_unref (file);
+      if (monitor == NULL)
+        {
+          g_warning ("Error monitoring directory %s: %s",
+                     authority->priv->rules_dirs[n],
+                     error->message);
+          g_clear_error (&error);
+        }
+      else
+        {
+          g_signal_connect (monitor,
+                            "changed",
+                            G_CALLBACK (polkit_backend_common_on_dir_monitor_changed),
+                            authority);
+          g_ptr_array_add (p, monitor);
+        }
+    }
+  g_ptr_array_add (p, NULL);
+  authority->priv->dir_monitors = (GFileMonitor**) g_ptr_array_free (p, FALSE);
+}
+
+void
+polkit_backend_common_js_authority_constructed (GObject *object)
+{
+  PolkitBackendJsAuthority *authority = POLKIT_BACKEND_JS_AUTHORITY (object);
+  JSValue global;
+  JSValue polkit;
+  JSValue result;
+
+  authority->priv->rt = JS_NewRuntime ();
+  if (authority->priv->rt == NULL)
+    goto fail;
+  JS_SetInterruptHandler (authority->priv->rt, interrupt_handler, authority);
+
+  authority->priv->cx = JS_NewContext (authority->priv->rt);
+  if (authority->priv->cx == NULL)
+    goto fail;
+  JS_SetContextOpaque (authority->priv->cx, authority);
+
+  global = JS_GetGlobalObject (authority->priv->cx);
+  polkit = JS_NewObject (authority->priv->cx);
+  JS_SetPropertyFunctionList (authority->priv->cx, polkit, js_polkit_functions, G_N_ELEMENTS (js_polkit_functions));
+  JS_SetPropertyStr (authority->priv->cx, global, "polkit", polkit);
+  JS_FreeValue (authority->priv->cx, global);
+
+  /* load polkit objects/functions into JS context (e.g. addRule(),
+   * _deleteRules(), _runRules() et al)
+   */
+  result = JS_Eval (authority->priv->cx, init_js, strlen (init_js), "init.js", JS_EVAL_TYPE_GLOBAL);
+  if (JS_IsException (result))
+    goto fail;
+  JS_FreeValue (authority->priv->cx, result);
+
+  if (authority->priv->rules_dirs == NULL)
+    {
+      authority->priv->rules_dirs = g_new0 (gchar *, 5);
+      authority->priv->rules_dirs[0] = g_strdup (PACKAGE_SYSCONF_DIR "/polkit-1/rules.d");
+      authority->priv->rules_dirs[1] = g_strdup ("/run/polkit-1/rules.d");
+      authority->priv->rules_dirs[2] = g_strdup ("/usr/local/share/polkit-1/rules.d");
+      authority->priv->rules_dirs[3] = g_strdup (PACKAGE_DATA_DIR "/polkit-1/rules.d");
+    }
+
+  setup_file_monitors (authority);
+  load_scripts (authority);
+
+  G_OBJECT_CLASS (polkit_backend_js_authority_parent_class)->constructed (object);
+  return;
+
+ fail:
+  g_critical ("Error initializing JavaScript environment");
+  g_assert_not_reached ();
+}
+
+void
+polkit_backend_common_js_authority_finalize (GObject *object)
+{
+  PolkitBackendJsAuthority *authority = POLKIT_BACKEND_JS_AUTHORITY (object);
+  guint n;
+
+  for (n = 0; authority->priv->dir_monitors != NULL && authority->priv->dir_monitors[n] != NULL; n++)
+    {
+      GFileMonitor *monitor = authority->priv->dir_monitors[n];
+      g_signal_handlers_disconnect_by_func (monitor,
+                                            G_CALLBACK (polkit_backend_common_on_dir_monitor_changed),
+                                            authority);
+      g_object_unref (monitor);
+    }
+  g_free (authority->priv->dir_monitors);
+  g_strfreev (authority->priv->rules_dirs);
+
+  JS_FreeContext (authority->priv->cx);
+  JS_FreeRuntime (authority->priv->rt);
+
+  G_OBJECT_CLASS (polkit_backend_js_authority_parent_class)->finalize (object);
+}
+
+void
+polkit_backend_common_js_authority_set_property (GObject      *object,
+                                                 guint         property_id,
+                                                 const GValue *value,
+                                                 GParamSpec   *pspec)
+{
+  PolkitBackendJsAuthority *authority = POLKIT_BACKEND_JS_AUTHORITY (object);
+
+  switch (property_id)
+    {
+      case PROP_RULES_DIRS:
+        g_assert (authority->priv->rules_dirs == NULL);
+        authority->priv->rules_dirs = (gchar **) g_value_dup_boxed (value);
+        break;
+
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+polkit_backend_js_authority_add_memory_usage (PolkitBackendAuthority *authority,
+                                              GVariantBuilder        *builder)
+{
+  PolkitBackendJsAuthority *js_authority = POLKIT_BACKEND_JS_AUTHORITY (authority);
+  JSMemoryUsage usage;
+
+  POLKIT_BACKEND_AUTHORITY_CLASS (polkit_backend_js_authority_parent_class)->add_memory_usage (authority, builder);
+
+  JS_ComputeMemoryUsage (js_authority->priv->rt, &usage);
+  g_variant_builder_add (builder, "{s(tt)}",
+                         "quickjs-heap",
+                         (guint64) 1,
+                         (guint64) usage.malloc_size);
+}
+
+/* Returns the number in polkit.@name */
+static guint64
+get_polkit_counter (PolkitBackendJsAuthority *authority,
+                    const gchar              *name)
+{
+  JSContext *cx = authority->priv->cx;
+  JSValue global;
+  JSValue polkit;
+  JSValue value;
+  double number = 0;
+
+  global = JS_GetGlobalObject (cx);
+  polkit = JS_GetPropertyStr (cx, global, "polkit");
+  value = JS_GetPropertyStr (cx, polkit, name);
+  if (!JS_IsNumber (value) || JS_ToFloat64 (cx, &number, value) != 0)
+    number = 0;
+  JS_FreeValue (cx, value);
+  JS_FreeValue (cx, polkit);
+  JS_FreeValue (cx, global);
+
+  return (guint64) number;
+}
+
+static void
+polkit_backend_js_authority_add_statistics (PolkitBackendAuthority *authority,
+                                            GVariantBuilder        *builder)
+{
+  PolkitBackendJsAuthority *js_authority = POLKIT_BACKEND_JS_AUTHORITY (authority);
+
+  POLKIT_BACKEND_AUTHORITY_CLASS (polkit_backend_js_authority_parent_class)->add_statistics (authority, builder);
+
+  /* runs of the rules whose check was cancelled while they ran, see interrupt_handler() */
+  g_variant_builder_add (builder, "{st}",
+                         "rule-evaluations-cancelled",
+                         js_authority->priv->num_rule_evaluations_cancelled);
+
+  /* see polkit._runRules() in init.js */
+  g_variant_builder_add (builder, "{st}", "rule-cache-hits", get_polkit_counter (js_authority, "_cacheHits"));
+  g_variant_builder_add (builder, "{st}", "rule-cache-misses", get_polkit_counter (js_authority, "_cacheMisses"));
+}
+
+static JSValue call_polkit_function (PolkitBackendJsAuthority *authority,
+                                     const gchar              *name,
+                                     int                       argc,
+                                     JSValueConst             *args,
+                                     GCancellable             *cancellable);
+
+/* See polkit._rulesIgnoreSubject() in init.js; leaves @has_rules
+ * alone if the rules fail */
+static void
+polkit_backend_js_authority_has_authorization_rules (PolkitBackendInteractiveAuthority *_authority,
+                                                     const gchar * const               *action_ids,
+                                                     gboolean                          *has_rules)
+{
+  PolkitBackendJsAuthority *authority = POLKIT_BACKEND_JS_AUTHORITY (_authority);
+  JSContext *cx = authority->priv->cx;
+  JSValue arg;
+  JSValue result;
+  guint n;
+
+  arg = JS_NewArray (cx);
+  for (n = 0; action_ids[n] != NULL; n++)
+    JS_SetPropertyUint32 (cx, arg, n, JS_NewString (cx, action_ids[n]));
+
+  result = call_polkit_function (authority, "_rulesIgnoreSubject", 1, &arg, NULL);
+  if (!JS_IsException (result))
+    {
+      for (n = 0; action_ids[n] != NULL; n++)
+        {
+          JSValue value = JS_GetPropertyUint32 (cx, result, n);
+          has_rules[n] = JS_ToBool (cx, value) != 1;
+          JS_FreeValue (cx, value);
+        }
+    }
+  JS_FreeValue (cx, result);
+  JS_FreeValue (cx, arg);
+}
+
+static void
+polkit_backend_js_authority_class_init (PolkitBackendJsAuthorityClass *klass)
+{
+  PolkitBackendAuthorityClass *authority_class;
+  PolkitBackendInteractiveAuthorityClass *interactive_authority_class;
+
+  polkit_backend_common_js_authority_class_init_common (klass);
+
+  authority_class = POLKIT_BACKEND_AUTHORITY_CLASS (klass);
+  authority_class->add_memory_usage = polkit_backend_js_authority_add_memory_usage;
+  authority_class->add_statistics = polkit_backend_js_authority_add_statistics;
+
+  interactive_authority_class = POLKIT_BACKEND_INTERACTIVE_AUTHORITY_CLASS (klass);
+  interactive_authority_class->has_authorization_rules = polkit_backend_js_authority_has_authorization_rules;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Like duk_push_string(), a %NULL @value becomes null */
+static void
+set_property_str (JSContext    *cx,
+                  JSValueConst  obj,
+                  const gchar  *name,
+                  const gchar  *value)
+{
+  JS_SetPropertyStr (cx, obj, name, value != NULL ? JS_NewString (cx, value) : JS_NULL);
+}
+
+static void
+set_property_strv (JSContext    *cx,
+                   JSValueConst  obj,
+                   const gchar  *name,
+                   GPtrArray    *value)
+{
+  JSValue array;
+  guint n;
+
+  array = JS_NewArray (cx);
+  for (n = 0; n < value->len; n++)
+    JS_SetPropertyUint32 (cx, array, n, JS_NewString (cx, g_ptr_array_index (value, n)));
+  JS_SetPropertyStr (cx, obj, name, array);
+}
+
+static void
+set_property_int32 (JSContext    *cx,
+                    JSValueConst  obj,
+                    const gchar  *name,
+                    gint32        value)
+{
+  JS_SetPropertyStr (cx, obj, name, JS_NewInt32 (cx, value));
+}
+
+static void
+set_property_bool (JSContext    *cx,
+                   JSValueConst  obj,
+                   const char   *name,
+                   gboolean      value)
+{
+  JS_SetPropertyStr (cx, obj, name, JS_NewBool (cx, value));
+}
+
+/* Returns a new object made by the global constructor @name from init.js */
+static JSValue
+new_init_js_object (JSContext   *cx,
+                    const gchar *name)
+{
+  JSValue global;
+  JSValue constructor;
+  JSValue ret;
+
+  global = JS_GetGlobalObject (cx);
+  constructor = JS_GetPropertyStr (cx, global, name);
+  ret = JS_CallConstructor (cx, constructor, 0, NULL);
+  JS_FreeValue (cx, constructor);
+  JS_FreeValue (cx, global);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static JSValue
+new_subject (JSContext      *cx,
+             PolkitSubject  *subject,
+             PolkitIdentity *user_for_subject,
+             gboolean        subject_is_local,
+             gboolean        subject_is_active,
+             GError        **error)
+{
+  JsSubjectInfo info;
+  JSValue obj;
+
+  if (!polkit_backend_common_js_subject_info_init (&info, subject, user_for_subject, error))
+    return JS_EXCEPTION;
+
+  obj = new_init_js_object (cx, "Subject");
+  if (JS_IsException (obj))
+    {
+      JS_FreeValue (cx, JS_GetException (cx));
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED, "Error creating Subject object");
+      goto out;
+    }
+
+  set_property_int32 (cx, obj, "pid", info.pid);
+  set_property_str (cx, obj, "user", info.user);
+  set_property_strv (cx, obj, "groups", info.groups);
+  set_property_str (cx, obj, "seat", info.seat);
+  set_property_str (cx, obj, "session", info.session);
+  set_property_str (cx, obj, "system_unit", info.system_unit);
+  /* If we have a unit, also record if it has the NoNewPrivileges setting enabled */
+  if (info.system_unit)
+    set_property_bool (cx, obj, "no_new_privileges", info.no_new_privileges);
+  set_property_bool (cx, obj, "local", subject_is_local);
+  set_property_bool (cx, obj, "active", subject_is_active);
+
+ out:
+  polkit_backend_common_js_subject_info_clear (&info);
+  return obj;
+}
+
+static JSValue
+new_action_and_details (JSContext      *cx,
+                        const gchar    *action_id,
+                        PolkitDetails  *details,
+                        GError        **error)
+{
+  PolkitDetailsIter iter;
+  const gchar *key;
+  const gchar *value;
+  JSValue obj;
+
+  obj = new_init_js_object (cx, "Action");
+  if (JS_IsException (obj))
+    {
+      JS_FreeValue (cx, JS_GetException (cx));
+      g_set_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED, "Error creating Action object");
+      return obj;
+    }
+
+  set_property_str (cx, obj, "id", action_id);
+
+  polkit_details_iter_init (&iter, details);
+  while (polkit_details_iter_next (&iter, &key, &value))
+    {
+      gchar *name;
+
+      name = g_strdup_printf ("_detail_%s", key);
+      set_property_str (cx, obj, name, value);
+      g_free (name);
+    }
+
+  return obj;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Makes the Action and Subject objects every rule function takes, in
+ * @args[0] and @args[1]
+ */
+static gboolean
+new_rules_arguments (PolkitBackendJsAuthority *authority,
+                     PolkitSubject            *subject,
+                     PolkitIdentity           *user_for_subject,
+                     gboolean                  subject_is_local,
+                     gboolean                  subject_is_active,
+                     const gchar              *action_id,
+                     PolkitDetails            *details,
+                     JSValue                  *args)
+{
+  JSContext *cx = authority->priv->cx;
+  GError *error = NULL;
+
+  args[0] = new_action_and_details (cx, action_id, details, &error);
+  if (JS_IsException (args[0]))
+    {
+      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                    LOG_LEVEL_ERROR,
+                                    "Error converting action and details to JS object: %s",
+                                    error->message);
+      g_clear_error (&error);
+      return FALSE;
+    }
+
+  args[1] = new_subject (cx, subject, user_for_subject, subject_is_local, subject_is_active, &error);
+  if (JS_IsException (args[1]))
+    {
+      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                    LOG_LEVEL_ERROR,
+                                    "Error converting subject to JS object: %s",
+                                    error->message);
+      g_clear_error (&error);
+      JS_FreeValue (cx, args[0]);
+      args[0] = JS_UNDEFINED;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Calls polkit.@name() with the @argc @args, for the check
+ * @cancellable belongs to if not %NULL
+ */
+static JSValue
+call_polkit_function (PolkitBackendJsAuthority *authority,
+                      const gchar              *name,
+                      int                       argc,
+                      JSValueConst             *args,
+                      GCancellable             *cancellable)
+{
+  JSContext *cx = authority->priv->cx;
+  JSValue global;
+  JSValue polkit;
+  JSValue func;
+  JSValue ret;
+
+  global = JS_GetGlobalObject (cx);
+  polkit = JS_GetPropertyStr (cx, global, "polkit");
+  func = JS_GetPropertyStr (cx, polkit, name);
+  ret = call_js_function_with_runaway_killer (authority, func, polkit, argc, args, cancellable);
+  JS_FreeValue (cx, func);
+  JS_FreeValue (cx, polkit);
+  JS_FreeValue (cx, global);
+
+  return ret;
+}
+
+/* Parses the comma-separated identities _runAdminRules() returns */
+static GList *
+admin_identities_from_value (PolkitBackendJsAuthority *authority,
+                             JSValueConst              value)
+{
+  JSContext *cx = authority->priv->cx;
+  GList *ret = NULL;
+  const char *ret_str;
+  gchar **ret_strs;
+  GError *error = NULL;
+  guint n;
+
+  if (!JS_IsString (value))
+    return NULL;
+
+  ret_str = JS_ToCString (cx, value);
+  if (ret_str == NULL)
+    return NULL;
+  ret_strs = g_strsplit (ret_str, ",", -1);
+  JS_FreeCString (cx, ret_str);
+
+  for (n = 0; ret_strs != NULL && ret_strs[n] != NULL; n++)
+    {
+      const gchar *identity_str = ret_strs[n];
+      PolkitIdentity *identity;
+
+      error = NULL;
+      identity = polkit_identity_from_string (identity_str, &error);
+      if (identity == NULL)
+        {
+          polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                        LOG_LEVEL_WARNING,
+                                        "Identity `%s' is not valid, ignoring: %s",
+                                        identity_str, error->message);
+          g_clear_error (&error);
+        }
+      else
+        {
+          ret = g_list_prepend (ret, identity);
+        }
+    }
+  g_strfreev (ret_strs);
+
+  return g_list_reverse (ret);
+}
+
+/* Parses the value _runRules() returned into @inout_implicit; it is
+ * left alone if no rule handled the action.
+ */
+static gboolean
+rules_result_to_implicit_authorization (PolkitBackendJsAuthority    *authority,
+                                        JSValueConst                 value,
+                                        PolkitImplicitAuthorization *inout_implicit)
+{
+  JSContext *cx = authority->priv->cx;
+  const char *ret_str;
+  gboolean ret;
+
+  /* this is fine, means there was no match, use implicit authorizations */
+  if (JS_IsNull (value))
+    return TRUE;
+
+  ret_str = JS_IsString (value) ? JS_ToCString (cx, value) : NULL;
+  ret = ret_str != NULL && polkit_implicit_authorization_from_string (ret_str, inout_implicit);
+  if (!ret)
+    {
+      polkit_backend_authority_log (POLKIT_BACKEND_AUTHORITY (authority),
+                                    LOG_LEVEL_WARNING,
+                                    "Returned result `%s' is not valid",
+                                    ret_str != NULL ? ret_str : "(not a string)");
+    }
+  JS_FreeCString (cx, ret_str);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+GList *
+polkit_backend_common_js_authority_get_admin_auth_identities (PolkitBackendInteractiveAuthority *_authority,
+                                                              PolkitSubject                     *caller,
+                                                              PolkitSubject                     *subject,
+                                                              PolkitIdentity                    *user_for_subject,
+                                                              gboolean                           subject_is_local,
+                                                              gboolean                           subject_is_active,
+                                                              const gchar                       *action_id,
+                                                              PolkitDetails                     *details)
+{
+  PolkitBackendJsAuthority *authority = POLKIT_BACKEND_JS_AUTHORITY (_authority);
+  JSContext *cx = authority->priv->cx;
+  GList *ret = NULL;
+  JSValue args[2] = { JS_UNDEFINED, JS_UNDEFINED };
+  JSValue result = JS_UNDEFINED;
+
+  if (!new_rules_arguments (authority, subject, user_for_subject, subject_is_local, subject_is_active,
+                            action_id, details, args))
+    goto out;
+
+  result = call_polkit_function (authority, "_runAdminRules", 2, args, NULL);
+  if (JS_IsException (result))
+    goto out;
+
+  ret = admin_identities_from_value (authority, result);
+
+ out:
+  JS_FreeValue (cx, result);
+  JS_FreeValue (cx, args[0]);
+  JS_FreeValue (cx, args[1]);
+
+  /* fallback to root password auth */
+  if (ret == NULL)
+    ret = g_list_prepend (ret, polkit_unix_user_new (0));
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Runs the authorization rules and, if @out_admin_identities is not
+ * %NULL and the result is an admin challenge, the admin rules in a
+ * single call of polkit._runRulesAndAdminRules(), which returns both
+ * results. If the admin rules throw, the result of the authorization
+ * rules stands and root is the one to authenticate, as with
+ * polkit_backend_common_js_authority_get_admin_auth_identities().
+ */
+static PolkitImplicitAuthorization
+check_authorization (PolkitBackendJsAuthority    *authority,
+                     PolkitSubject               *subject,
+                     PolkitIdentity              *user_for_subject,
+                     gboolean                     subject_is_local,
+                     gboolean                     subject_is_active,
+                     const gchar                 *action_id,
+                     PolkitDetails               *details,
+                     PolkitImplicitAuthorization  implicit,
+                     GList                      **out_admin_identities,
+                     GCancellable                *cancellable)
+{
+  JSContext *cx = authority->priv->cx;
+  PolkitImplicitAuthorization ret = implicit;
+  gboolean good = FALSE;
+  JSValue args[3] = { JS_UNDEFINED, JS_UNDEFINED, JS_UNDEFINED };
+  JSValue result = JS_UNDEFINED;
+  JSValue rules_result = JS_UNDEFINED;
+  JSValue admin_result = JS_UNDEFINED;
+
+  if (!new_rules_arguments (authority, subject, user_for_subject, subject_is_local, subject_is_active,
+                            action_id, details, args))
+    goto out;
+
+  /* If the rules threw, ran away or were cancelled, unauthorize */
+  if (out_admin_identities == NULL)
+    {
+      result = call_polkit_function (authority, "_runRules", 2, args, cancellable);
+      if (JS_IsException (result))
+        goto out;
+
+      good = rules_result_to_implicit_authorization (authority, result, &ret);
+      goto out;
+    }
+
+  args[2] = JS_NewString (cx, polkit_implicit_authorization_to_string (implicit));
+  result = call_polkit_function (authority, "_runRulesAndAdminRules", 3, args, cancellable);
+  if (JS_IsException (result))
+    goto out;
+
+  rules_result = JS_GetPropertyUint32 (cx, result, 0);
+  good = rules_result_to_implicit_authorization (authority, rules_result, &ret);
+  if (!good)
+    goto out;
+
+  if (ret != POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED &&
+      ret != POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED)
+    goto out;
+
+  admin_result = JS_GetPropertyUint32 (cx, result, 1);
+  *out_admin_identities = admin_identities_from_value (authority, admin_result);
+
+  /* fallback to root password auth */
+  if (*out_admin_identities == NULL)
+    *out_admin_identities = g_list_prepend (NULL, polkit_unix_user_new (0));
+
+ out:
+  JS_FreeValue (cx, admin_result);
+  JS_FreeValue (cx, rules_result);
+  JS_FreeValue (cx, result);
+  JS_FreeValue (cx, args[0]);
+  JS_FreeValue (cx, args[1]);
+  JS_FreeValue (cx, args[2]);
+
+  /* the caller throws the result away, and a rule may have caught
+   * the error it was stopped with
+   */
+  if (cancellable != NULL && g_cancellable_is_cancelled (cancellable))
+    {
+      authority->priv->num_rule_evaluations_cancelled++;
+      good = FALSE;
+    }
+
+  if (!good)
+    ret = POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED;
+
+  return ret;
+}
+
+PolkitImplicitAuthorization
+polkit_backend_common_js_authority_check_authorization_sync (PolkitBackendInteractiveAuthority *_authority,
+                                                             PolkitSubject                     *caller,
+                                                             PolkitSubject                     *subject,
+                                                             PolkitIdentity                    *user_for_subject,
+                                                             gboolean                           subject_is_local,
+                                                             gboolean                           subject_is_active,
+                                                             const gchar                       *action_id,
+                                                             PolkitDetails                     *details,
+                                                             PolkitImplicitAuthorization        implicit)
+{
+  return check_authorization (POLKIT_BACKEND_JS_AUTHORITY (_authority),
+                              subject, user_for_subject, subject_is_local, subject_is_active,
+                              action_id, details, implicit,
+                              NULL, NULL);
+}
+
+PolkitImplicitAuthorization
+polkit_backend_common_js_authority_check_authorization_and_get_admin_identities_sync (PolkitBackendInteractiveAuthority *_authority,
+                                                                                      PolkitSubject                     *caller,
+                                                                                      PolkitSubject                     *subject,
+                                                                                      PolkitIdentity                    *user_for_subject,
+                                                                                      gboolean                           subject_is_local,
+                                                                                      gboolean                           subject_is_active,
+                                                                                      const gchar                       *action_id,
+                                                                                      PolkitDetails                     *details,
+                                                                                      PolkitImplicitAuthorization        implicit,
+                                                                                      GList                            **out_admin_identities,
+                                                                                      GCancellable                      *cancellable)
+{
+  return check_authorization (POLKIT_BACKEND_JS_AUTHORITY (_authority),
+                              subject, user_for_subject, subject_is_local, subject_is_active,
+                              action_id, details, implicit,
+                              out_admin_identities, cancellable);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static JSValue
+js_polkit_log (JSContext    *cx,
+               JSValueConst  this_val,
+               int           argc,
+               JSValueConst *argv)
+{
+  const char *str;
+
+  str = JS_ToCString (cx, argv[0]);
+  if (str == NULL)
+    return JS_EXCEPTION;
+  fprintf (stderr, "%s\n", str);
+  JS_FreeCString (cx, str);
+  return JS_UNDEFINED;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Throws an Error, like duk_push_error_object() does */
+static JSValue
+throw_error (JSContext   *cx,
+             const gchar *message)
+{
+  JSValue error;
+
+  error = JS_NewError (cx);
+  JS_SetPropertyStr (cx, error, "message", JS_NewString (cx, message));
+  return JS_Throw (cx, error);
+}
+
+static JSValue
+js_polkit_spawn (JSContext    *cx,
+                 JSValueConst  this_val,
+                 int           argc,
+                 JSValueConst *js_argv)
+{
+  PolkitBackendJsAuthority *authority;
+  JSValue ret = JS_EXCEPTION;
+  JSValue length;
+  gchar *standard_output = NULL;
+  gchar *standard_error = NULL;
+  gint exit_status;
+  GError *error = NULL;
+  guint32 array_len;
+  gchar **argv = NULL;
+  GMainContext *context = NULL;
+  GMainLoop *loop = NULL;
+  SpawnData data = {0};
+  char *err_str = NULL;
+  guint n;
+
+  authority = POLKIT_BACKEND_JS_AUTHORITY (JS_GetContextOpaque (cx));
+
+  if (JS_IsArray (cx, js_argv[0]) <= 0)
+    {
+      err_str = g_strdup ("Expected an array");
+      goto out;
+    }
+
+  length = JS_GetPropertyStr (cx, js_argv[0], "length");
+  if (JS_ToUint32 (cx, &array_len, length) != 0)
+    {
+      JS_FreeValue (cx, length);
+      goto out;
+    }
+  JS_FreeValue (cx, length);
+
+  argv = g_new0 (gchar*, array_len + 1);
+  for (n = 0; n < array_len; n++)
+    {
+      JSValue elem;
+      const char *str;
+
+      elem = JS_GetPropertyUint32 (cx, js_argv[0], n);
+      str = JS_ToCString (cx, elem);
+      JS_FreeValue (cx, elem);
+      if (str == NULL)
+        goto out;
+      argv[n] = g_strdup (str);
+      JS_FreeCString (cx, str);
+    }
+
+  context = g_main_context_new ();
+  loop = g_main_loop_new (context, FALSE);
+
+  g_main_context_push_thread_default (context);
+
+  data.loop = loop;
+  polkit_backend_common_spawn ((const gchar *const *) argv,
+                               10, /* timeout_seconds */
+                               /* the helper is killed if the check is cancelled */
+                               authority->priv->cancellable,
+                               polkit_backend_common_spawn_cb,
+                               &data);
+
+  g_main_loop_run (loop);
+
+  g_main_context_pop_thread_default (context);
+
+  if (!polkit_backend_common_spawn_finish (data.res,
+                                           &exit_status,
+                                           &standard_output,
+                                           &standard_error,
+                                           &error))
+    {
+      err_str = g_strdup_printf ("Error spawning helper: %s (%s, %d)",
+                                 error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  if (!(WIFEXITED (exit_status) && WEXITSTATUS (exit_status) == 0))
+    {
+      GString *gstr;
+      gstr = g_string_new (NULL);
+      if (WIFEXITED (exit_status))
+        {
+          g_string_append_printf (gstr,
+                                  "Helper exited with non-zero exit status %d",
+                                  WEXITSTATUS (exit_status));
+        }
+      else if (WIFSIGNALED (exit_status))
+        {
+          g_string_append_printf (gstr,
+                                  "Helper was signaled with signal %s (%d)",
+                                  polkit_backend_common_get_signal_name (WTERMSIG (exit_status)),
+                                  WTERMSIG (exit_status));
+        }
+      g_string_append_printf (gstr, ", stdout=`%s', stderr=`%s'",
+                              standard_output, standard_error);
+      err_str = g_string_free (gstr, FALSE);
+      goto out;
+    }
+
+  ret = JS_NewString (cx, standard_output);
+
+ out:
+  g_strfreev (argv);
+  g_free (standard_output);
+  g_free (standard_error);
+  g_clear_object (&data.res);
+  if (loop != NULL)
+    g_main_loop_unref (loop);
+  if (context != NULL)
+    g_main_context_unref (context);
+
+  if (err_str)
+    {
+      ret = throw_error (cx, err_str);
+      g_free (err_str);
+    }
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+
+static JSValue
+js_polkit_user_is_in_netgroup (JSContext    *cx,
+                               JSValueConst  this_val,
+                               int           argc,
+                               JSValueConst *argv)
+{
+  const char *user;
+  const char *netgroup;
+  gboolean is_in_netgroup = FALSE;
+
+  user = JS_ToCString (cx, argv[0]);
+  netgroup = JS_ToCString (cx, argv[1]);
+  if (user == NULL || netgroup == NULL)
+    {
+      JS_FreeCString (cx, user);
+      JS_FreeCString (cx, netgroup);
+      return JS_EXCEPTION;
+    }
+#ifdef HAVE_SETNETGRENT
+  if (innetgr (netgroup,
+               NULL,  /* host */
+               user,
+               NULL)) /* domain */
+    {
+      is_in_netgroup = TRUE;
+    }
+#endif
+  JS_FreeCString (cx, user);
+  JS_FreeCString (cx, netgroup);
+  return JS_NewBool (cx, is_in_netgroup);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Checked by polkit._runRules() and polkit._runAdminRules() between
+ * rules. interrupt_handler() also stops a cancelled check in the
+ * middle of a rule, this just saves starting the next one.
+ */
+static JSValue
+js_polkit_is_cancelled (JSContext    *cx,
+                        JSValueConst  this_val,
+                        int           argc,
+                        JSValueConst *argv)
+{
+  return JS_NewBool (cx, rules_are_cancelled (POLKIT_BACKEND_JS_AUTHORITY (JS_GetContextOpaque (cx))));
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
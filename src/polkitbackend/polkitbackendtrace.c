@@ -0,0 +1,175 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "polkitbackendtrace.h"
+
+/* Bucket n counts latencies below 2^n microseconds, the last one
+ * everything else (from about 8 seconds)
+ */
+#define NUM_BUCKETS 24
+
+static const gchar *stage_names[POLKIT_BACKEND_NUM_STAGES] =
+{
+  "subject-resolution",
+  "session-lookup",
+  "rules",
+  "temporary-authorization-lookup",
+  "challenge",
+};
+
+typedef struct
+{
+  /* only incremented by the owning thread */
+  volatile gint buckets[POLKIT_BACKEND_NUM_STAGES][NUM_BUCKETS];
+  /* stages to let pass before sampling the next one */
+  guint countdown;
+} Shard;
+
+guint _polkit_backend_trace_sample_interval = 0;
+
+/* Protects shards and retired */
+G_LOCK_DEFINE_STATIC (shards);
+/* of Shard*, one for each thread that sampled a stage */
+static GSList *shards = NULL;
+/* what threads that have since exited sampled */
+static Shard retired;
+
+static void
+shard_free (gpointer data)
+{
+  Shard *shard = data;
+  guint n, m;
+
+  G_LOCK (shards);
+  shards = g_slist_remove (shards, shard);
+  for (n = 0; n < POLKIT_BACKEND_NUM_STAGES; n++)
+    for (m = 0; m < NUM_BUCKETS; m++)
+      retired.buckets[n][m] += g_atomic_int_get (&shard->buckets[n][m]);
+  G_UNLOCK (shards);
+
+  g_free (shard);
+}
+
+static GPrivate thread_shard = G_PRIVATE_INIT (shard_free);
+
+static Shard *
+get_thread_shard (void)
+{
+  Shard *shard;
+
+  shard = g_private_get (&thread_shard);
+  if (shard == NULL)
+    {
+      shard = g_new0 (Shard, 1);
+      g_private_set (&thread_shard, shard);
+
+      G_LOCK (shards);
+      shards = g_slist_prepend (shards, shard);
+      G_UNLOCK (shards);
+    }
+
+  return shard;
+}
+
+/* To be called before any authorization check, see
+ * polkit_backend_interactive_authority_set_latency_sampling()
+ */
+void
+_polkit_backend_trace_set_sample_interval (guint interval)
+{
+  _polkit_backend_trace_sample_interval = interval;
+}
+
+/* Returns the time the stage began if it is to be sampled, 0 otherwise */
+gint64
+_polkit_backend_trace_sample_begin (void)
+{
+  Shard *shard;
+
+  shard = get_thread_shard ();
+  if (shard->countdown > 0)
+    {
+      shard->countdown--;
+      return 0;
+    }
+  shard->countdown = _polkit_backend_trace_sample_interval - 1;
+
+  return g_get_monotonic_time ();
+}
+
+void
+_polkit_backend_trace_sample_end (PolkitBackendStage stage,
+                                  gint64             begin_time)
+{
+  Shard *shard;
+  guint64 elapsed;
+  guint bucket;
+
+  shard = get_thread_shard ();
+
+  elapsed = MAX (g_get_monotonic_time () - begin_time, 0);
+  for (bucket = 0; bucket < NUM_BUCKETS - 1 && elapsed >= ((guint64) 1 << bucket); bucket++)
+    ;
+
+  g_atomic_int_inc (&shard->buckets[stage][bucket]);
+}
+
+/* Adds a latency-<stage>-lt-<N>us entry for each bucket with samples */
+void
+_polkit_backend_trace_add_statistics (GVariantBuilder *builder)
+{
+  guint64 totals[POLKIT_BACKEND_NUM_STAGES][NUM_BUCKETS];
+  GSList *l;
+  guint n, m;
+
+  if (_polkit_backend_trace_sample_interval == 0)
+    return;
+
+  G_LOCK (shards);
+  for (n = 0; n < POLKIT_BACKEND_NUM_STAGES; n++)
+    for (m = 0; m < NUM_BUCKETS; m++)
+      totals[n][m] = (guint) retired.buckets[n][m];
+  for (l = shards; l != NULL; l = l->next)
+    {
+      Shard *shard = l->data;
+
+      for (n = 0; n < POLKIT_BACKEND_NUM_STAGES; n++)
+        for (m = 0; m < NUM_BUCKETS; m++)
+          totals[n][m] += (guint) g_atomic_int_get (&shard->buckets[n][m]);
+    }
+  G_UNLOCK (shards);
+
+  for (n = 0; n < POLKIT_BACKEND_NUM_STAGES; n++)
+    {
+      for (m = 0; m < NUM_BUCKETS; m++)
+        {
+          gchar *name;
+
+          if (totals[n][m] == 0)
+            continue;
+
+          if (m < NUM_BUCKETS - 1)
+            name = g_strdup_printf ("latency-%s-lt-%" G_GUINT64_FORMAT "us",
+                                    stage_names[n], (guint64) 1 << m);
+          else
+            name = g_strdup_printf ("latency-%s-ge-%" G_GUINT64_FORMAT "us",
+                                    stage_names[n], (guint64) 1 << (m - 1));
+          g_variant_builder_add (builder, "{st}", name, totals[n][m]);
+          g_free (name);
+        }
+    }
+}
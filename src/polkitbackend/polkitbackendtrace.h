@@ -0,0 +1,99 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#if !defined (_POLKIT_BACKEND_COMPILATION) || defined(_POLKIT_BACKEND_INSIDE_POLKIT_BACKEND_H)
+#error "This is a private header file."
+#endif
+
+#ifndef __POLKIT_BACKEND_TRACE_H
+#define __POLKIT_BACKEND_TRACE_H
+
+#include <glib.h>
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+/* Where polkitd spends its time while checking an authorization.
+ *
+ * Each stage is bracketed by polkitd:stage_begin and polkitd:stage_end
+ * USDT probes with the stage as argument, e.g.
+ *
+ *   bpftrace -e 'usdt:/usr/lib/polkit-1/polkitd:polkitd:stage_end { @[arg0] = count(); }'
+ *
+ * The probes are a nop instruction until a tracer attaches, which
+ * patches the code from the outside, so they work with polkitd's
+ * MemoryDenyWriteExecute= and SystemCallFilter= sandbox.
+ *
+ * Without a tracer, polkitd can also sample the latency of 1 in N
+ * stages itself, see polkit_backend_interactive_authority_set_latency_sampling().
+ * The samples go into histograms kept per thread, so threads don't
+ * contend, and are added up when the statistics are asked for.
+ */
+
+typedef enum
+{
+  POLKIT_BACKEND_STAGE_SUBJECT_RESOLUTION,
+  POLKIT_BACKEND_STAGE_SESSION_LOOKUP,
+  POLKIT_BACKEND_STAGE_RULES,
+  POLKIT_BACKEND_STAGE_TEMPORARY_AUTHORIZATION_LOOKUP,
+  POLKIT_BACKEND_STAGE_CHALLENGE,
+  POLKIT_BACKEND_NUM_STAGES
+} PolkitBackendStage;
+
+typedef struct
+{
+  PolkitBackendStage stage;
+  /* 0 unless this run of the stage is sampled */
+  gint64 begin_time;
+} PolkitBackendStageTimer;
+
+#ifdef HAVE_SYS_SDT_H
+#define POLKIT_BACKEND_PROBE1(name, arg1) DTRACE_PROBE1 (polkitd, name, arg1)
+#else
+#define POLKIT_BACKEND_PROBE1(name, arg1) G_STMT_START { } G_STMT_END
+#endif
+
+/* Only written before any check runs, so read without atomics */
+extern guint _polkit_backend_trace_sample_interval;
+
+void _polkit_backend_trace_set_sample_interval (guint interval);
+gint64 _polkit_backend_trace_sample_begin (void);
+void _polkit_backend_trace_sample_end (PolkitBackendStage stage,
+                                       gint64             begin_time);
+void _polkit_backend_trace_add_statistics (GVariantBuilder *builder);
+
+static inline void
+polkit_backend_stage_begin (PolkitBackendStageTimer *timer,
+                            PolkitBackendStage       stage)
+{
+  POLKIT_BACKEND_PROBE1 (stage_begin, (int) stage);
+  timer->stage = stage;
+  timer->begin_time = 0;
+  if (G_UNLIKELY (_polkit_backend_trace_sample_interval > 0))
+    timer->begin_time = _polkit_backend_trace_sample_begin ();
+}
+
+static inline void
+polkit_backend_stage_end (PolkitBackendStageTimer *timer)
+{
+  POLKIT_BACKEND_PROBE1 (stage_end, (int) timer->stage);
+  if (G_UNLIKELY (timer->begin_time != 0))
+    _polkit_backend_trace_sample_end (timer->stage, timer->begin_time);
+}
+
+#endif /* __POLKIT_BACKEND_TRACE_H */
@@ -28,26 +28,64 @@
 #include <grp.h>
 
 #include <polkit/polkit.h>
+#include <polkit/polkitprivate.h>
 #include <polkitbackend/polkitbackend.h>
 
 #ifdef HAVE_LIBSYSTEMD
 #  include <systemd/sd-daemon.h>
 #endif
 
+#if defined(HAVE_LIBSYSTEMD) && defined(HAVE_MEMFD_CREATE)
+#  define HAVE_STATE_HANDOFF 1
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#  include <gio/gunixfdlist.h>
+#endif
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static PolkitBackendAuthority *authority = NULL;
 static gpointer                registration_id = NULL;
+static gpointer                peer_socket_id = NULL;
 static GMainLoop              *loop = NULL;
 static gint                    exit_status = EXIT_FAILURE;
 static gboolean                opt_replace = FALSE;
 static gboolean                opt_no_debug = FALSE;
 static gchar                  *opt_log_level = "err";
+static gint                    opt_max_temporary_authorizations = 0;
+static gint                    opt_max_action_descriptions = 0;
+static gint                    opt_max_admin_identities = 0;
+static gint                    opt_sample_latency = 0;
+static gchar                 **opt_priority_callers = NULL;
+static gint                    opt_max_queued_calls = 0;
+static gboolean                opt_peer_socket = FALSE;
+#ifdef HAVE_STATE_HANDOFF
+static guint                   save_state_id = 0;
+/* what is in systemd's file descriptor store, see save_state() */
+static guint                   saved_generation = 0;
+static GHashTable             *saved_pidfd_names = NULL;
+#endif
 static GOptionEntry            opt_entries[] = {
   {"replace", 'r', 0, G_OPTION_ARG_NONE, &opt_replace, "Replace existing daemon", NULL},
   {"no-debug", 'n', 0, G_OPTION_ARG_NONE, &opt_no_debug, "Don't print debug information to stderr and stdout", NULL},
   {"log-level", 'l', 0, G_OPTION_ARG_STRING, &opt_log_level, "Set a level of logging (syslog style). Defaults to 'err'.",
           "[emerg|alert|crit|err|warning|notice|info|debug]"},
+  {"max-temporary-authorizations", 0, 0, G_OPTION_ARG_INT, &opt_max_temporary_authorizations,
+          "Maximum number of temporary authorizations to keep, least recently used are dropped first. Defaults to 0 (no limit).", "N"},
+  {"max-action-descriptions", 0, 0, G_OPTION_ARG_INT, &opt_max_action_descriptions,
+          "Maximum number of localized action descriptions to cache. Defaults to 0 (no limit).", "N"},
+  {"max-admin-identities", 0, 0, G_OPTION_ARG_INT, &opt_max_admin_identities,
+          "Maximum number of administrators to offer an authentication agent. Defaults to 0 (no limit).", "N"},
+  {"sample-latency", 0, 0, G_OPTION_ARG_INT, &opt_sample_latency,
+          "Measure 1 in N runs of each stage of authorization checks, reported with the statistics. Defaults to 0 (off).", "N"},
+  {"priority-caller", 0, 0, G_OPTION_ARG_STRING_ARRAY, &opt_priority_callers,
+          "Serve requests from this uid or well-known bus name first, may be given more than once. Enables scheduling.", "UID|NAME"},
+  {"max-queued-calls", 0, 0, G_OPTION_ARG_INT, &opt_max_queued_calls,
+          "Maximum number of requests of each priority class to keep waiting. Enables scheduling. Defaults to 0 (no limit).", "N"},
+  {"peer-socket", 0, 0, G_OPTION_ARG_NONE, &opt_peer_socket,
+          "Also serve local clients directly on " POLKIT_PEER_SOCKET_PATH, NULL},
   {NULL }
 };
 
@@ -72,7 +110,16 @@ on_bus_acquired (GDBusConnection *connection,
       g_printerr ("Error registering authority: %s\n", error->message);
       g_error_free (error);
       g_main_loop_quit (loop); /* exit */
+      return;
     }
+
+  /* only on request, since priority uids cost a round trip to the bus
+   * for each new caller
+   */
+  if (opt_priority_callers != NULL || opt_max_queued_calls > 0)
+    polkit_backend_authority_set_scheduling (registration_id,
+                                             (const gchar * const *) opt_priority_callers,
+                                             opt_max_queued_calls);
 }
 
 static void
@@ -106,6 +153,25 @@ on_sigint (gpointer user_data)
   return TRUE;
 }
 
+#ifdef HAVE_STATE_HANDOFF
+static void save_state (void);
+
+static gboolean
+on_sigterm (gpointer user_data)
+{
+  g_print ("Handling SIGTERM\n");
+  /* systemd stopping or restarting us; leave our state behind for the next instance */
+  if (save_state_id > 0)
+    {
+      g_source_remove (save_state_id);
+      save_state_id = 0;
+    }
+  save_state ();
+  g_main_loop_quit (loop);
+  return TRUE;
+}
+#endif
+
 static gboolean
 on_sighup (gpointer user_data)
 {
@@ -134,6 +200,392 @@ on_sighup (gpointer user_data)
   return TRUE;
 }
 
+static gboolean
+on_sigusr2 (gpointer user_data)
+{
+  GVariant *usage;
+  GVariant *statistics;
+  GVariantIter iter;
+  const gchar *name;
+  guint64 num_entries;
+  guint64 num_bytes;
+  guint64 value;
+
+  usage = polkit_backend_authority_get_memory_usage (authority);
+
+  g_variant_iter_init (&iter, usage);
+  while (g_variant_iter_next (&iter, "{&s(tt)}", &name, &num_entries, &num_bytes))
+    polkit_backend_authority_log (authority,
+                                  LOG_LEVEL_NOTICE,
+                                  "Memory usage: %s: %" G_GUINT64_FORMAT " entries, ~%" G_GUINT64_FORMAT " bytes",
+                                  name, num_entries, num_bytes);
+
+  g_variant_unref (usage);
+
+  statistics = polkit_backend_authority_get_statistics (authority);
+
+  g_variant_iter_init (&iter, statistics);
+  while (g_variant_iter_next (&iter, "{&st}", &name, &value))
+    polkit_backend_authority_log (authority,
+                                  LOG_LEVEL_NOTICE,
+                                  "Statistics: %s: %" G_GUINT64_FORMAT,
+                                  name, value);
+
+  g_variant_unref (statistics);
+  return TRUE;
+}
+
+#ifdef HAVE_STATE_HANDOFF
+/* Agents and temporary authorizations are handed to the next instance
+ * through systemd's file descriptor store: the state itself goes into
+ * a sealed memfd named polkit-state-<generation>, together with the
+ * name of each pidfd it refers to. A pidfd is stored as
+ * polkit-pidfd-<pid>-<start-time>, so it keeps its name from one save
+ * to the next and only the ones that changed are sent. See
+ * polkit_backend_interactive_authority_save_state().
+ *
+ * A new state is stored completely before the previous one is removed,
+ * so there is always a whole state to restore if we are killed in
+ * between. Pidfds no longer referred to are removed first; a state
+ * missing some of them still restores, with those processes identified
+ * by pid and start time instead.
+ */
+
+/* FileDescriptorStoreMax= in polkit.service, less the two states
+ * stored while switching from one to the next
+ */
+#define MAX_SAVED_PIDFDS (1024 - 2)
+
+static void
+remove_saved_fd (const gchar *name)
+{
+  gchar *message;
+
+  message = g_strdup_printf ("FDSTOREREMOVE=1\nFDNAME=%s", name);
+  sd_notify (0, message);
+  g_free (message);
+}
+
+static void
+remove_saved_state (guint generation)
+{
+  gchar *name;
+
+  name = g_strdup_printf ("polkit-state-%u", generation);
+  remove_saved_fd (name);
+  g_free (name);
+}
+
+/* Returns whether @name is a state, and its generation */
+static gboolean
+parse_saved_state_name (const gchar *name,
+                        guint       *out_generation)
+{
+  guint64 generation;
+
+  if (!g_str_has_prefix (name, "polkit-state-") ||
+      !g_ascii_string_to_unsigned (name + sizeof "polkit-state-" - 1, 10, 1, G_MAXUINT, &generation, NULL))
+    return FALSE;
+
+  *out_generation = generation;
+  return TRUE;
+}
+
+/* Returns the name to store @pidfd under, or %NULL if its process is gone */
+static gchar *
+get_pidfd_name (gint pidfd)
+{
+  PolkitSubject *process;
+  gchar *ret;
+  gint pid;
+
+  ret = NULL;
+  pidfd = fcntl (pidfd, F_DUPFD_CLOEXEC, 3);
+  if (pidfd < 0)
+    return NULL;
+
+  /* takes ownership of the duplicate */
+  process = polkit_unix_process_new_pidfd (pidfd, -1, NULL);
+  pid = polkit_unix_process_get_pid (POLKIT_UNIX_PROCESS (process));
+  if (pid > 0)
+    ret = g_strdup_printf ("polkit-pidfd-%d-%" G_GUINT64_FORMAT,
+                           pid,
+                           polkit_unix_process_get_start_time (POLKIT_UNIX_PROCESS (process)));
+  g_object_unref (process);
+
+  return ret;
+}
+
+static void
+save_state (void)
+{
+  GUnixFDList *fd_list;
+  GVariantBuilder names_builder;
+  GHashTable *pidfds;
+  GHashTableIter iter;
+  GVariant *state;
+  GVariant *wrapped;
+  const gint *fds;
+  const guint8 *data;
+  const gchar *name;
+  gpointer value;
+  gchar *message;
+  gsize size;
+  gsize written;
+  guint generation;
+  guint num_truncated;
+  gint num_fds;
+  gint fd;
+  gint n;
+
+  if (!POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority))
+    return;
+
+  if (g_getenv ("NOTIFY_SOCKET") == NULL)
+    {
+      g_debug ("Not saving state, not running under systemd");
+      return;
+    }
+
+  if (saved_pidfd_names == NULL)
+    saved_pidfd_names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  fd = -1;
+  fd_list = g_unix_fd_list_new ();
+  state = g_variant_ref_sink (polkit_backend_interactive_authority_save_state (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                               fd_list));
+
+  /* maps the names of the pidfds to store to the pidfds */
+  pidfds = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  num_truncated = 0;
+  g_variant_builder_init (&names_builder, G_VARIANT_TYPE ("as"));
+  fds = g_unix_fd_list_peek_fds (fd_list, &num_fds);
+  for (n = 0; n < num_fds; n++)
+    {
+      gchar *pidfd_name;
+
+      pidfd_name = get_pidfd_name (fds[n]);
+      if (pidfd_name != NULL &&
+          !g_hash_table_contains (pidfds, pidfd_name) &&
+          g_hash_table_size (pidfds) >= MAX_SAVED_PIDFDS)
+        {
+          num_truncated++;
+          g_clear_pointer (&pidfd_name, g_free);
+        }
+
+      g_variant_builder_add (&names_builder, "s", pidfd_name != NULL ? pidfd_name : "");
+      if (pidfd_name != NULL)
+        g_hash_table_replace (pidfds, pidfd_name, GINT_TO_POINTER (fds[n]));
+    }
+  if (num_truncated > 0)
+    polkit_backend_authority_log (authority,
+                                  LOG_LEVEL_WARNING,
+                                  "Not saving the pidfds of %u processes, at most %u can be stored; "
+                                  "they will be identified by pid and start time instead",
+                                  num_truncated, (guint) MAX_SAVED_PIDFDS);
+
+  /* first make room, see above */
+  g_hash_table_iter_init (&iter, saved_pidfd_names);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &name, NULL))
+    {
+      if (!g_hash_table_contains (pidfds, name))
+        {
+          remove_saved_fd (name);
+          g_hash_table_iter_remove (&iter);
+        }
+    }
+
+  g_hash_table_iter_init (&iter, pidfds);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &name, &value))
+    {
+      gint pidfd = GPOINTER_TO_INT (value);
+
+      if (g_hash_table_contains (saved_pidfd_names, name))
+        continue;
+      message = g_strdup_printf ("FDSTORE=1\nFDNAME=%s", name);
+      if (sd_pid_notify_with_fds (0, FALSE, message, &pidfd, 1) > 0)
+        g_hash_table_add (saved_pidfd_names, g_strdup (name));
+      g_free (message);
+    }
+
+  /* wrapped so the reader doesn't need to know the type of the state up front */
+  wrapped = g_variant_ref_sink (g_variant_new ("(v@as)", state, g_variant_builder_end (&names_builder)));
+
+  fd = memfd_create ("polkit-state", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0)
+    {
+      polkit_backend_authority_log (authority, LOG_LEVEL_WARNING, "Error creating memfd for state: %m");
+      goto out;
+    }
+
+  data = g_variant_get_data (wrapped);
+  size = g_variant_get_size (wrapped);
+  for (written = 0; written < size; )
+    {
+      gssize r = write (fd, data + written, size - written);
+      if (r < 0 && errno == EINTR)
+        continue;
+      if (r < 0)
+        {
+          polkit_backend_authority_log (authority, LOG_LEVEL_WARNING, "Error writing state: %m");
+          goto out;
+        }
+      written += r;
+    }
+  fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+
+  generation = saved_generation + 1;
+  if (generation == 0)
+    generation = 1;
+
+  message = g_strdup_printf ("FDSTORE=1\nFDNAME=polkit-state-%u", generation);
+  if (sd_pid_notify_with_fds (0, FALSE, message, &fd, 1) <= 0)
+    {
+      polkit_backend_authority_log (authority, LOG_LEVEL_WARNING, "Error storing state");
+      g_free (message);
+      goto out;
+    }
+  g_free (message);
+
+  /* only now that the new state is stored completely */
+  if (saved_generation > 0)
+    remove_saved_state (saved_generation);
+  saved_generation = generation;
+
+ out:
+  if (fd >= 0)
+    close (fd);
+  g_hash_table_unref (pidfds);
+  g_variant_unref (wrapped);
+  g_variant_unref (state);
+  g_object_unref (fd_list);
+}
+
+static void
+restore_state (void)
+{
+  GMappedFile *mapped_file;
+  GVariant *wrapped;
+  GVariant *state;
+  GVariant *pidfd_names;
+  GHashTable *pidfds;
+  GHashTableIter iter;
+  gpointer value;
+  GError *error;
+  GArray *fds;
+  gchar **names;
+  guint generation;
+  gint state_fd;
+  gint num_fds;
+  gint n;
+
+  if (!POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority))
+    return;
+
+  names = NULL;
+  state_fd = -1;
+  fds = g_array_new (FALSE, FALSE, sizeof (gint));
+  /* maps from name to fd */
+  pidfds = g_hash_table_new (g_str_hash, g_str_equal);
+
+  num_fds = sd_listen_fds_with_names (TRUE, &names);
+
+  /* there are two states if the previous instance was killed while
+   * saving, the newer one is complete
+   */
+  for (n = 0; n < num_fds; n++)
+    {
+      if (parse_saved_state_name (names[n], &generation))
+        saved_generation = MAX (saved_generation, generation);
+    }
+
+  for (n = 0; n < num_fds; n++)
+    {
+      gint fd = SD_LISTEN_FDS_START + n;
+
+      if (parse_saved_state_name (names[n], &generation) && generation == saved_generation)
+        state_fd = fd;
+      else if (g_str_has_prefix (names[n], "polkit-pidfd-"))
+        g_hash_table_insert (pidfds, names[n], GINT_TO_POINTER (fd));
+      else
+        close (fd);
+    }
+
+  if (state_fd < 0)
+    goto out;
+
+  error = NULL;
+  mapped_file = g_mapped_file_new_from_fd (state_fd, FALSE, &error);
+  if (mapped_file == NULL)
+    {
+      polkit_backend_authority_log (authority, LOG_LEVEL_WARNING, "Error reading saved state: %s", error->message);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  wrapped = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE ("(vas)"),
+                                                          g_mapped_file_get_bytes (mapped_file),
+                                                          FALSE));
+  g_mapped_file_unref (mapped_file);
+  g_variant_get (wrapped, "(v@as)", &state, &pidfd_names);
+
+  /* in the order of the fd list the state refers to, -1 for lost ones */
+  for (n = 0; n < (gint) g_variant_n_children (pidfd_names); n++)
+    {
+      const gchar *name;
+      gint fd = -1;
+
+      g_variant_get_child (pidfd_names, n, "&s", &name);
+      if (g_hash_table_lookup_extended (pidfds, name, NULL, &value))
+        fd = GPOINTER_TO_INT (value);
+      g_array_append_val (fds, fd);
+    }
+
+  if (!polkit_backend_interactive_authority_restore_state (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                           state,
+                                                           (const gint *) fds->data,
+                                                           fds->len,
+                                                           &error))
+    {
+      polkit_backend_authority_log (authority, LOG_LEVEL_WARNING, "Error restoring saved state: %s", error->message);
+      g_clear_error (&error);
+    }
+  g_variant_unref (pidfd_names);
+  g_variant_unref (state);
+  g_variant_unref (wrapped);
+
+ out:
+  /* we own everything now; don't have a later crash bring back stale state */
+  for (n = 0; n < num_fds; n++)
+    remove_saved_fd (names[n]);
+  if (state_fd >= 0)
+    close (state_fd);
+  g_hash_table_iter_init (&iter, pidfds);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    close (GPOINTER_TO_INT (value));
+  g_hash_table_unref (pidfds);
+  g_array_unref (fds);
+  g_strfreev (names);
+}
+
+static gboolean
+on_save_state_timeout (gpointer user_data)
+{
+  save_state_id = 0;
+  save_state ();
+  return G_SOURCE_REMOVE;
+}
+
+static void
+on_authority_changed (PolkitBackendAuthority *authority,
+                      gpointer                user_data)
+{
+  /* also keeps the state around if we crash; batched since changes come in bursts */
+  if (save_state_id == 0)
+    save_state_id = g_timeout_add_seconds (1, on_save_state_timeout, NULL);
+}
+#endif /* HAVE_STATE_HANDOFF */
+
 static gboolean
 become_user (const gchar  *user,
              GError      **error)
@@ -209,12 +661,16 @@ main (int    argc,
   guint name_owner_id;
   guint sigint_id;
   guint sighup_id;
+  guint sigusr2_id;
+  guint sigterm_id;
 
   loop = NULL;
   opt_context = NULL;
   name_owner_id = 0;
   sigint_id = 0;
   sighup_id = 0;
+  sigusr2_id = 0;
+  sigterm_id = 0;
   registration_id = NULL;
 
   /* Disable remote file access from GIO. */
@@ -265,8 +721,42 @@ main (int    argc,
 
   authority = polkit_backend_authority_get ();
 
+  if (POLKIT_BACKEND_IS_INTERACTIVE_AUTHORITY (authority))
+    {
+      polkit_backend_interactive_authority_set_cache_limits (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                             MAX (opt_max_temporary_authorizations, 0),
+                                                             MAX (opt_max_action_descriptions, 0));
+      polkit_backend_interactive_authority_set_max_admin_identities (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                     MAX (opt_max_admin_identities, 0));
+      polkit_backend_interactive_authority_set_latency_sampling (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                 MAX (opt_sample_latency, 0));
+    }
+
+#ifdef HAVE_STATE_HANDOFF
+  /* before taking the name, so agents re-registering find themselves already there */
+  restore_state ();
+  g_signal_connect (authority, "changed", G_CALLBACK (on_authority_changed), NULL);
+#endif
+
   loop = g_main_loop_new (NULL, FALSE);
 
+  if (opt_peer_socket)
+    {
+      peer_socket_id = polkit_backend_authority_register_peer_socket (authority,
+                                                                      POLKIT_PEER_SOCKET_PATH,
+                                                                      "/org/freedesktop/PolicyKit1/Authority",
+                                                                      &error);
+      if (peer_socket_id == NULL)
+        {
+          /* clients just keep using the bus */
+          polkit_backend_authority_log (authority,
+                                        LOG_LEVEL_WARNING,
+                                        "Error serving on %s: %s",
+                                        POLKIT_PEER_SOCKET_PATH, error->message);
+          g_clear_error (&error);
+        }
+    }
+
   sigint_id = g_unix_signal_add (SIGINT,
                                  on_sigint,
                                  NULL);
@@ -275,6 +765,20 @@ main (int    argc,
                                  on_sighup,
                                  NULL);
 
+  /* dumps memory usage and statistics to the log, see
+   * polkit_backend_authority_get_memory_usage() and
+   * polkit_backend_authority_get_statistics()
+   */
+  sigusr2_id = g_unix_signal_add (SIGUSR2,
+                                  on_sigusr2,
+                                  NULL);
+
+#ifdef HAVE_STATE_HANDOFF
+  sigterm_id = g_unix_signal_add (SIGTERM,
+                                  on_sigterm,
+                                  NULL);
+#endif
+
   name_owner_id = g_bus_own_name (G_BUS_TYPE_SYSTEM,
                                   "org.freedesktop.PolicyKit1",
                                   G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT |
@@ -303,16 +807,27 @@ main (int    argc,
     g_source_remove (sigint_id);
   if (sighup_id > 0)
     g_source_remove (sighup_id);
+  if (sigusr2_id > 0)
+    g_source_remove (sigusr2_id);
+  if (sigterm_id > 0)
+    g_source_remove (sigterm_id);
+#ifdef HAVE_STATE_HANDOFF
+  if (save_state_id > 0)
+    g_source_remove (save_state_id);
+#endif
   if (name_owner_id != 0)
     g_bus_unown_name (name_owner_id);
   if (registration_id != NULL)
     polkit_backend_authority_unregister (registration_id);
+  if (peer_socket_id != NULL)
+    polkit_backend_authority_unregister_peer_socket (peer_socket_id);
   if (authority != NULL)
     g_object_unref (authority);
   if (loop != NULL)
     g_main_loop_unref (loop);
   if (opt_context != NULL)
     g_option_context_free (opt_context);
+  g_strfreev (opt_priority_callers);
 
   g_print ("Exiting with code %d\n", exit_status);
   return exit_status;
@@ -74,14 +74,6 @@ print_action (PolkitActionDescription *action,
     }
 }
 
-static gint
-action_desc_compare_by_action_id_func (PolkitActionDescription *a,
-                                       PolkitActionDescription *b)
-{
-  return g_strcmp0 (polkit_action_description_get_action_id (a),
-                    polkit_action_description_get_action_id (b));
-}
-
 int
 main (int argc, char *argv[])
 {
@@ -108,14 +100,15 @@ main (int argc, char *argv[])
     };
   GOptionContext *context;
   PolkitAuthority *authority;
-  GList *l;
-  GList *actions;
+  PolkitActionEnumerator *enumerator;
+  PolkitActionDescription *action;
+  gboolean found;
   GError *error;
 
   opt_action_id = NULL;
   context = NULL;
   authority = NULL;
-  actions = NULL;
+  enumerator = NULL;
   ret = 1;
 
   /* Disable remote file access from GIO. */
@@ -159,10 +152,26 @@ main (int argc, char *argv[])
       goto out;
     }
 
+  /* actions are returned ordered by action id, a page at a time */
+  enumerator = polkit_action_enumerator_new (authority,
+                                             opt_action_id, /* id_prefix */
+                                             NULL,          /* annotation_key */
+                                             NULL,          /* annotation_value */
+                                             0);            /* page_size */
+  found = FALSE;
   error = NULL;
-  actions = polkit_authority_enumerate_actions_sync (authority,
-                                                     NULL,      /* GCancellable */
-                                                     &error);
+  while ((action = polkit_action_enumerator_next_sync (enumerator,
+                                                       NULL,      /* GCancellable */
+                                                       &error)) != NULL)
+    {
+      if (opt_action_id == NULL ||
+          g_strcmp0 (polkit_action_description_get_action_id (action), opt_action_id) == 0)
+        {
+          print_action (action, opt_verbose);
+          found = TRUE;
+        }
+      g_object_unref (action);
+    }
   if (error != NULL)
     {
       g_printerr ("Error enumerating actions: %s\n", error->message);
@@ -170,46 +179,17 @@ main (int argc, char *argv[])
       goto out;
     }
 
-  if (opt_action_id != NULL)
-    {
-      for (l = actions; l != NULL; l = l->next)
-        {
-          PolkitActionDescription *action = POLKIT_ACTION_DESCRIPTION (l->data);
-          const gchar *id;
-
-          id = polkit_action_description_get_action_id (action);
-
-          if (g_strcmp0 (id, opt_action_id) == 0)
-            {
-              print_action (action, opt_verbose);
-              break;
-            }
-        }
-
-      if (l == NULL)
-        {
-          g_printerr ("No action with action id %s\n", opt_action_id);
-          goto out;
-        }
-    }
-  else
+  if (opt_action_id != NULL && !found)
     {
-      actions = g_list_sort (actions,
-                             (GCompareFunc) action_desc_compare_by_action_id_func);
-
-      for (l = actions; l != NULL; l = l->next)
-        {
-          PolkitActionDescription *action = POLKIT_ACTION_DESCRIPTION (l->data);
-
-          print_action (action, opt_verbose);
-        }
+      g_printerr ("No action with action id %s\n", opt_action_id);
+      goto out;
     }
 
   ret = 0;
 
  out:
-  g_list_foreach (actions, (GFunc) g_object_unref, NULL);
-  g_list_free (actions);
+  if (enumerator != NULL)
+    g_object_unref (enumerator);
 
   g_free (opt_action_id);
 
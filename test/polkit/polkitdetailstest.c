@@ -0,0 +1,123 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "glib.h"
+#include <polkit/polkit.h>
+#include <polkit/polkitprivate.h>
+
+
+static PolkitDetails *
+new_details_from_string (const gchar *text)
+{
+  GVariant *value;
+  PolkitDetails *details;
+
+  value = g_variant_parse (G_VARIANT_TYPE ("a{ss}"), text, NULL, NULL, NULL);
+  g_assert (value);
+  details = polkit_details_new_for_gvariant (value);
+  g_variant_unref (value);
+
+  return details;
+}
+
+
+static void
+test_lookup (void)
+{
+  PolkitDetails *details;
+
+  details = new_details_from_string ("{'b': '2', 'a': '1', 'b': '3'}");
+
+  /* the last of duplicated keys wins */
+  g_assert_cmpuint (polkit_details_get_count (details), ==, 2);
+  g_assert_cmpstr (polkit_details_lookup (details, "a"), ==, "1");
+  g_assert_cmpstr (polkit_details_lookup (details, "b"), ==, "3");
+  g_assert_null (polkit_details_lookup (details, "c"));
+
+  g_object_unref (details);
+}
+
+
+static void
+test_insert (void)
+{
+  PolkitDetails *details;
+  PolkitDetailsIter iter;
+  const gchar *key;
+  const gchar *value;
+  guint seen;
+
+  details = new_details_from_string ("{'a': '1', 'b': '2'}");
+
+  polkit_details_insert (details, "a", "10");
+  polkit_details_insert (details, "b", NULL);
+  polkit_details_insert (details, "c", "3");
+  polkit_details_insert (details, "d", "4");
+  polkit_details_insert (details, "d", NULL);
+
+  g_assert_cmpuint (polkit_details_get_count (details), ==, 2);
+  g_assert_cmpstr (polkit_details_lookup (details, "a"), ==, "10");
+  g_assert_null (polkit_details_lookup (details, "b"));
+  g_assert_cmpstr (polkit_details_lookup (details, "c"), ==, "3");
+  g_assert_null (polkit_details_lookup (details, "d"));
+
+  seen = 0;
+  polkit_details_iter_init (&iter, details);
+  while (polkit_details_iter_next (&iter, &key, &value))
+    {
+      g_assert_cmpstr (polkit_details_lookup (details, key), ==, value);
+      seen++;
+    }
+  g_assert_cmpuint (seen, ==, 2);
+
+  g_object_unref (details);
+}
+
+
+static void
+test_to_gvariant (void)
+{
+  PolkitDetails *details;
+  PolkitDetails *copy;
+  GVariant *value;
+
+  details = polkit_details_new ();
+  g_assert_cmpuint (polkit_details_get_count (details), ==, 0);
+  g_assert_null (polkit_details_get_keys (details));
+  polkit_details_insert (details, "user", "root");
+
+  value = g_variant_ref_sink (polkit_details_to_gvariant (details));
+  copy = polkit_details_new_for_gvariant (value);
+  g_variant_unref (value);
+
+  g_assert_cmpuint (polkit_details_get_count (copy), ==, 1);
+  g_assert_cmpstr (polkit_details_lookup (copy, "user"), ==, "root");
+
+  g_object_unref (copy);
+  g_object_unref (details);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/PolkitDetails/lookup", test_lookup);
+  g_test_add_func ("/PolkitDetails/insert", test_insert);
+  g_test_add_func ("/PolkitDetails/to_gvariant", test_to_gvariant);
+  return g_test_run ();
+}
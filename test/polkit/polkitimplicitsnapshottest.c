@@ -0,0 +1,218 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "glib.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <polkit/polkit.h>
+#include <polkit/polkitprivate.h>
+#include <polkit/polkitimplicitsnapshot.h>
+
+/* Snapshots as written by polkitd, see polkitimplicitsnapshot.h, and
+ * ways of getting them wrong
+ */
+
+#define TEST_ACTION_ID "org.freedesktop.policykit.test"
+
+typedef enum
+{
+  CORRUPTION_NONE,
+  CORRUPTION_UNSEALED,
+  CORRUPTION_TRUNCATED,
+  CORRUPTION_BAD_MAGIC,
+  CORRUPTION_BAD_SIZE,
+  CORRUPTION_BAD_OFFSET,
+  CORRUPTION_NO_NUL
+} Corruption;
+
+/* Returns a memfd with a snapshot holding TEST_ACTION_ID, or -1 if
+ * this system can't seal it. If @out_header is not %NULL, it is set
+ * to a writable mapping of the header, like the one polkitd keeps.
+ */
+static gint
+new_snapshot_fd (Corruption                     corruption,
+                 PolkitImplicitSnapshotHeader **out_header)
+{
+#if defined(HAVE_MEMFD_CREATE) && defined(F_SEAL_FUTURE_WRITE)
+  PolkitImplicitSnapshotHeader *header;
+  PolkitImplicitSnapshotEntry *entry;
+  guint8 *data;
+  gsize offset;
+  gsize size;
+  gint fd;
+
+  offset = sizeof (PolkitImplicitSnapshotHeader) + sizeof (PolkitImplicitSnapshotEntry);
+  size = offset + sizeof (TEST_ACTION_ID) + 1;
+
+  data = g_malloc0 (size);
+  header = (PolkitImplicitSnapshotHeader *) data;
+  header->magic = POLKIT_IMPLICIT_SNAPSHOT_MAGIC;
+  header->version = POLKIT_IMPLICIT_SNAPSHOT_VERSION;
+  header->size = size;
+  header->num_actions = 1;
+  header->pid = getpid ();
+  header->generation = 1;
+  header->current_generation = 1;
+  entry = (PolkitImplicitSnapshotEntry *) (header + 1);
+  entry->action_id_offset = offset;
+  entry->any = POLKIT_IMPLICIT_SNAPSHOT_NOT_AUTHORIZED;
+  entry->inactive = POLKIT_IMPLICIT_SNAPSHOT_NOT_AUTHORIZED;
+  entry->active = POLKIT_IMPLICIT_SNAPSHOT_NOT_AUTHORIZED;
+  memcpy (data + offset, TEST_ACTION_ID, sizeof (TEST_ACTION_ID));
+
+  switch (corruption)
+    {
+    case CORRUPTION_TRUNCATED:
+      size = sizeof (PolkitImplicitSnapshotHeader) - 1;
+      break;
+    case CORRUPTION_BAD_MAGIC:
+      header->magic = ~POLKIT_IMPLICIT_SNAPSHOT_MAGIC;
+      break;
+    case CORRUPTION_BAD_SIZE:
+      header->size = size + 1;
+      break;
+    case CORRUPTION_BAD_OFFSET:
+      entry->action_id_offset = size;
+      break;
+    case CORRUPTION_NO_NUL:
+      data[size - 1] = 'x';
+      break;
+    default:
+      break;
+    }
+
+  fd = memfd_create ("polkit-implicit-snapshot-test", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  g_assert_cmpint (fd, >=, 0);
+  g_assert_cmpint (write (fd, data, size), ==, (gssize) size);
+  g_free (data);
+
+  if (out_header != NULL)
+    {
+      *out_header = mmap (NULL, sizeof (PolkitImplicitSnapshotHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      g_assert (*out_header != MAP_FAILED);
+    }
+
+  if (corruption != CORRUPTION_UNSEALED &&
+      fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) != 0)
+    {
+      if (out_header != NULL)
+        munmap (*out_header, sizeof (PolkitImplicitSnapshotHeader));
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+#else
+  return -1;
+#endif
+}
+
+static void
+test_check (void)
+{
+  PolkitImplicitSnapshotHeader *header;
+  PolkitImplicitSnapshot *snapshot;
+  PolkitAuthorizationResult *result;
+  PolkitSubject *subject;
+  GError *error = NULL;
+  gint fd;
+
+  fd = new_snapshot_fd (CORRUPTION_NONE, &header);
+  if (fd < 0)
+    {
+      g_test_skip ("memfd sealing is not supported");
+      return;
+    }
+
+  snapshot = _polkit_implicit_snapshot_new_for_fd (fd, &error);
+  if (snapshot == NULL)
+    {
+      g_assert_error (error, POLKIT_ERROR, POLKIT_ERROR_NOT_SUPPORTED);
+      g_test_skip ("pidfds are not supported");
+      g_clear_error (&error);
+      munmap (header, sizeof (PolkitImplicitSnapshotHeader));
+      return;
+    }
+  g_assert_no_error (error);
+  g_assert_true (_polkit_implicit_snapshot_is_current (snapshot));
+
+  /* so that being root doesn't short-cut the answer */
+  subject = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  result = _polkit_implicit_snapshot_check (snapshot, subject, TEST_ACTION_ID, NULL,
+                                            POLKIT_CHECK_AUTHORIZATION_FLAGS_ALWAYS_CHECK);
+  g_assert (result != NULL);
+  g_assert_false (polkit_authorization_result_get_is_authorized (result));
+  g_object_unref (result);
+
+  /* polkitd decides actions not in the snapshot */
+  g_assert_null (_polkit_implicit_snapshot_check (snapshot, subject, "org.freedesktop.policykit.unknown", NULL,
+                                                  POLKIT_CHECK_AUTHORIZATION_FLAGS_ALWAYS_CHECK));
+
+  /* a new generation supersedes the snapshot */
+  g_atomic_int_set (&header->current_generation, 2);
+  g_assert_false (_polkit_implicit_snapshot_is_current (snapshot));
+  g_assert_null (_polkit_implicit_snapshot_check (snapshot, subject, TEST_ACTION_ID, NULL,
+                                                  POLKIT_CHECK_AUTHORIZATION_FLAGS_ALWAYS_CHECK));
+
+  g_object_unref (subject);
+  _polkit_implicit_snapshot_unref (snapshot);
+  munmap (header, sizeof (PolkitImplicitSnapshotHeader));
+}
+
+static void
+test_malformed (gconstpointer user_data)
+{
+  Corruption corruption = GPOINTER_TO_UINT (user_data);
+  PolkitImplicitSnapshot *snapshot;
+  GError *error = NULL;
+  gint fd;
+
+  fd = new_snapshot_fd (corruption, NULL);
+  if (fd < 0)
+    {
+      g_test_skip ("memfd sealing is not supported");
+      return;
+    }
+
+  snapshot = _polkit_implicit_snapshot_new_for_fd (fd, &error);
+  g_assert_null (snapshot);
+  g_assert (error != NULL);
+  g_assert (error->domain == POLKIT_ERROR);
+  g_clear_error (&error);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/PolkitImplicitSnapshot/check", test_check);
+  g_test_add_data_func ("/PolkitImplicitSnapshot/unsealed",
+                        GUINT_TO_POINTER (CORRUPTION_UNSEALED), test_malformed);
+  g_test_add_data_func ("/PolkitImplicitSnapshot/truncated",
+                        GUINT_TO_POINTER (CORRUPTION_TRUNCATED), test_malformed);
+  g_test_add_data_func ("/PolkitImplicitSnapshot/bad_magic",
+                        GUINT_TO_POINTER (CORRUPTION_BAD_MAGIC), test_malformed);
+  g_test_add_data_func ("/PolkitImplicitSnapshot/bad_size",
+                        GUINT_TO_POINTER (CORRUPTION_BAD_SIZE), test_malformed);
+  g_test_add_data_func ("/PolkitImplicitSnapshot/bad_offset",
+                        GUINT_TO_POINTER (CORRUPTION_BAD_OFFSET), test_malformed);
+  g_test_add_data_func ("/PolkitImplicitSnapshot/no_nul",
+                        GUINT_TO_POINTER (CORRUPTION_NO_NUL), test_malformed);
+  return g_test_run ();
+}
@@ -0,0 +1,128 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "glib.h"
+#include <polkitagent/polkitagenthelperframe.h>
+
+
+static GByteArray *
+append_frame (GByteArray  *buf,
+              const gchar *payload,
+              gsize        len)
+{
+  guint32 be_len;
+
+  be_len = GUINT32_TO_BE ((guint32) len);
+  g_byte_array_append (buf, (const guint8 *) &be_len, sizeof be_len);
+  g_byte_array_append (buf, (const guint8 *) payload, len);
+
+  return buf;
+}
+
+
+static void
+test_complete (void)
+{
+  GByteArray *buf;
+  gsize len = 0;
+
+  buf = append_frame (g_byte_array_new (), "PAM_PROMPT_ECHO_OFF Password: ", 30);
+  append_frame (buf, "SUCCESS", 7);
+
+  g_assert_cmpint (helper_frame_parse (buf->data, buf->len, &len), ==, HELPER_FRAME_COMPLETE);
+  g_assert_cmpuint (len, ==, 30);
+  g_assert (memcmp (buf->data + HELPER_FRAME_HEADER_SIZE, "PAM_PROMPT_ECHO_OFF", 19) == 0);
+
+  /* consuming the first frame leaves the second one */
+  g_byte_array_remove_range (buf, 0, HELPER_FRAME_HEADER_SIZE + len);
+  g_assert_cmpint (helper_frame_parse (buf->data, buf->len, &len), ==, HELPER_FRAME_COMPLETE);
+  g_assert_cmpuint (len, ==, 7);
+
+  g_byte_array_remove_range (buf, 0, HELPER_FRAME_HEADER_SIZE + len);
+  g_assert_cmpuint (buf->len, ==, 0);
+
+  g_byte_array_unref (buf);
+}
+
+
+static void
+test_empty (void)
+{
+  GByteArray *buf;
+  gsize len = 1;
+
+  buf = append_frame (g_byte_array_new (), "", 0);
+
+  g_assert_cmpint (helper_frame_parse (buf->data, buf->len, &len), ==, HELPER_FRAME_COMPLETE);
+  g_assert_cmpuint (len, ==, 0);
+
+  g_byte_array_unref (buf);
+}
+
+
+static void
+test_incomplete (void)
+{
+  GByteArray *buf;
+  gsize len = 0;
+  guint n;
+
+  buf = append_frame (g_byte_array_new (), "SUCCESS", 7);
+
+  /* every prefix, including a partial length, is incomplete */
+  for (n = 0; n < buf->len; n++)
+    g_assert_cmpint (helper_frame_parse (buf->data, n, &len), ==, HELPER_FRAME_INCOMPLETE);
+  g_assert_cmpint (helper_frame_parse (buf->data, buf->len, &len), ==, HELPER_FRAME_COMPLETE);
+
+  g_byte_array_unref (buf);
+}
+
+
+static void
+test_oversized (void)
+{
+  GByteArray *buf;
+  gchar *payload;
+  gsize len = 0;
+
+  payload = g_malloc0 (HELPER_MAX_FRAME_SIZE + 1);
+
+  buf = append_frame (g_byte_array_new (), payload, HELPER_MAX_FRAME_SIZE);
+  g_assert_cmpint (helper_frame_parse (buf->data, buf->len, &len), ==, HELPER_FRAME_COMPLETE);
+  g_assert_cmpuint (len, ==, HELPER_MAX_FRAME_SIZE);
+  g_byte_array_unref (buf);
+
+  /* rejected from the length alone, before the payload arrives */
+  buf = append_frame (g_byte_array_new (), payload, HELPER_MAX_FRAME_SIZE + 1);
+  g_assert_cmpint (helper_frame_parse (buf->data, HELPER_FRAME_HEADER_SIZE, &len), ==, HELPER_FRAME_INVALID);
+  g_assert_cmpint (helper_frame_parse (buf->data, buf->len, &len), ==, HELPER_FRAME_INVALID);
+  g_byte_array_unref (buf);
+
+  g_free (payload);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/PolkitAgentHelperFrame/complete", test_complete);
+  g_test_add_func ("/PolkitAgentHelperFrame/empty", test_empty);
+  g_test_add_func ("/PolkitAgentHelperFrame/incomplete", test_incomplete);
+  g_test_add_func ("/PolkitAgentHelperFrame/oversized", test_oversized);
+  return g_test_run ();
+}
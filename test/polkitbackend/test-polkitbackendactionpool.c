@@ -0,0 +1,534 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "glib.h"
+
+#include <locale.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include <polkit/polkit.h>
+#include <polkit/polkitprivate.h>
+#include <polkitbackend/polkitbackendactionpool.h>
+
+/* Test helper types */
+
+typedef struct
+{
+  gchar *root;
+  GPtrArray *paths;
+} PolicyTree;
+
+static PolicyTree *
+policy_tree_new (void)
+{
+  PolicyTree *tree;
+  GError *error = NULL;
+
+  tree = g_new0 (PolicyTree, 1);
+  tree->root = g_dir_make_tmp ("polkit-test-actions-XXXXXX", &error);
+  g_assert_no_error (error);
+  tree->paths = g_ptr_array_new_with_free_func (g_free);
+
+  return tree;
+}
+
+static gchar *
+policy_tree_add_dir (PolicyTree  *tree,
+                     const gchar *name)
+{
+  gchar *path;
+
+  path = g_build_filename (tree->root, name, NULL);
+  g_assert_cmpint (g_mkdir (path, 0700), ==, 0);
+  g_ptr_array_add (tree->paths, g_strdup (path));
+
+  return path;
+}
+
+static void
+policy_tree_add_file (PolicyTree  *tree,
+                      const gchar *dir,
+                      const gchar *name,
+                      const gchar *contents)
+{
+  GError *error = NULL;
+  gchar *path;
+
+  path = g_build_filename (dir, name, NULL);
+  g_file_set_contents (path, contents, -1, &error);
+  g_assert_no_error (error);
+  g_ptr_array_add (tree->paths, path);
+}
+
+static void
+policy_tree_free (PolicyTree *tree)
+{
+  guint n;
+
+  /* files were added after their directory, so remove in reverse */
+  for (n = tree->paths->len; n > 0; n--)
+    g_remove (tree->paths->pdata[n - 1]);
+  g_rmdir (tree->root);
+
+  g_ptr_array_unref (tree->paths);
+  g_free (tree->root);
+  g_free (tree);
+}
+
+static gchar *
+make_policy (const gchar *vendor,
+             const gchar *const *action_ids,
+             const gchar *allow_any)
+{
+  GString *str;
+  guint n;
+
+  str = g_string_new ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                      "<policyconfig>\n");
+  g_string_append_printf (str, "  <vendor>%s</vendor>\n", vendor);
+  for (n = 0; action_ids[n] != NULL; n++)
+    {
+      g_string_append_printf (str,
+                              "  <action id=\"%s\">\n"
+                              "    <description>Do %s</description>\n"
+                              "    <description xml:lang=\"da\">Gør %s</description>\n"
+                              "    <message>Authentication is required to do %s</message>\n"
+                              "    <defaults>\n"
+                              "      <allow_any>%s</allow_any>\n"
+                              "      <allow_inactive>no</allow_inactive>\n"
+                              "      <allow_active>auth_admin_keep</allow_active>\n"
+                              "    </defaults>\n"
+                              "    <annotate key=\"org.example.key\">%s</annotate>\n"
+                              "  </action>\n",
+                              action_ids[n],
+                              action_ids[n], action_ids[n], action_ids[n],
+                              allow_any,
+                              action_ids[n]);
+    }
+  g_string_append (str, "</policyconfig>\n");
+
+  return g_string_free (str, FALSE);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+test_precedence (void)
+{
+  const gchar *etc_ids[] = { "org.example.a", NULL };
+  const gchar *usr_ids[] = { "org.example.a", "org.example.b", NULL };
+  const gchar *other_ids[] = { "org.example.c", NULL };
+  const gchar *broken_ids[] = { "org.example.d", NULL };
+  PolicyTree *tree;
+  PolkitBackendActionPool *pool;
+  PolkitActionDescription *desc;
+  PolkitActionDescription *desc2;
+  const gchar *dirs[3];
+  gchar *etc_dir;
+  gchar *usr_dir;
+  gchar *s;
+  GList *actions;
+  guint num_cached;
+
+  tree = policy_tree_new ();
+  etc_dir = policy_tree_add_dir (tree, "etc");
+  usr_dir = policy_tree_add_dir (tree, "usr");
+
+  /* etc/org.example.policy shadows usr/org.example.policy */
+  s = make_policy ("Etc", etc_ids, "yes");
+  policy_tree_add_file (tree, etc_dir, "org.example.policy", s);
+  g_free (s);
+  s = make_policy ("Usr", usr_ids, "no");
+  policy_tree_add_file (tree, usr_dir, "org.example.policy", s);
+  g_free (s);
+
+  s = make_policy ("Other", other_ids, "auth_self");
+  policy_tree_add_file (tree, usr_dir, "org.other.policy", s);
+  g_free (s);
+
+  /* a broken file doesn't shadow a good one */
+  policy_tree_add_file (tree, etc_dir, "org.broken.policy", "<policyconfig><action");
+  s = make_policy ("Fixed", broken_ids, "yes");
+  policy_tree_add_file (tree, usr_dir, "org.broken.policy", s);
+  g_free (s);
+
+  dirs[0] = usr_dir;
+  dirs[1] = etc_dir;
+  dirs[2] = NULL;
+  pool = polkit_backend_action_pool_new (dirs);
+
+  g_test_expect_message (NULL, G_LOG_LEVEL_WARNING, "Error parsing file with path*org.broken.policy*");
+  actions = polkit_backend_action_pool_get_all_actions (pool, NULL);
+  g_test_assert_expected_messages ();
+  g_assert_cmpuint (g_list_length (actions), ==, 3);
+  g_list_free_full (actions, g_object_unref);
+
+  desc = polkit_backend_action_pool_get_action (pool, "org.example.a", NULL);
+  g_assert (desc != NULL);
+  g_assert_cmpstr (polkit_action_description_get_vendor_name (desc), ==, "Etc");
+  g_assert_cmpint (polkit_action_description_get_implicit_any (desc), ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+  g_object_unref (desc);
+
+  desc = polkit_backend_action_pool_get_action (pool, "org.example.a", "da_DK");
+  g_assert (desc != NULL);
+  g_assert_cmpstr (polkit_action_description_get_description (desc), ==, "Gør org.example.a");
+  g_assert_cmpstr (polkit_action_description_get_annotation (desc, "org.example.key"), ==, "org.example.a");
+
+  /* descriptions are shared per translation, not per locale */
+  desc2 = polkit_backend_action_pool_get_action (pool, "org.example.a", "da");
+  g_assert (desc2 == desc);
+  g_object_unref (desc2);
+  desc2 = polkit_backend_action_pool_get_action (pool, "org.example.a", "fr_FR");
+  g_assert (desc2 != desc);
+  g_assert_cmpstr (polkit_action_description_get_description (desc2), !=, "Gør org.example.a");
+  g_object_unref (desc2);
+  g_object_unref (desc);
+
+  g_test_expect_message (NULL, G_LOG_LEVEL_WARNING, "Unknown action_id 'org.example.b'");
+  desc = polkit_backend_action_pool_get_action (pool, "org.example.b", NULL);
+  g_test_assert_expected_messages ();
+  g_assert (desc == NULL);
+
+  desc = polkit_backend_action_pool_get_action (pool, "org.example.c", NULL);
+  g_assert (desc != NULL);
+  g_assert_cmpstr (polkit_action_description_get_vendor_name (desc), ==, "Other");
+  g_object_unref (desc);
+
+  desc = polkit_backend_action_pool_get_action (pool, "org.example.d", NULL);
+  g_assert (desc != NULL);
+  g_assert_cmpstr (polkit_action_description_get_vendor_name (desc), ==, "Fixed");
+  g_object_unref (desc);
+
+  /* the description cache is capped, dropping the least recently used */
+  polkit_backend_action_pool_set_max_cached_descriptions (pool, 1);
+  polkit_backend_action_pool_get_cache_usage (pool, &num_cached);
+  g_assert_cmpuint (num_cached, ==, 1);
+  desc = polkit_backend_action_pool_get_action (pool, "org.example.c", NULL);
+  desc2 = polkit_backend_action_pool_get_action (pool, "org.example.c", NULL);
+  g_assert (desc2 == desc);
+  g_object_unref (desc2);
+  desc2 = polkit_backend_action_pool_get_action (pool, "org.example.d", NULL);
+  g_object_unref (desc2);
+  desc2 = polkit_backend_action_pool_get_action (pool, "org.example.c", NULL);
+  g_assert (desc2 != desc);
+  g_assert_cmpstr (polkit_action_description_get_vendor_name (desc2), ==, "Other");
+  g_object_unref (desc2);
+  g_object_unref (desc);
+  polkit_backend_action_pool_get_cache_usage (pool, &num_cached);
+  g_assert_cmpuint (num_cached, ==, 1);
+
+  g_object_unref (pool);
+  g_free (etc_dir);
+  g_free (usr_dir);
+  policy_tree_free (tree);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+test_reload (void)
+{
+  const gchar *ids[] = { "org.example.a", "org.example.b", NULL };
+  PolicyTree *tree;
+  PolkitBackendActionPool *pool;
+  PolkitActionDescription *desc;
+  PolkitActionDescription *desc2;
+  const gchar *dirs[2];
+  gchar *dir;
+  gchar *s;
+  gsize num_bytes;
+  guint num_actions;
+
+  tree = policy_tree_new ();
+  dir = policy_tree_add_dir (tree, "actions");
+  s = make_policy ("Example", ids, "yes");
+  policy_tree_add_file (tree, dir, "org.example.policy", s);
+  g_free (s);
+
+  dirs[0] = dir;
+  dirs[1] = NULL;
+  pool = polkit_backend_action_pool_new (dirs);
+
+  desc = polkit_backend_action_pool_get_action (pool, "org.example.a", NULL);
+  g_assert (desc != NULL);
+  num_bytes = polkit_backend_action_pool_get_memory_usage (pool, &num_actions);
+  g_assert_cmpuint (num_actions, ==, 2);
+
+  /* a reload frees the strings the pool interned but descriptions
+   * handed out before keep their own copies
+   */
+  polkit_backend_action_pool_reload (pool);
+  g_assert_cmpstr (polkit_action_description_get_vendor_name (desc), ==, "Example");
+  g_assert_cmpstr (polkit_action_description_get_annotation (desc, "org.example.key"), ==, "org.example.a");
+
+  /* ... and interning again doesn't grow the pool */
+  g_assert_cmpuint (polkit_backend_action_pool_get_memory_usage (pool, &num_actions), ==, num_bytes);
+  g_assert_cmpuint (num_actions, ==, 2);
+
+  desc2 = polkit_backend_action_pool_get_action (pool, "org.example.a", NULL);
+  g_assert (desc2 != desc);
+  g_assert_cmpstr (polkit_action_description_get_vendor_name (desc2), ==, "Example");
+  g_object_unref (desc2);
+  g_object_unref (desc);
+
+  g_object_unref (pool);
+  g_free (dir);
+  policy_tree_free (tree);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+assert_action_ids (GVariant    *actions,
+                   const gchar *expected)
+{
+  GString *str;
+  GVariantIter iter;
+  const gchar *action_id;
+
+  str = g_string_new (NULL);
+  g_variant_iter_init (&iter, actions);
+  while (g_variant_iter_next (&iter, "(&sssssuuua{ss})", &action_id,
+                              NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL))
+    {
+      if (str->len > 0)
+        g_string_append_c (str, ' ');
+      g_string_append (str, action_id);
+    }
+  g_assert_cmpstr (str->str, ==, expected);
+  g_string_free (str, TRUE);
+  g_variant_unref (actions);
+}
+
+static void
+test_enumerate (void)
+{
+  const gchar *example_ids[] = { "org.example.c", "org.example.a", "org.example.b", NULL };
+  const gchar *other_ids[] = { "org.exampleother.a", "org.other.a", NULL };
+  PolicyTree *tree;
+  PolkitBackendActionPool *pool;
+  PolkitActionDescription *desc;
+  const gchar *dirs[2];
+  GVariant *actions;
+  GVariant *action;
+  gchar *dir;
+  gchar *s;
+  guint num_matches;
+
+  tree = policy_tree_new ();
+  dir = policy_tree_add_dir (tree, "actions");
+  s = make_policy ("Example", example_ids, "yes");
+  policy_tree_add_file (tree, dir, "org.example.policy", s);
+  g_free (s);
+  s = make_policy ("Other", other_ids, "no");
+  policy_tree_add_file (tree, dir, "org.other.policy", s);
+  g_free (s);
+
+  dirs[0] = dir;
+  dirs[1] = NULL;
+  pool = polkit_backend_action_pool_new (dirs);
+
+  /* everything, ordered by action id */
+  actions = polkit_backend_action_pool_enumerate_actions (pool, NULL, NULL, NULL, NULL, 0, 0, &num_matches);
+  g_variant_ref_sink (actions);
+  g_assert_cmpuint (num_matches, ==, 5);
+  assert_action_ids (actions, "org.example.a org.example.b org.example.c org.exampleother.a org.other.a");
+
+  actions = polkit_backend_action_pool_enumerate_actions (pool, NULL, "org.example.", NULL, NULL, 0, 0, &num_matches);
+  g_variant_ref_sink (actions);
+  g_assert_cmpuint (num_matches, ==, 3);
+  assert_action_ids (actions, "org.example.a org.example.b org.example.c");
+
+  /* pages */
+  actions = polkit_backend_action_pool_enumerate_actions (pool, NULL, "org.example", NULL, NULL, 0, 2, &num_matches);
+  g_variant_ref_sink (actions);
+  g_assert_cmpuint (num_matches, ==, 4);
+  assert_action_ids (actions, "org.example.a org.example.b");
+  actions = polkit_backend_action_pool_enumerate_actions (pool, NULL, "org.example", NULL, NULL, 2, 2, &num_matches);
+  g_variant_ref_sink (actions);
+  g_assert_cmpuint (num_matches, ==, 4);
+  assert_action_ids (actions, "org.example.c org.exampleother.a");
+  actions = polkit_backend_action_pool_enumerate_actions (pool, NULL, "org.example", NULL, NULL, 4, 2, &num_matches);
+  g_variant_ref_sink (actions);
+  g_assert_cmpuint (num_matches, ==, 4);
+  assert_action_ids (actions, "");
+
+  /* annotations */
+  actions = polkit_backend_action_pool_enumerate_actions (pool, NULL, NULL, "org.example.key", "org.other.a", 0, 0, &num_matches);
+  g_variant_ref_sink (actions);
+  g_assert_cmpuint (num_matches, ==, 1);
+  assert_action_ids (actions, "org.other.a");
+  actions = polkit_backend_action_pool_enumerate_actions (pool, NULL, NULL, "org.example.key", "", 0, 0, &num_matches);
+  g_variant_ref_sink (actions);
+  g_assert_cmpuint (num_matches, ==, 5);
+  g_variant_unref (actions);
+  actions = polkit_backend_action_pool_enumerate_actions (pool, NULL, NULL, "org.example.nokey", NULL, 0, 0, &num_matches);
+  g_variant_ref_sink (actions);
+  g_assert_cmpuint (num_matches, ==, 0);
+  assert_action_ids (actions, "");
+
+  /* the same serialization as EnumerateActions */
+  actions = polkit_backend_action_pool_enumerate_actions (pool, "da_DK", "org.example.b", NULL, NULL, 0, 0, NULL);
+  g_variant_ref_sink (actions);
+  action = g_variant_get_child_value (actions, 0);
+  desc = polkit_action_description_new_for_gvariant (action);
+  g_assert_cmpstr (polkit_action_description_get_action_id (desc), ==, "org.example.b");
+  g_assert_cmpstr (polkit_action_description_get_description (desc), ==, "Gør org.example.b");
+  g_assert_cmpstr (polkit_action_description_get_vendor_name (desc), ==, "Example");
+  g_assert_cmpint (polkit_action_description_get_implicit_active (desc), ==,
+                   POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED);
+  g_assert_cmpstr (polkit_action_description_get_annotation (desc, "org.example.key"), ==, "org.example.b");
+  g_object_unref (desc);
+  g_variant_unref (action);
+  g_variant_unref (actions);
+
+  g_object_unref (pool);
+  g_free (dir);
+  policy_tree_free (tree);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+#define ACTIONS_PER_FILE 5
+
+static gsize
+get_resident_bytes (void)
+{
+  gchar *contents;
+  gsize ret = 0;
+  gulong size;
+  gulong resident;
+
+  if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    {
+      if (sscanf (contents, "%lu %lu", &size, &resident) == 2)
+        ret = (gsize) resident * sysconf (_SC_PAGESIZE);
+      g_free (contents);
+    }
+
+  return ret;
+}
+
+static void
+test_perf_startup (gconstpointer user_data)
+{
+  guint num_files = GPOINTER_TO_UINT (user_data);
+  PolicyTree *tree;
+  PolkitBackendActionPool *pool;
+  const gchar *dirs[2];
+  gchar *dir;
+  GList *actions;
+  gdouble elapsed;
+  gsize total_bytes = 0;
+  gsize resident_before;
+  gsize resident_after;
+  gsize num_bytes;
+  guint num_actions;
+  guint n;
+
+  tree = policy_tree_new ();
+  dir = policy_tree_add_dir (tree, "actions");
+
+  for (n = 0; n < num_files; n++)
+    {
+      gchar *ids[ACTIONS_PER_FILE + 1];
+      gchar *name;
+      gchar *s;
+      guint m;
+
+      for (m = 0; m < ACTIONS_PER_FILE; m++)
+        ids[m] = g_strdup_printf ("org.example.vendor%u.action%u", n, m);
+      ids[m] = NULL;
+
+      s = make_policy ("The Example Project", (const gchar *const *) ids, "auth_admin");
+      name = g_strdup_printf ("org.example.vendor%u.policy", n);
+      policy_tree_add_file (tree, dir, name, s);
+      total_bytes += strlen (s);
+      g_free (name);
+      g_free (s);
+
+      for (m = 0; m < ACTIONS_PER_FILE; m++)
+        g_free (ids[m]);
+    }
+
+  dirs[0] = dir;
+  dirs[1] = NULL;
+
+  resident_before = get_resident_bytes ();
+  g_test_timer_start ();
+  pool = polkit_backend_action_pool_new (dirs);
+  polkit_backend_action_pool_reload (pool);
+  elapsed = g_test_timer_elapsed ();
+  resident_after = get_resident_bytes ();
+
+  num_bytes = polkit_backend_action_pool_get_memory_usage (pool, &num_actions);
+  g_assert_cmpuint (num_actions, ==, num_files * ACTIONS_PER_FILE);
+  g_test_message ("stored bytes per action: %.0f", (gdouble) num_bytes / num_actions);
+  if (resident_after > resident_before)
+    {
+      g_test_message ("resident bytes per action: %.0f",
+                      (gdouble) (resident_after - resident_before) / num_actions);
+      g_test_message ("resident KiB per 1000 actions: %.1f",
+                      (gdouble) (resident_after - resident_before) * 1000 / num_actions / 1024);
+    }
+
+  actions = polkit_backend_action_pool_get_all_actions (pool, NULL);
+
+  g_assert_cmpuint (g_list_length (actions), ==, num_files * ACTIONS_PER_FILE);
+  g_test_minimized_result (elapsed, "loading %u policy files: %.3f ms", num_files, elapsed * 1000);
+  g_test_message ("parse throughput: %.0f actions/s, %.2f MiB/s",
+                  num_files * ACTIONS_PER_FILE / elapsed,
+                  total_bytes / elapsed / (1024 * 1024));
+
+  g_list_free_full (actions, g_object_unref);
+  g_object_unref (pool);
+  g_free (dir);
+  policy_tree_free (tree);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+  static const guint num_files[] = { 10, 100, 1000 };
+  guint n;
+
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/PolkitBackendActionPool/precedence", test_precedence);
+  g_test_add_func ("/PolkitBackendActionPool/reload", test_reload);
+  g_test_add_func ("/PolkitBackendActionPool/enumerate", test_enumerate);
+
+  if (g_test_perf ())
+    {
+      for (n = 0; n < G_N_ELEMENTS (num_files); n++)
+        {
+          gchar *s;
+          s = g_strdup_printf ("/PolkitBackendActionPool/perf/startup_%u", num_files[n]);
+          g_test_add_data_func (s, GUINT_TO_POINTER (num_files[n]), test_perf_startup);
+          g_free (s);
+        }
+    }
+
+  return g_test_run ();
+};
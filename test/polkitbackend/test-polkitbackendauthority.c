@@ -0,0 +1,495 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "glib.h"
+
+#include <string.h>
+
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendauthority.h>
+
+/* Tests for the D-Bus interface of PolkitBackendAuthority, run on the
+ * mock system bus of test/wrapper.py. The authority below only records
+ * the order in which method calls reach it.
+ */
+
+#define AUTHORITY_OBJECT_PATH "/org/freedesktop/PolicyKit1/Authority"
+#define PRIORITY_NAME         "net.company.PriorityCaller"
+
+typedef struct
+{
+  PolkitBackendAuthority parent_instance;
+  /* of gchar*, "<method>:<unique name of the caller>" */
+  GPtrArray *calls;
+} TestAuthority;
+
+typedef struct
+{
+  PolkitBackendAuthorityClass parent_class;
+} TestAuthorityClass;
+
+static GType test_authority_get_type (void);
+
+G_DEFINE_TYPE (TestAuthority, test_authority, POLKIT_BACKEND_TYPE_AUTHORITY);
+
+static void
+test_authority_record (TestAuthority *authority,
+                       const gchar   *method_name,
+                       PolkitSubject *caller)
+{
+  g_ptr_array_add (authority->calls,
+                   g_strdup_printf ("%s:%s",
+                                    method_name,
+                                    polkit_system_bus_name_get_name (POLKIT_SYSTEM_BUS_NAME (caller))));
+}
+
+static GList *
+test_authority_enumerate_actions (PolkitBackendAuthority  *authority,
+                                  PolkitSubject           *caller,
+                                  const gchar             *locale,
+                                  GError                 **error)
+{
+  test_authority_record ((TestAuthority *) authority, "EnumerateActions", caller);
+  return NULL;
+}
+
+static gboolean
+test_authority_register_authentication_agent (PolkitBackendAuthority  *authority,
+                                              PolkitSubject           *caller,
+                                              PolkitSubject           *subject,
+                                              const gchar             *locale,
+                                              const gchar             *object_path,
+                                              GVariant                *options,
+                                              GError                 **error)
+{
+  test_authority_record ((TestAuthority *) authority, "RegisterAuthenticationAgent", caller);
+  return TRUE;
+}
+
+static void
+on_check_cancelled (GCancellable *cancellable,
+                    GTask        *task)
+{
+  g_task_return_new_error (task, POLKIT_ERROR, POLKIT_ERROR_CANCELLED, "The check was cancelled");
+}
+
+/* Checks are only answered once they are cancelled */
+static void
+test_authority_check_authorization (PolkitBackendAuthority        *authority,
+                                    PolkitSubject                 *caller,
+                                    PolkitSubject                 *subject,
+                                    const gchar                   *action_id,
+                                    PolkitDetails                 *details,
+                                    PolkitCheckAuthorizationFlags  flags,
+                                    GCancellable                  *cancellable,
+                                    GAsyncReadyCallback            callback,
+                                    gpointer                       user_data)
+{
+  GTask *task;
+
+  test_authority_record ((TestAuthority *) authority, "CheckAuthorization", caller);
+
+  task = g_task_new (authority, NULL, callback, user_data);
+  g_assert (cancellable != NULL);
+  g_cancellable_connect (cancellable, G_CALLBACK (on_check_cancelled), task, g_object_unref);
+}
+
+static PolkitAuthorizationResult *
+test_authority_check_authorization_finish (PolkitBackendAuthority  *authority,
+                                           GAsyncResult            *res,
+                                           GError                 **error)
+{
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+
+static void
+test_authority_finalize (GObject *object)
+{
+  TestAuthority *authority = (TestAuthority *) object;
+
+  g_ptr_array_unref (authority->calls);
+
+  G_OBJECT_CLASS (test_authority_parent_class)->finalize (object);
+}
+
+static void
+test_authority_init (TestAuthority *authority)
+{
+  authority->calls = g_ptr_array_new_with_free_func (g_free);
+}
+
+static void
+test_authority_class_init (TestAuthorityClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  PolkitBackendAuthorityClass *authority_class = POLKIT_BACKEND_AUTHORITY_CLASS (klass);
+
+  gobject_class->finalize = test_authority_finalize;
+
+  authority_class->enumerate_actions             = test_authority_enumerate_actions;
+  authority_class->register_authentication_agent = test_authority_register_authentication_agent;
+  authority_class->check_authorization           = test_authority_check_authorization;
+  authority_class->check_authorization_finish    = test_authority_check_authorization_finish;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  GDBusConnection *server_connection;
+  TestAuthority *authority;
+  gpointer registration_id;
+} Fixture;
+
+typedef struct
+{
+  gboolean done;
+  GError *error;
+} Reply;
+
+static GDBusConnection *
+new_bus_connection (void)
+{
+  GDBusConnection *connection;
+  GError *error = NULL;
+  gchar *address;
+
+  address = g_dbus_address_get_for_bus_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+  g_assert_no_error (error);
+  connection = g_dbus_connection_new_for_address_sync (address,
+                                                       G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                       G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                       NULL, /* GDBusAuthObserver */
+                                                       NULL, /* GCancellable */
+                                                       &error);
+  g_assert_no_error (error);
+  g_free (address);
+
+  return connection;
+}
+
+static void
+bus_round_trip (GDBusConnection *connection)
+{
+  GVariant *value;
+  GError *error = NULL;
+
+  value = g_dbus_connection_call_sync (connection,
+                                       "org.freedesktop.DBus",
+                                       "/org/freedesktop/DBus",
+                                       "org.freedesktop.DBus",
+                                       "GetId",
+                                       NULL,
+                                       G_VARIANT_TYPE ("(s)"),
+                                       G_DBUS_CALL_FLAGS_NONE,
+                                       -1,
+                                       NULL,
+                                       &error);
+  g_assert_no_error (error);
+  g_variant_unref (value);
+}
+
+static void
+fixture_setup (Fixture                    *fixture,
+               const gchar * const        *priority_callers,
+               guint                       max_queued_calls)
+{
+  GError *error = NULL;
+
+  fixture->server_connection = new_bus_connection ();
+  fixture->authority = g_object_new (test_authority_get_type (), NULL);
+  fixture->registration_id = polkit_backend_authority_register (POLKIT_BACKEND_AUTHORITY (fixture->authority),
+                                                                fixture->server_connection,
+                                                                AUTHORITY_OBJECT_PATH,
+                                                                &error);
+  g_assert_no_error (error);
+  polkit_backend_authority_set_scheduling (fixture->registration_id, priority_callers, max_queued_calls);
+
+  /* so the bus applies the match rules for priority names before any
+   * client acts
+   */
+  bus_round_trip (fixture->server_connection);
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+}
+
+static void
+fixture_teardown (Fixture *fixture)
+{
+  polkit_backend_authority_unregister (fixture->registration_id);
+  g_object_unref (fixture->authority);
+  g_dbus_connection_close_sync (fixture->server_connection, NULL, NULL);
+  g_object_unref (fixture->server_connection);
+}
+
+/* Returns once every message @clients sent so far has been handed to
+ * the main context of the server, but without running it, so that
+ * they are all queued when it next runs
+ */
+static void
+fixture_sync (Fixture          *fixture,
+              GDBusConnection **clients)
+{
+  guint n;
+
+  /* the bus has forwarded what a client sent before answering it, and
+   * the server reads what the bus forwarded in order
+   */
+  for (n = 0; clients != NULL && clients[n] != NULL; n++)
+    bus_round_trip (clients[n]);
+  bus_round_trip (fixture->server_connection);
+}
+
+static void
+on_reply (GObject      *source_object,
+          GAsyncResult *res,
+          gpointer      user_data)
+{
+  Reply *reply = user_data;
+  GVariant *value;
+
+  value = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &reply->error);
+  if (value != NULL)
+    g_variant_unref (value);
+  reply->done = TRUE;
+}
+
+static void
+call_authority (Fixture          *fixture,
+                GDBusConnection  *client,
+                const gchar      *method_name,
+                GVariant         *parameters,
+                Reply            *reply)
+{
+  reply->done = FALSE;
+  reply->error = NULL;
+  g_dbus_connection_call (client,
+                          g_dbus_connection_get_unique_name (fixture->server_connection),
+                          AUTHORITY_OBJECT_PATH,
+                          "org.freedesktop.PolicyKit1.Authority",
+                          method_name,
+                          parameters,
+                          NULL,
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          on_reply,
+                          reply);
+}
+
+static void
+wait_for_reply (Reply *reply)
+{
+  while (!reply->done)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static GVariant *
+new_register_agent_parameters (void)
+{
+  PolkitSubject *session;
+  GVariant *ret;
+
+  session = polkit_unix_session_new ("c1");
+  ret = g_variant_new ("(@(sa{sv})ss)",
+                       polkit_subject_to_gvariant (session),
+                       "C",
+                       "/org/freedesktop/PolicyKit1/AuthenticationAgent");
+  g_object_unref (session);
+
+  return ret;
+}
+
+/* Returns the calls that reached the authority, comma-separated */
+static gchar *
+get_calls (Fixture *fixture)
+{
+  GString *str;
+  guint n;
+
+  str = g_string_new (NULL);
+  for (n = 0; n < fixture->authority->calls->len; n++)
+    {
+      if (n > 0)
+        g_string_append_c (str, ',');
+      g_string_append (str, fixture->authority->calls->pdata[n]);
+    }
+
+  return g_string_free (str, FALSE);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Calls that pile up are dispatched priority ones first and bulk ones last */
+static void
+test_scheduling_classes (void)
+{
+  static const gchar * const priority_callers[] = { PRIORITY_NAME, NULL };
+  Fixture fixture;
+  GDBusConnection *clients[3];
+  Reply replies[3];
+  GVariant *value;
+  GError *error = NULL;
+  gchar *expected;
+  gchar *calls;
+  guint n;
+
+  fixture_setup (&fixture, priority_callers, 0);
+
+  clients[0] = new_bus_connection ();
+  clients[1] = new_bus_connection ();
+  clients[2] = NULL;
+
+  /* let the server see who has the priority name */
+  value = g_dbus_connection_call_sync (clients[1],
+                                       "org.freedesktop.DBus",
+                                       "/org/freedesktop/DBus",
+                                       "org.freedesktop.DBus",
+                                       "RequestName",
+                                       g_variant_new ("(su)", PRIORITY_NAME, 0),
+                                       G_VARIANT_TYPE ("(u)"),
+                                       G_DBUS_CALL_FLAGS_NONE,
+                                       -1,
+                                       NULL,
+                                       &error);
+  g_assert_no_error (error);
+  g_variant_unref (value);
+  fixture_sync (&fixture, NULL);
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+
+  /* in the opposite order of the classes */
+  call_authority (&fixture, clients[0], "EnumerateActions", g_variant_new ("(s)", "C"), &replies[0]);
+  call_authority (&fixture, clients[0], "RegisterAuthenticationAgent", new_register_agent_parameters (), &replies[1]);
+  call_authority (&fixture, clients[1], "RegisterAuthenticationAgent", new_register_agent_parameters (), &replies[2]);
+  fixture_sync (&fixture, clients);
+
+  for (n = 0; n < G_N_ELEMENTS (replies); n++)
+    {
+      wait_for_reply (&replies[n]);
+      g_assert_no_error (replies[n].error);
+    }
+
+  expected = g_strdup_printf ("RegisterAuthenticationAgent:%s,RegisterAuthenticationAgent:%s,EnumerateActions:%s",
+                              g_dbus_connection_get_unique_name (clients[1]),
+                              g_dbus_connection_get_unique_name (clients[0]),
+                              g_dbus_connection_get_unique_name (clients[0]));
+  calls = get_calls (&fixture);
+  g_assert_cmpstr (calls, ==, expected);
+  g_free (calls);
+  g_free (expected);
+
+  g_object_unref (clients[0]);
+  g_object_unref (clients[1]);
+  fixture_teardown (&fixture);
+}
+
+/* Calls beyond the bound of their class are refused right away */
+static void
+test_scheduling_queue_bound (void)
+{
+  Fixture fixture;
+  GDBusConnection *clients[2];
+  Reply replies[3];
+  guint num_rejected;
+  guint n;
+
+  fixture_setup (&fixture, NULL, 2);
+
+  clients[0] = new_bus_connection ();
+  clients[1] = NULL;
+
+  for (n = 0; n < G_N_ELEMENTS (replies); n++)
+    call_authority (&fixture, clients[0], "EnumerateActions", g_variant_new ("(s)", "C"), &replies[n]);
+  fixture_sync (&fixture, clients);
+
+  num_rejected = 0;
+  for (n = 0; n < G_N_ELEMENTS (replies); n++)
+    {
+      wait_for_reply (&replies[n]);
+      if (replies[n].error != NULL)
+        {
+          g_assert_error (replies[n].error, POLKIT_ERROR, POLKIT_ERROR_FAILED);
+          g_clear_error (&replies[n].error);
+          num_rejected++;
+        }
+    }
+  g_assert_cmpuint (num_rejected, ==, 1);
+  g_assert_cmpuint (fixture.authority->calls->len, ==, 2);
+
+  g_object_unref (clients[0]);
+  fixture_teardown (&fixture);
+}
+
+/* CancelCheckAuthorization() never overtakes the check it cancels,
+ * even when the check is queued behind other calls of the caller
+ */
+static void
+test_scheduling_cancel_order (void)
+{
+  Fixture fixture;
+  GDBusConnection *clients[2];
+  PolkitSubject *session;
+  Reply replies[3];
+  guint n;
+
+  fixture_setup (&fixture, NULL, 0);
+
+  clients[0] = new_bus_connection ();
+  clients[1] = NULL;
+
+  session = polkit_unix_session_new ("c1");
+  call_authority (&fixture, clients[0], "RegisterAuthenticationAgent", new_register_agent_parameters (), &replies[0]);
+  call_authority (&fixture, clients[0], "CheckAuthorization",
+                  g_variant_new ("(@(sa{sv})s@a{ss}us)",
+                                 polkit_subject_to_gvariant (session),
+                                 "net.company.action1",
+                                 polkit_details_to_gvariant (NULL),
+                                 POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE,
+                                 "cancel-me"),
+                  &replies[1]);
+  call_authority (&fixture, clients[0], "CancelCheckAuthorization", g_variant_new ("(s)", "cancel-me"), &replies[2]);
+  fixture_sync (&fixture, clients);
+  g_object_unref (session);
+
+  /* if the cancellation had come first, it would have failed and the
+   * check would never be answered
+   */
+  for (n = 0; n < G_N_ELEMENTS (replies); n++)
+    wait_for_reply (&replies[n]);
+  g_assert_no_error (replies[0].error);
+  g_assert_error (replies[1].error, POLKIT_ERROR, POLKIT_ERROR_CANCELLED);
+  g_clear_error (&replies[1].error);
+  g_assert_no_error (replies[2].error);
+
+  g_object_unref (clients[0]);
+  fixture_teardown (&fixture);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  /* Force registering error domain, so replies map back to it */
+  (void) POLKIT_ERROR;
+
+  g_test_add_func ("/PolkitBackendAuthority/scheduling/classes", test_scheduling_classes);
+  g_test_add_func ("/PolkitBackendAuthority/scheduling/queue_bound", test_scheduling_queue_bound);
+  g_test_add_func ("/PolkitBackendAuthority/scheduling/cancel_order", test_scheduling_cancel_order);
+  return g_test_run ();
+}
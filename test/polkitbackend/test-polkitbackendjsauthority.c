@@ -23,11 +23,19 @@
 
 #include "glib.h"
 
+#include <fcntl.h>
 #include <locale.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+#include <gio/gunixfdlist.h>
 
 #include <polkit/polkit.h>
+#include <polkit/polkitprivate.h>
 #include <polkitbackend/polkitbackendjsauthority.h>
+#include <polkitbackend/polkitbackendprivate.h>
 #include <polkittesthelper.h>
 
 /* see test/data/etc/polkit-1/rules.d/10-testing.rules */
@@ -40,6 +48,7 @@ static PolkitBackendJsAuthority *
 get_authority (void)
 {
   gchar *rules_dirs[3] = {0};
+  gchar *action_dirs[2] = {0};
   PolkitBackendJsAuthority *authority;
 
   rules_dirs[0] = polkit_test_get_data_path ("etc/polkit-1/rules.d");
@@ -48,11 +57,18 @@ get_authority (void)
   g_assert (rules_dirs[0] != NULL);
   g_assert (rules_dirs[1] != NULL);
 
+  /* see test/data/usr/share/polkit-1/actions/net.company.policy */
+  action_dirs[0] = polkit_test_get_data_path ("usr/share/polkit-1/actions");
+  action_dirs[1] = NULL;
+  g_assert (action_dirs[0] != NULL);
+
   authority = g_object_new (POLKIT_BACKEND_TYPE_JS_AUTHORITY,
                             "rules-dirs", rules_dirs,
+                            "action-dirs", action_dirs,
                             NULL);
   g_free (rules_dirs[0]);
   g_free (rules_dirs[1]);
+  g_free (action_dirs[0]);
   return authority;
 }
 
@@ -418,6 +434,7 @@ rules_test_func (gconstpointer user_data)
   PolkitDetails *details = NULL;
   GError *error = NULL;
   PolkitImplicitAuthorization result;
+  GList *admin_identities = NULL;
 
   authority = get_authority ();
 
@@ -456,6 +473,26 @@ rules_test_func (gconstpointer user_data)
                                                                           POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
   g_assert_cmpint (result, ==, tc->expected_result);
 
+  /* the combined evaluation must agree, and only run the admin rules for admin challenges */
+  result = polkit_backend_interactive_authority_check_authorization_and_get_admin_identities_sync (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                                                   caller,
+                                                                                                   subject,
+                                                                                                   user_for_subject,
+                                                                                                   TRUE,
+                                                                                                   TRUE,
+                                                                                                   tc->action_id,
+                                                                                                   details,
+                                                                                                   POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN,
+                                                                                                   &admin_identities,
+                                                                                                   NULL);
+  g_assert_cmpint (result, ==, tc->expected_result);
+  if (result == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED ||
+      result == POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED)
+    g_assert (admin_identities != NULL);
+  else
+    g_assert (admin_identities == NULL);
+  g_list_free_full (admin_identities, g_object_unref);
+
   g_clear_object (&details);
   g_clear_object (&user_for_subject);
   g_clear_object (&subject);
@@ -463,6 +500,117 @@ rules_test_func (gconstpointer user_data)
   g_clear_object (&authority);
 }
 
+static gpointer
+cancel_after_a_while (gpointer user_data)
+{
+  GCancellable *cancellable = user_data;
+
+  g_usleep (G_USEC_PER_SEC / 10);
+  g_cancellable_cancel (cancellable);
+  return NULL;
+}
+
+/* A check cancelled while a rule runs stops it, rather than waiting
+ * for the rule to finish or run away
+ */
+static void
+test_rules_cancelled_while_running (void)
+{
+  PolkitBackendJsAuthority *authority;
+  PolkitSubject *subject;
+  PolkitIdentity *user_for_subject;
+  PolkitDetails *details;
+  PolkitImplicitAuthorization result;
+  GCancellable *cancellable;
+  GThread *thread;
+  GVariant *statistics;
+  GError *error = NULL;
+  gint64 begin;
+  guint64 value;
+
+  authority = get_authority ();
+  subject = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  user_for_subject = polkit_identity_from_string ("unix-user:john", &error);
+  g_assert_no_error (error);
+  details = polkit_details_new ();
+
+  cancellable = g_cancellable_new ();
+  thread = g_thread_new ("cancel", cancel_after_a_while, cancellable);
+
+  begin = g_get_monotonic_time ();
+  result = polkit_backend_interactive_authority_check_authorization_and_get_admin_identities_sync (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                                                   subject,
+                                                                                                   subject,
+                                                                                                   user_for_subject,
+                                                                                                   TRUE,
+                                                                                                   TRUE,
+                                                                                                   "net.company.run_away_script",
+                                                                                                   details,
+                                                                                                   POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN,
+                                                                                                   NULL,
+                                                                                                   cancellable);
+  g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_NOT_AUTHORIZED);
+  /* the runaway killer would have taken 15 seconds */
+  g_assert_cmpint (g_get_monotonic_time () - begin, <, 5 * G_USEC_PER_SEC);
+  g_thread_join (thread);
+
+  statistics = polkit_backend_authority_get_statistics (POLKIT_BACKEND_AUTHORITY (authority));
+  g_assert (g_variant_lookup (statistics, "rule-evaluations-cancelled", "t", &value));
+  g_assert_cmpuint (value, ==, 1);
+  g_variant_unref (statistics);
+
+  g_object_unref (cancellable);
+  g_object_unref (details);
+  g_object_unref (user_for_subject);
+  g_object_unref (subject);
+  g_object_unref (authority);
+}
+
+/* An admin rule that throws must not change the result of the
+ * authorization rules; root authenticates instead
+ */
+static void
+test_failing_admin_rule (void)
+{
+  PolkitBackendJsAuthority *authority;
+  PolkitSubject *subject;
+  PolkitIdentity *user_for_subject;
+  PolkitDetails *details;
+  PolkitImplicitAuthorization result;
+  GList *admin_identities = NULL;
+  gchar *s;
+  GError *error = NULL;
+
+  authority = get_authority ();
+  subject = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  user_for_subject = polkit_identity_from_string ("unix-user:john", &error);
+  g_assert_no_error (error);
+  details = polkit_details_new ();
+
+  result = polkit_backend_interactive_authority_check_authorization_and_get_admin_identities_sync (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                                                   subject,
+                                                                                                   subject,
+                                                                                                   user_for_subject,
+                                                                                                   TRUE,
+                                                                                                   TRUE,
+                                                                                                   "net.company.failing_admin_rule",
+                                                                                                   details,
+                                                                                                   POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN,
+                                                                                                   &admin_identities,
+                                                                                                   NULL);
+  g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED);
+  g_assert_cmpuint (g_list_length (admin_identities), ==, 1);
+  s = polkit_identity_to_string (admin_identities->data);
+  g_assert_cmpstr (s, ==, "unix-user:root");
+  g_free (s);
+
+  g_list_free_full (admin_identities, g_object_unref);
+  g_object_unref (details);
+  g_object_unref (user_for_subject);
+  g_object_unref (subject);
+  g_object_unref (authority);
+}
+
 static void
 add_rules_tests (void)
 {
@@ -479,16 +627,940 @@ add_rules_tests (void)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+on_check_authorization_done (GObject      *source_object,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+  GAsyncResult **out_res = user_data;
+  *out_res = g_object_ref (res);
+}
+
+/* A check cancelled before its rules run is answered without them */
+static void
+test_check_authorization_cancelled (void)
+{
+  PolkitBackendJsAuthority *authority;
+  PolkitSubject *caller;
+  PolkitSubject *subject;
+  PolkitDetails *details;
+  GCancellable *cancellable;
+  GAsyncResult *res = NULL;
+  PolkitAuthorizationResult *result;
+  GVariant *statistics;
+  GError *error = NULL;
+  guint64 value;
+
+  authority = get_authority ();
+  caller = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  subject = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  details = polkit_details_new ();
+
+  cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+
+  polkit_backend_authority_check_authorization (POLKIT_BACKEND_AUTHORITY (authority),
+                                                caller,
+                                                subject,
+                                                "net.company.action1",
+                                                details,
+                                                POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE,
+                                                cancellable,
+                                                on_check_authorization_done,
+                                                &res);
+  while (res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  result = polkit_backend_authority_check_authorization_finish (POLKIT_BACKEND_AUTHORITY (authority), res, &error);
+  g_assert_error (error, POLKIT_ERROR, POLKIT_ERROR_CANCELLED);
+  g_assert (result == NULL);
+  g_clear_error (&error);
+
+  statistics = polkit_backend_authority_get_statistics (POLKIT_BACKEND_AUTHORITY (authority));
+  g_assert (g_variant_lookup (statistics, "check-authorization-cancelled", "t", &value));
+  g_assert_cmpuint (value, ==, 1);
+  g_assert (g_variant_lookup (statistics, "rule-evaluations-skipped", "t", &value));
+  g_assert_cmpuint (value, ==, 1);
+  g_assert (g_variant_lookup (statistics, "rule-evaluations-cancelled", "t", &value));
+  g_assert_cmpuint (value, ==, 0);
+  g_variant_unref (statistics);
+
+  g_object_unref (res);
+  g_object_unref (cancellable);
+  g_object_unref (details);
+  g_object_unref (subject);
+  g_object_unref (caller);
+  g_object_unref (authority);
+}
+
+/* Identical non-interactive checks in flight together share one
+ * evaluation. They only wait for others to join while some check is
+ * still resolving a bus name, here one that doesn't exist.
+ */
+static void
+test_check_authorization_coalesced (void)
+{
+  PolkitBackendJsAuthority *authority;
+  PolkitSubject *caller;
+  PolkitSubject *subject;
+  PolkitSubject *bus_name_subject;
+  PolkitDetails *details;
+  GAsyncResult *res[2] = { NULL, NULL };
+  GAsyncResult *bus_name_res = NULL;
+  PolkitAuthorizationResult *result;
+  GVariant *statistics;
+  GError *error = NULL;
+  guint64 value;
+  guint n;
+
+  authority = get_authority ();
+  caller = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  subject = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  bus_name_subject = polkit_system_bus_name_new (":1.4242");
+  details = polkit_details_new ();
+
+  polkit_backend_authority_check_authorization (POLKIT_BACKEND_AUTHORITY (authority),
+                                                caller,
+                                                bus_name_subject,
+                                                "net.company.action1",
+                                                details,
+                                                POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE,
+                                                NULL,
+                                                on_check_authorization_done,
+                                                &bus_name_res);
+  for (n = 0; n < G_N_ELEMENTS (res); n++)
+    polkit_backend_authority_check_authorization (POLKIT_BACKEND_AUTHORITY (authority),
+                                                  caller,
+                                                  subject,
+                                                  "net.company.action1",
+                                                  details,
+                                                  POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE,
+                                                  NULL,
+                                                  on_check_authorization_done,
+                                                  &res[n]);
+  while (res[0] == NULL || res[1] == NULL || bus_name_res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  for (n = 0; n < G_N_ELEMENTS (res); n++)
+    {
+      result = polkit_backend_authority_check_authorization_finish (POLKIT_BACKEND_AUTHORITY (authority), res[n], &error);
+      g_assert_no_error (error);
+      g_assert (result != NULL);
+      g_object_unref (result);
+      g_object_unref (res[n]);
+    }
+
+  result = polkit_backend_authority_check_authorization_finish (POLKIT_BACKEND_AUTHORITY (authority), bus_name_res, &error);
+  g_assert (result == NULL);
+  g_assert (error != NULL);
+  g_clear_error (&error);
+  g_object_unref (bus_name_res);
+
+  statistics = polkit_backend_authority_get_statistics (POLKIT_BACKEND_AUTHORITY (authority));
+  g_assert (g_variant_lookup (statistics, "check-authorization-coalesced", "t", &value));
+  g_assert_cmpuint (value, ==, 1);
+  g_assert (g_variant_lookup (statistics, "check-authorization-coalesced-max", "t", &value));
+  g_assert_cmpuint (value, ==, 2);
+  g_variant_unref (statistics);
+
+  g_object_unref (details);
+  g_object_unref (bus_name_subject);
+  g_object_unref (subject);
+  g_object_unref (caller);
+  g_object_unref (authority);
+}
+
+/* Checks that differ only in what the rules don't read share a result */
+static void
+test_rules_cache (void)
+{
+  PolkitBackendJsAuthority *authority;
+  PolkitSubject *caller;
+  PolkitSubject *subject;
+  PolkitSubject *other_subject;
+  PolkitIdentity *user_for_subject;
+  PolkitDetails *details;
+  PolkitImplicitAuthorization result;
+  GVariant *statistics;
+  GError *error = NULL;
+  guint64 value;
+  guint n;
+
+  authority = get_authority ();
+  caller = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  subject = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  other_subject = polkit_unix_process_new_for_owner (getppid (), 0, getuid ());
+  user_for_subject = polkit_identity_from_string ("unix-user:john", &error);
+  g_assert_no_error (error);
+  details = polkit_details_new ();
+
+  /* the rule deciding net.company.productA.action0 only reads action.id
+   * and asks to be memoized
+   */
+  result = polkit_backend_interactive_authority_check_authorization_sync (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                          caller, subject, user_for_subject,
+                                                                          TRUE, TRUE, "net.company.productA.action0", details,
+                                                                          POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+  g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED);
+  result = polkit_backend_interactive_authority_check_authorization_sync (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                          caller, other_subject, user_for_subject,
+                                                                          TRUE, TRUE, "net.company.productA.action0", details,
+                                                                          POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+  g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED);
+
+  statistics = polkit_backend_authority_get_statistics (POLKIT_BACKEND_AUTHORITY (authority));
+  g_assert (g_variant_lookup (statistics, "rule-cache-misses", "t", &value));
+  g_assert_cmpuint (value, ==, 1);
+  g_assert (g_variant_lookup (statistics, "rule-cache-hits", "t", &value));
+  g_assert_cmpuint (value, ==, 1);
+  g_variant_unref (statistics);
+
+  /* rules that didn't ask to be memoized, or that read the clock or
+   * random numbers, are evaluated every time
+   */
+  for (n = 0; n < 2; n++)
+    {
+      result = polkit_backend_interactive_authority_check_authorization_sync (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                              caller, subject, user_for_subject,
+                                                                              TRUE, TRUE, "net.company.failing_admin_rule", details,
+                                                                              POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+      g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_ADMINISTRATOR_AUTHENTICATION_REQUIRED);
+      result = polkit_backend_interactive_authority_check_authorization_sync (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                              caller, subject, user_for_subject,
+                                                                              TRUE, TRUE, "net.company.clock_dependent", details,
+                                                                              POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+      g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+      result = polkit_backend_interactive_authority_check_authorization_sync (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                              caller, subject, user_for_subject,
+                                                                              TRUE, TRUE, "net.company.random_dependent", details,
+                                                                              POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+      g_assert_cmpint (result, ==, POLKIT_IMPLICIT_AUTHORIZATION_AUTHORIZED);
+    }
+
+  statistics = polkit_backend_authority_get_statistics (POLKIT_BACKEND_AUTHORITY (authority));
+  g_assert (g_variant_lookup (statistics, "rule-cache-misses", "t", &value));
+  g_assert_cmpuint (value, ==, 7);
+  g_assert (g_variant_lookup (statistics, "rule-cache-hits", "t", &value));
+  g_assert_cmpuint (value, ==, 1);
+  g_variant_unref (statistics);
+
+  g_object_unref (details);
+  g_object_unref (user_for_subject);
+  g_object_unref (other_subject);
+  g_object_unref (subject);
+  g_object_unref (caller);
+  g_object_unref (authority);
+}
+
+/* Administrators are offered once each, in order, up to the limit */
+static void
+test_admin_identities_set (void)
+{
+  static const gint uids[] = { 1000, 1001, 1000, 1002, 1003 };
+  PolkitBackendUserSet *set;
+  GList *users;
+  GList *l;
+  guint n;
+
+  set = _polkit_backend_user_set_new (3);
+  for (n = 0; n < G_N_ELEMENTS (uids); n++)
+    {
+      PolkitIdentity *user;
+
+      user = polkit_unix_user_new (uids[n]);
+      g_assert_cmpint (_polkit_backend_user_set_add (set, user), ==, n != 2 && n != 4);
+      g_object_unref (user);
+    }
+  g_assert_true (_polkit_backend_user_set_is_truncated (set));
+
+  users = _polkit_backend_user_set_steal_users (set);
+  g_assert_cmpuint (g_list_length (users), ==, 3);
+  for (l = users, n = 1000; l != NULL; l = l->next, n++)
+    g_assert_cmpint (polkit_unix_user_get_uid (POLKIT_UNIX_USER (l->data)), ==, n);
+
+  g_list_free_full (users, g_object_unref);
+  _polkit_backend_user_set_free (set);
+}
+
+/* Sampled stage latencies show up in the statistics */
+static void
+test_latency_sampling (void)
+{
+  PolkitBackendJsAuthority *authority;
+  PolkitSubject *caller;
+  PolkitSubject *subject;
+  PolkitDetails *details;
+  GAsyncResult *res = NULL;
+  PolkitAuthorizationResult *result;
+  GVariant *statistics;
+  GVariantIter iter;
+  const gchar *name;
+  GError *error = NULL;
+  guint64 value;
+  guint64 num_samples;
+
+  authority = get_authority ();
+  caller = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  subject = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  details = polkit_details_new ();
+
+  polkit_backend_interactive_authority_set_latency_sampling (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority), 1);
+
+  polkit_backend_authority_check_authorization (POLKIT_BACKEND_AUTHORITY (authority),
+                                                caller,
+                                                subject,
+                                                "net.company.action1",
+                                                details,
+                                                POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION,
+                                                NULL,
+                                                on_check_authorization_done,
+                                                &res);
+  while (res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  result = polkit_backend_authority_check_authorization_finish (POLKIT_BACKEND_AUTHORITY (authority), res, &error);
+  g_assert_no_error (error);
+  g_assert (result != NULL);
+
+  /* resolving the user of the caller and subject happens for every check */
+  num_samples = 0;
+  statistics = polkit_backend_authority_get_statistics (POLKIT_BACKEND_AUTHORITY (authority));
+  g_variant_iter_init (&iter, statistics);
+  while (g_variant_iter_next (&iter, "{&st}", &name, &value))
+    if (g_str_has_prefix (name, "latency-subject-resolution-"))
+      num_samples += value;
+  g_assert_cmpuint (num_samples, >=, 2);
+  g_variant_unref (statistics);
+
+  polkit_backend_interactive_authority_set_latency_sampling (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority), 0);
+
+  g_object_unref (result);
+  g_object_unref (res);
+  g_object_unref (details);
+  g_object_unref (subject);
+  g_object_unref (caller);
+  g_object_unref (authority);
+}
+
+/* A process as saved by polkit_backend_interactive_authority_save_state() */
+static GVariant *
+new_saved_process (gint pid)
+{
+  PolkitSubject *process;
+  GVariant *ret;
+
+  process = polkit_unix_process_new_for_owner (pid, 0, -1);
+  ret = g_variant_ref_sink (g_variant_new ("(ssutih)",
+                                           "unix-process",
+                                           "",
+                                           (guint32) pid,
+                                           polkit_unix_process_get_start_time (POLKIT_UNIX_PROCESS (process)),
+                                           (gint32) polkit_unix_process_get_uid (POLKIT_UNIX_PROCESS (process)),
+                                           -1));
+  g_object_unref (process);
+  return ret;
+}
+
+/* A saved state without agents, @authorizations is consumed if floating */
+static GVariant *
+new_saved_state (guint32   version,
+                 GVariant *authorizations)
+{
+  return g_variant_ref_sink (g_variant_new ("(u@a((ssutih)usssa{sv})t@a((ssutih)(ssutih)ssxx))",
+                                            version,
+                                            g_variant_new_array (G_VARIANT_TYPE ("((ssutih)usssa{sv})"), NULL, 0),
+                                            (guint64) 42,
+                                            authorizations));
+}
+
+/* The sorted ids of the temporary authorizations in @authority */
+static gchar *
+get_saved_authorization_ids (PolkitBackendJsAuthority *authority)
+{
+  GUnixFDList *fd_list;
+  GVariant *saved;
+  GVariant *authorizations;
+  GPtrArray *ids;
+  gchar *ret;
+  guint n;
+
+  fd_list = g_unix_fd_list_new ();
+  saved = g_variant_ref_sink (polkit_backend_interactive_authority_save_state (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                               fd_list));
+  authorizations = g_variant_get_child_value (saved, 3);
+
+  ids = g_ptr_array_new ();
+  for (n = 0; n < g_variant_n_children (authorizations); n++)
+    {
+      const gchar *id;
+
+      g_variant_get_child (authorizations, n, "(@(ssutih)@(ssutih)&ssxx)",
+                           NULL, NULL, &id, NULL, NULL, NULL);
+      g_ptr_array_add (ids, (gpointer) id);
+    }
+  g_ptr_array_sort (ids, (GCompareFunc) g_strcmp0);
+  g_ptr_array_add (ids, NULL);
+  ret = g_strjoinv (",", (gchar **) ids->pdata);
+
+  g_ptr_array_unref (ids);
+  g_variant_unref (authorizations);
+  g_variant_unref (saved);
+  g_object_unref (fd_list);
+  return ret;
+}
+
+/* Temporary authorizations survive being handed to another instance,
+ * except for expired ones
+ */
+static void
+test_state_round_trip (void)
+{
+  PolkitBackendJsAuthority *authority;
+  PolkitBackendJsAuthority *next_authority;
+  GVariantBuilder builder;
+  GVariant *subject;
+  GVariant *state;
+  GVariant *saved;
+  GVariant *saved_again;
+  GVariant *authorizations;
+  GUnixFDList *fd_list;
+  const gint *fds;
+  const gchar *id;
+  const gchar *action_id;
+  GError *error = NULL;
+  guint64 serial;
+  gint64 now;
+  gint num_fds;
+
+  subject = new_saved_process (getpid ());
+  now = g_get_monotonic_time ();
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a((ssutih)(ssutih)ssxx)"));
+  g_variant_builder_add (&builder, "(@(ssutih)@(ssutih)ssxx)",
+                         subject, subject, "tmpauthz1", "net.company.action1",
+                         now, now + 300 * G_USEC_PER_SEC);
+  g_variant_builder_add (&builder, "(@(ssutih)@(ssutih)ssxx)",
+                         subject, subject, "tmpauthz2", "net.company.productA.action0",
+                         now - 2, now - 1);
+  state = new_saved_state (1, g_variant_builder_end (&builder));
+
+  authority = get_authority ();
+  g_assert_true (polkit_backend_interactive_authority_restore_state (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                     state, NULL, 0, &error));
+  g_assert_no_error (error);
+
+  fd_list = g_unix_fd_list_new ();
+  saved = g_variant_ref_sink (polkit_backend_interactive_authority_save_state (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                               fd_list));
+  g_variant_get (saved, "(u@a((ssutih)usssa{sv})t@a((ssutih)(ssutih)ssxx))",
+                 NULL, NULL, &serial, &authorizations);
+  g_assert_cmpuint (serial, >=, 42);
+  g_assert_cmpuint (g_variant_n_children (authorizations), ==, 1);
+  g_variant_get_child (authorizations, 0, "(@(ssutih)@(ssutih)&s&sxx)",
+                       NULL, NULL, &id, &action_id, NULL, NULL);
+  g_assert_cmpstr (id, ==, "tmpauthz1");
+  g_assert_cmpstr (action_id, ==, "net.company.action1");
+  g_variant_unref (authorizations);
+
+  /* and the next instance saves the same state again */
+  next_authority = get_authority ();
+  fds = g_unix_fd_list_peek_fds (fd_list, &num_fds);
+  g_assert_true (polkit_backend_interactive_authority_restore_state (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (next_authority),
+                                                                     saved, fds, num_fds, &error));
+  g_assert_no_error (error);
+  g_object_unref (fd_list);
+
+  fd_list = g_unix_fd_list_new ();
+  saved_again = g_variant_ref_sink (polkit_backend_interactive_authority_save_state (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (next_authority),
+                                                                                     fd_list));
+  g_assert_true (g_variant_equal (saved, saved_again));
+
+  /* state of another version is refused */
+  g_variant_unref (state);
+  state = new_saved_state (2, g_variant_new_array (G_VARIANT_TYPE ("((ssutih)(ssutih)ssxx)"), NULL, 0));
+  g_assert_false (polkit_backend_interactive_authority_restore_state (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (next_authority),
+                                                                      state, NULL, 0, &error));
+  g_assert_error (error, POLKIT_ERROR, POLKIT_ERROR_FAILED);
+  g_clear_error (&error);
+
+  g_variant_unref (saved_again);
+  g_variant_unref (saved);
+  g_variant_unref (state);
+  g_variant_unref (subject);
+  g_object_unref (fd_list);
+  g_object_unref (next_authority);
+  g_object_unref (authority);
+}
+
+/* The temporary authorization store looks authorizations up by subject;
+ * entries it drops must leave its indexes too
+ */
+static void
+test_temporary_authorization_index (void)
+{
+  PolkitBackendJsAuthority *authority;
+  GVariantBuilder builder;
+  GVariant *process;
+  GVariant *parent;
+  GVariant *state;
+  gchar *ids;
+  gint64 now;
+
+  process = new_saved_process (getpid ());
+  parent = new_saved_process (getppid ());
+  now = g_get_monotonic_time ();
+
+  /* same action for two subjects, two actions for one subject */
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a((ssutih)(ssutih)ssxx)"));
+  g_variant_builder_add (&builder, "(@(ssutih)@(ssutih)ssxx)",
+                         process, process, "tmpauthz1", "net.company.action1",
+                         now, now + 300 * G_USEC_PER_SEC);
+  g_variant_builder_add (&builder, "(@(ssutih)@(ssutih)ssxx)",
+                         parent, parent, "tmpauthz2", "net.company.action1",
+                         now, now + 300 * G_USEC_PER_SEC);
+  g_variant_builder_add (&builder, "(@(ssutih)@(ssutih)ssxx)",
+                         process, process, "tmpauthz3", "net.company.productA.action0",
+                         now, now + 300 * G_USEC_PER_SEC);
+  state = new_saved_state (1, g_variant_builder_end (&builder));
+
+  authority = get_authority ();
+  g_assert_true (polkit_backend_interactive_authority_restore_state (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                     state, NULL, 0, NULL));
+  ids = get_saved_authorization_ids (authority);
+  g_assert_cmpstr (ids, ==, "tmpauthz1,tmpauthz2,tmpauthz3");
+  g_free (ids);
+
+  /* each one is found for its own subject and action, so none is added twice */
+  g_assert_true (polkit_backend_interactive_authority_restore_state (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                     state, NULL, 0, NULL));
+  ids = get_saved_authorization_ids (authority);
+  g_assert_cmpstr (ids, ==, "tmpauthz1,tmpauthz2,tmpauthz3");
+  g_free (ids);
+
+  /* the lookups above made tmpauthz1 the least recently used */
+  polkit_backend_interactive_authority_set_cache_limits (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority), 2, 0);
+  ids = get_saved_authorization_ids (authority);
+  g_assert_cmpstr (ids, ==, "tmpauthz2,tmpauthz3");
+  g_free (ids);
+
+  /* so it can be added again, replacing the least recently used one */
+  g_variant_unref (state);
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a((ssutih)(ssutih)ssxx)"));
+  g_variant_builder_add (&builder, "(@(ssutih)@(ssutih)ssxx)",
+                         process, process, "tmpauthz1", "net.company.action1",
+                         now, now + 300 * G_USEC_PER_SEC);
+  state = new_saved_state (1, g_variant_builder_end (&builder));
+  g_assert_true (polkit_backend_interactive_authority_restore_state (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                     state, NULL, 0, NULL));
+  ids = get_saved_authorization_ids (authority);
+  g_assert_cmpstr (ids, ==, "tmpauthz1,tmpauthz3");
+  g_free (ids);
+
+  g_variant_unref (state);
+  g_variant_unref (parent);
+  g_variant_unref (process);
+  g_object_unref (authority);
+}
+
+/* Only actions whose rules can't depend on the subject get a decision
+ * in the snapshot, see test/data/usr/share/polkit-1/actions/net.company.policy
+ */
+static void
+test_implicit_authorizations (void)
+{
+  static const struct
+  {
+    const gchar *action_id;
+    guint8 any;
+    guint8 inactive;
+    guint8 active;
+  } expected[] =
+  {
+    /* only admin rules look at it */
+    {"net.company.action1",
+     POLKIT_IMPLICIT_SNAPSHOT_NOT_AUTHORIZED, POLKIT_IMPLICIT_SNAPSHOT_NOT_AUTHORIZED, POLKIT_IMPLICIT_SNAPSHOT_AUTHORIZED},
+    /* a rule returns a result */
+    {"net.company.productA.action0",
+     POLKIT_IMPLICIT_SNAPSHOT_ASK_AUTHORITY, POLKIT_IMPLICIT_SNAPSHOT_ASK_AUTHORITY, POLKIT_IMPLICIT_SNAPSHOT_ASK_AUTHORITY},
+    /* a rule reads subject.user */
+    {"net.company.john_action",
+     POLKIT_IMPLICIT_SNAPSHOT_ASK_AUTHORITY, POLKIT_IMPLICIT_SNAPSHOT_ASK_AUTHORITY, POLKIT_IMPLICIT_SNAPSHOT_ASK_AUTHORITY},
+  };
+  PolkitBackendJsAuthority *authority;
+  PolkitImplicitSnapshotHeader *header;
+  const PolkitImplicitSnapshotEntry *entries;
+  GVariant *decisions;
+  GVariantIter iter;
+  const gchar *action_id;
+  guint8 any, inactive, active;
+  GError *error = NULL;
+  gsize size;
+  guint num_found;
+  guint n;
+  gint fd;
+
+  authority = get_authority ();
+  decisions = polkit_backend_authority_get_implicit_authorizations (POLKIT_BACKEND_AUTHORITY (authority));
+  g_assert (decisions != NULL);
+
+  num_found = 0;
+  g_variant_iter_init (&iter, decisions);
+  while (g_variant_iter_next (&iter, "(&syyy)", &action_id, &any, &inactive, &active))
+    {
+      for (n = 0; n < G_N_ELEMENTS (expected); n++)
+        {
+          if (g_strcmp0 (action_id, expected[n].action_id) != 0)
+            continue;
+          g_assert_cmpuint (any, ==, expected[n].any);
+          g_assert_cmpuint (inactive, ==, expected[n].inactive);
+          g_assert_cmpuint (active, ==, expected[n].active);
+          num_found++;
+        }
+    }
+  g_assert_cmpuint (num_found, ==, G_N_ELEMENTS (expected));
+
+  /* and what GetImplicitAuthorizations() hands out */
+  fd = _polkit_backend_implicit_snapshot_new (decisions, 1, &header, &size, &error);
+  if (fd < 0)
+    {
+      g_assert_error (error, POLKIT_ERROR, POLKIT_ERROR_NOT_SUPPORTED);
+      g_test_skip ("memfd sealing is not supported");
+      g_clear_error (&error);
+      goto out;
+    }
+  g_assert_no_error (error);
+
+#ifdef F_SEAL_FUTURE_WRITE
+  g_assert_cmpint (fcntl (fd, F_GET_SEALS) & F_SEAL_FUTURE_WRITE, !=, 0);
+#endif
+  g_assert_cmpuint (header->magic, ==, POLKIT_IMPLICIT_SNAPSHOT_MAGIC);
+  g_assert_cmpuint (header->size, ==, size);
+  g_assert_cmpuint (header->num_actions, ==, g_variant_n_children (decisions));
+  g_assert_cmpint (header->current_generation, ==, header->generation);
+  g_assert_cmpuint (((const guint8 *) header)[size - 1], ==, '\0');
+
+  entries = (const PolkitImplicitSnapshotEntry *) (header + 1);
+  for (n = 0; n + 1 < header->num_actions; n++)
+    g_assert_cmpstr ((const gchar *) header + entries[n].action_id_offset, <,
+                     (const gchar *) header + entries[n + 1].action_id_offset);
+
+  munmap (header, size);
+  close (fd);
+
+ out:
+  g_variant_unref (decisions);
+  g_object_unref (authority);
+}
+
+/* The authority is also served on a peer socket, with the process
+ * that connected as the caller
+ */
+static void
+test_peer_socket (void)
+{
+  PolkitBackendJsAuthority *authority;
+  PolkitSubject *subject;
+  GDBusConnection *connection;
+  GAsyncResult *res = NULL;
+  GVariant *value;
+  GError *error = NULL;
+  gpointer registration_id;
+  gchar *dir;
+  gchar *path;
+  gchar *address;
+
+  authority = get_authority ();
+  subject = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+
+  dir = g_dir_make_tmp ("polkit-test-XXXXXX", &error);
+  g_assert_no_error (error);
+  path = g_build_filename (dir, "authority", NULL);
+  registration_id = polkit_backend_authority_register_peer_socket (POLKIT_BACKEND_AUTHORITY (authority),
+                                                                   path,
+                                                                   "/org/freedesktop/PolicyKit1/Authority",
+                                                                   &error);
+  g_assert_no_error (error);
+  g_assert (registration_id != NULL);
+
+  /* the server side needs the main loop, so nothing here may block */
+  address = g_strdup_printf ("unix:path=%s", path);
+  g_dbus_connection_new_for_address (address,
+                                     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                     NULL, /* GDBusAuthObserver */
+                                     NULL, /* GCancellable */
+                                     on_check_authorization_done,
+                                     &res);
+  while (res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+  connection = g_dbus_connection_new_for_address_finish (res, &error);
+  g_assert_no_error (error);
+  g_clear_object (&res);
+
+  g_dbus_connection_call (connection,
+                          NULL, /* bus name */
+                          "/org/freedesktop/PolicyKit1/Authority",
+                          "org.freedesktop.PolicyKit1.Authority",
+                          "CheckAuthorization",
+                          g_variant_new ("(@(sa{sv})s@a{ss}us)",
+                                         polkit_subject_to_gvariant (subject),
+                                         "net.company.action1",
+                                         polkit_details_to_gvariant (NULL),
+                                         POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE,
+                                         ""),
+                          G_VARIANT_TYPE ("((bba{ss}))"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          on_check_authorization_done,
+                          &res);
+  while (res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+  value = g_dbus_connection_call_finish (connection, res, &error);
+  g_assert_no_error (error);
+  g_variant_unref (value);
+  g_clear_object (&res);
+
+  /* agents need a bus name */
+  g_dbus_connection_call (connection,
+                          NULL, /* bus name */
+                          "/org/freedesktop/PolicyKit1/Authority",
+                          "org.freedesktop.PolicyKit1.Authority",
+                          "RegisterAuthenticationAgent",
+                          g_variant_new ("(@(sa{sv})ss)",
+                                         polkit_subject_to_gvariant (subject),
+                                         "C",
+                                         "/org/freedesktop/PolicyKit1/AuthenticationAgent"),
+                          NULL,
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          on_check_authorization_done,
+                          &res);
+  while (res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+  value = g_dbus_connection_call_finish (connection, res, &error);
+  g_assert_error (error, POLKIT_ERROR, POLKIT_ERROR_NOT_SUPPORTED);
+  g_assert (value == NULL);
+  g_clear_error (&error);
+  g_clear_object (&res);
+
+  /* root-only methods go by the uid of the connection */
+  g_dbus_connection_call (connection,
+                          NULL, /* bus name */
+                          "/org/freedesktop/PolicyKit1/Authority",
+                          "org.freedesktop.PolicyKit1.Authority",
+                          "GetMemoryUsage",
+                          NULL,
+                          NULL,
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          on_check_authorization_done,
+                          &res);
+  while (res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+  value = g_dbus_connection_call_finish (connection, res, &error);
+  if (getuid () == 0)
+    {
+      g_assert_no_error (error);
+      g_variant_unref (value);
+    }
+  else
+    {
+      g_assert_error (error, POLKIT_ERROR, POLKIT_ERROR_NOT_AUTHORIZED);
+      g_assert (value == NULL);
+      g_clear_error (&error);
+    }
+  g_clear_object (&res);
+
+  g_object_unref (connection);
+  polkit_backend_authority_unregister_peer_socket (registration_id);
+  g_assert (!g_file_test (path, G_FILE_TEST_EXISTS));
+  g_rmdir (dir);
+
+  g_free (address);
+  g_free (path);
+  g_free (dir);
+  g_object_unref (subject);
+  g_object_unref (authority);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+#define PERF_NUM_EVALUATIONS 10000
+
+/* Returns the bytes held by the JS engine, e.g. "duktape-heap" */
+static guint64
+get_js_heap_bytes (PolkitBackendJsAuthority *authority)
+{
+  GVariant *usage;
+  GVariantIter iter;
+  const gchar *name;
+  guint64 count;
+  guint64 bytes;
+  guint64 ret = 0;
+
+  usage = polkit_backend_authority_get_memory_usage (POLKIT_BACKEND_AUTHORITY (authority));
+  g_variant_iter_init (&iter, usage);
+  while (g_variant_iter_next (&iter, "{&s(tt)}", &name, &count, &bytes))
+    {
+      if (g_str_has_suffix (name, "-heap"))
+        ret += bytes;
+    }
+  g_variant_unref (usage);
+
+  return ret;
+}
+
+/* Rules evaluated per second and heap retained per evaluation, for
+ * comparing the JS engines polkitd can be built with (-Djs_engine=).
+ */
+static void
+test_perf_rules (gconstpointer user_data)
+{
+  const gchar *action_id = user_data;
+  PolkitBackendJsAuthority *authority;
+  PolkitSubject *caller;
+  PolkitSubject *subject;
+  PolkitIdentity *user_for_subject;
+  PolkitDetails *details;
+  GError *error = NULL;
+  guint64 heap_before;
+  guint64 heap_after;
+  gdouble elapsed;
+  guint n;
+
+  authority = get_authority ();
+  caller = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  subject = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  user_for_subject = polkit_identity_from_string ("unix-user:john", &error);
+  g_assert_no_error (error);
+  details = polkit_details_new ();
+
+  /* warm up, so that one-off allocations don't count as growth */
+  polkit_backend_interactive_authority_check_authorization_sync (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                 caller, subject, user_for_subject,
+                                                                 TRUE, TRUE, action_id, details,
+                                                                 POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+
+  heap_before = get_js_heap_bytes (authority);
+  g_test_timer_start ();
+  for (n = 0; n < PERF_NUM_EVALUATIONS; n++)
+    polkit_backend_interactive_authority_check_authorization_sync (POLKIT_BACKEND_INTERACTIVE_AUTHORITY (authority),
+                                                                   caller, subject, user_for_subject,
+                                                                   TRUE, TRUE, action_id, details,
+                                                                   POLKIT_IMPLICIT_AUTHORIZATION_UNKNOWN);
+  elapsed = g_test_timer_elapsed ();
+  heap_after = get_js_heap_bytes (authority);
+
+  g_test_maximized_result (PERF_NUM_EVALUATIONS / elapsed, "%s: %.0f evaluations/s",
+                           action_id, PERF_NUM_EVALUATIONS / elapsed);
+  g_test_message ("heap bytes retained per evaluation: %.1f",
+                  heap_after > heap_before ? (gdouble) (heap_after - heap_before) / PERF_NUM_EVALUATIONS : 0.0);
+
+  g_object_unref (details);
+  g_object_unref (user_for_subject);
+  g_object_unref (subject);
+  g_object_unref (caller);
+  g_object_unref (authority);
+}
+
+#define PERF_NUM_GROUPS 4
+
+/* Expanding overlapping admin groups of @user_data members each into
+ * the identities sent to an authentication agent; each group shares
+ * half of its members with the next one.
+ */
+static void
+test_perf_admin_identities (gconstpointer user_data)
+{
+  guint num_members = GPOINTER_TO_UINT (user_data);
+  GPtrArray *members;
+  PolkitBackendUserSet *set;
+  GVariantBuilder builder;
+  GVariant *value;
+  GList *users;
+  GList *l;
+  gdouble elapsed;
+  guint n;
+
+  /* as polkit_unix_user_new_for_name() would return them */
+  members = g_ptr_array_new_with_free_func (g_object_unref);
+  for (n = 0; n < PERF_NUM_GROUPS * num_members; n++)
+    {
+      guint group = n / num_members;
+      guint member = n % num_members;
+
+      g_ptr_array_add (members, polkit_unix_user_new (100000 + group * num_members / 2 + member));
+    }
+
+  g_test_timer_start ();
+  set = _polkit_backend_user_set_new (0);
+  for (n = 0; n < members->len; n++)
+    _polkit_backend_user_set_add (set, members->pdata[n]);
+  users = _polkit_backend_user_set_steal_users (set);
+  _polkit_backend_user_set_free (set);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa{sv})"));
+  for (l = users; l != NULL; l = l->next)
+    g_variant_builder_add_value (&builder, polkit_identity_to_gvariant (l->data));
+  value = g_variant_ref_sink (g_variant_builder_end (&builder));
+  elapsed = g_test_timer_elapsed ();
+
+  g_assert_cmpuint (g_list_length (users), ==, (PERF_NUM_GROUPS + 1) * num_members / 2);
+  g_test_minimized_result (elapsed, "%u groups of %u members: %.3f ms",
+                           PERF_NUM_GROUPS, num_members, elapsed * 1000);
+  g_test_message ("%u members, %u identities, %" G_GSIZE_FORMAT " bytes sent to the agent",
+                  members->len, g_list_length (users), g_variant_get_size (value));
+
+  g_variant_unref (value);
+  g_list_free_full (users, g_object_unref);
+  g_ptr_array_unref (members);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 int
 main (int argc, char *argv[])
 {
+  static const guint num_members[] = { 10, 100, 1000, 10000 };
+  guint n;
+
   setlocale (LC_ALL, "");
 
   g_test_init (&argc, &argv, NULL);
   //polkit_test_redirect_logs ();
 
   g_test_add_func ("/PolkitBackendJsAuthority/get_admin_identities", test_get_admin_identities);
+  g_test_add_func ("/PolkitBackendJsAuthority/check_authorization_cancelled", test_check_authorization_cancelled);
+  g_test_add_func ("/PolkitBackendJsAuthority/rules_cancelled_while_running", test_rules_cancelled_while_running);
+  g_test_add_func ("/PolkitBackendJsAuthority/check_authorization_coalesced", test_check_authorization_coalesced);
+  g_test_add_func ("/PolkitBackendJsAuthority/rules_cache", test_rules_cache);
+  g_test_add_func ("/PolkitBackendJsAuthority/admin_identities_set", test_admin_identities_set);
+  g_test_add_func ("/PolkitBackendJsAuthority/failing_admin_rule", test_failing_admin_rule);
+  g_test_add_func ("/PolkitBackendJsAuthority/latency_sampling", test_latency_sampling);
+  g_test_add_func ("/PolkitBackendJsAuthority/peer_socket", test_peer_socket);
+  g_test_add_func ("/PolkitBackendJsAuthority/implicit_authorizations", test_implicit_authorizations);
+  g_test_add_func ("/PolkitBackendJsAuthority/state_round_trip", test_state_round_trip);
+  g_test_add_func ("/PolkitBackendJsAuthority/temporary_authorization_index", test_temporary_authorization_index);
   add_rules_tests ();
 
+  if (g_test_perf ())
+    {
+      /* decided by an early rule, and falling through all of them */
+      g_test_add_data_func ("/PolkitBackendJsAuthority/perf/rules_first",
+                            "net.company.productA.action0", test_perf_rules);
+      g_test_add_data_func ("/PolkitBackendJsAuthority/perf/rules_none",
+                            "net.company.unmatched_action", test_perf_rules);
+
+      for (n = 0; n < G_N_ELEMENTS (num_members); n++)
+        {
+          gchar *s;
+          s = g_strdup_printf ("/PolkitBackendJsAuthority/perf/admin_identities_%u", num_members[n]);
+          g_test_add_data_func (s, GUINT_TO_POINTER (num_members[n]), test_perf_admin_identities);
+          g_free (s);
+        }
+    }
+
   return g_test_run ();
 };
@@ -0,0 +1,204 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "glib.h"
+
+#include <unistd.h>
+
+#include <polkit/polkit.h>
+#include <polkitbackend/polkitbackendprivate.h>
+
+/* PolkitBackendSubject must agree with polkit_subject_hash() and
+ * polkit_subject_equal(), or lookups in the backend would miss.
+ */
+static void
+assert_keys_agree (PolkitSubject *a,
+                   PolkitSubject *b)
+{
+  PolkitBackendSubject key_a;
+  PolkitBackendSubject key_b;
+
+  polkit_backend_subject_init (&key_a, a);
+  polkit_backend_subject_init (&key_b, b);
+
+  g_assert_cmpuint (polkit_backend_subject_hash (&key_a), ==, polkit_subject_hash (a));
+  g_assert_cmpuint (polkit_backend_subject_hash (&key_b), ==, polkit_subject_hash (b));
+  g_assert_cmpint (polkit_backend_subject_equal (&key_a, &key_b), ==, polkit_subject_equal (a, b));
+}
+
+static void
+test_kinds (void)
+{
+  PolkitSubject *process;
+  PolkitSubject *process_again;
+  PolkitSubject *parent;
+  PolkitSubject *bus_name;
+  PolkitSubject *bus_name_again;
+  PolkitSubject *session;
+  PolkitSubject *other_session;
+  PolkitBackendSubject key;
+
+  process = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  process_again = polkit_unix_process_new_for_owner (getpid (), 0, getuid ());
+  parent = polkit_unix_process_new_for_owner (getppid (), 0, getuid ());
+  bus_name = polkit_system_bus_name_new (":1.42");
+  bus_name_again = polkit_system_bus_name_new (":1.42");
+  session = polkit_unix_session_new ("c1");
+  other_session = polkit_unix_session_new ("c2");
+
+  polkit_backend_subject_init (&key, process);
+  g_assert_cmpint (key.kind, ==, POLKIT_BACKEND_SUBJECT_KIND_UNIX_PROCESS);
+  g_assert_cmpint (key.u.process.pid, ==, getpid ());
+  g_assert_cmpint (key.u.process.uid, ==, getuid ());
+  g_assert_true (key.object == process);
+
+  polkit_backend_subject_init (&key, bus_name);
+  g_assert_cmpint (key.kind, ==, POLKIT_BACKEND_SUBJECT_KIND_SYSTEM_BUS_NAME);
+  g_assert_cmpstr (key.u.system_bus_name, ==, ":1.42");
+
+  polkit_backend_subject_init (&key, session);
+  g_assert_cmpint (key.kind, ==, POLKIT_BACKEND_SUBJECT_KIND_UNIX_SESSION);
+  g_assert_cmpstr (key.u.session_id, ==, "c1");
+
+  assert_keys_agree (process, process_again);
+  assert_keys_agree (process, parent);
+  assert_keys_agree (bus_name, bus_name_again);
+  assert_keys_agree (session, other_session);
+  assert_keys_agree (session, process);
+  assert_keys_agree (bus_name, session);
+
+  g_object_unref (process);
+  g_object_unref (process_again);
+  g_object_unref (parent);
+  g_object_unref (bus_name);
+  g_object_unref (bus_name_again);
+  g_object_unref (session);
+  g_object_unref (other_session);
+}
+
+static void
+test_hash_table (void)
+{
+  PolkitSubject *session;
+  PolkitSubject *session_again;
+  PolkitBackendSubject key;
+  PolkitBackendSubject lookup_key;
+  GHashTable *table;
+
+  session = polkit_unix_session_new ("c1");
+  session_again = polkit_unix_session_new ("c1");
+  polkit_backend_subject_init (&key, session);
+  polkit_backend_subject_init (&lookup_key, session_again);
+
+  table = g_hash_table_new (polkit_backend_subject_hash_func, polkit_backend_subject_equal_func);
+  g_hash_table_insert (table, &key, session);
+  g_assert_true (g_hash_table_lookup (table, &lookup_key) == session);
+  g_hash_table_unref (table);
+
+  g_object_unref (session);
+  g_object_unref (session_again);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+#define PERF_NUM_SUBJECTS 1000
+#define PERF_NUM_LOOKUPS  1000000
+
+/* Looks up subjects the way the temporary authorization store did
+ * before and after PolkitBackendSubject: through the PolkitSubject
+ * interface on every lookup, or through keys filled in once.
+ */
+static void
+test_perf_lookup (void)
+{
+  PolkitSubject *subjects[PERF_NUM_SUBJECTS];
+  PolkitSubject *lookup_subjects[PERF_NUM_SUBJECTS];
+  PolkitBackendSubject keys[PERF_NUM_SUBJECTS];
+  PolkitBackendSubject lookup_keys[PERF_NUM_SUBJECTS];
+  GHashTable *subject_table;
+  GHashTable *key_table;
+  gdouble subject_elapsed;
+  gdouble key_elapsed;
+  guint n;
+
+  subject_table = g_hash_table_new ((GHashFunc) polkit_subject_hash, (GEqualFunc) polkit_subject_equal);
+  key_table = g_hash_table_new (polkit_backend_subject_hash_func, polkit_backend_subject_equal_func);
+
+  /* the lookups use other objects, as a new request would */
+  for (n = 0; n < PERF_NUM_SUBJECTS; n++)
+    {
+      gchar *name;
+
+      if (n % 2 == 0)
+        {
+          name = g_strdup_printf ("c%u", n);
+          subjects[n] = polkit_unix_session_new (name);
+          lookup_subjects[n] = polkit_unix_session_new (name);
+        }
+      else
+        {
+          name = g_strdup_printf (":1.%u", n);
+          subjects[n] = polkit_system_bus_name_new (name);
+          lookup_subjects[n] = polkit_system_bus_name_new (name);
+        }
+      g_free (name);
+
+      polkit_backend_subject_init (&keys[n], subjects[n]);
+      polkit_backend_subject_init (&lookup_keys[n], lookup_subjects[n]);
+      g_hash_table_insert (subject_table, subjects[n], subjects[n]);
+      g_hash_table_insert (key_table, &keys[n], subjects[n]);
+    }
+
+  g_test_timer_start ();
+  for (n = 0; n < PERF_NUM_LOOKUPS; n++)
+    g_assert_true (g_hash_table_lookup (subject_table, lookup_subjects[n % PERF_NUM_SUBJECTS]) != NULL);
+  subject_elapsed = g_test_timer_elapsed ();
+
+  g_test_timer_start ();
+  for (n = 0; n < PERF_NUM_LOOKUPS; n++)
+    g_assert_true (g_hash_table_lookup (key_table, &lookup_keys[n % PERF_NUM_SUBJECTS]) != NULL);
+  key_elapsed = g_test_timer_elapsed ();
+
+  g_test_message ("PolkitSubject lookups: %.1f ns each",
+                  subject_elapsed * 1e9 / PERF_NUM_LOOKUPS);
+  g_test_minimized_result (key_elapsed * 1e9 / PERF_NUM_LOOKUPS,
+                           "PolkitBackendSubject lookups: %.1f ns each",
+                           key_elapsed * 1e9 / PERF_NUM_LOOKUPS);
+
+  g_hash_table_unref (subject_table);
+  g_hash_table_unref (key_table);
+  for (n = 0; n < PERF_NUM_SUBJECTS; n++)
+    {
+      g_object_unref (subjects[n]);
+      g_object_unref (lookup_subjects[n]);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/PolkitBackendSubject/kinds", test_kinds);
+  g_test_add_func ("/PolkitBackendSubject/hash_table", test_hash_table);
+
+  if (g_test_perf ())
+    g_test_add_func ("/PolkitBackendSubject/perf/lookup", test_perf_lookup);
+
+  return g_test_run ();
+}